@@ -8,14 +8,14 @@
 #include "AppWindow.h"
 
 #include "BitmapImage.h"
+#include "CapturePipeline.h"
+#include "FrameResult.h"
+#include "HslThreshold.h"
+#include "StreamController.h"
+#include "Trace.h"
 #include <cmath>
 #include <iostream>
 
-AppWindow::AppWindow() {
-  // Create a mutex lock to be shared with the camera thread.
-  mutex_ = CreateMutex(NULL, FALSE, "CameraMutex");
-}
-
 /*
  * Registers the window Win32 class and creates the window instance.
  */
@@ -58,6 +58,7 @@ void AppWindow::Create(HINSTANCE hInstance) {
   camera_.SetWindow(hWnd_);
 
   // Start a separate thread for acquisition and processing of images from the camera.
+  Trace::SetThreadName("Window");
   CreateThread(NULL, 0, Camera::StartCamera, &camera_, 0, NULL);
 
   leftTextWnd_ = CreateWindow("static",
@@ -88,15 +89,20 @@ HWND AppWindow::GetHWnd() {
   return hWnd_;
 }
 
+Camera* AppWindow::GetCamera() {
+  return &camera_;
+}
+
 /*
  * Redraws the contents of the window.
  */
 void AppWindow::Paint() {
-  // Synchronize with the camera thread to access the current images.
-  WaitForSingleObject(mutex_, INFINITE);
+  TRACE_SCOPE("Paint");
 
-  BitmapImage* beforeBmp = camera_.GetBeforeBmp();
-  BitmapImage* afterBmp = camera_.GetAfterBmp();
+  // Take the newest frame from the camera thread, which leaves it alone until the next paint.
+  FrameSnapshot* frame = camera_.GetLatestFrame();
+  BitmapImage* beforeBmp = frame->before;
+  BitmapImage* afterBmp = frame->after;
   if (!(beforeBmp && afterBmp)) {
     // Fill the window background with a solid color if no images have yet to be acquired.
     PAINTSTRUCT ps;
@@ -105,8 +111,6 @@ void AppWindow::Paint() {
     GetClientRect(hWnd_, &rect);
     FillRect(hdc, &rect, (HBRUSH)GetStockObject(WHITE_BRUSH));
     EndPaint(hWnd_, &ps);
-
-    ReleaseMutex(mutex_);
     return;
   }
 
@@ -126,16 +130,28 @@ void AppWindow::Paint() {
   SelectObject(hdcMem, hbmpBefore);
   BitBlt(hdc, 0, 0, bmpBefore.bmWidth, bmpBefore.bmHeight, hdcMem, 0, 0, SRCCOPY);
 
-  // Display the processed image on the right side.
+  // Display the processed image on the right side, stretched to the size of the original if it was processed at
+  // a smaller scale.
   HBITMAP hbmpAfter = afterBmp->GetBitmap();
   BITMAP bmpAfter;
   GetObject(hbmpAfter, sizeof(BITMAP), &bmpAfter);
   SelectObject(hdcMem, hbmpAfter);
-  BitBlt(hdc, bmpBefore.bmWidth, 0, bmpAfter.bmWidth, bmpAfter.bmHeight, hdcMem, 0, 0, SRCCOPY);
-
-  // Release the lock on the bitmaps once they are no longer needed.
-  ReleaseMutex(mutex_);
-
+  if (bmpAfter.bmWidth < bmpBefore.bmWidth) {
+    StretchBlt(hdc,
+               bmpBefore.bmWidth,
+               0,
+               bmpBefore.bmWidth,
+               bmpBefore.bmHeight,
+               hdcMem,
+               0,
+               0,
+               bmpAfter.bmWidth,
+               bmpAfter.bmHeight,
+               SRCCOPY);
+  }
+  else {
+    BitBlt(hdc, bmpBefore.bmWidth, 0, bmpAfter.bmWidth, bmpAfter.bmHeight, hdcMem, 0, 0, SRCCOPY);
+  }
   DeleteDC(hdcMem);
 
   // Get the colour of the pixel currently beneath the mouse cursor.
@@ -148,22 +164,94 @@ void AppWindow::Paint() {
   EndPaint(hWnd_, &ps);
 
   // Display the colour information text on the left side.
-  char colorText[128];
-  sprintf_s(colorText,
-            128,
-            "Pixel colour at (%d, %d):\r\nR: %d\tH: %d\r\nG: %d\tS: %d\r\nB: %d\tL: %d",
-            pt.x,
-            pt.y,
-            GetRValue(color),
-            hsl.h,
-            GetGValue(color),
-            hsl.s,
-            GetBValue(color),
-            hsl.l);
+  char colorText[512];
+  int numChars = sprintf_s(colorText,
+                           512,
+                           "Pixel colour at (%d, %d):\r\nR: %d\tH: %d\r\nG: %d\tS: %d\r\nB: %d\tL: %d\r\n"
+                           "Allocations in last frame: %d\r\n",
+                           pt.x,
+                           pt.y,
+                           GetRValue(color),
+                           hsl.h,
+                           GetGValue(color),
+                           hsl.s,
+                           GetBValue(color),
+                           hsl.l,
+                           camera_.GetFrameAllocations());
+#if ENABLE_TRACING
+  numChars += sprintf_s(colorText + numChars,
+                        512 - numChars,
+                        "Tracing: %s (F8 toggles, F9 saves)\r\n",
+                        Trace::IsEnabled() ? "on" : "off");
+#endif
+
+  // Follow it with the state of the connection, or the counters of each camera when receiving from several, as
+  // long as there is room.
+  CaptureEngine* engine = camera_.GetEngine();
+  if (!engine) {
+    numChars += sprintf_s(colorText + numChars,
+                          512 - numChars,
+                          "Camera: %s\tReconnects: %d\tDropped: %d\tSkipped: %d\r\n",
+                          camera_.IsConnected() ? "streaming" : "reconnecting",
+                          camera_.GetReconnectCount(),
+                          camera_.GetDroppedFrames(),
+                          camera_.GetSkippedFrames());
+    StreamController* controller = camera_.GetStreamController();
+    if (controller) {
+      StreamSettings settings = controller->GetSettings();
+      numChars += sprintf_s(colorText + numChars,
+                            512 - numChars,
+                            "Stream: %d fps\tCompression: %d\tLoad: %.0f%%\r\n",
+                            settings.framesPerSecond,
+                            settings.compression,
+                            100 * controller->GetLoad());
+    }
+  }
+  else {
+    for (int camera = 0; camera < engine->GetCameraCount() && numChars < 512 - 160; camera++) {
+      CameraStats stats;
+      engine->GetStats(camera, &stats);
+      numChars += sprintf_s(colorText + numChars,
+                            512 - numChars,
+                            "\r\n%sCamera %d: %s\t%.1f fps\t%.0f KB/s\t%d dropped\t%d skipped\t%d errors\t"
+                            "%d reconnects\t%d fps at %d compression\t%.0f%% load",
+                            camera == camera_.GetDisplayedStream() ? "> " : "",
+                            camera + 1,
+                            stats.connected ? "streaming" : "connecting",
+                            stats.framesPerSecond,
+                            stats.kilobytesPerSecond,
+                            stats.dropped,
+                            stats.skipped,
+                            stats.errors,
+                            stats.reconnects,
+                            stats.requestedFps,
+                            stats.requestedCompression,
+                            100 * stats.load);
+    }
+  }
+
+  // Follow it with the throughput of each stage when running the capture pipeline.
+  CapturePipeline* pipeline = camera_.GetPipeline();
+  if (pipeline) {
+    for (int stage = 0; stage < CapturePipeline::kStageCount; stage++) {
+      StageStats stats;
+      pipeline->GetStats(stage, &stats);
+      numChars += sprintf_s(colorText + numChars,
+                            512 - numChars,
+                            "\r\n%s: %.1f fps\t%.0f%% busy\t%d dropped\t%d queued",
+                            CapturePipeline::GetStageName(stage),
+                            stats.framesPerSecond,
+                            100 * stats.utilization,
+                            stats.dropped,
+                            stats.queueDepth);
+    }
+  }
   SetWindowText(leftTextWnd_, colorText);
 
-  // Display the text defined in the image processing function on the right side.
-  SetWindowText(rightTextWnd_, camera_.GetText());
+  // Display the image processor's results as text on the right side.
+  char resultText[512];
+  FormatFrameResult(&frame->result, resultText, sizeof(resultText));
+  SetWindowText(rightTextWnd_, resultText);
 }
 
 /*
@@ -179,6 +267,9 @@ LRESULT AppWindow::WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
       Paint();
       result = TRUE;
       break;
+    case WM_KEYDOWN:
+      HandleKey((int)wParam);
+      break;
     case WM_DESTROY:
       PostQuitMessage(0);
       break;
@@ -186,6 +277,35 @@ LRESULT AppWindow::WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
   return result;
 }
 
+/*
+ * Handles the hotkeys: 1 to 9 choose the camera to display, and for tracing, F8 starts and stops recording events
+ * and F9 saves the events recorded so far.
+ */
+void AppWindow::HandleKey(int key) {
+  // The number keys choose which camera to display when receiving from several.
+  if (key >= '1' && key <= '9') {
+    camera_.SelectStream(key - '1');
+    return;
+  }
+
+#if ENABLE_TRACING
+  if (key == VK_F8) {
+    Trace::SetEnabled(!Trace::IsEnabled());
+    InvalidateRect(hWnd_, NULL, FALSE);
+  }
+  else if (key == VK_F9) {
+    char message[256];
+    if (Trace::WriteChromeTrace(TRACE_FILE)) {
+      sprintf_s(message, sizeof(message), "Wrote the trace to %s.", TRACE_FILE);
+    }
+    else {
+      sprintf_s(message, sizeof(message), "Couldn't write the trace to %s.", TRACE_FILE);
+    }
+    MessageBox(hWnd_, message, "Tracing", MB_OK);
+  }
+#endif
+}
+
 /*
  * Static message handler. Determines the window instance and calls its WndProc.
  */
@@ -201,49 +321,16 @@ LRESULT CALLBACK AppWindow::_WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM
 }
 
 /*
- * Converts pixel colour values from the RGB colour space to the HSL colour space.
+ * Converts pixel colour values from the RGB colour space to the HSL colour space, scaled to the 0-255 range used
+ * by NI. This is the same conversion the colour threshold uses, so the values shown are the ones it tests.
  */
 HslStruct AppWindow::RgbToHsl(COLORREF color) {
-    // Scale the RGB values down to floating point numbers between 0 and 1.
-    double r = (double)GetRValue(color) / 255;
-    double g = (double)GetGValue(color) / 255;
-    double b = (double)GetBValue(color) / 255;
-    double rgbMin = min(min(r, g), min(g, b));
-    double rgbMax = max(max(r, g), max(g, b));
-    double h, s, l;
-
-    l = (rgbMin + rgbMax) / 2;
-    if (rgbMin == rgbMax) {
-      h = 0;
-      s = 0;
-    }
-    else {
-      if (l <= 0.5) {
-        s = (rgbMax - rgbMin) / (rgbMax + rgbMin);
-      }
-      else {
-        s = (rgbMax - rgbMin) / (2.0 - rgbMax - rgbMin);
-      }
-
-      if (r == rgbMax) {
-        h = (g - b) / (rgbMax - rgbMin);
-      }
-      else if (g == rgbMax) {
-        h = 2.0 + (b - r) / (rgbMax - rgbMin);
-      }
-      else {
-        h = 4.0 + (r - g) / (rgbMax - rgbMin);
-      }
-    }
-    if (h < 0) {
-      h += 6;
-    }
-
-    // Scale the HSL values up to the 0-255 range used by NI.
-    HslStruct hsl;
-    hsl.h = (unsigned char)(h * 42.5);
-    hsl.s = (unsigned char)(s * 255);
-    hsl.l = (unsigned char)(l * 255);
+  int h, s, l;
+  HslThreshold::RgbToHsl(GetRValue(color), GetGValue(color), GetBValue(color), &h, &s, &l);
 
-    return hsl;
+  HslStruct hsl;
+  hsl.h = (unsigned char)h;
+  hsl.s = (unsigned char)s;
+  hsl.l = (unsigned char)l;
+  return hsl;
 }
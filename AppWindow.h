@@ -21,12 +21,13 @@ typedef struct {
 
 class AppWindow {
 public:
-  AppWindow();
   void Create(HINSTANCE hInstance);
   HWND GetHWnd();
+  Camera* GetCamera();
 
 private:
   void Paint();
+  void HandleKey(int key);
   LRESULT WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
   static LRESULT CALLBACK _WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
   HslStruct RgbToHsl(COLORREF color);
@@ -34,7 +35,6 @@ private:
   HWND hWnd_;
   HWND leftTextWnd_;
   HWND rightTextWnd_;
-  HANDLE mutex_;
   Camera camera_;
 };
 
@@ -0,0 +1,210 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a replay of the frames in a frame archive, standing in for the camera's stream.
+ *
+ * The whole archive is mapped into memory and every page of it is touched when it is opened, so frames are
+ * handed out as pointers straight into the mapping without any copying or disk reads while replaying.
+ */
+
+#include "ArchiveReplay.h"
+
+#include "Timer.h"
+#include <string.h>
+
+/*
+ * @param realTime Whether frames are delivered at the times they were recorded, rather than as fast as they are
+ *                 asked for.
+ * @param loop Whether the replay starts again from the first frame after the last one.
+ */
+ArchiveReplay::ArchiveReplay(bool realTime, bool loop) {
+  realTime_ = realTime;
+  loop_ = loop;
+  file_ = INVALID_HANDLE_VALUE;
+  mapping_ = NULL;
+  data_ = NULL;
+  size_ = 0;
+  next_ = 0;
+  startTime_ = 0;
+}
+
+ArchiveReplay::~ArchiveReplay() {
+  Close();
+}
+
+/*
+ * Maps the archive at the given path into memory and reads its index.
+ *
+ * @return False if the file can't be mapped or isn't a frame archive.
+ */
+bool ArchiveReplay::Open(const char* path) {
+  Close();
+  file_ = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file_ == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  DWORD sizeHigh = 0;
+  DWORD size = GetFileSize(file_, &sizeHigh);
+  if (size == INVALID_FILE_SIZE || sizeHigh != 0 || size > ARCHIVE_MAX_SIZE || size < sizeof(ArchiveHeader)) {
+    Close();
+    return false;
+  }
+  size_ = size;
+  mapping_ = CreateFileMapping(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (mapping_ == NULL) {
+    Close();
+    return false;
+  }
+  data_ = (const char*)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+  if (data_ == NULL) {
+    Close();
+    return false;
+  }
+
+  const ArchiveHeader* header = (const ArchiveHeader*)data_;
+  if (memcmp(header->magic, ARCHIVE_MAGIC, 4) != 0 || header->version != ARCHIVE_VERSION) {
+    Close();
+    return false;
+  }
+  if (!ReadIndex() && !ScanRecords()) {
+    Close();
+    return false;
+  }
+
+  // Read a byte from each page so that the whole archive is in memory before the replay starts.
+  volatile char touch = 0;
+  for (unsigned int offset = 0; offset < size_; offset += 4096) {
+    touch += data_[offset];
+  }
+  Rewind();
+  return true;
+}
+
+void ArchiveReplay::Close() {
+  if (data_ != NULL) {
+    UnmapViewOfFile(data_);
+    data_ = NULL;
+  }
+  if (mapping_ != NULL) {
+    CloseHandle(mapping_);
+    mapping_ = NULL;
+  }
+  if (file_ != INVALID_HANDLE_VALUE) {
+    CloseHandle(file_);
+    file_ = INVALID_HANDLE_VALUE;
+  }
+  size_ = 0;
+  index_.clear();
+}
+
+/*
+ * Reads the index written when the archive was closed, checking that every frame lies within the file.
+ *
+ * @return False if the archive has no index or it is invalid.
+ */
+bool ArchiveReplay::ReadIndex() {
+  const ArchiveHeader* header = (const ArchiveHeader*)data_;
+  if (header->indexOffset == 0 || header->indexOffset > size_ ||
+      (size_ - header->indexOffset) / sizeof(ArchiveEntry) < header->frameCount) {
+    return false;
+  }
+  const ArchiveEntry* entries = (const ArchiveEntry*)(data_ + header->indexOffset);
+  for (unsigned int i = 0; i < header->frameCount; i++) {
+    if (entries[i].offset > header->indexOffset || entries[i].size > header->indexOffset - entries[i].offset) {
+      index_.clear();
+      return false;
+    }
+    index_.push_back(entries[i]);
+  }
+  return !index_.empty();
+}
+
+/*
+ * Rebuilds the index by walking the records from the start of the archive, for an archive whose recording was
+ * cut short. A record which runs past the end of the file is ignored.
+ *
+ * @return False if the archive has no complete frames.
+ */
+bool ArchiveReplay::ScanRecords() {
+  unsigned int offset = sizeof(ArchiveHeader);
+  while (size_ - offset >= sizeof(ArchiveRecord)) {
+    const ArchiveRecord* record = (const ArchiveRecord*)(data_ + offset);
+    unsigned int paddedSize = (record->size + 7) & ~7;
+    offset += sizeof(ArchiveRecord);
+    if (record->size == 0 || paddedSize < record->size || paddedSize > size_ - offset) {
+      break;
+    }
+    ArchiveEntry entry;
+    entry.offset = offset;
+    entry.size = record->size;
+    entry.timestamp = record->timestamp;
+    index_.push_back(entry);
+    offset += paddedSize;
+  }
+  return !index_.empty();
+}
+
+/*
+ * Returns the next frame in the archive, pointing into the mapped file. When replaying in real time, waits
+ * until the frame is due.
+ *
+ * @return False once the last frame has been returned, unless looping.
+ */
+bool ArchiveReplay::NextFrame(const char** jpeg, int* jpegSize) {
+  if (index_.empty()) {
+    return false;
+  }
+  if (next_ == (int)index_.size()) {
+    if (!loop_) {
+      return false;
+    }
+
+    // Carry on from the end of the archive, leaving the average frame interval before the first frame again.
+    startTime_ += GetDuration() + GetDuration() / max(1, (int)index_.size() - 1);
+    next_ = 0;
+  }
+
+  const ArchiveEntry& entry = index_[next_];
+  if (realTime_) {
+    if (startTime_ == 0) {
+      startTime_ = GetMilliseconds() - entry.timestamp;
+    }
+    double wait = startTime_ + entry.timestamp - GetMilliseconds();
+    if (wait > 0) {
+      Sleep((DWORD)wait);
+    }
+  }
+  *jpeg = data_ + entry.offset;
+  *jpegSize = entry.size;
+  next_++;
+  return true;
+}
+
+int ArchiveReplay::GetFrameCount() {
+  return (int)index_.size();
+}
+
+/*
+ * Returns the time in milliseconds from the first frame to the last.
+ */
+double ArchiveReplay::GetDuration() {
+  return index_.empty() ? 0 : index_.back().timestamp - index_[0].timestamp;
+}
+
+/*
+ * Gets any frame from the archive along with the time it was received, in milliseconds from the first frame.
+ */
+void ArchiveReplay::GetFrame(int index, const char** jpeg, int* jpegSize, double* timestamp) {
+  *jpeg = data_ + index_[index].offset;
+  *jpegSize = index_[index].size;
+  *timestamp = index_[index].timestamp;
+}
+
+/*
+ * Starts the replay again from the first frame.
+ */
+void ArchiveReplay::Rewind() {
+  next_ = 0;
+  startTime_ = 0;
+}
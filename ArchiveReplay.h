@@ -0,0 +1,43 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a replay of the frames in a frame archive, standing in for the camera's stream.
+ */
+
+#ifndef _ARCHIVE_REPLAY_H_
+#define _ARCHIVE_REPLAY_H_
+
+#include "FrameArchive.h"
+#include "FrameSource.h"
+#include <vector>
+#include <Windows.h>
+
+class ArchiveReplay : public FrameSource {
+public:
+  ArchiveReplay(bool realTime, bool loop);
+  ~ArchiveReplay();
+  bool Open(const char* path);
+  void Close();
+  virtual bool NextFrame(const char** jpeg, int* jpegSize);
+  int GetFrameCount();
+  double GetDuration();
+  void GetFrame(int index, const char** jpeg, int* jpegSize, double* timestamp);
+  void Rewind();
+
+private:
+  bool ReadIndex();
+  bool ScanRecords();
+
+  bool realTime_;
+  bool loop_;
+  HANDLE file_;
+  HANDLE mapping_;
+  const char* data_;
+  unsigned int size_;
+  std::vector<ArchiveEntry> index_;
+  int next_;
+  double startTime_;
+};
+
+#endif // _ARCHIVE_REPLAY_H_
@@ -0,0 +1,122 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a recording of frames into a frame archive.
+ */
+
+#include "ArchiveWriter.h"
+
+#include <string.h>
+
+ArchiveWriter::ArchiveWriter() {
+  file_ = NULL;
+  offset_ = 0;
+  firstTimestamp_ = 0;
+}
+
+ArchiveWriter::~ArchiveWriter() {
+  Close();
+}
+
+/*
+ * Creates the archive file, replacing any existing file at the given path.
+ *
+ * @return Whether the file could be created.
+ */
+bool ArchiveWriter::Open(const char* path) {
+  Close();
+  file_ = fopen(path, "wb");
+  if (file_ == NULL) {
+    return false;
+  }
+
+  // The header is written again with the frame count and index offset when the archive is closed.
+  ArchiveHeader header;
+  memcpy(header.magic, ARCHIVE_MAGIC, 4);
+  header.version = ARCHIVE_VERSION;
+  header.frameCount = 0;
+  header.indexOffset = 0;
+  index_.clear();
+  offset_ = sizeof(header);
+  if (fwrite(&header, sizeof(header), 1, file_) != 1) {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+/*
+ * Appends a frame to the archive. Each frame is flushed to the file as it is written, so that the recording up
+ * to the last frame survives the application exiting without closing the archive.
+ *
+ * @param timestamp The time the frame was received, in milliseconds from any fixed point.
+ * @return False if the frame couldn't be written, in which case the archive is closed.
+ */
+bool ArchiveWriter::Write(const char* jpeg, int jpegSize, double timestamp) {
+  if (file_ == NULL) {
+    return false;
+  }
+  if (index_.empty()) {
+    firstTimestamp_ = timestamp;
+  }
+
+  // Stop at the largest archive the offsets can describe, leaving room for the index.
+  static const char padding[8] = { 0 };
+  unsigned int paddedSize = (jpegSize + 7) & ~7;
+  unsigned int indexSize = (unsigned int)((index_.size() + 1) * sizeof(ArchiveEntry));
+  if (ARCHIVE_MAX_SIZE - offset_ < sizeof(ArchiveRecord) + paddedSize + indexSize) {
+    Close();
+    return false;
+  }
+
+  ArchiveRecord record;
+  record.size = jpegSize;
+  record.reserved = 0;
+  record.timestamp = timestamp - firstTimestamp_;
+  if (fwrite(&record, sizeof(record), 1, file_) != 1 ||
+      fwrite(jpeg, 1, jpegSize, file_) != (size_t)jpegSize ||
+      fwrite(padding, 1, paddedSize - jpegSize, file_) != paddedSize - jpegSize ||
+      fflush(file_) != 0) {
+    Close();
+    return false;
+  }
+
+  ArchiveEntry entry;
+  entry.offset = offset_ + sizeof(record);
+  entry.size = jpegSize;
+  entry.timestamp = record.timestamp;
+  index_.push_back(entry);
+  offset_ += sizeof(record) + paddedSize;
+  return true;
+}
+
+/*
+ * Writes the index and finishes the archive.
+ *
+ * @return Whether the index was written.
+ */
+bool ArchiveWriter::Close() {
+  if (file_ == NULL) {
+    return false;
+  }
+  ArchiveHeader header;
+  memcpy(header.magic, ARCHIVE_MAGIC, 4);
+  header.version = ARCHIVE_VERSION;
+  header.frameCount = (unsigned int)index_.size();
+  header.indexOffset = offset_;
+
+  // The index goes straight after the last complete frame, over anything left by a write which failed.
+  bool success = (fseek(file_, (long)offset_, SEEK_SET) == 0);
+  if (success && !index_.empty()) {
+    success = (fwrite(&index_[0], sizeof(ArchiveEntry), index_.size(), file_) == index_.size());
+  }
+  success = success && fseek(file_, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file_) == 1;
+  success = (fclose(file_) == 0) && success;
+  file_ = NULL;
+  return success;
+}
+
+int ArchiveWriter::GetFrameCount() {
+  return (int)index_.size();
+}
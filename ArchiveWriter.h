@@ -0,0 +1,31 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a recording of frames into a frame archive.
+ */
+
+#ifndef _ARCHIVE_WRITER_H_
+#define _ARCHIVE_WRITER_H_
+
+#include "FrameArchive.h"
+#include <stdio.h>
+#include <vector>
+
+class ArchiveWriter {
+public:
+  ArchiveWriter();
+  ~ArchiveWriter();
+  bool Open(const char* path);
+  bool Write(const char* jpeg, int jpegSize, double timestamp);
+  bool Close();
+  int GetFrameCount();
+
+private:
+  FILE* file_;
+  unsigned int offset_;
+  double firstTimestamp_;
+  std::vector<ArchiveEntry> index_;
+};
+
+#endif // _ARCHIVE_WRITER_H_
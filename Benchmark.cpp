@@ -0,0 +1,72 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing the headless benchmarks, run in place of the application window. The benchmarks of each part
+ * of the application are in the Benchmark*.cpp file named after it, and those of the portable core, with the
+ * constructor, in BenchmarkCore.cpp.
+ */
+
+#include "Benchmark.h"
+
+#include <stdio.h>
+#include <winsock2.h>
+#include <Windows.h>
+
+/*
+ * Runs all benchmarks and prints the results to the console.
+ *
+ * @return The process exit code.
+ */
+int Benchmark::Run() {
+  // Write to the console the application was started from, or to a new one.
+  bool ownConsole = false;
+  if (!AttachConsole(ATTACH_PARENT_PROCESS)) {
+    AllocConsole();
+    ownConsole = true;
+  }
+  freopen("CONOUT$", "w", stdout);
+
+  // The conversion benchmark uses generated images, so it runs even if the recording can't be loaded.
+  BenchmarkConversion();
+  BenchmarkThreshold();
+  BenchmarkParticles();
+  BenchmarkMorphology();
+  BenchmarkGraph();
+  BenchmarkPipelines();
+  BenchmarkFrames();
+  BenchmarkEllipses();
+  BenchmarkTracking();
+  BenchmarkTracing();
+  BenchmarkDisplayHandoff();
+  BenchmarkResultChannel();
+  BenchmarkStreamController();
+
+  if (!LoadStream()) {
+    return 1;
+  }
+
+  WSADATA WsaDat;
+  if (WSAStartup(MAKEWORD(2, 2), &WsaDat) != NO_ERROR) {
+    printf("Unable to initialize sockets.\n");
+    return 1;
+  }
+
+  printf("Stream: %s (%d bytes, replayed %d times)\n\n", streamFile_, streamSize_, kStreamPasses);
+  BenchmarkParser();
+  BenchmarkReceive();
+  BenchmarkStreamGraph();
+  BenchmarkReplay();
+  CompareEllipses();
+  BenchmarkScaledDecode();
+  BenchmarkChangeDetection();
+  int result = BenchmarkLatency();
+
+  WSACleanup();
+
+  if (ownConsole) {
+    printf("\nPress Enter to exit.\n");
+    getchar();
+  }
+  return result;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing the headless benchmarks, run in place of the application window. The benchmarks of the
+ * portable core also build on Linux, where RunCore runs just those.
+ */
+
+#ifndef _BENCHMARK_H_
+#define _BENCHMARK_H_
+
+#include <string>
+#include <vector>
+
+class LatencyHistogram;
+
+class Benchmark {
+public:
+  Benchmark(const char* streamFile);
+  ~Benchmark();
+  int Run();
+  int RunCore();
+
+private:
+  // Number of times the recorded stream is replayed for each measurement.
+  enum {
+    kStreamPasses = 20
+  };
+
+  // Exit codes of Run when the latency benchmark doesn't pass: a stage is slower than its baseline, or no stage
+  // had a baseline to be compared against.
+  enum {
+    kExitRegressed = 2,
+    kExitNotCompared = 3
+  };
+
+  void BenchmarkConversion();
+  void BenchmarkThreshold();
+  void BenchmarkParticles();
+  void BenchmarkMorphology();
+  void BenchmarkGraph();
+  void BenchmarkPipelines();
+  void BenchmarkFrames();
+  void BenchmarkEllipses();
+  void BenchmarkTracking();
+  void CompareEllipses();
+  void BenchmarkTracing();
+  void BenchmarkDisplayHandoff();
+  void BenchmarkResultChannel();
+  int BenchmarkLatency();
+  void WriteLatencyResults(LatencyHistogram* latencies);
+  int CompareLatencyBaseline(LatencyHistogram* latencies);
+  void BenchmarkStreamController();
+  void BenchmarkScaledDecode();
+  void BenchmarkChangeDetection();
+  bool LoadStream();
+  void ReadFrames(int maxFrames, std::vector<std::string>* frames);
+  void BenchmarkParser();
+  void BenchmarkStreamGraph();
+  void BenchmarkReceive();
+  void BenchmarkReplay();
+
+  const char* streamFile_;
+  char* stream_;
+  int streamSize_;
+};
+
+#endif // _BENCHMARK_H_
@@ -0,0 +1,244 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * The headless benchmarks of the stream through the portable core: parsing, and decoding and processing on frames
+ * without NI Vision. With BenchmarkProcessing.cpp and the core listed in README.md, this file also builds on Linux,
+ * where its main runs RunCore in place of the application.
+ */
+
+#include "Benchmark.h"
+
+#include "Constants.h"
+#include "Frame.h"
+#include "FrameGraph.h"
+#include "HslThreshold.h"
+#include "JpegDecoder.h"
+#include "MjpegParser.h"
+#include "Timer.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+/*
+ * Creates a benchmark which replays the given file, containing a raw MJPEG HTTP response recorded from the
+ * camera (e.g. with "curl -o stream.mjpg http://<camera>/axis-cgi/mjpg/video.cgi").
+ */
+Benchmark::Benchmark(const char* streamFile) {
+  streamFile_ = streamFile;
+  stream_ = NULL;
+  streamSize_ = 0;
+}
+
+Benchmark::~Benchmark() {
+  delete[] stream_;
+}
+
+/*
+ * Runs the benchmarks which don't need NI Vision, sockets or the window and prints the results, as Run does.
+ *
+ * @return The process exit code.
+ */
+int Benchmark::RunCore() {
+  BenchmarkConversion();
+  BenchmarkThreshold();
+  BenchmarkParticles();
+  BenchmarkMorphology();
+  BenchmarkGraph();
+  BenchmarkPipelines();
+  BenchmarkFrames();
+
+  if (!LoadStream()) {
+    return 1;
+  }
+  printf("Stream: %s (%d bytes, replayed %d times)\n\n", streamFile_, streamSize_, kStreamPasses);
+  BenchmarkParser();
+  BenchmarkStreamGraph();
+  return 0;
+}
+
+/*
+ * Loads the whole recording into memory so that disk reads aren't measured.
+ *
+ * @return Whether the recording could be read.
+ */
+bool Benchmark::LoadStream() {
+  FILE* file = fopen(streamFile_, "rb");
+  if (file == NULL) {
+    printf("Unable to open stream recording '%s'.\n", streamFile_);
+    return false;
+  }
+  fseek(file, 0, SEEK_END);
+  streamSize_ = (int)ftell(file);
+  fseek(file, 0, SEEK_SET);
+  stream_ = new char[streamSize_];
+  fread(stream_, 1, streamSize_, file);
+  fclose(file);
+  return true;
+}
+
+/*
+ * Parses up to the given number of frames from the start of the recording.
+ */
+void Benchmark::ReadFrames(int maxFrames, std::vector<std::string>* frames) {
+  MjpegParser parser(STREAM_BUFFER_SIZE);
+  int position = 0;
+  while (position < streamSize_ && (int)frames->size() < maxFrames) {
+    int space;
+    char* writePtr = parser.GetWriteBuffer(&space);
+    int chunk = min(min(space, 65536), streamSize_ - position);
+    memcpy(writePtr, stream_ + position, chunk);
+    parser.CommitWrite(chunk);
+    position += chunk;
+
+    const char* jpeg;
+    int jpegSize;
+    while ((int)frames->size() < maxFrames && parser.NextFrame(&jpeg, &jpegSize)) {
+      frames->push_back(std::string(jpeg, jpegSize));
+    }
+  }
+}
+
+/*
+ * Parses the stream from memory to measure the cost of MjpegParser alone, without any socket calls.
+ */
+void Benchmark::BenchmarkParser() {
+  MjpegParser parser(STREAM_BUFFER_SIZE);
+  int frames = 0;
+  double start = GetMilliseconds();
+  for (int pass = 0; pass < kStreamPasses; pass++) {
+    int position = 0;
+    while (position < streamSize_) {
+      int space;
+      char* writePtr = parser.GetWriteBuffer(&space);
+      int chunk = min(min(space, 65536), streamSize_ - position);
+      memcpy(writePtr, stream_ + position, chunk);
+      parser.CommitWrite(chunk);
+      position += chunk;
+
+      const char* jpeg;
+      int jpegSize;
+      while (parser.NextFrame(&jpeg, &jpegSize)) {
+        frames++;
+      }
+    }
+  }
+  double elapsed = GetMilliseconds() - start;
+  printf("Parser (memory):   %6d frames in %8.1f ms  %8.1f MB/s  %6.1f us/frame\n",
+         frames,
+         elapsed,
+         kStreamPasses * (double)streamSize_ / 1000.0 / elapsed,
+         frames ? 1000.0 * elapsed / frames : 0.0);
+}
+
+/*
+ * Decodes every frame of the recording into a frame buffer and runs ColorThreshold's stages on it with a
+ * FrameGraph, as the capture path does but without NI Vision. Checks that decoding into rows which don't start on
+ * a cache line gives the same pixels, then times decoding and the graph.
+ */
+void Benchmark::BenchmarkStreamGraph() {
+  std::vector<std::string> frames;
+  ReadFrames(streamSize_, &frames);
+  if (frames.empty()) {
+    printf("\nNo frames found in the recording.\n");
+    return;
+  }
+
+  // The stages ColorThreshold adds to its graph.
+  FrameGraph graph;
+  HslThreshold* threshold = graph.AddHslThreshold(150);
+  threshold->SetRanges(250, 255, 90, 150, 70, 130);
+  threshold->SetLookupTable(THRESHOLD_LOOKUP_TABLE != 0, THRESHOLD_LOOKUP_BITS);
+  if (MASK_MORPHOLOGY != BinaryMorphology::kNone) {
+    BinaryMorphology* morphology = graph.AddMorphology((BinaryMorphology::Operation)MASK_MORPHOLOGY);
+    morphology->SetElement(MORPHOLOGY_CROSS ? BinaryMorphology::kCross : BinaryMorphology::kRectangle,
+                           MORPHOLOGY_WIDTH,
+                           MORPHOLOGY_HEIGHT);
+  }
+  graph.AddParticleAnalysis(false);
+
+  // Decode each frame a second time one pixel into a wider buffer, where no row is aligned.
+  JpegDecoder decoder;
+  FrameBuffer imageBuffer;
+  FrameBuffer maskBuffer;
+  FrameBuffer unalignedBuffer;
+  bool match = true;
+  int failed = 0;
+  for (unsigned int i = 0; i < frames.size(); i++) {
+    int width;
+    int height;
+    if (!decoder.ReadHeader(frames[i].data(), (int)frames[i].size(), &width, &height)) {
+      failed++;
+      continue;
+    }
+    Frame image = imageBuffer.Allocate(kBgrx32, width, height);
+    Frame unaligned = unalignedBuffer.Allocate(kBgrx32, width + 1, height).GetView(1, 0, width, height);
+    if (!decoder.Decode(frames[i].data(), (int)frames[i].size(), image.GetPixels(), image.GetStride()) ||
+        !decoder.Decode(frames[i].data(), (int)frames[i].size(), unaligned.GetPixels(), unaligned.GetStride())) {
+      failed++;
+      continue;
+    }
+    bool same = true;
+    for (int y = 0; y < height; y++) {
+      same = same && memcmp(image.GetRow(y), unaligned.GetRow(y), 4 * width) == 0;
+    }
+    if (!same && match) {
+      printf("MISMATCH: frame %d decoded into unaligned rows\n", i);
+      match = false;
+    }
+  }
+  printf("\nDecoded frames %s in aligned and unaligned rows (%d of %d frames decoded).\n",
+         match ? "match" : "DO NOT match",
+         (int)frames.size() - failed,
+         (int)frames.size());
+
+  // Time each step over every frame in turn, as the capture thread would receive them.
+  double decodeTime = 0;
+  double graphTime = 0;
+  int decoded = 0;
+  int particles = 0;
+  for (int pass = 0; pass < kStreamPasses; pass++) {
+    for (unsigned int i = 0; i < frames.size(); i++) {
+      double start = GetMilliseconds();
+      int width;
+      int height;
+      if (!decoder.ReadHeader(frames[i].data(), (int)frames[i].size(), &width, &height)) {
+        continue;
+      }
+      Frame image = imageBuffer.Allocate(kBgrx32, width, height);
+      Frame mask = maskBuffer.Allocate(kGray8, width, height);
+      if (!decoder.Decode(frames[i].data(), (int)frames[i].size(), image.GetPixels(), image.GetStride())) {
+        continue;
+      }
+      double decodeEnd = GetMilliseconds();
+      graph.Run(image, mask);
+      double graphEnd = GetMilliseconds();
+      decodeTime += decodeEnd - start;
+      graphTime += graphEnd - decodeEnd;
+      decoded++;
+      particles += graph.GetParticles()->GetCount();
+    }
+  }
+  printf("Decode and threshold on frames (%d frames, %.1f particles/frame):\n",
+         decoded,
+         decoded ? (double)particles / decoded : 0.0);
+  printf("  Decode              %6.3f ms/frame\n", decoded ? decodeTime / decoded : 0.0);
+  printf("  Graph               %6.3f ms/frame\n", decoded ? graphTime / decoded : 0.0);
+}
+
+#ifndef _WIN32
+
+/*
+ * Entry point on Linux, where only the portable core is built, e.g. "./benchmark stream.mjpg".
+ */
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    printf("Usage: %s <stream.mjpg>\n", argv[0]);
+    return 1;
+  }
+  Benchmark benchmark(argv[1]);
+  return benchmark.RunCore();
+}
+
+#endif
@@ -0,0 +1,315 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * The headless benchmarks of ellipse detection and region of interest tracking.
+ */
+
+#include "Benchmark.h"
+
+#include "Constants.h"
+#include "DetectEllipses.h"
+#include "EllipseDetector.h"
+#include "JpegDecoder.h"
+#include "MjpegParser.h"
+#include "RoiTracker.h"
+#include "Timer.h"
+#include "WorkerPool.h"
+#include <math.h>
+#include <nivision.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+// Number of frames searched by the ellipse detector for each synthetic measurement, and the most recorded frames
+// on which it is compared against NIVision.
+static const int kEllipsePasses = 50;
+static const int kMaxEllipseFrames = 100;
+
+static const double kPi = 3.14159265358979323846;
+
+// An ellipse drawn into a generated image, with its rotation in degrees anticlockwise on screen.
+struct TestEllipse {
+  double x;
+  double y;
+  double majorRadius;
+  double minorRadius;
+  double rotation;
+  int brightness;
+};
+
+/*
+ * Draws filled ellipses on a plain background, averaging 4x4 samples per pixel so that the edges are anti-aliased
+ * as they would be in a camera image, and adds uniform noise of up to the given amplitude.
+ */
+static void RenderEllipses(const TestEllipse* ellipses, int count, int background, int noise, unsigned char* pixels,
+                           int width, int height) {
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      int sum = 0;
+      for (int sample = 0; sample < 16; sample++) {
+        double sampleX = x + (sample % 4 + 0.5) / 4 - 0.5;
+        double sampleY = y + (sample / 4 + 0.5) / 4 - 0.5;
+        int value = background;
+        for (int i = 0; i < count; i++) {
+          const TestEllipse& ellipse = ellipses[i];
+          if (fabs(sampleX - ellipse.x) > ellipse.majorRadius || fabs(sampleY - ellipse.y) > ellipse.majorRadius) {
+            continue;
+          }
+
+          // Rows count downwards, so the angle is negated to rotate anticlockwise on screen.
+          double angle = -ellipse.rotation * kPi / 180;
+          double dx = sampleX - ellipse.x;
+          double dy = sampleY - ellipse.y;
+          double u = (dx * cos(angle) + dy * sin(angle)) / ellipse.majorRadius;
+          double v = (dy * cos(angle) - dx * sin(angle)) / ellipse.minorRadius;
+          if (u * u + v * v <= 1) {
+            value = ellipse.brightness;
+          }
+        }
+        sum += value;
+      }
+      int value = (sum + 8) / 16 + (noise > 0 ? rand() % (2 * noise + 1) - noise : 0);
+      pixels[y * width + x] = (unsigned char)max(0, min(255, value));
+    }
+  }
+}
+
+/*
+ * Returns whether a detected ellipse matches an expected one, with its center within the given distance and its
+ * radii within the given fraction.
+ */
+static bool EllipsesMatch(const DetectedEllipse& found, double x, double y, double majorRadius, double minorRadius,
+                          double distance, double fraction) {
+  return fabs(found.x - x) <= distance && fabs(found.y - y) <= distance &&
+         fabs(found.majorRadius - majorRadius) <= fraction * majorRadius &&
+         fabs(found.minorRadius - minorRadius) <= fraction * minorRadius;
+}
+
+/*
+ * Checks that EllipseDetector finds generated ellipses of known size and position, then measures it on a
+ * full-size frame with each number of threads up to the number of processors.
+ */
+void Benchmark::BenchmarkEllipses() {
+  const int width = 640;
+  const int height = 480;
+  static const TestEllipse ellipses[] = {
+    { 200.3, 150.7, 60, 40, 30, 220 },
+    { 450, 300, 35, 34, 0, 30 },
+    { 320, 380, 90, 45, 120, 200 },
+    { 520, 100, 25, 22, 80, 200 },
+    { 100, 380, 70, 20, 160, 40 }
+  };
+  static const int kEllipseCount = (int)(sizeof(ellipses) / sizeof(ellipses[0]));
+  unsigned char* pixels = new unsigned char[width * height];
+  RenderEllipses(ellipses, kEllipseCount, 110, 8, pixels, width, height);
+
+  WorkerPool* pool = new WorkerPool(1);
+  EllipseDetector* detector = new EllipseDetector(pool);
+  std::vector<DetectedEllipse> found;
+  detector->Detect(pixels, width, width, height, &found);
+  int matched = 0;
+  double centerError = 0;
+  double radiusError = 0;
+  for (int i = 0; i < kEllipseCount; i++) {
+    const TestEllipse& ellipse = ellipses[i];
+    for (unsigned int j = 0; j < found.size(); j++) {
+      if (EllipsesMatch(found[j], ellipse.x, ellipse.y, ellipse.majorRadius, ellipse.minorRadius, 1, 0.02)) {
+        matched++;
+        centerError = max(centerError, max(fabs(found[j].x - ellipse.x), fabs(found[j].y - ellipse.y)));
+        radiusError = max(radiusError, max(fabs(found[j].majorRadius - ellipse.majorRadius),
+                                           fabs(found[j].minorRadius - ellipse.minorRadius)));
+        break;
+      }
+    }
+  }
+  printf("Ellipse detector found %d of %d generated ellipses (%d detections), within %.2f px of the center and "
+         "%.2f px of the radii.\n\n",
+         matched,
+         kEllipseCount,
+         (int)found.size(),
+         centerError,
+         radiusError);
+
+  SYSTEM_INFO systemInfo;
+  GetSystemInfo(&systemInfo);
+  for (int threads = 1; threads <= (int)systemInfo.dwNumberOfProcessors; threads *= 2) {
+    delete detector;
+    delete pool;
+    pool = new WorkerPool(threads);
+    detector = new EllipseDetector(pool);
+    double start = GetMilliseconds();
+    for (int pass = 0; pass < kEllipsePasses; pass++) {
+      detector->Detect(pixels, width, width, height, &found);
+    }
+    double elapsed = (GetMilliseconds() - start) / kEllipsePasses;
+    printf("Ellipse detector, %2d thread%s: %7.3f ms/frame\n", threads, threads == 1 ? " " : "s", elapsed);
+  }
+  printf("\n");
+  delete detector;
+  delete pool;
+  delete[] pixels;
+}
+
+/*
+ * Follows a generated ellipse moving across a sequence of frames, searching each frame in full and then only
+ * where RoiTracker predicts the ellipse will be, and compares the time taken and the positions found.
+ */
+void Benchmark::BenchmarkTracking() {
+  const int width = 640;
+  const int height = 480;
+  const int frameCount = 60;
+  const int firstHidden = 28;
+  const int hiddenCount = 4;
+  unsigned char* frames = new unsigned char[frameCount * width * height];
+  std::vector<TestEllipse> path(frameCount);
+  for (int frame = 0; frame < frameCount; frame++) {
+    // A loop around the image at up to about ten pixels per frame, leaving the image for a few frames midway.
+    double t = 2 * kPi * frame / frameCount;
+    TestEllipse ellipse = { 320 + 260 * sin(t), 240 + 150 * sin(2 * t), 45, 35, 20, 220 };
+    path[frame] = ellipse;
+    int count = (frame >= firstHidden && frame < firstHidden + hiddenCount) ? 0 : 1;
+    RenderEllipses(&path[frame], count, 110, 8, frames + frame * width * height, width, height);
+  }
+
+  WorkerPool pool(WORKER_THREADS);
+  EllipseDetector detector(&pool);
+  detector.SetRadii(20, 300, 20, 300);
+  std::vector<DetectedEllipse> found;
+  for (int tracked = 0; tracked < 2; tracked++) {
+    RoiTracker tracker;
+    tracker.SetMargin(ROI_MARGIN);
+    tracker.SetCoastFrames(ROI_COAST_FRAMES);
+    tracker.SetFullScanInterval(ROI_FULL_SCAN_INTERVAL);
+    int windowed = 0;
+    int hits = 0;
+    double searched = 0;
+    double error = 0;
+    double start = GetMilliseconds();
+    for (int frame = 0; frame < frameCount; frame++) {
+      RoiWindow window = { 0, 0, width, height };
+      if (tracked && tracker.Predict(width, height, &window)) {
+        windowed++;
+      }
+      searched += (double)window.width * window.height / (width * height);
+      const unsigned char* pixels = frames + frame * width * height + window.top * width + window.left;
+      detector.Detect(pixels, width, window.width, window.height, &found);
+
+      // Take the best ellipse as the target, as DetectEllipses does.
+      bool hit = !found.empty();
+      double x = hit ? found[0].x + window.left : 0;
+      double y = hit ? found[0].y + window.top : 0;
+      tracker.Update(hit, x, y, hit ? found[0].majorRadius : 0, hit ? found[0].majorRadius : 0);
+      if (hit) {
+        hits++;
+        error = max(error, max(fabs(x - path[frame].x), fabs(y - path[frame].y)));
+      }
+    }
+    double elapsed = (GetMilliseconds() - start) / frameCount;
+    printf("%s %6.3f ms/frame  %2d of %d frames found (%d hidden), %2d windowed, %5.1f%% of pixels searched, "
+           "within %.2f px\n",
+           tracked ? "Tracked:   " : "Full frame:",
+           elapsed,
+           hits,
+           frameCount,
+           hiddenCount,
+           windowed,
+           100 * searched / frameCount,
+           error);
+  }
+  printf("\n");
+  delete[] frames;
+}
+
+/*
+ * Runs EllipseDetector and imaqDetectEllipses on the green plane of the same recorded frames, as DetectEllipses
+ * does, and reports the time each takes and how many of NIVision's ellipses the detector also finds.
+ */
+void Benchmark::CompareEllipses() {
+  MjpegParser parser(STREAM_BUFFER_SIZE);
+  JpegDecoder decoder;
+  WorkerPool pool(WORKER_THREADS);
+  EllipseDetector detector(&pool);
+  detector.SetRadii(20, 300, 20, 300);
+  EllipseDescriptor descriptor;
+  descriptor.minMajorRadius = 20;
+  descriptor.maxMajorRadius = 300;
+  descriptor.minMinorRadius = 20;
+  descriptor.maxMinorRadius = 300;
+  Image* image = imaqCreateImage(IMAQ_IMAGE_U8, 3);
+  std::vector<unsigned char> rgb;
+  std::vector<unsigned char> green;
+  std::vector<DetectedEllipse> found;
+
+  int frames = 0;
+  int niEllipses = 0;
+  int nativeEllipses = 0;
+  int matched = 0;
+  double niTime = 0;
+  double nativeTime = 0;
+  int position = 0;
+  while (position < streamSize_ && frames < kMaxEllipseFrames) {
+    int space;
+    char* writePtr = parser.GetWriteBuffer(&space);
+    int chunk = min(min(space, 65536), streamSize_ - position);
+    memcpy(writePtr, stream_ + position, chunk);
+    parser.CommitWrite(chunk);
+    position += chunk;
+
+    const char* jpeg;
+    int jpegSize;
+    while (frames < kMaxEllipseFrames && parser.NextFrame(&jpeg, &jpegSize)) {
+      int width, height;
+      if (!decoder.ReadHeader(jpeg, jpegSize, &width, &height)) {
+        continue;
+      }
+      rgb.resize(4 * width * height);
+      green.resize(width * height);
+      if (!decoder.Decode(jpeg, jpegSize, &rgb[0], 4 * width)) {
+        continue;
+      }
+
+      // Pixels are stored as BGRX, so green is the second byte of each.
+      for (int i = 0; i < width * height; i++) {
+        green[i] = rgb[4 * i + 1];
+      }
+      imaqArrayToImage(image, &green[0], width, height);
+
+      double start = GetMilliseconds();
+      int count = 0;
+      EllipseMatch* match = imaqDetectEllipses(image, &descriptor, NULL, NULL, NULL, &count);
+      niTime += GetMilliseconds() - start;
+
+      start = GetMilliseconds();
+      detector.Detect(&green[0], width, width, height, &found);
+      nativeTime += GetMilliseconds() - start;
+
+      for (int i = 0; i < count; i++) {
+        for (unsigned int j = 0; j < found.size(); j++) {
+          if (EllipsesMatch(found[j], match[i].position.x, match[i].position.y, match[i].majorRadius,
+                            match[i].minorRadius, 3, 0.1)) {
+            matched++;
+            break;
+          }
+        }
+      }
+      niEllipses += count;
+      nativeEllipses += (int)found.size();
+      frames++;
+      if (match) {
+        imaqDispose(match);
+      }
+    }
+  }
+  imaqDispose(image);
+
+  if (frames == 0) {
+    printf("\nNo frames could be decoded for the ellipse comparison.\n");
+    return;
+  }
+  printf("\nEllipses in %d recorded frames (detector using %d threads):\n", frames, pool.GetThreadCount());
+  printf("NIVision:  %6d ellipses  %8.3f ms/frame\n", niEllipses, niTime / frames);
+  printf("Native:    %6d ellipses  %8.3f ms/frame\n", nativeEllipses, nativeTime / frames);
+  printf("%d of NIVision's ellipses found within 3 px and 10%% of their radii.\n", matched);
+}
@@ -0,0 +1,317 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * The headless benchmark of the latency of each stage of the frame path, compared against a baseline.
+ */
+
+#include "Benchmark.h"
+
+#include "BitmapImage.h"
+#include "CapturePipeline.h"
+#include "ColorPlaneExtraction.h"
+#include "ColorThreshold.h"
+#include "Constants.h"
+#include "DetectEllipses.h"
+#include "FramePool.h"
+#include "FrameQueue.h"
+#include "JpegDecoder.h"
+#include "LatencyHistogram.h"
+#include "MjpegParser.h"
+#include "Timer.h"
+#include "TrackedProcessor.h"
+#include <nivision.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// Number of recorded frames in the corpus for the latency benchmark, and the number of times each is measured.
+static const int kLatencyFrames = 100;
+static const int kLatencyPasses = 5;
+
+// Stages of the frame path measured by the latency benchmark, in the order frames pass through them.
+enum LatencyStage {
+  kReceiveStage,
+  kDecodeStage,
+  kColorThresholdStage,
+  kColorPlaneExtractionStage,
+  kDetectEllipsesStage,
+  kTrackedEllipsesStage,
+  kConvertRgbStage,
+  kConvertGrayStage,
+  kHandoffStage,
+  kLatencyStageCount
+};
+
+// Names of the latency benchmark stages, which identify them in the baseline file and so contain no spaces.
+static const char* kLatencyStageNames[kLatencyStageCount] = {
+  "receive",
+  "decode",
+  "process.ColorThreshold",
+  "process.ColorPlaneExtraction",
+  "process.DetectEllipses",
+  "process.DetectEllipses+ROI",
+  "convert.rgb",
+  "convert.gray",
+  "handoff"
+};
+
+// State shared with the thread receiving frames in the handoff measurement.
+struct HandoffTest {
+  FrameQueue* queue;
+  HANDLE received;
+  volatile double pushTime;
+  LatencyHistogram* latency;
+};
+
+/*
+ * Receives frames from the handoff queue until it is closed, recording how long each took to arrive.
+ */
+static DWORD WINAPI ReceiveHandoffs(LPVOID param) {
+  HandoffTest* test = (HandoffTest*)param;
+  while (test->queue->Pop() != NULL) {
+    test->latency->Record(GetMilliseconds() - test->pushTime);
+    SetEvent(test->received);
+  }
+  return 0;
+}
+
+/*
+ * Measures each stage a frame passes through on its way from the camera to the screen, over a corpus of frames
+ * from the recording: receiving, decoding, each image processor, converting the original and processed images
+ * for display, and handing a frame from one pipeline thread to the next. The latency percentiles of each stage
+ * are compared against the baseline file, and written to the results file in the same format.
+ *
+ * @return The process exit code, as returned by CompareLatencyBaseline.
+ */
+int Benchmark::BenchmarkLatency() {
+  LatencyHistogram latencies[kLatencyStageCount];
+
+  // Receiving is measured as the work of parsing the stream from memory since the previous frame.
+  std::vector<std::string> corpus;
+  for (int pass = 0; pass < kLatencyPasses; pass++) {
+    MjpegParser parser(STREAM_BUFFER_SIZE);
+    int frames = 0;
+    int position = 0;
+    double mark = GetMilliseconds();
+    while (position < streamSize_ && frames < kLatencyFrames) {
+      int space;
+      char* writePtr = parser.GetWriteBuffer(&space);
+      int chunk = min(min(space, 65536), streamSize_ - position);
+      memcpy(writePtr, stream_ + position, chunk);
+      parser.CommitWrite(chunk);
+      position += chunk;
+
+      const char* jpeg;
+      int jpegSize;
+      while (frames < kLatencyFrames && parser.NextFrame(&jpeg, &jpegSize)) {
+        latencies[kReceiveStage].Record(GetMilliseconds() - mark);
+        if (pass == 0) {
+          corpus.push_back(std::string(jpeg, jpegSize));
+        }
+        frames++;
+        mark = GetMilliseconds();
+      }
+    }
+  }
+  if (corpus.empty()) {
+    printf("\nNo frames in the recording for the latency benchmark.\n");
+    return false;
+  }
+
+  FramePool framePool;
+  JpegDecoder decoder;
+  ImageProcessor* processors[] = {
+    new ColorThreshold(),
+    new ColorPlaneExtraction(),
+    new DetectEllipses(),
+    new TrackedProcessor(new DetectEllipses())
+  };
+  static const int kProcessorCount = (int)(sizeof(processors) / sizeof(processors[0]));
+  for (int i = 0; i < kProcessorCount; i++) {
+    processors[i]->SetFramePool(&framePool);
+  }
+  BitmapImage* rgbBitmap = NULL;
+  BitmapImage* grayBitmap = NULL;
+  FrameResult result;
+  for (int pass = 0; pass < kLatencyPasses; pass++) {
+    for (unsigned int frame = 0; frame < corpus.size(); frame++) {
+      // Decode as Camera::DecodeFrame does, into an image from the pool.
+      const char* jpeg = corpus[frame].data();
+      int jpegSize = (int)corpus[frame].size();
+      double start = GetMilliseconds();
+      int width, height;
+      if (!decoder.ReadHeader(jpeg, jpegSize, &width, &height)) {
+        continue;
+      }
+      Image* image = framePool.Acquire(IMAQ_IMAGE_RGB, width, height);
+      ImageInfo info;
+      imaqGetImageInfo(image, &info);
+      bool decoded = decoder.Decode(jpeg, jpegSize, (unsigned char*)info.imageStart, 4 * info.pixelsPerLine);
+      latencies[kDecodeStage].Record(GetMilliseconds() - start);
+      if (!decoded) {
+        framePool.Release(image);
+        continue;
+      }
+
+      for (int i = 0; i < kProcessorCount; i++) {
+        start = GetMilliseconds();
+        Image* processed = processors[i]->ProcessImage(image, &result);
+        latencies[kColorThresholdStage + i].Record(GetMilliseconds() - start);
+
+        // Colour plane extraction gives a grayscale image for the grayscale conversion. Bitmaps are created
+        // before timing, as the camera only creates them when the resolution changes.
+        if (i == kColorPlaneExtractionStage - kColorThresholdStage) {
+          if (grayBitmap == NULL) {
+            grayBitmap = new BitmapImage(processed);
+          }
+          start = GetMilliseconds();
+          grayBitmap->Update(processed);
+          latencies[kConvertGrayStage].Record(GetMilliseconds() - start);
+        }
+        framePool.Release(processed);
+      }
+
+      if (rgbBitmap == NULL) {
+        rgbBitmap = new BitmapImage(image);
+      }
+      start = GetMilliseconds();
+      rgbBitmap->Update(image);
+      latencies[kConvertRgbStage].Record(GetMilliseconds() - start);
+      framePool.Release(image);
+    }
+  }
+  delete rgbBitmap;
+  delete grayBitmap;
+  for (int i = 0; i < kProcessorCount; i++) {
+    delete processors[i];
+  }
+
+  // Hand a frame to a waiting thread through a pipeline queue, one at a time, as an idle stage receives its next
+  // frame.
+  FrameQueue queue(1, FrameQueue::kBlock);
+  HandoffTest handoff;
+  handoff.queue = &queue;
+  handoff.received = CreateEvent(NULL, FALSE, FALSE, NULL);
+  handoff.pushTime = 0;
+  handoff.latency = &latencies[kHandoffStage];
+  HANDLE receiver = CreateThread(NULL, 0, ReceiveHandoffs, &handoff, 0, NULL);
+  PipelineFrame pipelineFrame;
+  for (unsigned int i = 0; i < corpus.size(); i++) {
+    // Give the receiving thread time to go back to waiting on the queue.
+    Sleep(1);
+    handoff.pushTime = GetMilliseconds();
+    queue.Push(&pipelineFrame);
+    WaitForSingleObject(handoff.received, INFINITE);
+  }
+  queue.Close();
+  WaitForSingleObject(receiver, INFINITE);
+  CloseHandle(receiver);
+  CloseHandle(handoff.received);
+
+  printf("\nLatency over %d recorded frames, %d passes:\n", (int)corpus.size(), kLatencyPasses);
+  printf("%-30s %7s %9s %9s %9s %10s\n", "Stage", "Frames", "p50 ms", "p99 ms", "Max ms", "Frames/s");
+  for (int stage = 0; stage < kLatencyStageCount; stage++) {
+    LatencyHistogram& latency = latencies[stage];
+    printf("%-30s %7d %9.3f %9.3f %9.3f %10.1f\n",
+           kLatencyStageNames[stage],
+           latency.GetCount(),
+           latency.GetPercentile(50),
+           latency.GetPercentile(99),
+           latency.GetMax(),
+           latency.GetTotal() > 0 ? 1000.0 * latency.GetCount() / latency.GetTotal() : 0.0);
+  }
+  WriteLatencyResults(latencies);
+  return CompareLatencyBaseline(latencies);
+}
+
+/*
+ * Writes the latency of each stage to the results file, in the format of the baseline file, so that it can be
+ * copied over the baseline to accept the new numbers.
+ */
+void Benchmark::WriteLatencyResults(LatencyHistogram* latencies) {
+  FILE* file = fopen(BENCHMARK_RESULTS, "w");
+  if (file == NULL) {
+    printf("Unable to write latency results to '%s'.\n", BENCHMARK_RESULTS);
+    return;
+  }
+  fprintf(file, "# stage                        p50_ms     p99_ms     max_ms     frames_per_second\n");
+  for (int stage = 0; stage < kLatencyStageCount; stage++) {
+    LatencyHistogram& latency = latencies[stage];
+    fprintf(file,
+            "%-30s %-10.4f %-10.4f %-10.4f %.1f\n",
+            kLatencyStageNames[stage],
+            latency.GetPercentile(50),
+            latency.GetPercentile(99),
+            latency.GetMax(),
+            latency.GetTotal() > 0 ? 1000.0 * latency.GetCount() / latency.GetTotal() : 0.0);
+  }
+  fclose(file);
+}
+
+/*
+ * Compares the median and 99th percentile latency of each stage against the baseline file. A stage has
+ * regressed if either is more than BENCHMARK_TOLERANCE percent above its baseline, ignoring differences of less
+ * than 10 microseconds, which are within the timer's noise.
+ *
+ * A baseline which gives no stage, or is missing, fails the comparison rather than passing it with nothing
+ * checked.
+ *
+ * @return 0 if every stage is within the tolerance, kExitRegressed if any has regressed, or kExitNotCompared if
+ *         no stage was compared.
+ */
+int Benchmark::CompareLatencyBaseline(LatencyHistogram* latencies) {
+  FILE* file = fopen(BENCHMARK_BASELINE, "r");
+  if (file == NULL) {
+    printf("\nNOT COMPARED: no latency baseline at '%s' to compare against.\n", BENCHMARK_BASELINE);
+    return kExitNotCompared;
+  }
+  bool found[kLatencyStageCount] = { false };
+  double baseline50[kLatencyStageCount];
+  double baseline99[kLatencyStageCount];
+  char line[256];
+  while (fgets(line, sizeof(line), file) != NULL) {
+    char name[64];
+    double p50, p99;
+    if (line[0] == '#' || sscanf(line, "%63s %lf %lf", name, &p50, &p99) != 3) {
+      continue;
+    }
+    for (int stage = 0; stage < kLatencyStageCount; stage++) {
+      if (strcmp(name, kLatencyStageNames[stage]) == 0) {
+        found[stage] = true;
+        baseline50[stage] = p50;
+        baseline99[stage] = p99;
+      }
+    }
+  }
+  fclose(file);
+
+  printf("\nCompared to baseline '%s' (tolerance %d%%):\n", BENCHMARK_BASELINE, BENCHMARK_TOLERANCE);
+  bool regressed = false;
+  int compared = 0;
+  double tolerance = 1 + BENCHMARK_TOLERANCE / 100.0;
+  for (int stage = 0; stage < kLatencyStageCount; stage++) {
+    if (!found[stage]) {
+      printf("%-30s no baseline\n", kLatencyStageNames[stage]);
+      continue;
+    }
+    double p50 = latencies[stage].GetPercentile(50);
+    double p99 = latencies[stage].GetPercentile(99);
+    bool slower = (p50 > baseline50[stage] * tolerance + 0.01) || (p99 > baseline99[stage] * tolerance + 0.01);
+    printf("%-30s p50 %+7.1f%%  p99 %+7.1f%%  %s\n",
+           kLatencyStageNames[stage],
+           baseline50[stage] > 0 ? 100 * (p50 / baseline50[stage] - 1) : 0.0,
+           baseline99[stage] > 0 ? 100 * (p99 / baseline99[stage] - 1) : 0.0,
+           slower ? "REGRESSION" : "ok");
+    regressed = regressed || slower;
+    compared++;
+  }
+  if (compared == 0) {
+    printf("NOT COMPARED: '%s' gives no stages; copy '%s' from the reference machine over it.\n",
+           BENCHMARK_BASELINE,
+           BENCHMARK_RESULTS);
+    return kExitNotCompared;
+  }
+  return regressed ? kExitRegressed : 0;
+}
@@ -0,0 +1,652 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * The headless benchmarks of the stream: the stream controller, receiving, replay, scaled decoding and change
+ * detection.
+ */
+
+#include "Benchmark.h"
+
+// Sockets are only used here, and winsock2.h has to be included before anything which includes Windows.h.
+#include <winsock2.h>
+
+#include "ArchiveReplay.h"
+#include "ArchiveWriter.h"
+#include "ColorThreshold.h"
+#include "Constants.h"
+#include "FrameChangeDetector.h"
+#include "FrameDecoder.h"
+#include "FramePool.h"
+#include "JpegDecoder.h"
+#include "MjpegParser.h"
+#include "StreamController.h"
+#include "Timer.h"
+#include <math.h>
+#include <nivision.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// Number of frames replayed in real time to measure how closely the recorded timing is kept to.
+static const int kRealTimeFrames = 10;
+
+// Number of recorded frames decoded at each scale by the scaled decode benchmark.
+static const int kScaledDecodeFrames = 50;
+
+// Length in seconds of each phase of the simulated stream given to the stream controller.
+static const int kStreamPhaseSeconds = 120;
+
+// The recording sent over the loopback connection by the thread playing the part of the camera.
+struct LoopbackStream {
+  SOCKET sender;
+  const char* stream;
+  int streamSize;
+  int passes;
+};
+
+/*
+ * Runs the stream controller against a simulated camera and processing thread, in simulated time, through
+ * frames which are cheap to process, then expensive, then cheap again. Checks that it settles at the most
+ * expensive settings while frames are cheap, and at settings which the thread keeps up with while they're
+ * expensive, without changing settings again once it has settled.
+ */
+void Benchmark::BenchmarkStreamController() {
+  // Each frame takes a fixed time to process, plus half as much again at the lowest compression.
+  static const double phaseCosts[] = { 10, 40, 10 };
+  static const char* phaseNames[] = { "cheap", "expensive", "cheap again" };
+  int phaseCount = sizeof(phaseCosts) / sizeof(phaseCosts[0]);
+
+  StreamController controller(FRAMES_PER_SECOND, COMPRESSION);
+  double now = 0;
+  double busyUntil = 0;
+  double busyMs = 0;
+  bool hasPending = false;
+  double pendingCost = 0;
+  int frames = 0;
+  int dropped = 0;
+  printf("\nStream controller, starting at %d fps and compression %d:\n", FRAMES_PER_SECOND, COMPRESSION);
+  for (int phase = 0; phase < phaseCount; phase++) {
+    double phaseEnd = (phase + 1) * 1000.0 * kStreamPhaseSeconds;
+    int settledChanges = controller.GetChangeCount();
+    int phaseDropped = dropped;
+    int phaseFrames = frames;
+    while (now < phaseEnd) {
+      StreamSettings settings = controller.GetSettings();
+      now += 1000.0 / settings.framesPerSecond;
+      double cost = phaseCosts[phase] * (1 + 0.5 * (ADAPTIVE_MAX_COMPRESSION - settings.compression) /
+                                             (ADAPTIVE_MAX_COMPRESSION - ADAPTIVE_MIN_COMPRESSION));
+
+      // The thread starts on the waiting frame once it's done with the last, and a frame which arrives while
+      // another is still waiting replaces it.
+      if (hasPending && busyUntil <= now) {
+        busyMs += pendingCost;
+        busyUntil += pendingCost;
+        hasPending = false;
+      }
+      frames++;
+      if (busyUntil <= now) {
+        busyMs += cost;
+        busyUntil = now + cost;
+      }
+      else {
+        if (hasPending) {
+          dropped++;
+        }
+        hasPending = true;
+        pendingCost = cost;
+      }
+      controller.Update(now, &busyMs, 1, frames, dropped);
+
+      // Count the changes made over the second half of the phase, by which time it should have settled.
+      if (now < phaseEnd - 500.0 * kStreamPhaseSeconds) {
+        settledChanges = controller.GetChangeCount();
+        phaseDropped = dropped;
+        phaseFrames = frames;
+      }
+    }
+
+    // While frames are cheap, the most expensive settings should be reached. Otherwise, the thread should keep up.
+    StreamSettings settings = controller.GetSettings();
+    int changes = controller.GetChangeCount() - settledChanges;
+    bool top = controller.GetLevel() == controller.GetLevelCount() - 1;
+    bool settled = changes == 0 && controller.GetLoad() <= ADAPTIVE_HIGH_LOAD &&
+                   dropped - phaseDropped <= ADAPTIVE_MAX_DROPPED * (frames - phaseFrames);
+    bool expected = settled && (phaseCosts[phase] > phaseCosts[0] ? !top : top);
+    printf("%.0f ms frames (%s): %d fps at compression %d, %.0f%% load, %d of %d frames dropped, %d changes "
+           "after settling%s\n",
+           phaseCosts[phase],
+           phaseNames[phase],
+           settings.framesPerSecond,
+           settings.compression,
+           100 * controller.GetLoad(),
+           dropped - phaseDropped,
+           frames - phaseFrames,
+           changes,
+           expected ? "" : " (MISMATCH)");
+  }
+  printf("%d changes in all\n\n", controller.GetChangeCount());
+}
+
+/*
+ * Decodes frames of the recording at each scale the decoder supports, checking that each reduced frame is close
+ * to the full-size frame averaged over the same pixels, and measures the decode, decoding at full size and the
+ * reduced scale in one pass, and the colour threshold on the result.
+ */
+void Benchmark::BenchmarkScaledDecode() {
+  std::vector<std::string> frames;
+  ReadFrames(kScaledDecodeFrames, &frames);
+
+  JpegDecoder decoder;
+  FramePool framePool;
+  ColorThreshold threshold;
+  threshold.SetFramePool(&framePool);
+  std::vector<unsigned char> full;
+  std::vector<unsigned char> reduced;
+  std::vector<unsigned char> both;
+  FrameResult result;
+  printf("\nScaled decode of %d recorded frames:\n", (int)frames.size());
+  printf("%-6s %11s %11s %11s %11s %9s\n", "Scale", "Size", "Decode ms", "+Full ms", "Thresh ms", "Error");
+  for (int scale = 1; scale <= 8; scale *= 2) {
+    int decoded = 0;
+    double decodeTime = 0;
+    double dualTime = 0;
+    double thresholdTime = 0;
+    double error = 0;
+    int samples = 0;
+    int scaledWidth = 0;
+    int scaledHeight = 0;
+    for (unsigned int i = 0; i < frames.size(); i++) {
+      const char* jpeg = frames[i].data();
+      int jpegSize = (int)frames[i].size();
+      int width, height;
+      if (!decoder.ReadHeader(jpeg, jpegSize, &width, &height)) {
+        continue;
+      }
+      scaledWidth = FrameDecoder::GetScaledSize(width, scale);
+      scaledHeight = FrameDecoder::GetScaledSize(height, scale);
+      full.resize(4 * width * height);
+      reduced.resize(4 * scaledWidth * scaledHeight);
+      both.resize(4 * width * height);
+      if (!decoder.Decode(jpeg, jpegSize, &full[0], 4 * width)) {
+        continue;
+      }
+
+      Image* image = framePool.Acquire(IMAQ_IMAGE_RGB, scaledWidth, scaledHeight);
+      ImageInfo info;
+      imaqGetImageInfo(image, &info);
+      DecodeTarget targets[2];
+      targets[0].pixels = (unsigned char*)info.imageStart;
+      targets[0].stride = 4 * info.pixelsPerLine;
+      targets[0].scale = scale;
+      double start = GetMilliseconds();
+      bool success = decoder.DecodeScaled(jpeg, jpegSize, targets, 1);
+      decodeTime += GetMilliseconds() - start;
+      if (!success) {
+        framePool.Release(image);
+        continue;
+      }
+      decoded++;
+
+      // Decode at full size and at the reduced scale together, as for display at full size.
+      if (scale > 1) {
+        targets[0].pixels = &both[0];
+        targets[0].stride = 4 * width;
+        targets[0].scale = 1;
+        targets[1].pixels = &reduced[0];
+        targets[1].stride = 4 * scaledWidth;
+        targets[1].scale = scale;
+        start = GetMilliseconds();
+        decoder.DecodeScaled(jpeg, jpegSize, targets, 2);
+        dualTime += GetMilliseconds() - start;
+      }
+
+      start = GetMilliseconds();
+      Image* processed = threshold.ProcessImage(image, &result);
+      thresholdTime += GetMilliseconds() - start;
+      framePool.Release(processed);
+
+      // Compare each whole reduced pixel against the average of the full-size pixels it covers.
+      const unsigned char* pixels = (const unsigned char*)info.imageStart;
+      for (int y = 0; y < height / scale; y++) {
+        for (int x = 0; x < width / scale; x++) {
+          for (int channel = 0; channel < 3; channel++) {
+            int sum = 0;
+            for (int dy = 0; dy < scale; dy++) {
+              for (int dx = 0; dx < scale; dx++) {
+                sum += full[4 * ((y * scale + dy) * width + x * scale + dx) + channel];
+              }
+            }
+            error += fabs((double)sum / (scale * scale) - pixels[4 * (y * info.pixelsPerLine + x) + channel]);
+            samples++;
+          }
+        }
+      }
+      framePool.Release(image);
+    }
+    if (decoded == 0) {
+      printf("No frames could be decoded at 1/%d scale.\n", scale);
+      continue;
+    }
+
+    // Each reduced sample should be within a few levels of the full-size average; more means the wrong frequencies
+    // or scaling were used.
+    double meanError = samples ? error / samples : 0.0;
+    char size[32];
+    sprintf_s(size, sizeof(size), "%dx%d", scaledWidth, scaledHeight);
+    char dual[32];
+    if (scale > 1) {
+      sprintf_s(dual, sizeof(dual), "%11.3f", dualTime / decoded);
+    }
+    else {
+      sprintf_s(dual, sizeof(dual), "%11s", "-");
+    }
+    printf("1/%-4d %11s %11.3f %s %11.3f %9.2f%s\n",
+           scale,
+           size,
+           decodeTime / decoded,
+           dual,
+           thresholdTime / decoded,
+           meanError,
+           meanError < 4.0 ? "" : " (MISMATCH)");
+  }
+}
+
+// A decoder for frames which are their own eighth-size thumbnails, one grey byte per pixel, so that the change
+// detector can be given scenes drawn directly.
+class ThumbnailDecoder : public FrameDecoder {
+public:
+  ThumbnailDecoder(int width, int height) {
+    width_ = width;
+    height_ = height;
+  }
+
+  virtual bool ReadHeader(const char* data, int size, int* width, int* height) {
+    *width = 8 * width_;
+    *height = 8 * height_;
+    return size == width_ * height_;
+  }
+
+  virtual bool Decode(const char* data, int size, unsigned char* pixels, int stride) {
+    return false;
+  }
+
+  virtual bool DecodeScaled(const char* data, int size, const DecodeTarget* targets, int targetCount) {
+    if (size != width_ * height_ || targetCount != 1 || targets[0].scale != 8) {
+      return false;
+    }
+    for (int y = 0; y < height_; y++) {
+      unsigned char* row = targets[0].pixels + y * targets[0].stride;
+      for (int x = 0; x < width_; x++) {
+        memset(row + 4 * x, data[y * width_ + x], 4);
+      }
+    }
+    return true;
+  }
+
+private:
+  int width_;
+  int height_;
+};
+
+/*
+ * Checks that the change detector skips a still scene with sensor noise but not a small target moving across it,
+ * and that it skips a repeated frame. Then measures what it costs for a repeated frame and for a new one against
+ * decoding the frame, along with how many frames of the recording it skips.
+ */
+void Benchmark::BenchmarkChangeDetection() {
+  // A 640x480 scene, as thumbnail pixels, with noise changing each block by up to half the threshold. From frame
+  // 20, a 16x16 pixel target (two blocks across) moves one block a frame, so every frame from then on must be
+  // processed, even though the mean difference over the frame is tiny.
+  const int thumbnailWidth = 80;
+  const int thumbnailHeight = 60;
+  const int noise = CHANGE_THRESHOLD / 2;
+  ThumbnailDecoder thumbnailDecoder(thumbnailWidth, thumbnailHeight);
+  FrameChangeDetector sceneDetector(CHANGE_THRESHOLD, 0);
+  sceneDetector.SetDecoder(&thumbnailDecoder);
+  std::string scene(thumbnailWidth * thumbnailHeight, 0);
+  int noiseProcessed = 0;
+  int targetSkipped = 0;
+  for (int frame = 0; frame < 40; frame++) {
+    for (int y = 0; y < thumbnailHeight; y++) {
+      for (int x = 0; x < thumbnailWidth; x++) {
+        int value = 60 + x + ((x / 5 + y / 5) % 2) * 40 + rand() % (2 * noise + 1) - noise;
+        if (frame >= 20 && x >= frame && x < frame + 2 && y >= 30 && y < 32) {
+          value = 255;
+        }
+        scene[y * thumbnailWidth + x] = (char)value;
+      }
+    }
+    bool changed = sceneDetector.HasChanged(scene.data(), (int)scene.size());
+    if (frame > 0 && frame < 20 && changed) {
+      noiseProcessed++;
+    }
+    if (frame >= 20 && !changed) {
+      targetSkipped++;
+    }
+  }
+  printf("\nChange detection: %d of 19 noisy still frames processed, %d of 20 moving target frames skipped%s\n",
+         noiseProcessed,
+         targetSkipped,
+         noiseProcessed == 0 && targetSkipped == 0 ? "" : " (MISMATCH)");
+
+  std::vector<std::string> frames;
+  ReadFrames(kScaledDecodeFrames, &frames);
+  if (frames.empty()) {
+    printf("No frames in the recording for the change detection benchmark.\n");
+    return;
+  }
+
+  // Each frame is given twice, and the copy should always be skipped.
+  FrameChangeDetector detector(CHANGE_THRESHOLD, 0);
+  int repeatsSkipped = 0;
+  double newTime = 0;
+  double repeatTime = 0;
+  for (unsigned int i = 0; i < frames.size(); i++) {
+    const char* jpeg = frames[i].data();
+    int jpegSize = (int)frames[i].size();
+    double start = GetMilliseconds();
+    detector.HasChanged(jpeg, jpegSize);
+    newTime += GetMilliseconds() - start;
+    start = GetMilliseconds();
+    if (!detector.HasChanged(jpeg, jpegSize)) {
+      repeatsSkipped++;
+    }
+    repeatTime += GetMilliseconds() - start;
+  }
+
+  // Compare against a full decode of the same frames.
+  JpegDecoder decoder;
+  std::vector<unsigned char> pixels;
+  double decodeTime = 0;
+  for (unsigned int i = 0; i < frames.size(); i++) {
+    int width, height;
+    if (!decoder.ReadHeader(frames[i].data(), (int)frames[i].size(), &width, &height)) {
+      continue;
+    }
+    pixels.resize(4 * width * height);
+    double start = GetMilliseconds();
+    decoder.Decode(frames[i].data(), (int)frames[i].size(), &pixels[0], 4 * width);
+    decodeTime += GetMilliseconds() - start;
+  }
+
+  // Count the frames of the recording itself which would be skipped, as the camera would with its settings.
+  FrameChangeDetector recording(CHANGE_THRESHOLD, CHANGE_MAX_SKIPPED);
+  for (unsigned int i = 0; i < frames.size(); i++) {
+    recording.HasChanged(frames[i].data(), (int)frames[i].size());
+  }
+
+  int count = (int)frames.size();
+  printf("Change detection: %.3f ms/new frame, %.3f ms/repeated frame, %.3f ms/full decode\n",
+         newTime / count,
+         repeatTime / count,
+         decodeTime / count);
+  printf("%d of %d repeated frames skipped%s; %d of %d recorded frames skipped at a threshold of %.1f\n",
+         repeatsSkipped,
+         count,
+         repeatsSkipped == count ? "" : " (MISMATCH)",
+         recording.GetSkippedCount(),
+         count,
+         (double)CHANGE_THRESHOLD);
+}
+
+/*
+ * Opens a connected pair of TCP sockets on the loopback interface, standing in for the camera connection.
+ */
+static bool OpenLoopback(SOCKET* sender, SOCKET* receiver) {
+  SOCKET listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  SOCKADDR_IN sockAddr;
+  sockAddr.sin_family = AF_INET;
+  sockAddr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  sockAddr.sin_port = 0;
+  int addrSize = sizeof(sockAddr);
+  if (bind(listener, (SOCKADDR*)&sockAddr, sizeof(sockAddr)) == SOCKET_ERROR ||
+      listen(listener, 1) == SOCKET_ERROR ||
+      getsockname(listener, (SOCKADDR*)&sockAddr, &addrSize) == SOCKET_ERROR) {
+    closesocket(listener);
+    return false;
+  }
+
+  *receiver = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (connect(*receiver, (SOCKADDR*)&sockAddr, sizeof(sockAddr)) == SOCKET_ERROR) {
+    closesocket(listener);
+    closesocket(*receiver);
+    return false;
+  }
+  *sender = accept(listener, NULL, NULL);
+  closesocket(listener);
+  return *sender != INVALID_SOCKET;
+}
+
+/*
+ * Reads frames using the original receive loop from Camera::Run, which reads the part headers with one
+ * recv() call per byte, into the given buffer of STREAM_BUFFER_SIZE bytes.
+ *
+ * @return The number of frames read before the connection was closed.
+ */
+static int ReadLegacy(SOCKET socket, char* buffer) {
+  int frames = 0;
+  while(1) {
+    int counter = 0;
+    char* trailingPtr = buffer;
+    char* bufferPtr = buffer;
+
+    // Search for the double CRLF separating the HTTP headers from the content.
+    while(1) {
+      if (recv(socket, bufferPtr, 1, 0) <= 0) {
+        return frames;
+      }
+      counter++;
+      if (counter >= 4) {
+        if (strncmp(trailingPtr, "\r\n\r\n", 4) == 0) {
+          *(bufferPtr + 1) = 0;
+          break;
+        }
+        trailingPtr++;
+      }
+      bufferPtr++;
+    }
+
+    char* contentPtr = strstr(buffer, "Content-Length: ");
+    if (contentPtr == NULL) {
+      continue;
+    }
+    int contentSize = atol(contentPtr + 16);
+
+    int bufferSize = 0;
+    do {
+      int received = recv(socket, buffer + bufferSize, contentSize - bufferSize, 0);
+      if (received <= 0) {
+        return frames;
+      }
+      bufferSize += received;
+    } while (bufferSize < contentSize);
+    frames++;
+  }
+}
+
+/*
+ * Reads frames using MjpegParser, as done in Camera::Run.
+ *
+ * @return The number of frames read before the connection was closed.
+ */
+static int ReadParser(SOCKET socket) {
+  MjpegParser parser(STREAM_BUFFER_SIZE);
+  int frames = 0;
+  while(1) {
+    const char* jpeg;
+    int jpegSize;
+    while (!parser.NextFrame(&jpeg, &jpegSize)) {
+      int space;
+      char* writePtr = parser.GetWriteBuffer(&space);
+      int received = recv(socket, writePtr, space, 0);
+      if (received <= 0) {
+        return frames;
+      }
+      parser.CommitWrite(received);
+    }
+    frames++;
+  }
+}
+
+/*
+ * Entry point for the thread playing the part of the camera, which sends the recording over the loopback
+ * connection and then closes it.
+ */
+static DWORD WINAPI SendStream(LPVOID param) {
+  LoopbackStream* loopback = (LoopbackStream*)param;
+  for (int pass = 0; pass < loopback->passes; pass++) {
+    int position = 0;
+    while (position < loopback->streamSize) {
+      int sent = send(loopback->sender,
+                      loopback->stream + position,
+                      min(65536, loopback->streamSize - position),
+                      0);
+      if (sent == SOCKET_ERROR) {
+        closesocket(loopback->sender);
+        return 1;
+      }
+      position += sent;
+    }
+  }
+  closesocket(loopback->sender);
+  return 0;
+}
+
+/*
+ * Measures the receive path over a loopback connection, comparing the original byte-at-a-time header scanning loop
+ * against MjpegParser including the socket calls.
+ */
+void Benchmark::BenchmarkReceive() {
+  char* buffer = new char[STREAM_BUFFER_SIZE];
+  LoopbackStream loopback;
+  loopback.stream = stream_;
+  loopback.streamSize = streamSize_;
+  loopback.passes = kStreamPasses;
+  for (int method = 0; method < 2; method++) {
+    SOCKET receiver;
+    if (!OpenLoopback(&loopback.sender, &receiver)) {
+      printf("Unable to open loopback connection.\n");
+      break;
+    }
+    HANDLE senderThread = CreateThread(NULL, 0, SendStream, &loopback, 0, NULL);
+
+    double start = GetMilliseconds();
+    int frames = (method == 0) ? ReadLegacy(receiver, buffer) : ReadParser(receiver);
+    double elapsed = GetMilliseconds() - start;
+
+    WaitForSingleObject(senderThread, INFINITE);
+    CloseHandle(senderThread);
+    closesocket(receiver);
+
+    printf("%s %6d frames in %8.1f ms  %8.1f MB/s  %6.1f us/frame\n",
+           (method == 0) ? "Legacy (socket):  " : "Parser (socket):  ",
+           frames,
+           elapsed,
+           kStreamPasses * (double)streamSize_ / 1000.0 / elapsed,
+           frames ? 1000.0 * elapsed / frames : 0.0);
+  }
+  delete[] buffer;
+}
+
+/*
+ * Records the frames of the stream into a frame archive, checks that replaying it gives back exactly the same
+ * frames, and measures the replay both as fast as possible and in real time.
+ */
+void Benchmark::BenchmarkReplay() {
+  // Record every frame in the stream as though it arrived at the camera's frame rate.
+  std::string archivePath = std::string(streamFile_) + ".frames";
+  std::vector<std::string> frames;
+  MjpegParser parser(STREAM_BUFFER_SIZE);
+  ArchiveWriter writer;
+  if (!writer.Open(archivePath.c_str())) {
+    printf("\nUnable to create frame archive '%s'.\n", archivePath.c_str());
+    return;
+  }
+  int position = 0;
+  while (position < streamSize_) {
+    int space;
+    char* writePtr = parser.GetWriteBuffer(&space);
+    int chunk = min(min(space, 65536), streamSize_ - position);
+    memcpy(writePtr, stream_ + position, chunk);
+    parser.CommitWrite(chunk);
+    position += chunk;
+
+    const char* jpeg;
+    int jpegSize;
+    while (parser.NextFrame(&jpeg, &jpegSize)) {
+      writer.Write(jpeg, jpegSize, frames.size() * 1000.0 / FRAMES_PER_SECOND);
+      frames.push_back(std::string(jpeg, jpegSize));
+    }
+  }
+  writer.Close();
+
+  ArchiveReplay replay(false, true);
+  double start = GetMilliseconds();
+  bool opened = replay.Open(archivePath.c_str());
+  double openTime = GetMilliseconds() - start;
+  if (!opened || frames.empty()) {
+    printf("\nUnable to replay frame archive '%s'.\n", archivePath.c_str());
+    remove(archivePath.c_str());
+    return;
+  }
+
+  bool match = (replay.GetFrameCount() == (int)frames.size());
+  const char* jpeg;
+  int jpegSize;
+  for (unsigned int i = 0; match && i < frames.size(); i++) {
+    replay.NextFrame(&jpeg, &jpegSize);
+    match = (jpegSize == (int)frames[i].size() && memcmp(jpeg, frames[i].data(), jpegSize) == 0);
+  }
+  printf("\nReplayed frames %s the recording (%d frames, mapped in %.1f ms).\n",
+         match ? "match" : "DO NOT match",
+         replay.GetFrameCount(),
+         openTime);
+
+  // Replaying as fast as possible costs no more than handing out a pointer, so each frame is read through to
+  // include the cost of bringing it into the cache.
+  int frameCount = kStreamPasses * replay.GetFrameCount();
+  double bytes = 0;
+  unsigned int checksum = 0;
+  replay.Rewind();
+  start = GetMilliseconds();
+  for (int i = 0; i < frameCount; i++) {
+    replay.NextFrame(&jpeg, &jpegSize);
+    for (int j = 0; j < jpegSize; j += 64) {
+      checksum += (unsigned char)jpeg[j];
+    }
+    bytes += jpegSize;
+  }
+  double elapsed = GetMilliseconds() - start;
+  printf("Replay (memory):   %6d frames in %8.1f ms  %8.1f MB/s  %6.1f us/frame  (checksum %08x)\n",
+         frameCount,
+         elapsed,
+         bytes / 1000.0 / elapsed,
+         1000.0 * elapsed / frameCount,
+         checksum);
+
+  // Replay the first few frames at the recorded timing and measure how late each one is delivered.
+  ArchiveReplay realTime(true, false);
+  realTime.Open(archivePath.c_str());
+  int realTimeFrames = min(kRealTimeFrames, realTime.GetFrameCount());
+  double maxLateness = 0;
+  double totalLateness = 0;
+  start = GetMilliseconds();
+  for (int i = 0; i < realTimeFrames; i++) {
+    realTime.NextFrame(&jpeg, &jpegSize);
+    double lateness = GetMilliseconds() - start - i * 1000.0 / FRAMES_PER_SECOND;
+    maxLateness = max(maxLateness, lateness);
+    totalLateness += lateness;
+  }
+  printf("Replay (real time): %d frames at %d fps, %.2f ms late on average, %.2f ms at most\n",
+         realTimeFrames,
+         FRAMES_PER_SECOND,
+         totalLateness / realTimeFrames,
+         maxLateness);
+
+  realTime.Close();
+  replay.Close();
+  remove(archivePath.c_str());
+}
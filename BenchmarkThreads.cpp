@@ -0,0 +1,294 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * The headless benchmarks of what passes between threads: trace events, the display handoff and the results
+ * channel.
+ */
+
+#include "Benchmark.h"
+
+#include "Constants.h"
+#include "LatencyHistogram.h"
+#include "ResultChannel.h"
+#include "Timer.h"
+#include "Trace.h"
+#include "TripleBuffer.h"
+#include <stdio.h>
+#include <string.h>
+
+// Counts the calls made in the tracing overhead measurement, so that the loop isn't optimized away.
+static volatile int tracedCalls;
+
+static void TracedCall() {
+  TRACE_SCOPE("Benchmark");
+  tracedCalls++;
+}
+
+static void UntracedCall() {
+  tracedCalls++;
+}
+
+/*
+ * Measures the cost of a traced span of work, with tracing turned off and on, against the same work untraced.
+ */
+void Benchmark::BenchmarkTracing() {
+#if ENABLE_TRACING
+  const int iterations = 1000000;
+  bool wasEnabled = Trace::IsEnabled();
+  double times[3];
+  for (int pass = 0; pass < 3; pass++) {
+    Trace::SetEnabled(pass == 2);
+    double start = GetMilliseconds();
+    for (int i = 0; i < iterations; i++) {
+      if (pass == 0) {
+        UntracedCall();
+      }
+      else {
+        TracedCall();
+      }
+    }
+    times[pass] = (GetMilliseconds() - start) * 1000000 / iterations;
+  }
+  Trace::SetEnabled(wasEnabled);
+  printf("Tracing:     %6.1f ns/span untraced, %6.1f ns/span traced but off, %6.1f ns/span traced and on\n\n",
+         times[0],
+         times[1],
+         times[2]);
+#else
+  printf("Tracing:     compiled out (ENABLE_TRACING is 0)\n\n");
+#endif
+}
+
+// A value passed through the display handoff, every word of which holds the number of the frame it was written
+// for, so that a value read while half-written can be told apart.
+struct HandoffSnapshot {
+  LONG words[128];
+};
+
+// State shared with the thread publishing values in the display handoff measurement.
+struct DisplayHandoffTest {
+  TripleBuffer<HandoffSnapshot>* buffer;
+  volatile bool stop;
+  LONG published;
+};
+
+/*
+ * Publishes numbered values to the display handoff as fast as possible until told to stop.
+ */
+static DWORD WINAPI PublishHandoffs(LPVOID param) {
+  DisplayHandoffTest* test = (DisplayHandoffTest*)param;
+  while (!test->stop) {
+    HandoffSnapshot* snapshot = test->buffer->GetWriteSlot();
+    LONG frame = test->published + 1;
+    for (int i = 0; i < 128; i++) {
+      snapshot->words[i] = frame;
+    }
+    test->buffer->Publish();
+    test->published = frame;
+  }
+  return 0;
+}
+
+/*
+ * Checks that the triple buffer used to hand frames to the window never gives the reader a value which is half
+ * written or older than one it has already seen, while a writer publishes as fast as it can, and measures how
+ * long each side takes.
+ */
+void Benchmark::BenchmarkDisplayHandoff() {
+  const int iterations = 1000000;
+  TripleBuffer<HandoffSnapshot> buffer;
+  for (int i = 0; i < TripleBuffer<HandoffSnapshot>::kSlotCount; i++) {
+    memset(buffer.GetSlot(i), 0, sizeof(HandoffSnapshot));
+  }
+
+  // Time each side on its own first, without the other competing for the shared slot.
+  double start = GetMilliseconds();
+  for (int i = 0; i < iterations; i++) {
+    buffer.GetWriteSlot()->words[0] = i;
+    buffer.Publish();
+  }
+  double publishTime = (GetMilliseconds() - start) * 1000000 / iterations;
+  start = GetMilliseconds();
+  for (int i = 0; i < iterations; i++) {
+    buffer.Acquire();
+  }
+  double acquireTime = (GetMilliseconds() - start) * 1000000 / iterations;
+
+  DisplayHandoffTest test;
+  test.buffer = &buffer;
+  test.stop = false;
+  test.published = 0;
+  for (int i = 0; i < TripleBuffer<HandoffSnapshot>::kSlotCount; i++) {
+    memset(buffer.GetSlot(i), 0, sizeof(HandoffSnapshot));
+  }
+  HANDLE publisher = CreateThread(NULL, 0, PublishHandoffs, &test, 0, NULL);
+  int taken = 0;
+  int torn = 0;
+  int reordered = 0;
+  LONG lastFrame = 0;
+  start = GetMilliseconds();
+  while (GetMilliseconds() - start < 500) {
+    if (!buffer.Acquire()) {
+      continue;
+    }
+    taken++;
+    const HandoffSnapshot* snapshot = buffer.GetReadSlot();
+    for (int i = 1; i < 128; i++) {
+      if (snapshot->words[i] != snapshot->words[0]) {
+        torn++;
+        break;
+      }
+    }
+    if (snapshot->words[0] <= lastFrame) {
+      reordered++;
+    }
+    lastFrame = snapshot->words[0];
+  }
+  test.stop = true;
+  WaitForSingleObject(publisher, INFINITE);
+  CloseHandle(publisher);
+
+  printf("Display handoff: %5.1f ns/publish, %5.1f ns/take; %d of %d published values taken, %d torn, %d out of "
+         "order%s\n",
+         publishTime,
+         acquireTime,
+         taken,
+         (int)test.published,
+         torn,
+         reordered,
+         torn == 0 && reordered == 0 ? "" : " (MISMATCH)");
+}
+
+// State shared with the thread publishing results in the results channel measurement.
+struct ResultChannelTest {
+  ResultChannel* channel;
+  volatile bool stop;
+  volatile bool paced;
+  volatile LONG received;
+  volatile LONG published;
+};
+
+/*
+ * Publishes numbered results to the results channel until told to stop, either as fast as possible or, when
+ * paced, each only once the reader has read the one before.
+ */
+static DWORD WINAPI PublishResults(LPVOID param) {
+  ResultChannelTest* test = (ResultChannelTest*)param;
+  FrameResult result;
+  ClearFrameResult(&result);
+  result.objectCount = FrameResult::kMaxObjects;
+  while (!test->stop) {
+    if (test->paced && test->received != test->published) {
+      SwitchToThread();
+      continue;
+    }
+
+    // Every object holds the frame's number, so that a result read while half-written can be told apart.
+    LONG frame = test->published + 1;
+    result.frameId = frame;
+    for (int i = 0; i < FrameResult::kMaxObjects; i++) {
+      result.objects[i].x = frame;
+      result.objects[i].score = frame;
+    }
+    result.processedTime = GetMilliseconds();
+    test->channel->Publish(result);
+    test->published = frame;
+  }
+  return 0;
+}
+
+/*
+ * Checks that a reader of the shared memory results channel never gets a result which is half written or out of
+ * order while the publisher writes as fast as it can, and measures how long each side takes and how long a result
+ * takes to reach a reader which is polling for it.
+ */
+void Benchmark::BenchmarkResultChannel() {
+  const int iterations = 100000;
+  const char* name = RESULTS_CHANNEL_NAME "Benchmark";
+  ResultChannel channel;
+  ResultChannel reader;
+  if (!channel.Create(name, RESULTS_CHANNEL_SLOTS) || !reader.Open(name)) {
+    printf("Unable to create the results channel.\n\n");
+    return;
+  }
+
+  // Time each side on its own first.
+  FrameResult result;
+  ClearFrameResult(&result);
+  double start = GetMilliseconds();
+  for (int i = 0; i < iterations; i++) {
+    result.frameId = i;
+    channel.Publish(result);
+  }
+  double publishTime = (GetMilliseconds() - start) * 1000000 / iterations;
+  start = GetMilliseconds();
+  for (int i = 0; i < iterations; i++) {
+    reader.ReadLatest(&result);
+  }
+  double readTime = (GetMilliseconds() - start) * 1000000 / iterations;
+
+  // Read every result in order for half of the time while they're published as fast as possible, then one at a
+  // time for the other half, timing how long each takes to arrive.
+  channel.Create(name, RESULTS_CHANNEL_SLOTS);
+  ResultChannelTest test;
+  test.channel = &channel;
+  test.stop = false;
+  test.paced = false;
+  test.received = 0;
+  test.published = 0;
+  HANDLE publisher = CreateThread(NULL, 0, PublishResults, &test, 0, NULL);
+  LatencyHistogram latency;
+  int read = 0;
+  int torn = 0;
+  int reordered = 0;
+  unsigned int lastFrame = 0;
+  double pacedStart = 0;
+  start = GetMilliseconds();
+  double now;
+  while ((now = GetMilliseconds()) - start < 1000) {
+    if (!test.paced && now - start >= 500) {
+      pacedStart = now;
+      test.paced = true;
+    }
+    if (!reader.ReadNext(&result)) {
+      continue;
+    }
+    double arrival = GetMilliseconds();
+    if (test.paced && result.processedTime >= pacedStart) {
+      latency.Record(arrival - result.processedTime);
+    }
+    read++;
+    for (int i = 0; i < FrameResult::kMaxObjects; i++) {
+      if (result.objects[i].x != result.frameId || result.objects[i].score != result.frameId) {
+        torn++;
+        break;
+      }
+    }
+    if (result.frameId <= lastFrame) {
+      reordered++;
+    }
+    lastFrame = result.frameId;
+    test.received = result.frameId;
+  }
+  test.stop = true;
+  WaitForSingleObject(publisher, INFINITE);
+  CloseHandle(publisher);
+
+  printf("Results channel: %5.1f ns/publish, %5.1f ns/read; %d of %d results read, %u overwritten first, %d torn, "
+         "%d out of order%s\n",
+         publishTime,
+         readTime,
+         read,
+         (int)test.published,
+         reader.GetMissedCount(),
+         torn,
+         reordered,
+         torn == 0 && reordered == 0 ? "" : " (MISMATCH)");
+  printf("Results handoff to a polling reader: %.1f us median, %.1f us 99th percentile, %.1f us max over %d "
+         "results\n",
+         1000 * latency.GetPercentile(50),
+         1000 * latency.GetPercentile(99),
+         1000 * latency.GetMax(),
+         latency.GetCount());
+}
@@ -0,0 +1,363 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a morphological operation on a mask, such as removing specks of noise from it before its
+ * particles are analyzed.
+ *
+ * The mask has a byte per pixel, zero where it's empty. Eroding sets each pixel to the smallest value beneath
+ * the structuring element centred on it, and dilating to the largest, so a mask of zeroes and a single value
+ * keeps that value. Opening (erode, then dilate) removes particles and spurs too small to hold the element,
+ * and closing (dilate, then erode) fills holes and gaps too small to hold it, while leaving larger shapes as
+ * they were. The part of the element which falls outside the mask is ignored, so particles at the edge of the
+ * mask aren't eroded from it.
+ *
+ * A rectangle is the horizontal pass followed by the vertical pass over its result, and a cross is the two
+ * passes over the mask combined. Both passes come down to taking the smallest or largest of several rows
+ * element by element: the vertical pass over the rows above and below, and the horizontal pass over copies of
+ * the row shifted by each offset. That is done sixteen or thirty-two pixels at a time with SSE2 or AVX2, which
+ * give exactly the same mask as the scalar kernel.
+ *
+ * Given a WorkerPool, each pass is split into bands of rows shared out among its threads. Every band of a pass
+ * is finished before the next pass, which reads rows from the bands on either side, is started.
+ */
+
+#include "BinaryMorphology.h"
+
+#include "CpuFeatures.h"
+#include "Platform.h"
+#include "WorkerPool.h"
+
+// Runs a member function of BinaryMorphology for each band of rows of a parallel loop.
+class MorphologyTask : public ParallelTask {
+public:
+  typedef void (BinaryMorphology::*Function)(int);
+
+  MorphologyTask(BinaryMorphology* morphology, Function function) {
+    morphology_ = morphology;
+    function_ = function;
+  }
+
+  virtual void Run(int index) {
+    (morphology_->*function_)(index);
+  }
+
+private:
+  BinaryMorphology* morphology_;
+  Function function_;
+};
+
+// Combines several rows into one, pixel by pixel, taking the largest value if dilating or the smallest otherwise.
+typedef void (*CombineKernel)(const unsigned char* const* rows, int count, unsigned char* dest, int width,
+                              bool dilate);
+
+/*
+ * Combines the rows from the given pixel to the end, one pixel at a time.
+ */
+static void CombineFrom(const unsigned char* const* rows, int count, unsigned char* dest, int x, int width,
+                        bool dilate) {
+  for (; x < width; x++) {
+    unsigned char value = rows[0][x];
+    for (int i = 1; i < count; i++) {
+      unsigned char other = rows[i][x];
+      if (dilate ? other > value : other < value) {
+        value = other;
+      }
+    }
+    dest[x] = value;
+  }
+}
+
+/*
+ * Returns the largest pixel of a row between two pixels inclusive if dilating, or the smallest otherwise.
+ */
+static unsigned char CombineWindow(const unsigned char* row, int left, int right, bool dilate) {
+  unsigned char value = row[left];
+  for (int x = left + 1; x <= right; x++) {
+    if (dilate ? row[x] > value : row[x] < value) {
+      value = row[x];
+    }
+  }
+  return value;
+}
+
+static void CombineScalar(const unsigned char* const* rows, int count, unsigned char* dest, int width,
+                          bool dilate) {
+  CombineFrom(rows, count, dest, 0, width, dilate);
+}
+
+#if SIMD_KERNELS
+
+TARGET_SSE2 static void CombineSse2(const unsigned char* const* rows, int count, unsigned char* dest, int width,
+                                    bool dilate) {
+  int x = 0;
+  if (dilate) {
+    for (; x + 16 <= width; x += 16) {
+      __m128i value = _mm_loadu_si128((const __m128i*)(rows[0] + x));
+      for (int i = 1; i < count; i++) {
+        value = _mm_max_epu8(value, _mm_loadu_si128((const __m128i*)(rows[i] + x)));
+      }
+      _mm_storeu_si128((__m128i*)(dest + x), value);
+    }
+  }
+  else {
+    for (; x + 16 <= width; x += 16) {
+      __m128i value = _mm_loadu_si128((const __m128i*)(rows[0] + x));
+      for (int i = 1; i < count; i++) {
+        value = _mm_min_epu8(value, _mm_loadu_si128((const __m128i*)(rows[i] + x)));
+      }
+      _mm_storeu_si128((__m128i*)(dest + x), value);
+    }
+  }
+  CombineFrom(rows, count, dest, x, width, dilate);
+}
+
+TARGET_AVX2 static void CombineAvx2(const unsigned char* const* rows, int count, unsigned char* dest, int width,
+                                    bool dilate) {
+  int x = 0;
+  if (dilate) {
+    for (; x + 32 <= width; x += 32) {
+      __m256i value = _mm256_loadu_si256((const __m256i*)(rows[0] + x));
+      for (int i = 1; i < count; i++) {
+        value = _mm256_max_epu8(value, _mm256_loadu_si256((const __m256i*)(rows[i] + x)));
+      }
+      _mm256_storeu_si256((__m256i*)(dest + x), value);
+    }
+  }
+  else {
+    for (; x + 32 <= width; x += 32) {
+      __m256i value = _mm256_loadu_si256((const __m256i*)(rows[0] + x));
+      for (int i = 1; i < count; i++) {
+        value = _mm256_min_epu8(value, _mm256_loadu_si256((const __m256i*)(rows[i] + x)));
+      }
+      _mm256_storeu_si256((__m256i*)(dest + x), value);
+    }
+  }
+  CombineFrom(rows, count, dest, x, width, dilate);
+}
+
+static const CombineKernel combineKernels[BinaryMorphology::kKernelCount] = {
+  CombineScalar, CombineSse2, CombineAvx2
+};
+
+#else
+
+static const CombineKernel combineKernels[BinaryMorphology::kKernelCount] = {
+  CombineScalar, CombineScalar, CombineScalar
+};
+
+#endif
+
+BinaryMorphology::BinaryMorphology() {
+  pool_ = NULL;
+  SetElement(kRectangle, 3, 3);
+}
+
+/*
+ * Sets the structuring element, which is the given number of pixels across and down, each of which should be odd.
+ */
+void BinaryMorphology::SetElement(Shape shape, int width, int height) {
+  shape_ = shape;
+  radiusX_ = max(width, 1) / 2;
+  radiusY_ = max(height, 1) / 2;
+
+  // Each band has room for the rows beneath the element, and for the two passes of a cross.
+  windowSize_ = max(2 * max(radiusX_, radiusY_) + 1, 2);
+}
+
+/*
+ * Sets the pool of threads to share out each pass among, or NULL to make every pass on the calling thread.
+ */
+void BinaryMorphology::SetWorkerPool(WorkerPool* pool) {
+  pool_ = pool;
+}
+
+/*
+ * Applies an operation to a mask in place, using the best kernel for the processor.
+ *
+ * @param stride The distance in bytes between the start of each row of the mask.
+ */
+void BinaryMorphology::Apply(Operation operation, unsigned char* mask, int stride, int width, int height) {
+  Apply(GetBestKernel(), operation, mask, stride, width, height);
+}
+
+/*
+ * Applies an operation to a mask in place using the given kernel, which must be supported by the processor. Used
+ * to compare the kernels against each other.
+ */
+void BinaryMorphology::Apply(Kernel kernel, Operation operation, unsigned char* mask, int stride, int width,
+                             int height) {
+  if (width <= 0 || height <= 0) {
+    return;
+  }
+  switch (operation) {
+    case kErode:
+      Filter(kernel, false, mask, stride, width, height);
+      break;
+    case kDilate:
+      Filter(kernel, true, mask, stride, width, height);
+      break;
+    case kOpen:
+      Filter(kernel, false, mask, stride, width, height);
+      Filter(kernel, true, mask, stride, width, height);
+      break;
+    case kClose:
+      Filter(kernel, true, mask, stride, width, height);
+      Filter(kernel, false, mask, stride, width, height);
+      break;
+    default:
+      break;
+  }
+}
+
+/*
+ * Returns the fastest kernel supported by the processor and operating system.
+ */
+BinaryMorphology::Kernel BinaryMorphology::GetBestKernel() {
+  if (CpuFeatures::HasAvx2()) {
+    return kAvx2;
+  }
+  if (CpuFeatures::HasSse2()) {
+    return kSse2;
+  }
+  return kScalar;
+}
+
+/*
+ * Returns whether the given kernel can be used on this processor.
+ */
+bool BinaryMorphology::IsSupported(Kernel kernel) {
+  return kernel <= GetBestKernel();
+}
+
+const char* BinaryMorphology::GetKernelName(Kernel kernel) {
+  static const char* names[kKernelCount] = { "Scalar", "SSE2", "AVX2" };
+  return names[kernel];
+}
+
+const char* BinaryMorphology::GetOperationName(Operation operation) {
+  static const char* names[kOperationCount] = { "None", "Erode", "Dilate", "Open", "Close" };
+  return names[operation];
+}
+
+/*
+ * Erodes or dilates a mask in place by the structuring element.
+ */
+void BinaryMorphology::Filter(Kernel kernel, bool dilate, unsigned char* mask, int stride, int width, int height) {
+  kernel_ = kernel;
+  dilate_ = dilate;
+  mask_ = mask;
+  stride_ = stride;
+  width_ = width;
+  height_ = height;
+  int tileCount = (height + kTileRows - 1) / kTileRows;
+  windows_.resize(tileCount * windowSize_);
+  rows_.resize(width * height);
+  if (shape_ == kCross) {
+    columns_.resize(width * height);
+  }
+  RunTiles(&BinaryMorphology::RowsTile, tileCount);
+  RunTiles(&BinaryMorphology::ColumnsTile, tileCount);
+  if (shape_ == kCross) {
+    RunTiles(&BinaryMorphology::CombineTile, tileCount);
+  }
+}
+
+/*
+ * Makes the horizontal pass over a band of rows of the mask.
+ */
+void BinaryMorphology::RowsTile(int tile) {
+  int top = tile * kTileRows;
+  int bottom = min(top + kTileRows, height_);
+  FilterRows(mask_ + top * stride_, stride_, &rows_[top * width_], bottom - top, &windows_[tile * windowSize_]);
+}
+
+/*
+ * Makes the vertical pass over a band of rows. For a rectangle, that is over the result of the horizontal pass,
+ * back into the mask. The vertical pass of a cross works from the mask itself, so it can't be written back until
+ * both are done.
+ */
+void BinaryMorphology::ColumnsTile(int tile) {
+  int top = tile * kTileRows;
+  int bottom = min(top + kTileRows, height_);
+  if (shape_ == kRectangle) {
+    FilterColumns(&rows_[0], width_, mask_, stride_, top, bottom, &windows_[tile * windowSize_]);
+  }
+  else {
+    FilterColumns(mask_, stride_, &columns_[0], width_, top, bottom, &windows_[tile * windowSize_]);
+  }
+}
+
+/*
+ * Combines the two passes of a cross over a band of rows into the mask.
+ */
+void BinaryMorphology::CombineTile(int tile) {
+  const unsigned char** window = &windows_[tile * windowSize_];
+  int bottom = min((tile + 1) * kTileRows, height_);
+  for (int y = tile * kTileRows; y < bottom; y++) {
+    window[0] = &rows_[y * width_];
+    window[1] = &columns_[y * width_];
+    combineKernels[kernel_](window, 2, mask_ + y * stride_, width_, dilate_);
+  }
+}
+
+/*
+ * Erodes or dilates each row of the source by the width of the structuring element, into a destination with no
+ * padding between rows.
+ */
+void BinaryMorphology::FilterRows(const unsigned char* source, int sourceStride, unsigned char* dest, int height,
+                                  const unsigned char** window) {
+  int radius = radiusX_;
+  int width = width_;
+  int edge = min(radius, width);
+  for (int y = 0; y < height; y++) {
+    // Pixels far enough from both ends of the row take their whole window, which is the row shifted by each
+    // offset in turn.
+    if (width > 2 * radius) {
+      for (int i = 0; i <= 2 * radius; i++) {
+        window[i] = source + i;
+      }
+      combineKernels[kernel_](window, 2 * radius + 1, dest + radius, width - 2 * radius, dilate_);
+    }
+
+    // The windows of the pixels near the ends are cut short by them.
+    for (int x = 0; x < edge; x++) {
+      dest[x] = CombineWindow(source, max(x - radius, 0), min(x + radius, width - 1), dilate_);
+    }
+    for (int x = max(width - radius, edge); x < width; x++) {
+      dest[x] = CombineWindow(source, max(x - radius, 0), min(x + radius, width - 1), dilate_);
+    }
+    source += sourceStride;
+    dest += width;
+  }
+}
+
+/*
+ * Erodes or dilates each column of the source by the height of the structuring element, for the rows from top
+ * up to bottom.
+ */
+void BinaryMorphology::FilterColumns(const unsigned char* source, int sourceStride, unsigned char* dest,
+                                     int destStride, int top, int bottom, const unsigned char** window) {
+  for (int y = top; y < bottom; y++) {
+    int first = max(y - radiusY_, 0);
+    int last = min(y + radiusY_, height_ - 1);
+    for (int i = first; i <= last; i++) {
+      window[i - first] = source + i * sourceStride;
+    }
+    combineKernels[kernel_](window, last - first + 1, dest + y * destStride, width_, dilate_);
+  }
+}
+
+/*
+ * Runs a function for each band of rows, sharing them out among the worker pool's threads if there is one.
+ */
+void BinaryMorphology::RunTiles(void (BinaryMorphology::*function)(int), int tileCount) {
+  if (pool_ == NULL) {
+    for (int tile = 0; tile < tileCount; tile++) {
+      (this->*function)(tile);
+    }
+    return;
+  }
+  MorphologyTask task(this, function);
+  pool_->ParallelFor(&task, tileCount);
+}
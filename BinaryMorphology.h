@@ -0,0 +1,84 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a morphological operation on a mask, such as removing specks of noise from it before its
+ * particles are analyzed.
+ */
+
+#ifndef _BINARY_MORPHOLOGY_H_
+#define _BINARY_MORPHOLOGY_H_
+
+#include <vector>
+
+class WorkerPool;
+
+class BinaryMorphology {
+public:
+  enum Operation {
+    kNone,
+    kErode,
+    kDilate,
+    kOpen,
+    kClose,
+    kOperationCount
+  };
+
+  // Shapes of structuring element, both centred on the pixel and made up of a horizontal and a vertical pass.
+  enum Shape {
+    kRectangle,
+    kCross
+  };
+
+  // Instruction sets the kernels are implemented with, in increasing order of preference.
+  enum Kernel {
+    kScalar,
+    kSse2,
+    kAvx2,
+    kKernelCount
+  };
+
+  BinaryMorphology();
+  void SetElement(Shape shape, int width, int height);
+  void SetWorkerPool(WorkerPool* pool);
+  void Apply(Operation operation, unsigned char* mask, int stride, int width, int height);
+  void Apply(Kernel kernel, Operation operation, unsigned char* mask, int stride, int width, int height);
+  static Kernel GetBestKernel();
+  static bool IsSupported(Kernel kernel);
+  static const char* GetKernelName(Kernel kernel);
+  static const char* GetOperationName(Operation operation);
+
+private:
+  enum {
+    kTileRows = 32
+  };
+
+  void Filter(Kernel kernel, bool dilate, unsigned char* mask, int stride, int width, int height);
+  void RowsTile(int tile);
+  void ColumnsTile(int tile);
+  void CombineTile(int tile);
+  void FilterRows(const unsigned char* source, int sourceStride, unsigned char* dest, int height,
+                  const unsigned char** window);
+  void FilterColumns(const unsigned char* source, int sourceStride, unsigned char* dest, int destStride, int top,
+                     int bottom, const unsigned char** window);
+  void RunTiles(void (BinaryMorphology::*function)(int), int tileCount);
+
+  Shape shape_;
+  int radiusX_;
+  int radiusY_;
+  int windowSize_;
+  WorkerPool* pool_;
+  std::vector<unsigned char> rows_;
+  std::vector<unsigned char> columns_;
+  std::vector<const unsigned char*> windows_;
+
+  // The pass being made over the mask, shared by the tiles it's split into.
+  Kernel kernel_;
+  bool dilate_;
+  unsigned char* mask_;
+  int stride_;
+  int width_;
+  int height_;
+};
+
+#endif // _BINARY_MORPHOLOGY_H_
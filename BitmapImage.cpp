@@ -7,23 +7,22 @@
 
 #include "BitmapImage.h"
 
+#include "PixelConversion.h"
+
+volatile LONG BitmapImage::allocationCount_ = 0;
+
 /*
  * Creates an HBITMAP object from the given NIVision Image object.
  */
 BitmapImage::BitmapImage(Image* image) {
   bitmap_ = NULL;
-
-  // Make sure the image is RGB for commonality.
-  imaqCast(NULL, image, IMAQ_IMAGE_RGB, NULL, 0);
-
-  ImageInfo info;
-  imaqGetImageInfo(image, &info);
-  BYTE* pixels = (BYTE*)info.imageStart;
+  rgbImage_ = NULL;
+  imaqGetImageSize(image, &width_, &height_);
 
   BITMAPINFOHEADER bmih;
   bmih.biSize = sizeof(BITMAPINFOHEADER);
-  bmih.biWidth = info.xRes;
-  bmih.biHeight = -info.yRes;
+  bmih.biWidth = width_;
+  bmih.biHeight = -height_;
   bmih.biPlanes = 1;
   bmih.biBitCount = 24;
   bmih.biCompression = BI_RGB;
@@ -34,29 +33,72 @@ BitmapImage::BitmapImage(Image* image) {
   bmih.biClrImportant = 0;
 
   // Create an HBITMAP with a writeable pixel data area.
-  BYTE* bitmapData;
-  bitmap_ = CreateDIBSection(NULL, (BITMAPINFO*)&bmih, 0, (void**)&bitmapData, NULL, 0);
-
-  // Manually copy each pixel from the Image to the bitmap.
-  for (int y = 0; y < info.yRes; y++) {
-    for (int x = 0; x < info.xRes; x++) {
-      int imageIndex = 3 * info.xRes * y + 3 * x;
-      int bitmapIndex = 4 * info.pixelsPerLine * y + 4 * x;
-
-      // Order of pixels is blue, green, red.
-      bitmapData[imageIndex] = pixels[bitmapIndex];
-      bitmapData[imageIndex + 1] = pixels[bitmapIndex + 1];
-      bitmapData[imageIndex + 2] = pixels[bitmapIndex + 2];
-    }
-  }
+  bitmap_ = CreateDIBSection(NULL, (BITMAPINFO*)&bmih, 0, (void**)&bitmapData_, NULL, 0);
+  InterlockedIncrement(&allocationCount_);
+
+  Update(image);
 }
 
 BitmapImage::~BitmapImage() {
   if (bitmap_) {
     DeleteObject(bitmap_);
   }
+  if (rgbImage_) {
+    imaqDispose(rgbImage_);
+  }
+}
+
+/*
+ * Replaces the contents of the bitmap with the given NIVision Image object, which must be the same size. This
+ * allows a bitmap to be reused for later frames rather than creating a new one each time.
+ *
+ * @return False if the image is a different size from the bitmap.
+ */
+bool BitmapImage::Update(Image* image) {
+  ImageInfo info;
+  imaqGetImageInfo(image, &info);
+  if (info.xRes != width_ || info.yRes != height_) {
+    return false;
+  }
+
+  // Grayscale and binary images are converted directly. Any other type is first cast to RGB, into an image kept
+  // for the purpose since casting in place would change the format of an image which is going back to the frame
+  // pool.
+  if (info.imageType != IMAQ_IMAGE_U8 && info.imageType != IMAQ_IMAGE_RGB) {
+    if (rgbImage_ == NULL) {
+      rgbImage_ = imaqCreateImage(IMAQ_IMAGE_RGB, 3);
+      InterlockedIncrement(&allocationCount_);
+    }
+    imaqCast(rgbImage_, image, IMAQ_IMAGE_RGB, NULL, 0);
+    imaqGetImageInfo(rgbImage_, &info);
+  }
+
+  const unsigned char* pixels = (const unsigned char*)info.imageStart;
+  int bitmapStride = PixelConversion::GetBitmapStride(width_);
+  if (info.imageType == IMAQ_IMAGE_U8) {
+    PixelConversion::GrayToBgr(pixels, info.pixelsPerLine, bitmapData_, bitmapStride, width_, height_);
+  }
+  else {
+    PixelConversion::BgrxToBgr(pixels, 4 * info.pixelsPerLine, bitmapData_, bitmapStride, width_, height_);
+  }
+  return true;
 }
 
 HBITMAP BitmapImage::GetBitmap() {
   return bitmap_;
 }
+
+int BitmapImage::GetWidth() {
+  return width_;
+}
+
+int BitmapImage::GetHeight() {
+  return height_;
+}
+
+/*
+ * Returns the number of bitmaps created since the application started.
+ */
+int BitmapImage::GetAllocationCount() {
+  return allocationCount_;
+}
@@ -15,10 +15,19 @@ class BitmapImage {
 public:
   BitmapImage(Image* image);
   ~BitmapImage();
+  bool Update(Image* image);
   HBITMAP GetBitmap();
+  int GetWidth();
+  int GetHeight();
+  static int GetAllocationCount();
 
 private:
   HBITMAP bitmap_;
+  Image* rgbImage_;
+  BYTE* bitmapData_;
+  int width_;
+  int height_;
+  static volatile LONG allocationCount_;
 };
 
 #endif // _BITMAP_IMAGE_H_
@@ -7,82 +7,179 @@
 
 #include "Camera.h"
 
+#include "ArchiveReplay.h"
+#include "ArchiveWriter.h"
 #include "BitmapImage.h"
 #include "Camera.h"
+#include "CaptureEngine.h"
+#include "CapturePipeline.h"
 #include "ColorPlaneExtraction.h"
 #include "ColorThreshold.h"
 #include "Constants.h"
 #include "DetectEllipses.h"
+#include "FrameChangeDetector.h"
+#include "FramePool.h"
 #include "ImageProcessor.h"
+#include "JpegDecoder.h"
+#include "MjpegParser.h"
+#include "ReconnectBackoff.h"
+#include "ResultChannel.h"
+#include "StreamController.h"
+#include "Timer.h"
+#include "Trace.h"
+#include "TrackedProcessor.h"
 #include <iostream>
 
 Camera::Camera() {
-  beforeBmp_ = NULL;
-  afterBmp_ = NULL;
+  pipeline_ = NULL;
+  controller_ = NULL;
+  busyMs_ = 0;
+  cameraSocket_ = INVALID_SOCKET;
+  socketsStarted_ = false;
+  connected_ = false;
+  everConnected_ = false;
+  reconnectCount_ = 0;
+  renegotiating_ = false;
+  decodeFailures_ = 0;
+  frameCount_ = 0;
+  results_ = NULL;
+  backoff_ = new ReconnectBackoff(RECONNECT_MIN_DELAY, RECONNECT_MAX_DELAY);
+  engine_ = NULL;
+  displayedStream_ = 0;
+  InitializeCriticalSection(&publishLock_);
+  address_ = IP_ADDRESS;
+  port_ = PORT;
+  recordFile_ = NULL;
+  replayFile_ = NULL;
+  recorder_ = NULL;
+  replay_ = NULL;
+  for (int i = 0; i < TripleBuffer<FrameSnapshot>::kSlotCount; i++) {
+    FrameSnapshot* snapshot = display_.GetSlot(i);
+    snapshot->before = NULL;
+    snapshot->after = NULL;
+    ClearFrameResult(&snapshot->result);
+  }
+  frameAllocations_ = 0;
+  allocationCount_ = 0;
+
+  // Recycle images between frames rather than creating new ones.
+  framePool_ = new FramePool();
 
-  // Create a 512k buffer on the heap for storing frames acquired from the camera.
-  buffer_ = new char[524288];
+  // Create a parser with a buffer on the heap for storing the stream acquired from the camera.
+  parser_ = new MjpegParser(STREAM_BUFFER_SIZE);
 
-  // The type of image processing to use is specified here.
-  imageProcessor_ = new DetectEllipses();
+  imageProcessor_ = CreateImageProcessor();
+  imageProcessor_->SetFramePool(framePool_);
 
-  // Create a dummy image to be used to decode the JPEG images from the camera.
-  // This is an ugly hack, necessary because NIVision doesn't provide a way to create an Image from
-  // JPEG data already in memory. We create an Image from a "noisy" JPEG file which is almost
-  // guaranteed to be bigger than the JPEG image from the camera, flatten it to a string, and
-  // continuously replace its data with that from the camera and unflatten it into an Image.
-  Image* flatImage = imaqCreateImage(IMAQ_IMAGE_RGB, 3);
-  if (flatImage == NULL) {
-    VisionError();
+  // Decode JPEG images from the camera directly in memory.
+  decoder_ = new JpegDecoder();
+
+  // Skip frames in which nothing has changed, if enabled.
+  changeDetector_ = NULL;
+  if (SKIP_UNCHANGED_FRAMES) {
+    changeDetector_ = new FrameChangeDetector(CHANGE_THRESHOLD, CHANGE_MAX_SKIPPED);
   }
-  if (imaqReadFile(flatImage, "noise.jpg", NULL, NULL) == 0) {
-    VisionError();
+}
+
+Camera::~Camera() {
+  delete pipeline_;
+  delete controller_;
+  delete engine_;
+  delete backoff_;
+  delete parser_;
+  delete recorder_;
+  delete replay_;
+  delete decoder_;
+  delete changeDetector_;
+  delete imageProcessor_;
+  delete results_;
+  for (int i = 0; i < TripleBuffer<FrameSnapshot>::kSlotCount; i++) {
+    delete display_.GetSlot(i)->before;
+    delete display_.GetSlot(i)->after;
   }
-  flatJpeg_ = imaqFlatten(flatImage, IMAQ_FLATTEN_IMAGE, IMAQ_COMPRESSION_JPEG, 1000, &flatJpegSize_);
-  if (flatJpeg_ == NULL) {
-    VisionError();
+  delete framePool_;
+  DeleteCriticalSection(&publishLock_);
+  if (cameraSocket_ != INVALID_SOCKET) {
+    closesocket(cameraSocket_);
   }
-  if (imaqDispose(flatImage) == 0) {
-    VisionError();
+  if (socketsStarted_) {
+    WSACleanup();
   }
 }
 
-Camera::~Camera() {
-  delete buffer_;
-  closesocket(cameraSocket_);
-  WSACleanup();
+/*
+ * Records the frames received from the camera into a frame archive at the given path. Must be called before the
+ * camera is started.
+ */
+void Camera::SetRecordFile(const char* path) {
+  recordFile_ = path;
 }
 
 /*
- * Sets up a socket connection to the camera and begins retrieving JPEG image data from it.
+ * Replays the frames in the frame archive at the given path instead of connecting to the camera. Must be called
+ * before the camera is started.
  */
-void Camera::Start() {
-  // Acquire a handle for the mutex lock created by the main thread.
-  mutex_ = OpenMutex(SYNCHRONIZE, FALSE, "CameraMutex");
+void Camera::SetReplayFile(const char* path) {
+  replayFile_ = path;
+}
 
-  // Set up the socket library.
-  WSADATA WsaDat;
-  if (WSAStartup(MAKEWORD(2, 2), &WsaDat) != NO_ERROR) {
-    SocketError();
+/*
+ * Connects to the camera at the given address instead of the one in Constants.h, e.g. to a FakeCamera. Must be
+ * called before the camera is started.
+ */
+void Camera::SetAddress(const char* address, int port) {
+  address_ = address;
+  port_ = port;
+}
+
+/*
+ * Receives from another camera at the given address as well, using a CaptureEngine to receive from all of them
+ * on one thread. The first camera added takes the place of the one at the default address. Must be called
+ * before the camera is started.
+ */
+void Camera::AddStream(const char* address, int port) {
+  if (engine_ == NULL) {
+    engine_ = new CaptureEngine(this, CAPTURE_WORKERS);
   }
+  engine_->AddCamera(address, port);
+}
 
-  // Create a TCP socket to the camera and connect to it.
-  cameraSocket_ = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-  if (cameraSocket_ == INVALID_SOCKET) {
-    SocketError();
+/*
+ * Chooses which camera's frames are displayed when receiving from more than one.
+ */
+void Camera::SelectStream(int index) {
+  if (engine_ != NULL && index >= 0 && index < engine_->GetCameraCount()) {
+    displayedStream_ = index;
   }
-  SOCKADDR_IN sockAddr;
-  sockAddr.sin_family = AF_INET;
-  sockAddr.sin_addr.s_addr = inet_addr(IP_ADDRESS);
-  sockAddr.sin_port = htons(PORT);
-  if (connect(cameraSocket_, (SOCKADDR*)&sockAddr, sizeof(sockAddr)) == SOCKET_ERROR) {
-    SocketError();
+}
+
+int Camera::GetDisplayedStream() {
+  return displayedStream_;
+}
+
+CaptureEngine* Camera::GetEngine() {
+  return engine_;
+}
+
+/*
+ * Creates the image processor to run on each frame. The type of image processing to use is specified here.
+ */
+ImageProcessor* Camera::CreateImageProcessor() {
+  ImageProcessor* imageProcessor = new DetectEllipses();
+  if (ROI_TRACKING) {
+    imageProcessor = new TrackedProcessor(imageProcessor);
   }
+  return imageProcessor;
+}
 
-  // Populate the settings string with user parameters defined in Constants.h
-  char settingsString[512];
-  sprintf_s(settingsString,
-            512,
+/*
+ * Formats the request which sets the camera's parameters to those in Constants.h.
+ *
+ * @return The length of the request.
+ */
+int Camera::GetSettingsRequest(char* buffer, int size) {
+  return sprintf_s(buffer,
+                   size,
 "GET /axis-cgi/admin/param.cgi?action=update\
 &ImageSource.I0.Sensor.WhiteBalance=%s\
 &ImageSource.I0.Sensor.Exposure=%s\
@@ -91,178 +188,569 @@ void Camera::Start() {
 &ImageSource.I0.Sensor.ColorLevel=%d HTTP/1.1\n\
 Connection: Keep-Alive\n\
 Authorization: Basic %s;\n\n",
-            WHITE_BALANCE,
-            EXPOSURE,
-            EXPOSURE_PRIORITY,
-            BRIGHTNESS,
-            COLOR_LEVEL,
-            AUTHENTICATION);
-
-  // Send the settings string to the camera to ensure desired video settings are selected.
-  if (send(cameraSocket_, settingsString, (int)strlen(settingsString), 0) == SOCKET_ERROR) {
-    SocketError();
+                   WHITE_BALANCE,
+                   EXPOSURE,
+                   EXPOSURE_PRIORITY,
+                   BRIGHTNESS,
+                   COLOR_LEVEL,
+                   AUTHENTICATION);
+}
+
+/*
+ * Formats the request for a motion JPEG stream with the given frame rate and compression, and the resolution in
+ * Constants.h.
+ *
+ * @return The length of the request.
+ */
+int Camera::GetStreamRequest(char* buffer, int size, int framesPerSecond, int compression) {
+  return sprintf_s(buffer,
+                   size,
+"GET /axis-cgi/mjpg/video.cgi?\
+des_fps=%i&compression=%i&resolution=%s&rotation=%i&color=1&colorlevel=100 HTTP/1.1\n\
+Connection: Keep-Alive\n\
+Authorization: Basic %s;\n\n",
+                   framesPerSecond,
+                   compression,
+                   RESOLUTION,
+                   ROTATION,
+                   AUTHENTICATION);
+}
+
+/*
+ * Sets up a socket connection to the camera and begins retrieving JPEG image data from it.
+ */
+void Camera::Start() {
+  // A replay takes the place of the camera entirely.
+  if (replayFile_ != NULL) {
+    ArchiveReplay* replay = new ArchiveReplay(REPLAY_REAL_TIME != 0, REPLAY_LOOP != 0);
+    replay_ = replay;
+    if (!replay->Open(replayFile_)) {
+      ArchiveError("Unable to open the frame archive to replay.");
+    }
+    connected_ = true;
+    Run();
+    return;
   }
 
-  char buffer[256];
-  if (recv(cameraSocket_, buffer, 256, 0) == SOCKET_ERROR) {
+  // Set up the socket library.
+  WSADATA WsaDat;
+  if (WSAStartup(MAKEWORD(2, 2), &WsaDat) != NO_ERROR) {
     SocketError();
   }
+  socketsStarted_ = true;
 
-  // Reset the socket for another operation since the camera closed it on the other end.
-  closesocket(cameraSocket_);
-  cameraSocket_ = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-  if (connect(cameraSocket_, (SOCKADDR*)&sockAddr, sizeof(sockAddr)) == SOCKET_ERROR) {
-    SocketError();
+  // Several cameras are received from on this thread by the engine, which processes their frames on its workers.
+  if (engine_ != NULL) {
+    engine_->Run();
+    return;
   }
 
-  // Populate the request string with user parameters defined in Constants.h
-  char requestString[256];
-  sprintf_s(requestString,
-            256,
-"GET /axis-cgi/mjpg/video.cgi?\
-des_fps=%i&compression=%i&resolution=%s&rotation=%i&color=1&colorlevel=100 HTTP/1.1\n\
-Connection: Keep-Alive\n\
-Authorization: Basic %s;\n\n",
-            FRAMES_PER_SECOND,
-            COMPRESSION,
-            RESOLUTION,
-            ROTATION,
-            AUTHENTICATION);
-
-  // Send the request string to the camera, prompting a continuous motion JPEG stream in reply.
-  if (send(cameraSocket_, requestString, (int)strlen(requestString), 0) == SOCKET_ERROR) {
-    SocketError();
+  // Ask for as high a frame rate and image quality as the processing keeps up with, if enabled.
+  if (ADAPTIVE_STREAM) {
+    controller_ = new StreamController(FRAMES_PER_SECOND, COMPRESSION);
   }
 
-  // Shut down the sending half of the socket, since it is no longer needed.
-  if (shutdown(cameraSocket_, SD_SEND) == SOCKET_ERROR) {
-    SocketError();
+  if (recordFile_ != NULL) {
+    recorder_ = new ArchiveWriter();
+    if (!recorder_->Open(recordFile_)) {
+      ArchiveError("Unable to create the frame archive to record to.");
+    }
   }
 
+  // The connection to the camera is made when the first frame is needed, and made again whenever it's lost.
   Run();
 }
 
+/*
+ * Opens the camera's stream again after it was lost, or for the first time, waiting longer between each failed
+ * attempt. Doesn't return until the stream is open.
+ */
+void Camera::Reconnect() {
+  TRACE_SCOPE("Reconnect");
+  while (1) {
+    int delay = backoff_->NextDelay();
+    if (delay > 0) {
+      Sleep(delay);
+    }
+    if (OpenStream()) {
+      break;
+    }
+  }
+  // Restarting the stream with new settings isn't counted as losing it.
+  if (everConnected_ && !renegotiating_) {
+    reconnectCount_++;
+  }
+  renegotiating_ = false;
+  everConnected_ = true;
+  connected_ = true;
+}
+
+/*
+ * Connects to the camera, sets its parameters and requests its stream. Any step which fails or takes longer than
+ * the timeouts in Constants.h gives up the attempt.
+ *
+ * @return Whether the stream was opened.
+ */
+bool Camera::OpenStream() {
+  SOCKADDR_IN sockAddr;
+  sockAddr.sin_family = AF_INET;
+  sockAddr.sin_addr.s_addr = inet_addr(address_);
+  sockAddr.sin_port = htons(port_);
+  cameraSocket_ = ConnectSocket(sockAddr);
+  if (cameraSocket_ == INVALID_SOCKET) {
+    return false;
+  }
+
+  // Send the settings string to the camera to ensure desired video settings are selected. They're still in place
+  // when the stream is only being restarted with a new frame rate or compression.
+  if (!renegotiating_) {
+    char settingsString[512];
+    int settingsSize = GetSettingsRequest(settingsString, sizeof(settingsString));
+    char buffer[256];
+    if (send(cameraSocket_, settingsString, settingsSize, 0) == SOCKET_ERROR ||
+        recv(cameraSocket_, buffer, 256, 0) == SOCKET_ERROR) {
+      CloseStream();
+      return false;
+    }
+
+    // Reset the socket for another operation since the camera closed it on the other end.
+    closesocket(cameraSocket_);
+    cameraSocket_ = ConnectSocket(sockAddr);
+    if (cameraSocket_ == INVALID_SOCKET) {
+      return false;
+    }
+  }
+
+  // Send the request string to the camera, prompting a continuous motion JPEG stream in reply, then shut down
+  // the sending half of the socket, since it is no longer needed.
+  int framesPerSecond = FRAMES_PER_SECOND;
+  int compression = COMPRESSION;
+  if (controller_ != NULL) {
+    StreamSettings settings = controller_->GetSettings();
+    framesPerSecond = settings.framesPerSecond;
+    compression = settings.compression;
+  }
+  char requestString[256];
+  int requestSize = GetStreamRequest(requestString, sizeof(requestString), framesPerSecond, compression);
+  if (send(cameraSocket_, requestString, requestSize, 0) == SOCKET_ERROR ||
+      shutdown(cameraSocket_, SD_SEND) == SOCKET_ERROR) {
+    CloseStream();
+    return false;
+  }
+
+  // Anything left from the previous connection is the start of a frame which will never be finished.
+  parser_->Reset();
+  return true;
+}
+
+/*
+ * Opens a connection to the camera, with the connect and receive timeouts in Constants.h.
+ *
+ * @return The connected socket, or INVALID_SOCKET if the camera couldn't be reached in time.
+ */
+SOCKET Camera::ConnectSocket(const SOCKADDR_IN& sockAddr) {
+  SOCKET connection = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (connection == INVALID_SOCKET) {
+    return INVALID_SOCKET;
+  }
+
+  // Connect without blocking, so that an unreachable camera is given up on after the connect timeout rather than
+  // the system's, which is many seconds.
+  unsigned long nonBlocking = 1;
+  ioctlsocket(connection, FIONBIO, &nonBlocking);
+  if (connect(connection, (SOCKADDR*)&sockAddr, sizeof(sockAddr)) == SOCKET_ERROR &&
+      WSAGetLastError() != WSAEWOULDBLOCK) {
+    closesocket(connection);
+    return INVALID_SOCKET;
+  }
+  fd_set writable;
+  fd_set failed;
+  FD_ZERO(&writable);
+  FD_ZERO(&failed);
+  FD_SET(connection, &writable);
+  FD_SET(connection, &failed);
+  timeval timeout = { CAMERA_CONNECT_TIMEOUT / 1000, 1000 * (CAMERA_CONNECT_TIMEOUT % 1000) };
+  if (select(0, NULL, &writable, &failed, &timeout) <= 0 || !FD_ISSET(connection, &writable)) {
+    closesocket(connection);
+    return INVALID_SOCKET;
+  }
+  nonBlocking = 0;
+  ioctlsocket(connection, FIONBIO, &nonBlocking);
+
+  // A camera which stops sending without closing the connection is noticed once the receive timeout passes.
+  DWORD receiveTimeout = CAMERA_RECEIVE_TIMEOUT;
+  setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, (const char*)&receiveTimeout, sizeof(receiveTimeout));
+  setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, (const char*)&receiveTimeout, sizeof(receiveTimeout));
+  return connection;
+}
+
+/*
+ * Closes the connection to the camera, so that it is opened again when the next frame is needed.
+ */
+void Camera::CloseStream() {
+  if (cameraSocket_ != INVALID_SOCKET) {
+    closesocket(cameraSocket_);
+    cameraSocket_ = INVALID_SOCKET;
+  }
+  connected_ = false;
+}
+
 /*
  * Receives images from the camera and performs image processing on them.
  */
 void Camera::Run() {
-  // Continue acquiring frames in an infinite loop.
-  while(1) {
-    int counter = 0;
-    char* trailingPtr = buffer_;
-    char* bufferPtr = buffer_;
-
-    // Search for the double CRLF separating the HTTP headers from the content.
-    while(1) {
-      // Read one byte at a time into the buffer.
-      if (recv(cameraSocket_, bufferPtr, 1, 0) == SOCKET_ERROR) {
-        SocketError();
-      }
-      counter++;
-      if (counter >= 4) {
-        // Check for the double CRLF at the end of what has been read so far.
-        if (strncmp(trailingPtr, "\r\n\r\n", 4) == 0) {
-          // Introduce a null character so that the headers can safely be searched as a string.
-          *(bufferPtr + 1) = 0;
-          break;
-        }
-        trailingPtr++;
-      }
-      bufferPtr++;
+  // Publish each frame's results for the robot's code to read, if enabled. The capture engine publishes the
+  // results of its own cameras.
+  if (PUBLISH_RESULTS) {
+    char name[64];
+    ResultChannel::GetChannelName(0, name, sizeof(name));
+    results_ = new ResultChannel();
+    if (!results_->Create(name, RESULTS_CHANNEL_SLOTS)) {
+      delete results_;
+      results_ = NULL;
     }
+  }
 
-    // Determine the size in bytes of the current JPEG image.
-    char* contentPtr = strstr(buffer_, "Content-Length: ");
-    if (contentPtr == NULL) {
+  if (PIPELINE_MODE) {
+    // Run each stage on its own thread, so that the frame rate is limited by the slowest stage only.
+    pipeline_ = new CapturePipeline(this, PIPELINE_QUEUE_DEPTH, FrameQueue::ParsePolicy(PIPELINE_OVERFLOW));
+    pipeline_->Run();
+    return;
+  }
+
+  // Continue acquiring frames in an infinite loop.
+  while(1) {
+    const char* jpeg;
+    int jpegSize;
+    FrameResult result;
+    ReceiveFrame(&jpeg, &jpegSize, &result);
+    if (!HasFrameChanged(jpeg, jpegSize)) {
+      // The last results are still on display, and still hold for this frame.
       continue;
     }
-    int contentSize = atol(contentPtr + 16);
-
-    // Read from the socket until the entire image has been received.
-    int bufferSize = 0;
-    do {
-      int received = recv(cameraSocket_, buffer_ + bufferSize, contentSize - bufferSize, 0);
-      if (received == 0) {
-        continue;
-      }
-      else if (received == SOCKET_ERROR) {
-        SocketError();
-      }
-      bufferSize += received;
-    } while (bufferSize < contentSize);
 
-    // Create an NIVision Image object to represent the new frame.
-    Image* image = imaqCreateImage(IMAQ_IMAGE_RGB, 3);
-    if (image == NULL) {
-      VisionError();
+    double start = GetMilliseconds();
+    Image* input;
+    Image* image = DecodeFrame(jpeg, jpegSize, &input);
+    if (image != NULL) {
+      Image* processed = ProcessFrame(input, &result);
+      PublishFrame(image, input, processed, &result);
     }
+    busyMs_ += GetMilliseconds() - start;
+  }
+}
 
 /*
-    // Copy the JPEG data into the flattened JPEG and unflatten it into the new Image.
-    memcpy((char*)flatJpeg_ + 84, buffer_, bufferSize);
-    if (imaqUnflatten(image, (const unsigned char *)flatJpeg_, flatJpegSize_) == NULL) {
-      VisionError();
+ * Receives data from the camera until a complete JPEG image is available. The image is left in place within
+ * the parser's buffer, and remains valid until the next call.
+ *
+ * @param result The frame's results, which are cleared and given the frame's number and the time it arrived.
+ */
+void Camera::ReceiveFrame(const char** jpeg, int* jpegSize, FrameResult* result) {
+  TRACE_SCOPE("Receive");
+  ReadFrame(jpeg, jpegSize);
+  ClearFrameResult(result);
+  result->frameId = ++frameCount_;
+  result->captureTime = GetMilliseconds();
+  AdjustStream();
+}
+
+/*
+ * Reads the next frame from the replay or the camera, reconnecting to the camera as needed.
+ */
+void Camera::ReadFrame(const char** jpeg, int* jpegSize) {
+  if (replay_ != NULL) {
+    // The application's work is done at the end of a replay which doesn't loop.
+    if (!replay_->NextFrame(jpeg, jpegSize)) {
+      ExitProcess(0);
     }
-*/
-
-    // This is a hack to convert the in-memory JPEG to an NIVision Image object. The library doesn't
-    // have a way to do this, and the previous hack no longer seems to work, so we write the JPEG to
-    // disk and load it back with NIVision.
-    FILE* imageFile = fopen("temp.jpg", "wb");
-    fwrite(buffer_, 1, bufferSize, imageFile);
-    fclose(imageFile);
-    if (imaqReadFile(image, "temp.jpg", NULL, NULL) == 0) {
-      VisionError();
+    return;
+  }
+
+  while (!parser_->NextFrame(jpeg, jpegSize)) {
+    if (cameraSocket_ == INVALID_SOCKET) {
+      Reconnect();
+    }
+    int space;
+    char* writePtr = parser_->GetWriteBuffer(&space);
+    int received = recv(cameraSocket_, writePtr, space, 0);
+    if (received == SOCKET_ERROR || received == 0) {
+      // The camera closed or reset the connection, or sent nothing for longer than the receive timeout.
+      CloseStream();
+      continue;
     }
+    parser_->CommitWrite(received);
+  }
+  backoff_->Reset();
 
-    // Process the image using whatever image processing function was specified in the constructor.
-    Image* processed = imageProcessor_->ProcessImage(image, textOutput_);
+  // Stop recording rather than interrupting the stream if the archive can't be written to, e.g. the disk is full.
+  if (recorder_ != NULL && !recorder_->Write(*jpeg, *jpegSize, GetMilliseconds())) {
+    delete recorder_;
+    recorder_ = NULL;
+  }
+}
 
-    // Convert the Image objects to Windows HBITMAP objects.
-    BitmapImage* before = new BitmapImage(image);
-    BitmapImage* after = new BitmapImage(processed);
+/*
+ * Measures how busy the threads handling the stream are, and restarts the stream if the controller chooses new
+ * settings for it. The frame just received is still processed, and the stream is opened again when the next one
+ * is needed.
+ */
+void Camera::AdjustStream() {
+  if (controller_ == NULL) {
+    return;
+  }
 
-    // Synchronize with the main thread to update the images.
-    WaitForSingleObject(mutex_, INFINITE);
-    if (beforeBmp_) {
-      delete beforeBmp_;
-    }
-    beforeBmp_ = before;
-    if (afterBmp_) {
-      delete afterBmp_;
+  // In the pipeline, each stage after receiving has a thread of its own, and frames are dropped between them.
+  double busyMs[CapturePipeline::kStageCount];
+  int busyCount = 0;
+  int dropped = 0;
+  if (pipeline_ != NULL) {
+    for (int stage = CapturePipeline::kDecode; stage < CapturePipeline::kStageCount; stage++) {
+      busyMs[busyCount++] = pipeline_->GetBusyTime(stage);
+      StageStats stats;
+      pipeline_->GetStats(stage - 1, &stats);
+      dropped += stats.dropped;
     }
-    afterBmp_ = after;
-    ReleaseMutex(mutex_);
+  }
+  else {
+    busyMs[busyCount++] = busyMs_;
+  }
+  if (controller_->Update(GetMilliseconds(), busyMs, busyCount, frameCount_, dropped)) {
+    renegotiating_ = true;
+    CloseStream();
+  }
+}
 
-    // Force the application window to redraw itself using the new images.
-    InvalidateRect(appWindow_, NULL, false);
+/*
+ * Returns whether a frame differs enough from the last one processed to be decoded and processed, or whether it
+ * can be skipped. Frames are never skipped unless SKIP_UNCHANGED_FRAMES is set.
+ */
+bool Camera::HasFrameChanged(const char* jpeg, int jpegSize) {
+  if (changeDetector_ == NULL) {
+    return true;
+  }
+  TRACE_SCOPE("CompareFrame");
+  return changeDetector_->HasChanged(jpeg, jpegSize);
+}
+
+/*
+ * Decodes a JPEG image straight into the pixel buffers of NIVision Image objects from the pool, at the scale the
+ * image processor works at.
+ *
+ * @param input Set to the image to be processed, which may be the returned image itself.
+ * @return The image to display, or NULL if the JPEG is corrupt and the frame should be dropped.
+ */
+Image* Camera::DecodeFrame(const char* jpeg, int jpegSize, Image** input) {
+  TRACE_SCOPE("Decode");
+  Image* image = DecodeImages(decoder_, framePool_, jpeg, jpegSize, imageProcessor_->GetDecodeScale(), input);
+  if (image == NULL) {
+    decodeFailures_++;
+  }
+  return image;
+}
 
-    if (imaqDispose(image) == 0) {
-      VisionError();
+/*
+ * Decodes a JPEG image into images from the given pool. The image to be processed is decoded at the given scale,
+ * and if that is smaller than full size and DISPLAY_FULL_RESOLUTION is set, the image to display is decoded at
+ * full size in the same pass. Otherwise the same image is used for both.
+ *
+ * @param scale The scale the image processor works at, as given by ImageProcessor::GetDecodeScale().
+ * @param input Set to the image to be processed.
+ * @return The image to display, or NULL if the JPEG is corrupt or the images couldn't be created.
+ */
+Image* Camera::DecodeImages(FrameDecoder* decoder, FramePool* framePool, const char* jpeg, int jpegSize, int scale,
+                            Image** input) {
+  int width, height;
+  if (!decoder->ReadHeader(jpeg, jpegSize, &width, &height)) {
+    return NULL;
+  }
+  int targetCount = (scale > 1 && DISPLAY_FULL_RESOLUTION) ? 2 : 1;
+  int scales[2] = { targetCount == 2 ? 1 : scale, scale };
+  Image* images[2] = { NULL, NULL };
+  DecodeTarget targets[2];
+  bool acquired = true;
+  for (int i = 0; i < targetCount && acquired; i++) {
+    images[i] = framePool->Acquire(IMAQ_IMAGE_RGB,
+                                   FrameDecoder::GetScaledSize(width, scales[i]),
+                                   FrameDecoder::GetScaledSize(height, scales[i]));
+    ImageInfo info;
+    acquired = (images[i] != NULL && imaqGetImageInfo(images[i], &info) != 0);
+    if (acquired) {
+      targets[i].pixels = (unsigned char*)info.imageStart;
+      targets[i].stride = 4 * info.pixelsPerLine;
+      targets[i].scale = scales[i];
     }
-    if (processed != image) {
-      // If the image processor is just returning the original image object, don't delete it twice.
-      if (imaqDispose(processed) == 0) {
-        VisionError();
+  }
+  if (!acquired || !decoder->DecodeScaled(jpeg, jpegSize, targets, targetCount)) {
+    for (int i = 0; i < targetCount; i++) {
+      if (images[i] != NULL) {
+        framePool->Release(images[i]);
       }
     }
+    return NULL;
   }
+  *input = images[targetCount - 1];
+  return images[0];
+}
+
+/*
+ * Processes the image using whatever image processing function was specified in the constructor.
+ *
+ * @param result The frame's results, which are filled in by the processor and published straight away.
+ */
+Image* Camera::ProcessFrame(Image* image, FrameResult* result) {
+  TRACE_SCOPE("Process");
+  Image* processed = imageProcessor_->ProcessImage(image, result);
+  result->processedTime = GetMilliseconds();
+  if (results_ != NULL) {
+    results_->Publish(*result);
+  }
+  return processed;
+}
+
+/*
+ * Converts the original and processed images for display and hands them to the application window, then
+ * releases them along with the image which was processed.
+ */
+void Camera::PublishFrame(Image* image, Image* input, Image* processed, const FrameResult* result) {
+  TRACE_SCOPE("Publish");
+  DisplayFrame(image, processed, result);
+  ReleaseImages(image, input, processed);
+
+  // Count the images and bitmaps allocated since the previous frame, which should reach zero once running.
+  int allocationCount = framePool_->GetAllocationCount() + BitmapImage::GetAllocationCount();
+  frameAllocations_ = allocationCount - allocationCount_;
+  allocationCount_ = allocationCount;
+}
+
+/*
+ * Displays a frame from the capture engine if it's from the camera being displayed. Called on the engine's
+ * worker threads, which release the images afterwards.
+ */
+void Camera::OnFrameProcessed(int camera, Image* image, Image* processed, const FrameResult* result) {
+  if (camera != displayedStream_) {
+    return;
+  }
+
+  // Frames of the displayed camera are only processed by one worker at a time, but another camera's frame may
+  // still be being displayed just after switching.
+  EnterCriticalSection(&publishLock_);
+  DisplayFrame(image, processed, result);
+  LeaveCriticalSection(&publishLock_);
+}
+
+/*
+ * Converts the original and processed images for display and hands them to the application window, along with
+ * the processor's results. The window always has a snapshot of its own to paint from, so this never waits for it.
+ */
+void Camera::DisplayFrame(Image* image, Image* processed, const FrameResult* result) {
+  // Convert the Image objects to Windows HBITMAP objects, into the bitmaps this snapshot had last time.
+  FrameSnapshot* snapshot = display_.GetWriteSlot();
+  TRACE_BEGIN("Convert");
+  snapshot->before = ConvertImage(image, snapshot->before);
+  snapshot->after = ConvertImage(processed, snapshot->after);
+  TRACE_END("Convert");
+  snapshot->result = *result;
+  display_.Publish();
+
+  // Force the application window to redraw itself using the new images.
+  InvalidateRect(appWindow_, NULL, false);
+}
+
+/*
+ * Returns the original, input and processed images of a frame to the pool.
+ */
+void Camera::ReleaseImages(Image* image, Image* input, Image* processed) {
+  if (processed && processed != image && processed != input) {
+    // If the image processor is just returning the original image object, don't release it twice.
+    framePool_->Release(processed);
+  }
+  if (input && input != image) {
+    framePool_->Release(input);
+  }
+  if (image) {
+    framePool_->Release(image);
+  }
+}
+
+/*
+ * Converts an Image object for display, reusing the given bitmap if it is the same size.
+ *
+ * @param bitmap The bitmap previously used for the image, or NULL.
+ * @return The bitmap holding the image, which replaces the given one, or NULL if there is no image.
+ */
+BitmapImage* Camera::ConvertImage(Image* image, BitmapImage* bitmap) {
+  if (image == NULL) {
+    delete bitmap;
+    return NULL;
+  }
+  if (bitmap != NULL && bitmap->Update(image)) {
+    return bitmap;
+  }
+
+  // A bitmap of another size is left over from a resolution change, so there's no point keeping it.
+  delete bitmap;
+  return new BitmapImage(image);
 }
 
 void Camera::SetWindow(HWND appWindow) {
   appWindow_ = appWindow;
 }
 
-BitmapImage* Camera::GetBeforeBmp() {
-  return beforeBmp_;
+/*
+ * Returns the newest frame displayed, whose images are NULL until the first frame arrives. The snapshot is left
+ * alone by the camera until the next call, which must be made from the same thread.
+ */
+FrameSnapshot* Camera::GetLatestFrame() {
+  display_.Acquire();
+  return display_.GetReadSlot();
+}
+
+CapturePipeline* Camera::GetPipeline() {
+  return pipeline_;
+}
+
+/*
+ * Returns the controller choosing the stream's frame rate and compression, or NULL if they're fixed.
+ */
+StreamController* Camera::GetStreamController() {
+  return controller_;
 }
 
-BitmapImage* Camera::GetAfterBmp() {
-  return afterBmp_;
+/*
+ * Returns whether the camera's stream is open, or a replay is running.
+ */
+bool Camera::IsConnected() {
+  return connected_;
 }
 
-char* Camera::GetText() {
-  return textOutput_;
+/*
+ * Returns the number of times the stream has been opened again after being lost.
+ */
+int Camera::GetReconnectCount() {
+  return reconnectCount_;
+}
+
+/*
+ * Returns the number of frames lost to corruption: parts of the stream which the parser had to skip to find the
+ * next frame, and frames which couldn't be decoded.
+ */
+int Camera::GetDroppedFrames() {
+  return parser_->GetResyncCount() + decodeFailures_;
+}
+
+/*
+ * Returns the number of frames which weren't decoded or processed because they hadn't changed.
+ */
+int Camera::GetSkippedFrames() {
+  return changeDetector_ != NULL ? changeDetector_->GetSkippedCount() : 0;
+}
+
+/*
+ * Returns the number of images and bitmaps which had to be allocated for the most recently displayed frame.
+ */
+int Camera::GetFrameAllocations() {
+  return frameAllocations_;
 }
 
 /*
@@ -270,6 +758,7 @@ char* Camera::GetText() {
  */
 DWORD WINAPI Camera::StartCamera(LPVOID param) {
   Camera* camera = (Camera*)param;
+  Trace::SetThreadName("Camera");
   camera->Start();
 
   return 0;
@@ -303,11 +792,9 @@ void Camera::SocketError() {
 }
 
 /*
- * Handles vision errors. Displays an error message before exiting the application.
+ * Handles errors opening a frame archive. Displays an error message before exiting the application.
  */
-void Camera::VisionError() {
-  char errorText[64];
-  sprintf_s(errorText, 64, "Vision error: %s", imaqGetErrorText(imaqGetLastError()));
+void Camera::ArchiveError(const char* errorText) {
   MessageBox(NULL, errorText, "Error", MB_OK | MB_ICONERROR);
   ExitProcess(1);
 }
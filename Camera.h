@@ -8,39 +8,113 @@
 #ifndef _CAMERA_H_
 #define _CAMERA_H_
 
+#include "CaptureEngine.h"
+#include "FrameResult.h"
+#include "TripleBuffer.h"
+#include <nivision.h>
 #include <winsock2.h>
 #include <Windows.h>
 
+class ArchiveWriter;
 class BitmapImage;
+class CapturePipeline;
+class FrameChangeDetector;
+class FrameDecoder;
+class FramePool;
+class FrameSource;
 class ImageProcessor;
+class MjpegParser;
+class ReconnectBackoff;
+class ResultChannel;
+class StreamController;
 
-class Camera {
+// A frame as displayed by the application window: the original and processed images, and the processor's results.
+struct FrameSnapshot {
+  BitmapImage* before;
+  BitmapImage* after;
+  FrameResult result;
+};
+
+class Camera : public CaptureListener {
 public:
   Camera();
   ~Camera();
+  void SetRecordFile(const char* path);
+  void SetReplayFile(const char* path);
+  void SetAddress(const char* address, int port);
+  void AddStream(const char* address, int port);
+  void SelectStream(int index);
+  int GetDisplayedStream();
+  CaptureEngine* GetEngine();
   void Start();
   void Run();
+  void ReceiveFrame(const char** jpeg, int* jpegSize, FrameResult* result);
+  bool HasFrameChanged(const char* jpeg, int jpegSize);
+  Image* DecodeFrame(const char* jpeg, int jpegSize, Image** input);
+  Image* ProcessFrame(Image* image, FrameResult* result);
+  void PublishFrame(Image* image, Image* input, Image* processed, const FrameResult* result);
+  void ReleaseImages(Image* image, Image* input, Image* processed);
+  virtual void OnFrameProcessed(int camera, Image* image, Image* processed, const FrameResult* result);
   void Shutdown();
   void SetWindow(HWND appWindow);
-  BitmapImage* GetBeforeBmp();
-  BitmapImage* GetAfterBmp();
-  char* GetText();
+  FrameSnapshot* GetLatestFrame();
+  CapturePipeline* GetPipeline();
+  StreamController* GetStreamController();
+  int GetFrameAllocations();
+  bool IsConnected();
+  int GetReconnectCount();
+  int GetDroppedFrames();
+  int GetSkippedFrames();
+  static ImageProcessor* CreateImageProcessor();
+  static Image* DecodeImages(FrameDecoder* decoder, FramePool* framePool, const char* jpeg, int jpegSize, int scale,
+                             Image** input);
+  static int GetSettingsRequest(char* buffer, int size);
+  static int GetStreamRequest(char* buffer, int size, int framesPerSecond, int compression);
   static DWORD WINAPI StartCamera(LPVOID param);
 
 private:
+  void ReadFrame(const char** jpeg, int* jpegSize);
+  void AdjustStream();
+  void Reconnect();
+  bool OpenStream();
+  SOCKET ConnectSocket(const SOCKADDR_IN& sockAddr);
+  void CloseStream();
   void SocketError();
-  void VisionError();
+  void ArchiveError(const char* errorText);
+  void DisplayFrame(Image* image, Image* processed, const FrameResult* result);
+  BitmapImage* ConvertImage(Image* image, BitmapImage* bitmap);
 
-  HANDLE mutex_;
   SOCKET cameraSocket_;
-  char* buffer_;
-  void* flatJpeg_;
-  unsigned int flatJpegSize_;
+  bool socketsStarted_;
+  volatile bool connected_;
+  bool everConnected_;
+  int reconnectCount_;
+  bool renegotiating_;
+  int decodeFailures_;
+  unsigned int frameCount_;
+  ReconnectBackoff* backoff_;
+  const char* address_;
+  int port_;
+  MjpegParser* parser_;
+  const char* recordFile_;
+  const char* replayFile_;
+  ArchiveWriter* recorder_;
+  FrameSource* replay_;
+  FrameDecoder* decoder_;
+  FrameChangeDetector* changeDetector_;
   ImageProcessor* imageProcessor_;
+  ResultChannel* results_;
+  CapturePipeline* pipeline_;
+  StreamController* controller_;
+  double busyMs_;
+  CaptureEngine* engine_;
+  volatile int displayedStream_;
+  CRITICAL_SECTION publishLock_;
+  FramePool* framePool_;
   HWND appWindow_;
-  BitmapImage* beforeBmp_;
-  BitmapImage* afterBmp_;
-  char textOutput_[512];
+  TripleBuffer<FrameSnapshot> display_;
+  int frameAllocations_;
+  int allocationCount_;
 };
 
 #endif // _CAMERA_H_
@@ -0,0 +1,512 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing the capture engine, which receives from several cameras on a single thread and processes
+ * their frames on a shared set of worker threads.
+ *
+ * Every camera's socket is non-blocking, and one I/O thread waits on all of them at once with select(), working
+ * through each connection's steps as its socket becomes ready. A camera costs its socket, a parser buffer of
+ * CAPTURE_BUFFER_SIZE bytes and its processing state, rather than a thread of its own.
+ *
+ * Completed frames are copied out of the parser and queued for the workers. Each camera has at most one frame
+ * waiting: a frame which arrives before the previous one has started processing replaces it, and is counted as
+ * dropped, so a slow processor always works on the newest frame rather than falling behind. Each camera is only
+ * processed by one worker at a time, which keeps its frames in order and its image processor single-threaded.
+ *
+ * A connection which fails, is closed, or makes no progress within CAMERA_CONNECT_TIMEOUT or
+ * CAMERA_RECEIVE_TIMEOUT milliseconds is closed and retried with a growing delay between attempts, without
+ * affecting the other cameras.
+ *
+ * With ADAPTIVE_STREAM set, each camera's frame rate and compression follow the time its frames take to process
+ * and the frames it drops, and its stream is requested again whenever they change.
+ */
+
+#include "CaptureEngine.h"
+
+#include "Camera.h"
+#include "Constants.h"
+#include "FrameChangeDetector.h"
+#include "FramePool.h"
+#include "ImageProcessor.h"
+#include "JpegDecoder.h"
+#include "MjpegParser.h"
+#include "ReconnectBackoff.h"
+#include "ResultChannel.h"
+#include "StreamController.h"
+#include "Timer.h"
+#include "Trace.h"
+#include <string.h>
+
+/*
+ * Creates the engine.
+ *
+ * @param listener Receives the frames once they have been processed.
+ * @param workerCount The number of threads to process frames on, or zero for one per processor.
+ */
+CaptureEngine::CaptureEngine(CaptureListener* listener, int workerCount) {
+  listener_ = listener;
+  if (workerCount <= 0) {
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
+    workerCount = (int)systemInfo.dwNumberOfProcessors;
+  }
+  workerCount_ = workerCount;
+  InitializeCriticalSection(&queueLock_);
+  queueReady_ = CreateSemaphore(NULL, 0, 0x7fffffff, NULL);
+  startTime_ = GetMilliseconds();
+}
+
+CaptureEngine::~CaptureEngine() {
+  for (unsigned int i = 0; i < streams_.size(); i++) {
+    Stream* stream = streams_[i];
+    if (stream->socket != INVALID_SOCKET) {
+      closesocket(stream->socket);
+    }
+    DeleteCriticalSection(&stream->lock);
+    delete stream->parser;
+    delete stream->processor;
+    delete stream->results;
+    delete stream->controller;
+    delete stream->backoff;
+    delete stream->decoder;
+    delete stream->changeDetector;
+    delete stream->framePool;
+    delete stream;
+  }
+  DeleteCriticalSection(&queueLock_);
+  CloseHandle(queueReady_);
+}
+
+/*
+ * Adds a camera to receive from. Must be called before the engine is run.
+ *
+ * @return The camera's index, by which its frames and counters are identified.
+ */
+int CaptureEngine::AddCamera(const char* address, int port) {
+  Stream* stream = new Stream;
+  stream->index = (int)streams_.size();
+  memset(&stream->address, 0, sizeof(stream->address));
+  stream->address.sin_family = AF_INET;
+  stream->address.sin_addr.s_addr = inet_addr(address);
+  stream->address.sin_port = htons(port);
+  stream->state = kWaiting;
+  stream->streaming = false;
+  stream->socket = INVALID_SOCKET;
+  stream->retryTime = 0;
+  stream->deadline = 0;
+  stream->backoff = new ReconnectBackoff(RECONNECT_MIN_DELAY, RECONNECT_MAX_DELAY);
+  stream->everStreamed = false;
+  stream->renegotiating = false;
+  stream->requestSize = 0;
+  stream->requestSent = 0;
+  stream->parser = new MjpegParser(CAPTURE_BUFFER_SIZE);
+  InitializeCriticalSection(&stream->lock);
+  stream->pendingId = 0;
+  stream->pendingTime = 0;
+  stream->hasPending = false;
+  stream->scheduled = false;
+  stream->decoder = new JpegDecoder();
+  stream->changeDetector = NULL;
+  if (SKIP_UNCHANGED_FRAMES) {
+    stream->changeDetector = new FrameChangeDetector(CHANGE_THRESHOLD, CHANGE_MAX_SKIPPED);
+  }
+  stream->framePool = new FramePool();
+  stream->processor = Camera::CreateImageProcessor();
+  stream->processor->SetFramePool(stream->framePool);
+  stream->results = NULL;
+  if (PUBLISH_RESULTS) {
+    // Each camera's results are published on a channel of their own.
+    char name[64];
+    ResultChannel::GetChannelName(stream->index, name, sizeof(name));
+    stream->results = new ResultChannel();
+    if (!stream->results->Create(name, RESULTS_CHANNEL_SLOTS)) {
+      delete stream->results;
+      stream->results = NULL;
+    }
+  }
+  stream->controller = NULL;
+  if (ADAPTIVE_STREAM) {
+    stream->controller = new StreamController(FRAMES_PER_SECOND, COMPRESSION);
+  }
+  stream->busyMs = 0;
+  stream->busyMicroseconds = 0;
+  stream->frames = 0;
+  stream->processed = 0;
+  stream->dropped = 0;
+  stream->skipped = 0;
+  stream->errors = 0;
+  stream->reconnects = 0;
+  stream->bytes = 0;
+  streams_.push_back(stream);
+  return stream->index;
+}
+
+/*
+ * Starts the workers and runs the I/O loop on the calling thread. Never returns.
+ */
+void CaptureEngine::Run() {
+  startTime_ = GetMilliseconds();
+  for (int i = 0; i < workerCount_; i++) {
+    CreateThread(NULL, 0, StartWorker, this, 0, NULL);
+  }
+
+  while (1) {
+    // Start any connections which are due, and find how long to wait before the next one is.
+    double now = GetMilliseconds();
+    double wait = RECONNECT_MAX_DELAY;
+    fd_set readable;
+    fd_set writable;
+    fd_set failed;
+    FD_ZERO(&readable);
+    FD_ZERO(&writable);
+    FD_ZERO(&failed);
+    for (unsigned int i = 0; i < streams_.size(); i++) {
+      Stream* stream = streams_[i];
+      stream->busyMs += InterlockedExchange(&stream->busyMicroseconds, 0) / 1000.0;
+      if (stream->state == kReceiving && stream->controller != NULL &&
+          stream->controller->Update(now, &stream->busyMs, 1, stream->frames, stream->dropped)) {
+        Renegotiate(stream);
+      }
+      if (stream->state == kWaiting) {
+        if (now < stream->retryTime) {
+          wait = min(wait, stream->retryTime - now);
+          continue;
+        }
+        Connect(stream);
+      }
+      else if (now >= stream->deadline) {
+        // The camera has stopped answering without closing the connection.
+        Fail(stream);
+        continue;
+      }
+      if (stream->state != kWaiting) {
+        wait = min(wait, stream->deadline - now);
+      }
+
+      // A connection attempt completes when the socket becomes writable, or fails with an exception on it.
+      if (stream->state == kConnecting || stream->state == kSending) {
+        FD_SET(stream->socket, &writable);
+        FD_SET(stream->socket, &failed);
+      }
+      else if (stream->state == kReceiving) {
+        FD_SET(stream->socket, &readable);
+      }
+    }
+
+    int waitMs = (int)max(wait, 1.0);
+    timeval timeout = { waitMs / 1000, 1000 * (waitMs % 1000) };
+    int ready = select(0, &readable, &writable, &failed, &timeout);
+    if (ready == SOCKET_ERROR) {
+      // Nothing is waited on while every camera is between connection attempts, which Winsock reports as an
+      // error rather than waiting for the timeout.
+      Sleep((DWORD)max(wait, 1.0));
+      continue;
+    }
+
+    for (unsigned int i = 0; i < streams_.size(); i++) {
+      Stream* stream = streams_[i];
+      if (stream->socket == INVALID_SOCKET) {
+        continue;
+      }
+      if (FD_ISSET(stream->socket, &failed)) {
+        Fail(stream);
+      }
+      else if (FD_ISSET(stream->socket, &writable)) {
+        // Once a connection is made, the request is sent as soon as there is room for it.
+        stream->state = kSending;
+        SendRequest(stream);
+      }
+      else if (FD_ISSET(stream->socket, &readable)) {
+        Receive(stream);
+      }
+    }
+  }
+}
+
+int CaptureEngine::GetCameraCount() {
+  return (int)streams_.size();
+}
+
+/*
+ * Fills in the counters of the given camera, with rates averaged since the engine started.
+ */
+void CaptureEngine::GetStats(int camera, CameraStats* stats) {
+  Stream* stream = streams_[camera];
+  double elapsed = GetMilliseconds() - startTime_;
+  stats->connected = stream->streaming;
+  stats->frames = stream->frames;
+  stats->processed = stream->processed;
+  stats->dropped = stream->dropped;
+  stats->skipped = stream->skipped;
+  stats->errors = stream->errors;
+  stats->reconnects = stream->reconnects;
+  stats->requestedFps = FRAMES_PER_SECOND;
+  stats->requestedCompression = COMPRESSION;
+  stats->load = 0;
+  if (stream->controller != NULL) {
+    StreamSettings settings = stream->controller->GetSettings();
+    stats->requestedFps = settings.framesPerSecond;
+    stats->requestedCompression = settings.compression;
+    stats->load = stream->controller->GetLoad();
+  }
+  stats->framesPerSecond = elapsed > 0 ? 1000.0 * stats->processed / elapsed : 0;
+  stats->kilobytesPerSecond = elapsed > 0 ? stream->bytes / elapsed : 0;
+}
+
+/*
+ * Begins connecting to a camera, first to set its parameters and then, once that's done, to request its stream.
+ */
+void CaptureEngine::Connect(Stream* stream) {
+  stream->socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (stream->socket == INVALID_SOCKET) {
+    Fail(stream);
+    return;
+  }
+  unsigned long nonBlocking = 1;
+  ioctlsocket(stream->socket, FIONBIO, &nonBlocking);
+  if (connect(stream->socket, (SOCKADDR*)&stream->address, sizeof(stream->address)) == SOCKET_ERROR &&
+      WSAGetLastError() != WSAEWOULDBLOCK) {
+    Fail(stream);
+    return;
+  }
+  if (stream->streaming) {
+    int framesPerSecond = FRAMES_PER_SECOND;
+    int compression = COMPRESSION;
+    if (stream->controller != NULL) {
+      StreamSettings settings = stream->controller->GetSettings();
+      framesPerSecond = settings.framesPerSecond;
+      compression = settings.compression;
+    }
+    stream->requestSize = Camera::GetStreamRequest(stream->request, sizeof(stream->request), framesPerSecond,
+                                                   compression);
+  }
+  else {
+    stream->requestSize = Camera::GetSettingsRequest(stream->request, sizeof(stream->request));
+  }
+  stream->requestSent = 0;
+  stream->state = kConnecting;
+  stream->deadline = GetMilliseconds() + CAMERA_CONNECT_TIMEOUT;
+}
+
+/*
+ * Sends as much of the request as the socket will take, and starts waiting for the reply once it's all sent.
+ */
+void CaptureEngine::SendRequest(Stream* stream) {
+  int sent = send(stream->socket, stream->request + stream->requestSent, stream->requestSize - stream->requestSent,
+                  0);
+  if (sent == SOCKET_ERROR) {
+    if (WSAGetLastError() != WSAEWOULDBLOCK) {
+      Fail(stream);
+    }
+    return;
+  }
+  stream->requestSent += sent;
+  if (stream->requestSent < stream->requestSize) {
+    return;
+  }
+  if (stream->streaming) {
+    shutdown(stream->socket, SD_SEND);
+    stream->parser->Reset();
+    if (stream->everStreamed && !stream->renegotiating) {
+      InterlockedIncrement(&stream->reconnects);
+    }
+    stream->everStreamed = true;
+    stream->renegotiating = false;
+  }
+  stream->state = kReceiving;
+  stream->deadline = GetMilliseconds() + CAMERA_RECEIVE_TIMEOUT;
+}
+
+/*
+ * Reads whatever has arrived on a connection.
+ */
+void CaptureEngine::Receive(Stream* stream) {
+  if (!stream->streaming) {
+    // The camera closes the connection after replying to the settings request, so all that matters is that it
+    // replied. The stream is then requested on a new connection straight away.
+    char reply[256];
+    int received = recv(stream->socket, reply, sizeof(reply), 0);
+    if (received == SOCKET_ERROR && WSAGetLastError() == WSAEWOULDBLOCK) {
+      return;
+    }
+    closesocket(stream->socket);
+    stream->socket = INVALID_SOCKET;
+    if (received <= 0) {
+      Fail(stream);
+      return;
+    }
+    stream->streaming = true;
+    stream->state = kWaiting;
+    stream->retryTime = 0;
+    return;
+  }
+
+  TRACE_SCOPE("Receive");
+  int space;
+  char* writePtr = stream->parser->GetWriteBuffer(&space);
+  int received = recv(stream->socket, writePtr, space, 0);
+  if (received == SOCKET_ERROR && WSAGetLastError() == WSAEWOULDBLOCK) {
+    return;
+  }
+  if (received <= 0) {
+    Fail(stream);
+    return;
+  }
+  stream->parser->CommitWrite(received);
+  stream->bytes += received;
+  stream->deadline = GetMilliseconds() + CAMERA_RECEIVE_TIMEOUT;
+
+  const char* jpeg;
+  int jpegSize;
+  while (stream->parser->NextFrame(&jpeg, &jpegSize)) {
+    InterlockedIncrement(&stream->frames);
+    Deliver(stream, jpeg, jpegSize);
+  }
+}
+
+/*
+ * Closes a connection which has failed, timed out or been closed by the camera, and schedules the camera to be
+ * connected to again from the start, waiting longer after each attempt which fails in a row.
+ */
+void CaptureEngine::Fail(Stream* stream) {
+  if (stream->socket != INVALID_SOCKET) {
+    closesocket(stream->socket);
+    stream->socket = INVALID_SOCKET;
+  }
+  InterlockedIncrement(&stream->errors);
+  stream->state = kWaiting;
+  stream->streaming = false;
+  stream->renegotiating = false;
+  stream->retryTime = GetMilliseconds() + stream->backoff->NextDelay();
+}
+
+/*
+ * Closes a camera's stream so that it is requested again straight away with the settings its controller has
+ * chosen. The camera's parameters are still in place, so they aren't set again.
+ */
+void CaptureEngine::Renegotiate(Stream* stream) {
+  closesocket(stream->socket);
+  stream->socket = INVALID_SOCKET;
+  stream->renegotiating = true;
+  stream->state = kWaiting;
+  stream->retryTime = 0;
+}
+
+/*
+ * Hands a frame over to be processed, replacing any frame of the same camera which is still waiting.
+ */
+void CaptureEngine::Deliver(Stream* stream, const char* jpeg, int jpegSize) {
+  stream->backoff->Reset();
+  EnterCriticalSection(&stream->lock);
+  if (stream->hasPending) {
+    InterlockedIncrement(&stream->dropped);
+  }
+  stream->pending.assign(jpeg, jpeg + jpegSize);
+  stream->pendingId = stream->frames;
+  stream->pendingTime = GetMilliseconds();
+  stream->hasPending = true;
+  bool schedule = !stream->scheduled;
+  stream->scheduled = true;
+  LeaveCriticalSection(&stream->lock);
+
+  if (schedule) {
+    EnterCriticalSection(&queueLock_);
+    queue_.push_back(stream);
+    LeaveCriticalSection(&queueLock_);
+    ReleaseSemaphore(queueReady_, 1, NULL);
+  }
+}
+
+/*
+ * Processes a camera's waiting frames until there are none left, at which point the camera can be scheduled
+ * again.
+ */
+void CaptureEngine::ProcessStream(Stream* stream) {
+  while (1) {
+    EnterCriticalSection(&stream->lock);
+    if (!stream->hasPending) {
+      stream->scheduled = false;
+      LeaveCriticalSection(&stream->lock);
+      return;
+    }
+    stream->working.swap(stream->pending);
+    FrameResult result;
+    ClearFrameResult(&result);
+    result.camera = stream->index;
+    result.frameId = stream->pendingId;
+    result.captureTime = stream->pendingTime;
+    stream->hasPending = false;
+    LeaveCriticalSection(&stream->lock);
+
+    // A frame in which nothing has changed is skipped, leaving the camera's last results as they are.
+    const char* jpeg = &stream->working[0];
+    int jpegSize = (int)stream->working.size();
+    if (stream->changeDetector != NULL && !stream->changeDetector->HasChanged(jpeg, jpegSize)) {
+      InterlockedIncrement(&stream->skipped);
+      continue;
+    }
+
+    // Decode the frame straight into images from the camera's pool, as Camera::DecodeFrame does.
+    double start = GetMilliseconds();
+    TRACE_BEGIN("Decode");
+    Image* input;
+    Image* image = Camera::DecodeImages(stream->decoder,
+                                        stream->framePool,
+                                        jpeg,
+                                        jpegSize,
+                                        stream->processor->GetDecodeScale(),
+                                        &input);
+    TRACE_END("Decode");
+    if (image == NULL) {
+      InterlockedExchangeAdd(&stream->busyMicroseconds, (LONG)((GetMilliseconds() - start) * 1000));
+      InterlockedIncrement(&stream->dropped);
+      continue;
+    }
+
+    TRACE_BEGIN("Process");
+    Image* processed = stream->processor->ProcessImage(input, &result);
+    result.processedTime = GetMilliseconds();
+    if (stream->results != NULL) {
+      stream->results->Publish(result);
+    }
+    TRACE_END("Process");
+
+    TRACE_BEGIN("Publish");
+    listener_->OnFrameProcessed(stream->index, image, processed, &result);
+    if (processed && processed != image && processed != input) {
+      stream->framePool->Release(processed);
+    }
+    if (input != image) {
+      stream->framePool->Release(input);
+    }
+    stream->framePool->Release(image);
+    TRACE_END("Publish");
+    InterlockedExchangeAdd(&stream->busyMicroseconds, (LONG)((GetMilliseconds() - start) * 1000));
+    InterlockedIncrement(&stream->processed);
+  }
+}
+
+/*
+ * Processes cameras as they are scheduled.
+ */
+void CaptureEngine::RunWorker() {
+  while (1) {
+    WaitForSingleObject(queueReady_, INFINITE);
+    EnterCriticalSection(&queueLock_);
+    Stream* stream = queue_.front();
+    queue_.pop_front();
+    LeaveCriticalSection(&queueLock_);
+    ProcessStream(stream);
+  }
+}
+
+/*
+ * Entry point for a worker thread.
+ */
+DWORD WINAPI CaptureEngine::StartWorker(LPVOID param) {
+  Trace::SetThreadName("Capture worker");
+  CaptureEngine* engine = (CaptureEngine*)param;
+  engine->RunWorker();
+  return 0;
+}
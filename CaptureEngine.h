@@ -0,0 +1,141 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing the capture engine, which receives from several cameras on a single thread and processes
+ * their frames on a shared set of worker threads.
+ */
+
+#ifndef _CAPTURE_ENGINE_H_
+#define _CAPTURE_ENGINE_H_
+
+#include "FrameResult.h"
+#include <deque>
+#include <nivision.h>
+#include <vector>
+#include <winsock2.h>
+#include <Windows.h>
+
+class FrameChangeDetector;
+class FramePool;
+class ImageProcessor;
+class JpegDecoder;
+class MjpegParser;
+class ReconnectBackoff;
+class ResultChannel;
+class StreamController;
+
+// Counters for one camera of the capture engine.
+struct CameraStats {
+  bool connected;
+  int frames;
+  int processed;
+  int dropped;
+  int skipped;
+  int errors;
+  int reconnects;
+  int requestedFps;
+  int requestedCompression;
+  double load;
+  double framesPerSecond;
+  double kilobytesPerSecond;
+};
+
+// Receives each frame once it has been processed, on the worker thread which processed it. The images are
+// released when the call returns.
+class CaptureListener {
+public:
+  virtual ~CaptureListener() {}
+  virtual void OnFrameProcessed(int camera, Image* image, Image* processed, const FrameResult* result) = 0;
+};
+
+class CaptureEngine {
+public:
+  CaptureEngine(CaptureListener* listener, int workerCount);
+  ~CaptureEngine();
+  int AddCamera(const char* address, int port);
+  void Run();
+  int GetCameraCount();
+  void GetStats(int camera, CameraStats* stats);
+
+private:
+  // The steps of fetching a camera's stream: setting its parameters on one connection, then requesting the
+  // stream on another, as Camera::Start does.
+  enum State {
+    kWaiting,
+    kConnecting,
+    kSending,
+    kReceiving
+  };
+
+  // A camera, with its connection and the state used to process its frames. Only the I/O thread touches the
+  // connection, and only one worker at a time processes the camera's frames.
+  struct Stream {
+    int index;
+    SOCKADDR_IN address;
+    State state;
+    bool streaming;
+    SOCKET socket;
+    double retryTime;
+    double deadline;
+    ReconnectBackoff* backoff;
+    bool everStreamed;
+    bool renegotiating;
+    char request[512];
+    int requestSize;
+    int requestSent;
+    MjpegParser* parser;
+
+    // The newest frame waiting to be processed, which is replaced if another arrives first, with its number and
+    // the time it arrived.
+    CRITICAL_SECTION lock;
+    std::vector<char> pending;
+    unsigned int pendingId;
+    double pendingTime;
+    bool hasPending;
+    bool scheduled;
+    std::vector<char> working;
+
+    JpegDecoder* decoder;
+    FrameChangeDetector* changeDetector;
+    FramePool* framePool;
+    ImageProcessor* processor;
+    ResultChannel* results;
+
+    // Chooses the frame rate and compression to request, from the time spent processing the camera's frames.
+    StreamController* controller;
+    double busyMs;
+
+    // The time the workers have spent on the camera's frames since the I/O loop last added it to busyMs, in
+    // microseconds.
+    volatile LONG busyMicroseconds;
+
+    volatile LONG frames;
+    volatile LONG processed;
+    volatile LONG dropped;
+    volatile LONG skipped;
+    volatile LONG errors;
+    volatile LONG reconnects;
+    double bytes;
+  };
+
+  void Connect(Stream* stream);
+  void SendRequest(Stream* stream);
+  void Receive(Stream* stream);
+  void Fail(Stream* stream);
+  void Renegotiate(Stream* stream);
+  void Deliver(Stream* stream, const char* jpeg, int jpegSize);
+  void ProcessStream(Stream* stream);
+  void RunWorker();
+  static DWORD WINAPI StartWorker(LPVOID param);
+
+  CaptureListener* listener_;
+  std::vector<Stream*> streams_;
+  int workerCount_;
+  CRITICAL_SECTION queueLock_;
+  HANDLE queueReady_;
+  std::deque<Stream*> queue_;
+  double startTime_;
+};
+
+#endif // _CAPTURE_ENGINE_H_
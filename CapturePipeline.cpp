@@ -0,0 +1,216 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing the capture pipeline, which runs each stage of frame handling on its own thread.
+ *
+ * Frames flow from the receive stage (on the camera thread) through decode, process and publish, each of which
+ * runs on its own thread. Neighbouring stages are joined by bounded queues, so the frame rate is limited by the
+ * slowest stage rather than the sum of all of them. Frame objects are allocated up front and recycled through a
+ * free list, so none are created while running.
+ */
+
+#include "CapturePipeline.h"
+
+#include "Camera.h"
+#include "Timer.h"
+#include "Trace.h"
+#include <string.h>
+
+CapturePipeline::CapturePipeline(Camera* camera, int queueDepth, FrameQueue::OverflowPolicy policy) {
+  camera_ = camera;
+
+  // Enough frames for every queue to be full while every stage is also working on one.
+  frameCount_ = (kStageCount - 1) * queueDepth + kStageCount;
+  frames_ = new PipelineFrame[frameCount_];
+  freeFrames_ = new FrameQueue(frameCount_, FrameQueue::kBlock);
+  for (int i = 0; i < frameCount_; i++) {
+    frames_[i].jpeg = NULL;
+    frames_[i].jpegSize = 0;
+    frames_[i].jpegCapacity = 0;
+    frames_[i].image = NULL;
+    frames_[i].input = NULL;
+    frames_[i].processed = NULL;
+    ClearFrameResult(&frames_[i].result);
+    freeFrames_->Push(&frames_[i]);
+  }
+  InitializeCriticalSection(&busyLock_);
+
+  // Each stage other than receive has an input queue.
+  queues_[kReceive] = NULL;
+  for (int stage = kReceive + 1; stage < kStageCount; stage++) {
+    queues_[stage] = new FrameQueue(queueDepth, policy);
+  }
+
+  for (int stage = 0; stage < kStageCount; stage++) {
+    completed_[stage] = 0;
+    failed_[stage] = 0;
+    busyMicroseconds_[stage] = 0;
+    busyMs_[stage] = 0;
+    stageThreads_[stage].pipeline = this;
+    stageThreads_[stage].stage = stage;
+  }
+}
+
+CapturePipeline::~CapturePipeline() {
+  for (int stage = kReceive + 1; stage < kStageCount; stage++) {
+    delete queues_[stage];
+  }
+  delete freeFrames_;
+  for (int i = 0; i < frameCount_; i++) {
+    delete[] frames_[i].jpeg;
+  }
+  delete[] frames_;
+  DeleteCriticalSection(&busyLock_);
+}
+
+/*
+ * Starts the threads for the later stages, then runs the receive stage on the calling thread.
+ */
+void CapturePipeline::Run() {
+  startTime_ = GetMilliseconds();
+  for (int stage = kReceive + 1; stage < kStageCount; stage++) {
+    CreateThread(NULL, 0, StartStage, &stageThreads_[stage], 0, NULL);
+  }
+
+  while (1) {
+    TRACE_BEGIN("WaitFreeFrame");
+    PipelineFrame* frame = freeFrames_->Pop();
+    TRACE_END("WaitFreeFrame");
+
+    double start = GetMilliseconds();
+    const char* jpeg;
+    int jpegSize;
+    camera_->ReceiveFrame(&jpeg, &jpegSize, &frame->result);
+
+    // The parser's buffer is overwritten by the next receive, so the frame needs its own copy of the data.
+    if (jpegSize > frame->jpegCapacity) {
+      delete[] frame->jpeg;
+      frame->jpeg = new char[jpegSize];
+      frame->jpegCapacity = jpegSize;
+    }
+    memcpy(frame->jpeg, jpeg, jpegSize);
+    frame->jpegSize = jpegSize;
+    InterlockedExchangeAdd(&busyMicroseconds_[kReceive], (LONG)((GetMilliseconds() - start) * 1000));
+
+    InterlockedIncrement(&completed_[kReceive]);
+    Forward(kReceive, frame);
+  }
+}
+
+/*
+ * Takes frames from the input queue of the given stage, applies the stage to them, and passes them on.
+ */
+void CapturePipeline::RunStage(int stage) {
+  PipelineFrame* frame;
+  while ((frame = queues_[stage]->Pop()) != NULL) {
+    double start = GetMilliseconds();
+    bool success = true;
+    bool skipped = false;
+    switch (stage) {
+      case kDecode:
+        // A frame in which nothing has changed goes no further, leaving the last results on display.
+        if (!camera_->HasFrameChanged(frame->jpeg, frame->jpegSize)) {
+          skipped = true;
+          break;
+        }
+        frame->image = camera_->DecodeFrame(frame->jpeg, frame->jpegSize, &frame->input);
+        success = (frame->image != NULL);
+        break;
+      case kProcess:
+        frame->processed = camera_->ProcessFrame(frame->input, &frame->result);
+        break;
+      case kPublish:
+        // Publishing hands the images over to the camera, which releases them.
+        camera_->PublishFrame(frame->image, frame->input, frame->processed, &frame->result);
+        frame->image = NULL;
+        frame->input = NULL;
+        frame->processed = NULL;
+        break;
+    }
+    InterlockedExchangeAdd(&busyMicroseconds_[stage], (LONG)((GetMilliseconds() - start) * 1000));
+
+    if (skipped) {
+      Recycle(frame);
+      continue;
+    }
+    if (!success) {
+      InterlockedIncrement(&failed_[stage]);
+      Recycle(frame);
+      continue;
+    }
+    InterlockedIncrement(&completed_[stage]);
+    if (stage == kPublish) {
+      Recycle(frame);
+    }
+    else {
+      Forward(stage, frame);
+    }
+  }
+}
+
+/*
+ * Passes a frame from the given stage to the input queue of the next one, recycling any frame dropped because
+ * the queue was full.
+ */
+void CapturePipeline::Forward(int stage, PipelineFrame* frame) {
+  PipelineFrame* dropped = queues_[stage + 1]->Push(frame);
+  if (dropped) {
+    Recycle(dropped);
+  }
+}
+
+/*
+ * Releases the images held by a frame and returns it to the free list.
+ */
+void CapturePipeline::Recycle(PipelineFrame* frame) {
+  camera_->ReleaseImages(frame->image, frame->input, frame->processed);
+  frame->image = NULL;
+  frame->input = NULL;
+  frame->processed = NULL;
+  freeFrames_->Push(frame);
+}
+
+/*
+ * Fills in the throughput counters for the given stage.
+ */
+void CapturePipeline::GetStats(int stage, StageStats* stats) {
+  double elapsed = GetMilliseconds() - startTime_;
+  stats->frames = completed_[stage];
+
+  // Frames are dropped either by the stage itself or when the queue it feeds is full.
+  stats->dropped = failed_[stage];
+  if (stage + 1 < kStageCount) {
+    stats->dropped += queues_[stage + 1]->GetDropCount();
+  }
+  stats->queueDepth = queues_[stage] ? queues_[stage]->GetDepth() : 0;
+  stats->framesPerSecond = elapsed > 0 ? 1000.0 * stats->frames / elapsed : 0;
+  stats->utilization = elapsed > 0 ? GetBusyTime(stage) / elapsed : 0;
+}
+
+/*
+ * Returns the total time the given stage has spent working on frames, in milliseconds.
+ */
+double CapturePipeline::GetBusyTime(int stage) {
+  EnterCriticalSection(&busyLock_);
+  busyMs_[stage] += InterlockedExchange(&busyMicroseconds_[stage], 0) / 1000.0;
+  double busyMs = busyMs_[stage];
+  LeaveCriticalSection(&busyLock_);
+  return busyMs;
+}
+
+const char* CapturePipeline::GetStageName(int stage) {
+  static const char* names[kStageCount] = { "Receive", "Decode", "Process", "Publish" };
+  return names[stage];
+}
+
+/*
+ * Entry point for the thread running one stage of the pipeline.
+ */
+DWORD WINAPI CapturePipeline::StartStage(LPVOID param) {
+  StageThread* stageThread = (StageThread*)param;
+  Trace::SetThreadName(GetStageName(stageThread->stage));
+  stageThread->pipeline->RunStage(stageThread->stage);
+
+  return 0;
+}
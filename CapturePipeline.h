@@ -0,0 +1,84 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing the capture pipeline, which runs each stage of frame handling on its own thread.
+ */
+
+#ifndef _CAPTURE_PIPELINE_H_
+#define _CAPTURE_PIPELINE_H_
+
+#include "FrameQueue.h"
+#include "FrameResult.h"
+#include <nivision.h>
+#include <Windows.h>
+
+class Camera;
+
+// A frame passing through the stages of the capture pipeline.
+struct PipelineFrame {
+  char* jpeg;
+  int jpegSize;
+  int jpegCapacity;
+  Image* image;
+  Image* input;
+  Image* processed;
+  FrameResult result;
+};
+
+// Throughput counters for one stage of the capture pipeline.
+struct StageStats {
+  int frames;
+  int dropped;
+  int queueDepth;
+  double framesPerSecond;
+  double utilization;
+};
+
+class CapturePipeline {
+public:
+  enum Stage {
+    kReceive,
+    kDecode,
+    kProcess,
+    kPublish,
+    kStageCount
+  };
+
+  CapturePipeline(Camera* camera, int queueDepth, FrameQueue::OverflowPolicy policy);
+  ~CapturePipeline();
+  void Run();
+  void GetStats(int stage, StageStats* stats);
+  double GetBusyTime(int stage);
+  static const char* GetStageName(int stage);
+
+private:
+  // Parameters passed to the thread running a stage.
+  struct StageThread {
+    CapturePipeline* pipeline;
+    int stage;
+  };
+
+  void RunStage(int stage);
+  void Forward(int stage, PipelineFrame* frame);
+  void Recycle(PipelineFrame* frame);
+  static DWORD WINAPI StartStage(LPVOID param);
+
+  Camera* camera_;
+  PipelineFrame* frames_;
+  int frameCount_;
+  FrameQueue* freeFrames_;
+  FrameQueue* queues_[kStageCount];
+  StageThread stageThreads_[kStageCount];
+  volatile LONG completed_[kStageCount];
+  volatile LONG failed_[kStageCount];
+
+  // Each stage's thread adds the time it spends on a frame to its counter, in microseconds, and readers move the
+  // counters into the totals, so the stage threads never wait on a lock.
+  volatile LONG busyMicroseconds_[kStageCount];
+  CRITICAL_SECTION busyLock_;
+  double busyMs_[kStageCount];
+  double startTime_;
+};
+
+#endif // _CAPTURE_PIPELINE_H_
@@ -8,11 +8,11 @@
 #ifndef _COLOR_PLANE_EXTRACTION_H_
 #define _COLOR_PLANE_EXTRACTION_H_
 
-#include "ImageProcessor.h"
+#include "ProcessorGraph.h"
 
-class ColorPlaneExtraction : public ImageProcessor {
+class ColorPlaneExtraction : public ProcessorGraph {
 public:
-  virtual Image* ProcessImage(Image* image, char* textOut);
+  ColorPlaneExtraction();
 };
 
 #endif // _COLOR_PLANE_EXTRACTION_H_
@@ -8,11 +8,12 @@
 #ifndef _COLOR_THRESHOLD_H_
 #define _COLOR_THRESHOLD_H_
 
-#include "ImageProcessor.h"
+#include "ProcessorGraph.h"
 
-class ColorThreshold : public ImageProcessor {
+class ColorThreshold : public ProcessorGraph {
 public:
-  virtual Image* ProcessImage(Image* image, char* textOut);
+  ColorThreshold();
+  virtual int GetDecodeScale();
 };
 
 #endif // _COLOR_THRESHOLD_H_
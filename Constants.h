@@ -17,6 +17,34 @@
 #define PORT 80
 #define AUTHENTICATION "RlJDOkZSQw==" // Username 'FRC', password 'FRC'.
 
+// Adaptive stream settings. When ADAPTIVE_STREAM is set, the frame rate and compression asked of the camera are
+// adjusted while running, starting from FRAMES_PER_SECOND and COMPRESSION. Every ADAPTIVE_INTERVAL milliseconds, the
+// load of the busiest decoding or processing thread is measured as the fraction of the time it was busy. The stream
+// is requested again with a lower frame rate or higher compression if the load is over ADAPTIVE_HIGH_LOAD or more
+// than ADAPTIVE_MAX_DROPPED of the frames were dropped. Once the load has been under ADAPTIVE_LOW_LOAD for
+// ADAPTIVE_RAMP_INTERVALS measurements, the frame rate is raised by ADAPTIVE_FPS_STEP up to ADAPTIVE_MAX_FPS, and
+// then the compression is lowered by ADAPTIVE_COMPRESSION_STEP down to ADAPTIVE_MIN_COMPRESSION. Under load, the
+// same steps are taken back, down to ADAPTIVE_MIN_FPS and then up to ADAPTIVE_MAX_COMPRESSION. Measurements are
+// ignored for ADAPTIVE_SETTLE_TIME milliseconds after a change, and settings which overloaded aren't tried again
+// for ADAPTIVE_RETRY_TIME milliseconds.
+#define ADAPTIVE_STREAM 0
+#define ADAPTIVE_MIN_FPS 5
+#define ADAPTIVE_MAX_FPS 30
+#define ADAPTIVE_FPS_STEP 5
+#define ADAPTIVE_MIN_COMPRESSION 0
+#define ADAPTIVE_MAX_COMPRESSION 60
+#define ADAPTIVE_COMPRESSION_STEP 10
+#define ADAPTIVE_INTERVAL 1000
+#define ADAPTIVE_HIGH_LOAD 0.85
+#define ADAPTIVE_LOW_LOAD 0.6
+#define ADAPTIVE_MAX_DROPPED 0.1
+#define ADAPTIVE_RAMP_INTERVALS 3
+#define ADAPTIVE_SETTLE_TIME 2000
+#define ADAPTIVE_RETRY_TIME 30000
+
+// Size in bytes of the buffer into which the MJPEG stream is received. Must hold at least two frames.
+#define STREAM_BUFFER_SIZE 1048576
+
 // Camera white balance (auto, fixed_fluor2, fixed_indoor, fixed_outdoor1, fixed_outdoor2,
 // fixed_fluor1, fixed_fluor2, or hold).
 #define WHITE_BALANCE "fixed_fluor2"
@@ -30,6 +58,122 @@
 #define BRIGHTNESS 50
 #define COLOR_LEVEL 50
 
+// Capture pipeline. When enabled, receiving, decoding, processing and display conversion each run on their own
+// thread, joined by queues holding up to PIPELINE_QUEUE_DEPTH frames. When a queue is full, either the oldest
+// queued frame is dropped, the new frame is dropped, or the earlier stage waits (drop_oldest, drop_newest, or
+// block). Dropping the oldest frame with a depth of 1 always processes the latest frame.
+#define PIPELINE_MODE 0
+#define PIPELINE_QUEUE_DEPTH 1
+#define PIPELINE_OVERFLOW "drop_oldest"
+
+// Skipping unchanged frames. When SKIP_UNCHANGED_FRAMES is set, a frame which is an exact copy of the last frame
+// processed, or none of whose eighth-size thumbnail pixels differs from it by more than CHANGE_THRESHOLD grey levels
+// (0 to only skip exact copies), isn't decoded or processed, and the last results stay on display. At most
+// CHANGE_MAX_SKIPPED frames in a row are skipped (0 for no limit), so the results are still refreshed regularly.
+#define SKIP_UNCHANGED_FRAMES 0
+#define CHANGE_THRESHOLD 10
+#define CHANGE_MAX_SKIPPED 30
+
+// Reduced-resolution processing. The colour threshold and ellipse detection work on frames decoded at
+// 1/PROCESSING_SCALE of RESOLUTION in each direction (1, 2, 4 or 8), which the decoder produces directly by scaling
+// its inverse DCT, so the decoding and processing costs both fall by about the square of the scale. Positions in
+// their results are still given in full-resolution pixels. With DISPLAY_FULL_RESOLUTION set, the original image in
+// the window is decoded at full size in the same pass; otherwise it's shown at the processing size.
+#define PROCESSING_SCALE 1
+#define DISPLAY_FULL_RESOLUTION 1
+
+// Colour threshold. Uses a table of every RGB colour instead of converting each pixel to HSL when enabled, indexed
+// by the top THRESHOLD_LOOKUP_BITS bits of each channel (4-8; only 8 gives exact results).
+#define THRESHOLD_LOOKUP_TABLE 0
+#define THRESHOLD_LOOKUP_BITS 8
+
+// Morphology applied to the colour threshold's mask before its particles are analyzed: 0 for none, 1 to erode, 2 to
+// dilate, 3 to open (removing specks of noise) or 4 to close (filling small holes). The structuring element is
+// MORPHOLOGY_WIDTH by MORPHOLOGY_HEIGHT pixels, both odd, and is a cross rather than a rectangle if MORPHOLOGY_CROSS
+// is set.
+#define MASK_MORPHOLOGY 0
+#define MORPHOLOGY_WIDTH 3
+#define MORPHOLOGY_HEIGHT 3
+#define MORPHOLOGY_CROSS 0
+
+// Processor graph parallelism. When enabled, each pass over the image, such as the colour threshold's threshold,
+// clean-up and labelling, is made in bands of rows spread across WORKER_THREADS threads, giving exactly the same
+// particles as doing it on one thread.
+#define TILE_PARALLEL 0
+
+// Ellipse detection. Uses the native pyramid detector instead of imaqDetectEllipses when enabled, spread across
+// WORKER_THREADS threads including the processing thread (0 for one per processor). Every camera's processors share
+// the same worker threads, and one which finds them busy does its work on its own thread.
+#define NATIVE_ELLIPSE_DETECTION 0
+#define WORKER_THREADS 0
+
+// Region of interest tracking. When enabled, only the region where the target is predicted to be is processed,
+// extended by ROI_MARGIN pixels on each side. The whole image is processed once the target has been missed for
+// more than ROI_COAST_FRAMES frames in a row, and every ROI_FULL_SCAN_INTERVAL frames regardless (0 for never).
+#define ROI_TRACKING 0
+#define ROI_MARGIN 32
+#define ROI_COAST_FRAMES 5
+#define ROI_FULL_SCAN_INTERVAL 30
+
+// Results channel. When PUBLISH_RESULTS is set, the results of each processed frame are published to shared memory
+// named RESULTS_CHANNEL_NAME followed by the camera's number, from 0, which other processes on the machine can poll
+// with a ResultChannel. The last RESULTS_CHANNEL_SLOTS results are kept. Run with "-results <camera>" to watch them.
+#define PUBLISH_RESULTS 0
+#define RESULTS_CHANNEL_NAME "Local\\FrcCameraResults"
+#define RESULTS_CHANNEL_SLOTS 16
+
+// Replay of a frame archive, with "-replay <file>". Frames are delivered at the times they were recorded when
+// REPLAY_REAL_TIME is set, or as fast as they are processed otherwise, and the replay starts over after the last
+// frame when REPLAY_LOOP is set. The application exits at the end of a replay which doesn't loop.
+#define REPLAY_REAL_TIME 1
+#define REPLAY_LOOP 1
+
+// Latency benchmark. Each run compares the latency of every stage against the baseline file and writes its own
+// results to the results file in the same format. A stage is flagged as a regression if its median or 99th
+// percentile latency is more than BENCHMARK_TOLERANCE percent above the baseline.
+#define BENCHMARK_BASELINE "benchmark_baseline.txt"
+#define BENCHMARK_RESULTS "benchmark_results.txt"
+#define BENCHMARK_TOLERANCE 15
+
+// Tracing of the hot path. When ENABLE_TRACING is set, the start and end of each stage, queue wait and paint are
+// recorded into a per-thread ring of TRACE_BUFFER_EVENTS events, which costs a branch when tracing is off and a
+// timestamp when it is on. F8 starts and stops tracing, and F9 writes the recorded events to TRACE_FILE in the
+// Chrome trace format, which opens in chrome://tracing or Perfetto.
+#define ENABLE_TRACING 0
+#define TRACE_AT_STARTUP 0
+#define TRACE_BUFFER_EVENTS 16384
+#define TRACE_FILE "trace.json"
+
+// Reconnection to the camera. A connection attempt is given up after CAMERA_CONNECT_TIMEOUT milliseconds, and a
+// stream which sends nothing for CAMERA_RECEIVE_TIMEOUT milliseconds is treated as lost, so the receive timeout
+// must be longer than the time between frames. A lost stream is reconnected straight away, then after
+// RECONNECT_MIN_DELAY milliseconds, doubling after each failed attempt up to RECONNECT_MAX_DELAY.
+#define CAMERA_CONNECT_TIMEOUT 500
+#define CAMERA_RECEIVE_TIMEOUT 500
+#define RECONNECT_MIN_DELAY 50
+#define RECONNECT_MAX_DELAY 2000
+
+// Capture from several cameras, run with "-cameras <address>:<port>,<address>:<port>,...". One thread receives
+// from every camera, and CAPTURE_WORKERS threads (zero for one per processor) decode and process their frames.
+// Each camera has a parser buffer of CAPTURE_BUFFER_SIZE bytes, which must hold at least two frames, and a
+// connection which fails is reconnected as below. Keys 1 to 9 choose the camera shown.
+#define CAPTURE_WORKERS 0
+#define CAPTURE_BUFFER_SIZE 262144
+
+// Fake camera server, run with "-fakecamera <source>" and connected to with "-camera 127.0.0.1:8080". It serves
+// frames at FAKE_CAMERA_FPS, or at the rate the client asks for if zero, or as fast as possible if negative. The
+// faults are injected on every connection: a reset after FAKE_CAMERA_RESET_INTERVAL frames, every
+// FAKE_CAMERA_TRUNCATE_INTERVAL-th part cut off halfway, parts without a Content-Length if
+// FAKE_CAMERA_CONTENT_LENGTH is 0, and sends split into FAKE_CAMERA_SEND_CHUNK bytes with FAKE_CAMERA_SEND_DELAY
+// milliseconds after each. Zero turns off each interval and the chunking.
+#define FAKE_CAMERA_PORT 8080
+#define FAKE_CAMERA_FPS 0
+#define FAKE_CAMERA_RESET_INTERVAL 0
+#define FAKE_CAMERA_TRUNCATE_INTERVAL 0
+#define FAKE_CAMERA_CONTENT_LENGTH 1
+#define FAKE_CAMERA_SEND_CHUNK 0
+#define FAKE_CAMERA_SEND_DELAY 0
+
 // Parameters for the application window.
 #define CLASSNAME "AppWindow"
 #define APPNAME "FRC Camera Test v1.0"
@@ -0,0 +1,74 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class for detecting the instruction set extensions supported by the processor.
+ */
+
+#include "CpuFeatures.h"
+
+#if SIMD_KERNELS && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+volatile int CpuFeatures::features_ = 0;
+
+bool CpuFeatures::HasSse2() {
+  return (GetFeatures() & kSse2) != 0;
+}
+
+bool CpuFeatures::HasSsse3() {
+  return (GetFeatures() & kSsse3) != 0;
+}
+
+bool CpuFeatures::HasAvx2() {
+  return (GetFeatures() & kAvx2) != 0;
+}
+
+/*
+ * Returns the set of supported features, detecting them the first time. Detection always gives the same
+ * answer, so it doesn't matter if two threads race to do it.
+ */
+int CpuFeatures::GetFeatures() {
+  if (features_) {
+    return features_;
+  }
+
+  int features = kDetected;
+#if SIMD_KERNELS
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 0);
+  int maxLeaf = info[0];
+  __cpuid(info, 1);
+  if (info[3] & (1 << 26)) {
+    features |= kSse2;
+  }
+  if (info[2] & (1 << 9)) {
+    features |= kSsse3;
+  }
+
+  // AVX2 also needs the operating system to save the upper halves of the registers on a context switch.
+  bool avxEnabled = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+  if (avxEnabled && maxLeaf >= 7) {
+    __cpuidex(info, 7, 0);
+    if (info[1] & (1 << 5)) {
+      features |= kAvx2;
+    }
+  }
+#else
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2")) {
+    features |= kSse2;
+  }
+  if (__builtin_cpu_supports("ssse3")) {
+    features |= kSsse3;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    features |= kAvx2;
+  }
+#endif
+#endif
+  features_ = features;
+  return features;
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class for detecting the instruction set extensions supported by the processor.
+ */
+
+#ifndef _CPU_FEATURES_H_
+#define _CPU_FEATURES_H_
+
+// Vector kernels are only built with compilers which can generate code for an instruction set in individual
+// functions, without requiring it for the whole application. TARGET_SSE2, TARGET_SSSE3 and TARGET_AVX2 mark
+// those functions, which must only be called once CpuFeatures confirms the processor supports them.
+#if (defined(_MSC_VER) && _MSC_VER >= 1700 && (defined(_M_IX86) || defined(_M_X64))) || \
+    (defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__)))
+#define SIMD_KERNELS 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define TARGET_SSE2
+#define TARGET_SSSE3
+#define TARGET_AVX2
+#else
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#else
+#define SIMD_KERNELS 0
+#endif
+
+class CpuFeatures {
+public:
+  static bool HasSse2();
+  static bool HasSsse3();
+  static bool HasAvx2();
+
+private:
+  enum Feature {
+    kDetected = 1,
+    kSse2 = 2,
+    kSsse3 = 4,
+    kAvx2 = 8
+  };
+
+  static int GetFeatures();
+
+  static volatile int features_;
+};
+
+#endif // _CPU_FEATURES_H_
@@ -7,53 +7,153 @@
 
 #include "DetectEllipses.h"
 
+#include "Constants.h"
+#include "FramePool.h"
+#include "WorkerPool.h"
 #include <iostream>
 
+static const double kPi = 3.14159265358979323846;
+
+DetectEllipses::DetectEllipses() {
+  detector_ = new EllipseDetector(WorkerPool::GetShared());
+  detector_->SetRadii(20 / PROCESSING_SCALE, 300 / PROCESSING_SCALE, 20 / PROCESSING_SCALE, 300 / PROCESSING_SCALE);
+}
+
+DetectEllipses::~DetectEllipses() {
+  delete detector_;
+}
+
+int DetectEllipses::GetDecodeScale() {
+  return PROCESSING_SCALE;
+}
+
 /*
  * Applies an ellipse detection operation to the source image.
  *
- * @param textOut Pointer to a 512-character buffer that is displayed beneath the processed image.
+ * @param result The results of the frame, filled in with the ellipses found.
  */
-Image* DetectEllipses::ProcessImage(Image* image, char* textOut) {
-  Image* input = imaqCreateImage(IMAQ_IMAGE_U8, 3);
+Image* DetectEllipses::ProcessImage(Image* image, FrameResult* result) {
+  int width, height;
+  imaqGetImageSize(image, &width, &height);
+  Image* input = framePool_->Acquire(IMAQ_IMAGE_U8, width, height);
+  if (input == NULL) {
+    // Without an image for the green plane, the frame can't be processed, so the original is shown instead.
+    targetFound_ = false;
+    result->objectType = kResultNone;
+    result->objectCount = 0;
+    result->targetFound = 0;
+    return image;
+  }
 
   // Extract the green plane only by setting the other two to NULL.
   imaqExtractColorPlanes(image, IMAQ_RGB, NULL, input, NULL);
 
+  Rect region = GetRegion(width, height);
+  if (NATIVE_ELLIPSE_DETECTION) {
+    DetectNative(input, region);
+  }
+  else {
+    DetectNIVision(input, region);
+  }
+  int numEllipses = (int)ellipses_.size();
+
+  // The ellipse with the highest score is the target, extending as far as its major radius in any direction.
+  DetectedEllipse best;
+  targetFound_ = false;
+  for (int i = 0; i < numEllipses; i++) {
+    if (!targetFound_ || ellipses_[i].score > best.score) {
+      best = ellipses_[i];
+      targetFound_ = true;
+    }
+  }
+  if (targetFound_) {
+    target_.x = best.x;
+    target_.y = best.y;
+    target_.halfWidth = best.majorRadius;
+    target_.halfHeight = best.majorRadius;
+  }
+
+  // Report the location, size and score of each detected ellipse, in full-resolution pixels.
+  double scale = GetDecodeScale();
+  result->objectType = kResultEllipse;
+  result->objectCount = numEllipses;
+  for (int i = 0; i < numEllipses && i < FrameResult::kMaxObjects; i++) {
+    SetResultObject(ellipses_[i], scale, &result->objects[i]);
+  }
+  result->targetFound = targetFound_;
+  if (targetFound_) {
+    SetResultObject(best, scale, &result->target);
+  }
+
+  return input;
+}
+
+/*
+ * Converts an ellipse found at the processing scale to a reported object in full-resolution pixels.
+ */
+void DetectEllipses::SetResultObject(const DetectedEllipse& ellipse, double scale, ResultObject* object) {
+  object->x = scale * ellipse.x;
+  object->y = scale * ellipse.y;
+  object->halfWidth = scale * ellipse.majorRadius;
+  object->halfHeight = scale * ellipse.minorRadius;
+  object->rotation = ellipse.rotation;
+  object->area = kPi * object->halfWidth * object->halfHeight;
+  object->score = ellipse.score;
+}
+
+/*
+ * Finds the ellipses in a region of the green plane with EllipseDetector, working directly on the image's pixels.
+ */
+void DetectEllipses::DetectNative(Image* input, const Rect& region) {
+  ImageInfo info;
+  imaqGetImageInfo(input, &info);
+  int stride = info.pixelsPerLine;
+  const unsigned char* pixels = (const unsigned char*)info.imageStart + region.top * stride + region.left;
+  detector_->Detect(pixels, stride, region.width, region.height, &ellipses_);
+  for (unsigned int i = 0; i < ellipses_.size(); i++) {
+    ellipses_[i].x += region.left;
+    ellipses_[i].y += region.top;
+  }
+}
+
+/*
+ * Finds the ellipses in a region of the green plane with NIVision.
+ */
+void DetectEllipses::DetectNIVision(Image* input, const Rect& region) {
   // Set up ellipse filter parameters.
   EllipseDescriptor descriptor;
-  descriptor.minMajorRadius = 20;
-  descriptor.maxMajorRadius = 300;
-  descriptor.minMinorRadius = 20;
-  descriptor.maxMinorRadius = 300;
+  descriptor.minMajorRadius = 20 / PROCESSING_SCALE;
+  descriptor.maxMajorRadius = 300 / PROCESSING_SCALE;
+  descriptor.minMinorRadius = 20 / PROCESSING_SCALE;
+  descriptor.maxMinorRadius = 300 / PROCESSING_SCALE;
   int numEllipses = 0;
 
+  // Only search part of the image if the region doesn't cover all of it.
+  int width, height;
+  imaqGetImageSize(input, &width, &height);
+  ROI* roi = NULL;
+  if (region.width < width || region.height < height) {
+    roi = imaqCreateROI();
+    imaqAddRectContour(roi, region);
+  }
+
   // Get the array of detected ellipses.
-  EllipseMatch* match = imaqDetectEllipses(input, &descriptor, NULL, NULL, NULL, &numEllipses);
-  
-  int numChars = sprintf_s(textOut, 512, "# of ellipses: %d\r\n\r\n", numEllipses);
-  float totalX = 0;
-  for (int i = 0; i < numEllipses; i++)
-  {
-    // Print the location, size and score information for each detected ellipse.
-    numChars += sprintf_s(textOut + numChars,
-                          512 - numChars,
-                          "Pos: (%.0f, %.0f)\tMaj: %.0f\tMin: %.0f\tScore: %.0f\r\n",
-                          match[i].position.x,
-                          match[i].position.y,
-                          match[i].majorRadius,
-                          match[i].minorRadius,
-                          match[i].score);
-    totalX += match[i].position.x;
-  }
-  if (numEllipses > 0)
-  {
-    // Print the average X-coordinate of the ellipse centers.
-    numChars += sprintf_s(textOut + numChars,
-                          512 - numChars,
-                          "\r\nAverage X: %.0f\r\n",
-                          totalX / numEllipses);
+  EllipseMatch* match = imaqDetectEllipses(input, &descriptor, NULL, NULL, roi, &numEllipses);
+  ellipses_.resize(numEllipses);
+  for (int i = 0; i < numEllipses; i++) {
+    ellipses_[i].x = match[i].position.x;
+    ellipses_[i].y = match[i].position.y;
+    ellipses_[i].rotation = match[i].rotation;
+    ellipses_[i].majorRadius = match[i].majorRadius;
+    ellipses_[i].minorRadius = match[i].minorRadius;
+    ellipses_[i].score = match[i].score;
   }
 
-  return input;
+  // The array of matches and the ROI are allocated by NIVision and have to be freed separately.
+  if (match) {
+    imaqDispose(match);
+  }
+  if (roi) {
+    imaqDispose(roi);
+  }
 }
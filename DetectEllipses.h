@@ -8,11 +8,24 @@
 #ifndef _DETECT_ELLIPSES_H_
 #define _DETECT_ELLIPSES_H_
 
+#include "EllipseDetector.h"
 #include "ImageProcessor.h"
+#include <vector>
 
 class DetectEllipses : public ImageProcessor {
 public:
-  virtual Image* ProcessImage(Image* image, char* textOut);
+  DetectEllipses();
+  ~DetectEllipses();
+  virtual Image* ProcessImage(Image* image, FrameResult* result);
+  virtual int GetDecodeScale();
+
+private:
+  void DetectNative(Image* input, const Rect& region);
+  void DetectNIVision(Image* input, const Rect& region);
+  static void SetResultObject(const DetectedEllipse& ellipse, double scale, ResultObject* object);
+
+  EllipseDetector* detector_;
+  std::vector<DetectedEllipse> ellipses_;
 };
 
 #endif // _DETECT_ELLIPSES_H_
@@ -0,0 +1,796 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a detector for ellipses in a grayscale image, which searches an image pyramid from coarse
+ * to fine and spreads the work across a WorkerPool.
+ *
+ * Detection runs in four steps:
+ *
+ * 1. The image is halved twice to build a pyramid. On each level, edges are found with a Sobel operator and
+ *    thinned to the pixels where the gradient is strongest across the edge. Each level is split into bands of
+ *    rows which are processed in parallel.
+ * 2. On the quarter-size level, each edge pixel votes for the possible centers lying along its gradient, at
+ *    every distance in the range of radii being searched. The radius range is split into bands, each voting into
+ *    its own accumulator in parallel, and the peaks of the combined votes become candidate centers.
+ * 3. For each candidate, the edge pixels around it which face it are grouped by distance and polarity (whether
+ *    the shape is lighter or darker than its surroundings), and a conic is fitted to the strongest group. The fit
+ *    is repeated with the edge pixels lying close to the previous fit, first on the quarter-size level, then on
+ *    the half-size level and finally at full resolution. Candidates are refined in parallel.
+ * 4. Each ellipse is scored by sampling points around it and counting those with an edge pixel facing the
+ *    right way next to them. The score is from 0 to 1000, as with NIVision.
+ */
+
+#include "EllipseDetector.h"
+
+#include "WorkerPool.h"
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const double kPi = 3.14159265358979323846;
+
+// Runs a member function of EllipseDetector for each iteration of a parallel loop.
+class DetectorTask : public ParallelTask {
+public:
+  typedef void (EllipseDetector::*Function)(int);
+
+  DetectorTask(EllipseDetector* detector, Function function) {
+    detector_ = detector;
+    function_ = function;
+  }
+
+  virtual void Run(int index) {
+    (detector_->*function_)(index);
+  }
+
+private:
+  EllipseDetector* detector_;
+  Function function_;
+};
+
+// Orders candidates by decreasing number of votes, then by position so that the order is repeatable.
+struct CandidateOrder {
+  template <class T>
+  bool operator()(const T& first, const T& second) const {
+    if (first.votes != second.votes) {
+      return first.votes > second.votes;
+    }
+    return first.y != second.y ? first.y < second.y : first.x < second.x;
+  }
+};
+
+// Orders detected ellipses by decreasing score.
+static bool CompareScores(const DetectedEllipse& first, const DetectedEllipse& second) {
+  return first.score > second.score;
+}
+
+EllipseDetector::EllipseDetector(WorkerPool* pool) {
+  pool_ = pool;
+  minMajorRadius_ = 20;
+  maxMajorRadius_ = 300;
+  minMinorRadius_ = 20;
+  maxMinorRadius_ = 300;
+  edgeThreshold_ = 20;
+  minScore_ = 500;
+  currentLevel_ = 0;
+  voteBands_ = 1;
+  minVoteRadius_ = 0;
+  maxVoteRadius_ = 0;
+}
+
+/*
+ * Sets the range of sizes of ellipse to search for, in pixels.
+ */
+void EllipseDetector::SetRadii(double minMajorRadius, double maxMajorRadius, double minMinorRadius,
+                               double maxMinorRadius) {
+  minMajorRadius_ = minMajorRadius;
+  maxMajorRadius_ = maxMajorRadius;
+  minMinorRadius_ = minMinorRadius;
+  maxMinorRadius_ = maxMinorRadius;
+}
+
+/*
+ * Sets the minimum difference in brightness across an edge for it to be found.
+ */
+void EllipseDetector::SetEdgeThreshold(int contrast) {
+  edgeThreshold_ = contrast;
+}
+
+/*
+ * Sets the minimum score, from 0 to 1000, of the ellipses to return.
+ */
+void EllipseDetector::SetMinScore(double minScore) {
+  minScore_ = minScore;
+}
+
+/*
+ * Finds the ellipses in a grayscale image.
+ *
+ * @param stride The distance in bytes between the start of each row.
+ * @param ellipses Filled in with the ellipses found, in order of decreasing score.
+ * @return The number of ellipses found.
+ */
+int EllipseDetector::Detect(const unsigned char* pixels, int stride, int width, int height,
+                            std::vector<DetectedEllipse>* ellipses) {
+  ellipses->clear();
+  levels_[0].pixels = pixels;
+  levels_[0].stride = stride;
+  levels_[0].width = width;
+  levels_[0].height = height;
+  for (int level = 0; level < kLevelCount; level++) {
+    BuildLevel(level);
+  }
+
+  // The radius range on the coarsest level, which is split into bands for voting.
+  Level* coarsest = &levels_[kLevelCount - 1];
+  int scale = 1 << (kLevelCount - 1);
+  minVoteRadius_ = std::max(2, (int)(minMinorRadius_ / scale));
+  maxVoteRadius_ = std::max(minVoteRadius_, (int)ceil(maxMajorRadius_ / scale));
+  maxVoteRadius_ = std::min(maxVoteRadius_, std::max(coarsest->width, coarsest->height));
+  voteBands_ = std::min(2 * pool_->GetThreadCount(), (int)kMaxVoteBands);
+  voteBands_ = std::min(voteBands_, maxVoteRadius_ - minVoteRadius_ + 1);
+  DetectorTask voteTask(this, &EllipseDetector::VoteBand);
+  pool_->ParallelFor(&voteTask, voteBands_);
+  FindCandidates();
+
+  DetectorTask refineTask(this, &EllipseDetector::RefineCandidate);
+  pool_->ParallelFor(&refineTask, (int)candidates_.size());
+
+  // Keep the ellipses in the size range, dropping any which are the same as a better one found from another
+  // candidate.
+  for (unsigned int i = 0; i < candidates_.size(); i++) {
+    Refinement* refinement = &refinements_[i];
+    if (!refinement->found || refinement->score < minScore_) {
+      continue;
+    }
+    Fit* fit = &refinement->fit;
+    if (fit->majorRadius < minMajorRadius_ || fit->majorRadius > maxMajorRadius_ ||
+        fit->minorRadius < minMinorRadius_ || fit->minorRadius > maxMinorRadius_) {
+      continue;
+    }
+    DetectedEllipse ellipse;
+    ellipse.x = fit->x;
+    ellipse.y = fit->y;
+    ellipse.rotation = -fit->angle * 180 / kPi;
+    ellipse.rotation -= 180 * floor(ellipse.rotation / 180);
+    ellipse.majorRadius = fit->majorRadius;
+    ellipse.minorRadius = fit->minorRadius;
+    ellipse.score = refinement->score;
+    ellipses->push_back(ellipse);
+  }
+  std::stable_sort(ellipses->begin(), ellipses->end(), CompareScores);
+  unsigned int kept = 0;
+  for (unsigned int i = 0; i < ellipses->size(); i++) {
+    DetectedEllipse* ellipse = &(*ellipses)[i];
+    bool duplicate = false;
+    for (unsigned int j = 0; j < kept && !duplicate; j++) {
+      DetectedEllipse* better = &(*ellipses)[j];
+      double distance = sqrt((ellipse->x - better->x) * (ellipse->x - better->x) +
+                             (ellipse->y - better->y) * (ellipse->y - better->y));
+      duplicate = distance < 0.5 * better->minorRadius &&
+                  fabs(ellipse->majorRadius - better->majorRadius) < 0.2 * better->majorRadius &&
+                  fabs(ellipse->minorRadius - better->minorRadius) < 0.2 * better->minorRadius;
+    }
+    if (!duplicate) {
+      (*ellipses)[kept++] = *ellipse;
+    }
+  }
+  ellipses->resize(kept);
+  return (int)kept;
+}
+
+/*
+ * Builds one level of the pyramid from the one before it, and finds its edges.
+ */
+void EllipseDetector::BuildLevel(int level) {
+  Level* current = &levels_[level];
+  if (level > 0) {
+    current->width = levels_[level - 1].width / 2;
+    current->height = levels_[level - 1].height / 2;
+    current->stride = current->width;
+    current->buffer.resize(current->width * current->height);
+    current->pixels = current->buffer.empty() ? NULL : &current->buffer[0];
+  }
+  int size = current->width * current->height;
+  current->gradientX.resize(size);
+  current->gradientY.resize(size);
+  current->magnitude.resize(size);
+  current->edgeMap.resize(size);
+  if (size == 0) {
+    current->edges.clear();
+    current->rowStarts.assign(current->height + 1, 0);
+    return;
+  }
+
+  currentLevel_ = level;
+  int tileCount = GetTileCount(level);
+  if ((int)tileEdges_.size() < tileCount) {
+    tileEdges_.resize(tileCount);
+  }
+  if (level > 0) {
+    DetectorTask downsampleTask(this, &EllipseDetector::DownsampleTile);
+    pool_->ParallelFor(&downsampleTask, tileCount);
+  }
+  DetectorTask gradientTask(this, &EllipseDetector::GradientTile);
+  pool_->ParallelFor(&gradientTask, tileCount);
+  DetectorTask edgeTask(this, &EllipseDetector::EdgeTile);
+  pool_->ParallelFor(&edgeTask, tileCount);
+
+  // Join the edges found in each tile, which are in row order, and index the start of each row.
+  current->edges.clear();
+  for (int tile = 0; tile < tileCount; tile++) {
+    current->edges.insert(current->edges.end(), tileEdges_[tile].begin(), tileEdges_[tile].end());
+  }
+  current->rowStarts.assign(current->height + 1, 0);
+  for (unsigned int i = 0; i < current->edges.size(); i++) {
+    current->rowStarts[current->edges[i].y + 1]++;
+  }
+  for (int y = 0; y < current->height; y++) {
+    current->rowStarts[y + 1] += current->rowStarts[y];
+  }
+}
+
+/*
+ * Averages each 2x2 block of pixels in the previous level into one pixel of the current level, for a band of
+ * rows.
+ */
+void EllipseDetector::DownsampleTile(int tile) {
+  Level* current = &levels_[currentLevel_];
+  const Level* previous = &levels_[currentLevel_ - 1];
+  int endRow = std::min(current->height, (tile + 1) * kTileRows);
+  for (int y = tile * kTileRows; y < endRow; y++) {
+    const unsigned char* top = previous->pixels + 2 * y * previous->stride;
+    const unsigned char* bottom = top + previous->stride;
+    unsigned char* row = &current->buffer[y * current->width];
+    for (int x = 0; x < current->width; x++) {
+      row[x] = (unsigned char)((top[2 * x] + top[2 * x + 1] + bottom[2 * x] + bottom[2 * x + 1] + 2) >> 2);
+    }
+  }
+}
+
+/*
+ * Calculates the Sobel gradient of the current level for a band of rows. The gradient is left at zero around
+ * the border of the image.
+ */
+void EllipseDetector::GradientTile(int tile) {
+  Level* current = &levels_[currentLevel_];
+  int width = current->width;
+  int endRow = std::min(current->height, (tile + 1) * kTileRows);
+  for (int y = tile * kTileRows; y < endRow; y++) {
+    short* gradientX = &current->gradientX[y * width];
+    short* gradientY = &current->gradientY[y * width];
+    short* magnitude = &current->magnitude[y * width];
+    if (y == 0 || y == current->height - 1 || width < 3) {
+      memset(gradientX, 0, width * sizeof(short));
+      memset(gradientY, 0, width * sizeof(short));
+      memset(magnitude, 0, width * sizeof(short));
+      continue;
+    }
+    const unsigned char* above = current->pixels + (y - 1) * current->stride;
+    const unsigned char* row = above + current->stride;
+    const unsigned char* below = row + current->stride;
+    gradientX[0] = gradientY[0] = magnitude[0] = 0;
+    gradientX[width - 1] = gradientY[width - 1] = magnitude[width - 1] = 0;
+    for (int x = 1; x < width - 1; x++) {
+      int dx = (above[x + 1] + 2 * row[x + 1] + below[x + 1]) - (above[x - 1] + 2 * row[x - 1] + below[x - 1]);
+      int dy = (below[x - 1] + 2 * below[x] + below[x + 1]) - (above[x - 1] + 2 * above[x] + above[x + 1]);
+      gradientX[x] = (short)dx;
+      gradientY[x] = (short)dy;
+      magnitude[x] = (short)(abs(dx) + abs(dy));
+    }
+  }
+}
+
+/*
+ * Finds the edge pixels of the current level for a band of rows: those where the gradient is strong enough and
+ * stronger than at the neighbouring pixels on either side of the edge.
+ */
+void EllipseDetector::EdgeTile(int tile) {
+  Level* current = &levels_[currentLevel_];
+  int width = current->width;
+  std::vector<EdgePoint>* edges = &tileEdges_[tile];
+  edges->clear();
+
+  // A step in brightness of c gives a Sobel magnitude of 4c across a horizontal or vertical edge.
+  int threshold = 4 * edgeThreshold_;
+  int endRow = std::min(current->height, (tile + 1) * kTileRows);
+  for (int y = tile * kTileRows; y < endRow; y++) {
+    unsigned char* edgeMap = &current->edgeMap[y * width];
+    memset(edgeMap, 0, width);
+    if (y == 0 || y == current->height - 1) {
+      continue;
+    }
+    const short* magnitude = &current->magnitude[y * width];
+    const short* gradientX = &current->gradientX[y * width];
+    const short* gradientY = &current->gradientY[y * width];
+    for (int x = 1; x < width - 1; x++) {
+      int value = magnitude[x];
+      if (value < threshold) {
+        continue;
+      }
+
+      // Compare against the neighbours in the direction of the gradient, rounded to the nearest 45 degrees. Ties
+      // go to the first pixel in each direction so that a plateau still leaves a single edge.
+      int dx = gradientX[x];
+      int dy = gradientY[x];
+      int offset;
+      if (abs(dx) * 5 > abs(dy) * 12) {
+        offset = 1;
+      }
+      else if (abs(dy) * 5 > abs(dx) * 12) {
+        offset = width;
+      }
+      else if ((dx > 0) == (dy > 0)) {
+        offset = width + 1;
+      }
+      else {
+        offset = width - 1;
+      }
+      if (value > magnitude[x - offset] && value >= magnitude[x + offset]) {
+        EdgePoint edge;
+        edge.x = x;
+        edge.y = y;
+        edges->push_back(edge);
+        edgeMap[x] = 1;
+      }
+    }
+  }
+}
+
+/*
+ * Has each edge pixel on the coarsest level vote for the centers along its gradient, for a band of radii.
+ */
+void EllipseDetector::VoteBand(int band) {
+  Level* coarsest = &levels_[kLevelCount - 1];
+  int width = coarsest->width;
+  int height = coarsest->height;
+  std::vector<int>* accumulator = &accumulators_[band];
+  accumulator->assign(width * height, 0);
+  if (width == 0 || height == 0) {
+    return;
+  }
+
+  int radii = maxVoteRadius_ - minVoteRadius_ + 1;
+  int firstRadius = minVoteRadius_ + radii * band / voteBands_;
+  int lastRadius = minVoteRadius_ + radii * (band + 1) / voteBands_ - 1;
+  int* votes = &(*accumulator)[0];
+  for (unsigned int i = 0; i < coarsest->edges.size(); i++) {
+    int x = coarsest->edges[i].x;
+    int y = coarsest->edges[i].y;
+    double gradientX = coarsest->gradientX[y * width + x];
+    double gradientY = coarsest->gradientY[y * width + x];
+    double length = sqrt(gradientX * gradientX + gradientY * gradientY);
+    double unitX = gradientX / length;
+    double unitY = gradientY / length;
+
+    // The shape may be lighter or darker than its surroundings, so vote on both sides of the edge.
+    for (int radius = firstRadius; radius <= lastRadius; radius++) {
+      int offsetX = (int)floor(radius * unitX + 0.5);
+      int offsetY = (int)floor(radius * unitY + 0.5);
+      int centerX = x + offsetX;
+      int centerY = y + offsetY;
+      if (centerX >= 0 && centerX < width && centerY >= 0 && centerY < height) {
+        votes[centerY * width + centerX]++;
+      }
+      centerX = x - offsetX;
+      centerY = y - offsetY;
+      if (centerX >= 0 && centerX < width && centerY >= 0 && centerY < height) {
+        votes[centerY * width + centerX]++;
+      }
+    }
+  }
+}
+
+/*
+ * Combines the votes from each band and picks out the strongest peaks as candidate centers.
+ */
+void EllipseDetector::FindCandidates() {
+  Level* coarsest = &levels_[kLevelCount - 1];
+  int width = coarsest->width;
+  int height = coarsest->height;
+  candidates_.clear();
+  if (width < 3 || height < 3) {
+    return;
+  }
+
+  int* votes = &accumulators_[0][0];
+  for (int band = 1; band < voteBands_; band++) {
+    const int* bandVotes = &accumulators_[band][0];
+    for (int i = 0; i < width * height; i++) {
+      votes[i] += bandVotes[i];
+    }
+  }
+
+  // Sum the votes in each 3x3 block, since rounding spreads the votes for a center over neighbouring pixels.
+  smoothed_.assign(width * height, 0);
+  for (int y = 1; y < height - 1; y++) {
+    for (int x = 1; x < width - 1; x++) {
+      const int* center = votes + y * width + x;
+      smoothed_[y * width + x] = center[-width - 1] + center[-width] + center[-width + 1] + center[-1] + center[0] +
+                                 center[1] + center[width - 1] + center[width] + center[width + 1];
+    }
+  }
+
+  // A peak needs at least as many votes as half the circumference of the smallest circle being searched for.
+  int minVotes = (int)(kPi * minVoteRadius_);
+  for (int y = 1; y < height - 1; y++) {
+    for (int x = 1; x < width - 1; x++) {
+      const int* center = &smoothed_[y * width + x];
+      int value = *center;
+      if (value < minVotes || value <= center[-width - 1] || value <= center[-width] ||
+          value <= center[-width + 1] || value <= center[-1] || value < center[1] || value < center[width - 1] ||
+          value < center[width] || value < center[width + 1]) {
+        continue;
+      }
+      Candidate candidate;
+      candidate.x = x;
+      candidate.y = y;
+      candidate.votes = value;
+      candidates_.push_back(candidate);
+    }
+  }
+
+  // Keep the strongest peaks, skipping any too close to a stronger one to be a different ellipse.
+  std::sort(candidates_.begin(), candidates_.end(), CandidateOrder());
+  unsigned int kept = 0;
+  for (unsigned int i = 0; i < candidates_.size() && kept < kMaxCandidates; i++) {
+    bool tooClose = false;
+    for (unsigned int j = 0; j < kept && !tooClose; j++) {
+      int dx = candidates_[i].x - candidates_[j].x;
+      int dy = candidates_[i].y - candidates_[j].y;
+      tooClose = dx * dx + dy * dy < minVoteRadius_ * minVoteRadius_;
+    }
+    if (!tooClose) {
+      candidates_[kept++] = candidates_[i];
+    }
+  }
+  candidates_.resize(kept);
+}
+
+/*
+ * Fits an ellipse around a candidate center, refines it on each level of the pyramid and scores it.
+ */
+void EllipseDetector::RefineCandidate(int index) {
+  Refinement* refinement = &refinements_[index];
+  refinement->found = false;
+  if (!FitFromCenter(candidates_[index], refinement)) {
+    return;
+  }
+  for (int level = kLevelCount - 1; level >= 0; level--) {
+    if (level < kLevelCount - 1) {
+      // Pixel i on one level covers pixels 2i and 2i + 1 on the next.
+      Fit* fit = &refinement->fit;
+      fit->x = 2 * fit->x + 0.5;
+      fit->y = 2 * fit->y + 0.5;
+      fit->majorRadius *= 2;
+      fit->minorRadius *= 2;
+    }
+    if (!Refit(level, 2.0, refinement) || !Refit(level, 1.0, refinement)) {
+      return;
+    }
+  }
+  refinement->score = Score(refinement->fit);
+  refinement->found = true;
+}
+
+/*
+ * Makes the first fit for a candidate on the coarsest level, from the edge pixels around it which face towards
+ * or away from it.
+ *
+ * @return False if there weren't enough edge pixels to fit an ellipse.
+ */
+bool EllipseDetector::FitFromCenter(const Candidate& candidate, Refinement* refinement) {
+  const Level* coarsest = &levels_[kLevelCount - 1];
+  int minRadius = minVoteRadius_ - 1;
+  int maxRadius = maxVoteRadius_ + 1;
+
+  // Histogram the distances of the facing edge pixels, separately for each polarity, weighting each by the
+  // inverse of its distance so that a complete ellipse scores the same whatever its size.
+  const int kBins = 2 * (maxRadius + 2);
+  double stackHistogram[2 * 128];
+  std::vector<double> heapHistogram;
+  double* histogram = stackHistogram;
+  if (kBins > 2 * 128) {
+    heapHistogram.resize(kBins);
+    histogram = &heapHistogram[0];
+  }
+  memset(histogram, 0, kBins * sizeof(double));
+  int firstRow = std::max(0, candidate.y - maxRadius);
+  int lastRow = std::min(coarsest->height - 1, candidate.y + maxRadius);
+  int firstEdge = coarsest->rowStarts[firstRow];
+  int lastEdge = coarsest->rowStarts[lastRow + 1];
+  for (int i = firstEdge; i < lastEdge; i++) {
+    const EdgePoint& edge = coarsest->edges[i];
+    int dx = edge.x - candidate.x;
+    int dy = edge.y - candidate.y;
+    double distance = sqrt((double)(dx * dx + dy * dy));
+    if (distance < minRadius || distance > maxRadius) {
+      continue;
+    }
+    double facing = Alignment(*coarsest, edge.x, edge.y, dx / distance, dy / distance, 1);
+    if (fabs(facing) < 0.7) {
+      continue;
+    }
+    int bin = (int)(distance + 0.5);
+    histogram[(facing > 0 ? 0 : maxRadius + 2) + bin] += 1 / distance;
+  }
+
+  // Choose the distance and polarity with the most support, allowing for an ellipse spreading over a few bins.
+  double bestSupport = 0;
+  int bestRadius = 0;
+  int polarity = 1;
+  for (int side = 0; side < 2; side++) {
+    const double* bins = histogram + side * (maxRadius + 2);
+    for (int radius = minRadius + 1; radius < maxRadius; radius++) {
+      double support = bins[radius - 1] + bins[radius] + bins[radius + 1];
+      if (support > bestSupport) {
+        bestSupport = support;
+        bestRadius = radius;
+        polarity = side == 0 ? 1 : -1;
+      }
+    }
+  }
+  if (bestRadius == 0) {
+    return false;
+  }
+
+  refinement->pointsX.clear();
+  refinement->pointsY.clear();
+  for (int i = firstEdge; i < lastEdge; i++) {
+    const EdgePoint& edge = coarsest->edges[i];
+    int dx = edge.x - candidate.x;
+    int dy = edge.y - candidate.y;
+    double distance = sqrt((double)(dx * dx + dy * dy));
+    if (distance < 0.8 * bestRadius || distance > 1.25 * bestRadius) {
+      continue;
+    }
+    if (Alignment(*coarsest, edge.x, edge.y, dx / distance, dy / distance, polarity) < 0.7) {
+      continue;
+    }
+    refinement->pointsX.push_back(edge.x);
+    refinement->pointsY.push_back(edge.y);
+  }
+  if (!FitConic(refinement->pointsX, refinement->pointsY, &refinement->fit)) {
+    return false;
+  }
+  refinement->fit.polarity = polarity;
+  return true;
+}
+
+/*
+ * Fits the ellipse again on the given level, from the edge pixels within a band around the previous fit which
+ * face the same way it does.
+ *
+ * @param band The greatest distance in pixels of the edge pixels used from the previous fit.
+ * @return False if there weren't enough edge pixels to fit an ellipse.
+ */
+bool EllipseDetector::Refit(int level, double band, Refinement* refinement) {
+  const Level* current = &levels_[level];
+  Fit fit = refinement->fit;
+  double cosAngle = cos(fit.angle);
+  double sinAngle = sin(fit.angle);
+  double reach = fit.majorRadius + band + 1;
+  int firstRow = std::max(0, (int)floor(fit.y - reach));
+  int lastRow = std::min(current->height - 1, (int)ceil(fit.y + reach));
+  if (firstRow > lastRow) {
+    return false;
+  }
+
+  refinement->pointsX.clear();
+  refinement->pointsY.clear();
+  for (int i = current->rowStarts[firstRow]; i < current->rowStarts[lastRow + 1]; i++) {
+    const EdgePoint& edge = current->edges[i];
+    double dx = edge.x - fit.x;
+    double dy = edge.y - fit.y;
+    if (fabs(dx) > reach) {
+      continue;
+    }
+
+    // Approximate the distance to the ellipse by scaling the distance from the center.
+    double u = dx * cosAngle + dy * sinAngle;
+    double v = -dx * sinAngle + dy * cosAngle;
+    double uScaled = u / fit.majorRadius;
+    double vScaled = v / fit.minorRadius;
+    double rho = sqrt(uScaled * uScaled + vScaled * vScaled);
+    if (rho == 0) {
+      continue;
+    }
+    double distance = (rho - 1) * sqrt(u * u + v * v) / rho;
+    if (fabs(distance) > band) {
+      continue;
+    }
+
+    // The outward normal of the ellipse, rotated back into image coordinates.
+    double normalU = uScaled / fit.majorRadius;
+    double normalV = vScaled / fit.minorRadius;
+    double normalLength = sqrt(normalU * normalU + normalV * normalV);
+    double normalX = (normalU * cosAngle - normalV * sinAngle) / normalLength;
+    double normalY = (normalU * sinAngle + normalV * cosAngle) / normalLength;
+    if (Alignment(*current, edge.x, edge.y, normalX, normalY, fit.polarity) < 0.8) {
+      continue;
+    }
+    refinement->pointsX.push_back(edge.x);
+    refinement->pointsY.push_back(edge.y);
+  }
+  if (!FitConic(refinement->pointsX, refinement->pointsY, &fit)) {
+    return false;
+  }
+  fit.polarity = refinement->fit.polarity;
+  refinement->fit = fit;
+  return true;
+}
+
+/*
+ * Fits a conic Ax^2 + Bxy + Cy^2 + Dx + Ey = 1 to the points by least squares, and converts it to an ellipse.
+ * The points are first centered and scaled to a unit spread to keep the equations well conditioned.
+ *
+ * @return False if there are too few points or the conic isn't an ellipse.
+ */
+bool EllipseDetector::FitConic(const std::vector<double>& pointsX, const std::vector<double>& pointsY, Fit* fit) {
+  int count = (int)pointsX.size();
+  if (count < 6) {
+    return false;
+  }
+  double meanX = 0;
+  double meanY = 0;
+  for (int i = 0; i < count; i++) {
+    meanX += pointsX[i];
+    meanY += pointsY[i];
+  }
+  meanX /= count;
+  meanY /= count;
+  double spread = 0;
+  for (int i = 0; i < count; i++) {
+    spread += (pointsX[i] - meanX) * (pointsX[i] - meanX) + (pointsY[i] - meanY) * (pointsY[i] - meanY);
+  }
+  spread = sqrt(spread / count);
+  if (spread == 0) {
+    return false;
+  }
+
+  // Build the normal equations, with the right-hand side in the last column.
+  double equations[5][6];
+  memset(equations, 0, sizeof(equations));
+  for (int i = 0; i < count; i++) {
+    double x = (pointsX[i] - meanX) / spread;
+    double y = (pointsY[i] - meanY) / spread;
+    double terms[5] = { x * x, x * y, y * y, x, y };
+    for (int row = 0; row < 5; row++) {
+      for (int column = 0; column < 5; column++) {
+        equations[row][column] += terms[row] * terms[column];
+      }
+      equations[row][5] += terms[row];
+    }
+  }
+
+  // Solve them by Gaussian elimination with partial pivoting.
+  for (int column = 0; column < 5; column++) {
+    int pivot = column;
+    for (int row = column + 1; row < 5; row++) {
+      if (fabs(equations[row][column]) > fabs(equations[pivot][column])) {
+        pivot = row;
+      }
+    }
+    if (fabs(equations[pivot][column]) < 1e-12) {
+      return false;
+    }
+    for (int i = 0; i < 6; i++) {
+      std::swap(equations[column][i], equations[pivot][i]);
+    }
+    for (int row = column + 1; row < 5; row++) {
+      double factor = equations[row][column] / equations[column][column];
+      for (int i = column; i < 6; i++) {
+        equations[row][i] -= factor * equations[column][i];
+      }
+    }
+  }
+  double solution[5];
+  for (int row = 4; row >= 0; row--) {
+    double value = equations[row][5];
+    for (int i = row + 1; i < 5; i++) {
+      value -= equations[row][i] * solution[i];
+    }
+    solution[row] = value / equations[row][row];
+  }
+  double a = solution[0];
+  double b = solution[1];
+  double c = solution[2];
+  double d = solution[3];
+  double e = solution[4];
+
+  // The conic is an ellipse if 4AC - B^2 is positive. Its center is where the gradient is zero, and the axes
+  // follow from the eigenvalues of the quadratic part.
+  double determinant = 4 * a * c - b * b;
+  if (determinant <= 0) {
+    return false;
+  }
+  double centerX = (b * e - 2 * c * d) / determinant;
+  double centerY = (b * d - 2 * a * e) / determinant;
+  double constant = -1 + 0.5 * (d * centerX + e * centerY);
+  double halfSum = 0.5 * (a + c);
+  double halfDifference = sqrt(0.25 * (a - c) * (a - c) + 0.25 * b * b);
+  double smallEigenvalue = halfSum - halfDifference;
+  double largeEigenvalue = halfSum + halfDifference;
+  if (smallEigenvalue <= 0 || constant >= 0) {
+    return false;
+  }
+  fit->x = meanX + spread * centerX;
+  fit->y = meanY + spread * centerY;
+  fit->majorRadius = spread * sqrt(-constant / smallEigenvalue);
+  fit->minorRadius = spread * sqrt(-constant / largeEigenvalue);
+
+  // The direction at half the angle of (A - C, B) has the larger eigenvalue, so it is the minor axis.
+  fit->angle = 0.5 * atan2(b, a - c) + 0.5 * kPi;
+  return true;
+}
+
+/*
+ * Scores an ellipse at full resolution by the proportion of points sampled around it which have a suitable edge
+ * pixel next to them.
+ *
+ * @return The score from 0 to 1000.
+ */
+double EllipseDetector::Score(const Fit& fit) {
+  const Level* full = &levels_[0];
+  double major = fit.majorRadius;
+  double minor = fit.minorRadius;
+  double perimeter = kPi * (3 * (major + minor) - sqrt((3 * major + minor) * (major + 3 * minor)));
+  int samples = std::max(16, (int)perimeter);
+  double cosAngle = cos(fit.angle);
+  double sinAngle = sin(fit.angle);
+  int supported = 0;
+  for (int i = 0; i < samples; i++) {
+    double t = 2 * kPi * i / samples;
+    double u = major * cos(t);
+    double v = minor * sin(t);
+    int x = (int)floor(fit.x + u * cosAngle - v * sinAngle + 0.5);
+    int y = (int)floor(fit.y + u * sinAngle + v * cosAngle + 0.5);
+    double normalU = cos(t) / major;
+    double normalV = sin(t) / minor;
+    double normalLength = sqrt(normalU * normalU + normalV * normalV);
+    double normalX = (normalU * cosAngle - normalV * sinAngle) / normalLength;
+    double normalY = (normalU * sinAngle + normalV * cosAngle) / normalLength;
+
+    bool found = false;
+    for (int dy = -1; dy <= 1 && !found; dy++) {
+      for (int dx = -1; dx <= 1 && !found; dx++) {
+        int edgeX = x + dx;
+        int edgeY = y + dy;
+        if (edgeX < 0 || edgeX >= full->width || edgeY < 0 || edgeY >= full->height ||
+            !full->edgeMap[edgeY * full->width + edgeX]) {
+          continue;
+        }
+        found = Alignment(*full, edgeX, edgeY, normalX, normalY, fit.polarity) >= 0.8;
+      }
+    }
+    if (found) {
+      supported++;
+    }
+  }
+  return 1000.0 * supported / samples;
+}
+
+/*
+ * Returns the cosine of the angle between the gradient at a pixel and the direction it would have on the edge of
+ * a shape with the given outward normal and polarity. The gradient points from dark to light, so it points inwards
+ * on a shape lighter than its surroundings.
+ */
+double EllipseDetector::Alignment(const Level& level, int x, int y, double normalX, double normalY,
+                                  int polarity) {
+  double gradientX = level.gradientX[y * level.width + x];
+  double gradientY = level.gradientY[y * level.width + x];
+  double length = sqrt(gradientX * gradientX + gradientY * gradientY);
+  if (length == 0) {
+    return 0;
+  }
+  return -polarity * (gradientX * normalX + gradientY * normalY) / length;
+}
+
+/*
+ * Returns the number of bands of rows a level is split into for processing in parallel.
+ */
+int EllipseDetector::GetTileCount(int level) {
+  return (levels_[level].height + kTileRows - 1) / kTileRows;
+}
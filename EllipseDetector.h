@@ -0,0 +1,123 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a detector for ellipses in a grayscale image, which searches an image pyramid from coarse
+ * to fine and spreads the work across a WorkerPool.
+ */
+
+#ifndef _ELLIPSE_DETECTOR_H_
+#define _ELLIPSE_DETECTOR_H_
+
+#include <vector>
+
+class WorkerPool;
+
+// An ellipse found by EllipseDetector, in the same terms as NIVision's EllipseMatch.
+struct DetectedEllipse {
+  double x;
+  double y;
+  double rotation;
+  double majorRadius;
+  double minorRadius;
+  double score;
+};
+
+class EllipseDetector {
+public:
+  EllipseDetector(WorkerPool* pool);
+  void SetRadii(double minMajorRadius, double maxMajorRadius, double minMinorRadius, double maxMinorRadius);
+  void SetEdgeThreshold(int contrast);
+  void SetMinScore(double minScore);
+  int Detect(const unsigned char* pixels, int stride, int width, int height, std::vector<DetectedEllipse>* ellipses);
+
+private:
+  enum {
+    kLevelCount = 3,
+    kMaxCandidates = 32,
+    kMaxVoteBands = 16,
+    kTileRows = 16
+  };
+
+  // A pixel on an edge, at which the gradient is strongest across the edge.
+  struct EdgePoint {
+    int x;
+    int y;
+  };
+
+  // One level of the image pyramid, each half the size of the one before, with its gradients and edges.
+  struct Level {
+    int width;
+    int height;
+    int stride;
+    const unsigned char* pixels;
+    std::vector<unsigned char> buffer;
+    std::vector<short> gradientX;
+    std::vector<short> gradientY;
+    std::vector<short> magnitude;
+    std::vector<unsigned char> edgeMap;
+    std::vector<EdgePoint> edges;
+    std::vector<int> rowStarts;
+  };
+
+  // A possible ellipse center, found by gradient voting on the coarsest level.
+  struct Candidate {
+    int x;
+    int y;
+    int votes;
+  };
+
+  // An ellipse at a particular level, with its major axis at an angle in radians clockwise from horizontal (as
+  // rows count downwards), and the polarity of its edge: 1 if it is brighter than its surroundings, -1 if darker.
+  struct Fit {
+    double x;
+    double y;
+    double majorRadius;
+    double minorRadius;
+    double angle;
+    int polarity;
+  };
+
+  // The working state for refining one candidate, kept between frames so that it isn't reallocated.
+  struct Refinement {
+    std::vector<double> pointsX;
+    std::vector<double> pointsY;
+    bool found;
+    Fit fit;
+    double score;
+  };
+
+  void BuildLevel(int level);
+  void DownsampleTile(int tile);
+  void GradientTile(int tile);
+  void EdgeTile(int tile);
+  void VoteBand(int band);
+  void FindCandidates();
+  void RefineCandidate(int index);
+  bool FitFromCenter(const Candidate& candidate, Refinement* refinement);
+  bool Refit(int level, double band, Refinement* refinement);
+  bool FitConic(const std::vector<double>& pointsX, const std::vector<double>& pointsY, Fit* fit);
+  double Score(const Fit& fit);
+  double Alignment(const Level& level, int x, int y, double normalX, double normalY, int polarity);
+  int GetTileCount(int level);
+
+  WorkerPool* pool_;
+  double minMajorRadius_;
+  double maxMajorRadius_;
+  double minMinorRadius_;
+  double maxMinorRadius_;
+  int edgeThreshold_;
+  double minScore_;
+  Level levels_[kLevelCount];
+  int currentLevel_;
+  std::vector<std::vector<EdgePoint> > tileEdges_;
+  int voteBands_;
+  int minVoteRadius_;
+  int maxVoteRadius_;
+  std::vector<int> accumulators_[kMaxVoteBands];
+  std::vector<int> smoothed_;
+  std::vector<Candidate> candidates_;
+  Refinement refinements_[kMaxCandidates];
+};
+
+#endif // _ELLIPSE_DETECTOR_H_
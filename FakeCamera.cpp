@@ -0,0 +1,355 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a stand-in for the Axis camera's HTTP server, which streams recorded frames to clients on
+ * the local machine and can inject network faults.
+ *
+ * It answers the two requests made by Camera::Start: the settings update to /axis-cgi/admin/param.cgi, which is
+ * acknowledged and otherwise ignored, and /axis-cgi/mjpg/video.cgi, which is answered with an endless MJPEG
+ * stream of the loaded frames in a loop. Each connection is served on its own thread, so several clients can be
+ * streamed to at once. The frames are sent exactly as they were recorded, so their resolution and compression
+ * are those of the recording rather than the ones requested.
+ *
+ * The faults are set in Constants.h, and are injected on a fixed schedule so that a failure can be reproduced:
+ * the connection is reset after a number of frames, every so many parts are cut off halfway through, parts can
+ * be sent without a Content-Length header, and sends can be split into small chunks with a delay between each.
+ */
+
+#include "FakeCamera.h"
+
+#include "ArchiveReplay.h"
+#include "Constants.h"
+#include "MjpegParser.h"
+#include "Timer.h"
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Largest request accepted from a client.
+static const int kMaxRequestSize = 4096;
+
+/*
+ * Creates a server for the frames from the given source, which is a directory of JPEG files, a frame archive or
+ * a raw MJPEG stream recorded from the camera.
+ */
+FakeCamera::FakeCamera(const char* source) {
+  source_ = source;
+  connections_ = 0;
+  streams_ = 0;
+  framesSent_ = 0;
+  resets_ = 0;
+  truncations_ = 0;
+}
+
+/*
+ * Loads the frames and serves them until the process is ended, printing the number of connections and frames
+ * sent to the console once a second.
+ *
+ * @return The process exit code.
+ */
+int FakeCamera::Run() {
+  // Write to the console the application was started from, or to a new one.
+  if (!AttachConsole(ATTACH_PARENT_PROCESS)) {
+    AllocConsole();
+  }
+  freopen("CONOUT$", "w", stdout);
+
+  if (!LoadFrames()) {
+    printf("Unable to load any frames from '%s'.\n", source_);
+    return 1;
+  }
+
+  WSADATA wsaData;
+  if (WSAStartup(MAKEWORD(2, 2), &wsaData) != NO_ERROR) {
+    printf("Unable to start the socket library.\n");
+    return 1;
+  }
+  SOCKET listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  SOCKADDR_IN sockAddr;
+  sockAddr.sin_family = AF_INET;
+  sockAddr.sin_addr.s_addr = htonl(INADDR_ANY);
+  sockAddr.sin_port = htons(FAKE_CAMERA_PORT);
+  if (listener == INVALID_SOCKET || bind(listener, (SOCKADDR*)&sockAddr, sizeof(sockAddr)) == SOCKET_ERROR ||
+      listen(listener, SOMAXCONN) == SOCKET_ERROR) {
+    printf("Unable to listen on port %d: socket error %d.\n", FAKE_CAMERA_PORT, WSAGetLastError());
+    WSACleanup();
+    return 1;
+  }
+  printf("Serving %d frames from '%s' on port %d.\n", (int)frames_.size(), source_, FAKE_CAMERA_PORT);
+
+  // Wait for connections, waking up once a second to report progress.
+  double lastReport = GetMilliseconds();
+  LONG lastFrames = 0;
+  while (1) {
+    fd_set readable;
+    FD_ZERO(&readable);
+    FD_SET(listener, &readable);
+    timeval timeout = { 1, 0 };
+    if (select(0, &readable, NULL, NULL, &timeout) > 0) {
+      SOCKET client = accept(listener, NULL, NULL);
+      if (client != INVALID_SOCKET) {
+        InterlockedIncrement(&connections_);
+        Connection* connection = new Connection;
+        connection->server = this;
+        connection->socket = client;
+        CloseHandle(CreateThread(NULL, 0, StartConnection, connection, 0, NULL));
+      }
+    }
+
+    double now = GetMilliseconds();
+    if (now - lastReport >= 1000) {
+      LONG frames = framesSent_;
+      printf("%d connections, %d streaming, %d frames sent (%.1f fps), %d resets, %d truncated\n",
+             (int)connections_,
+             (int)streams_,
+             (int)frames,
+             1000 * (frames - lastFrames) / (now - lastReport),
+             (int)resets_,
+             (int)truncations_);
+      fflush(stdout);
+      lastReport = now;
+      lastFrames = frames;
+    }
+  }
+}
+
+/*
+ * Loads every frame from the source into memory, so that serving them never waits on the disk.
+ *
+ * @return Whether any frames were loaded.
+ */
+bool FakeCamera::LoadFrames() {
+  DWORD attributes = GetFileAttributes(source_);
+  if (attributes == INVALID_FILE_ATTRIBUTES) {
+    return false;
+  }
+  if (attributes & FILE_ATTRIBUTE_DIRECTORY) {
+    return LoadDirectory();
+  }
+  return LoadArchive() || LoadStream();
+}
+
+/*
+ * Loads the .jpg files in the source directory, in order of their names.
+ */
+bool FakeCamera::LoadDirectory() {
+  std::string pattern = std::string(source_) + "\\*.jpg";
+  WIN32_FIND_DATA findData;
+  HANDLE find = FindFirstFile(pattern.c_str(), &findData);
+  if (find == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  std::vector<std::string> names;
+  do {
+    if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+      names.push_back(findData.cFileName);
+    }
+  } while (FindNextFile(find, &findData));
+  FindClose(find);
+  std::sort(names.begin(), names.end());
+
+  for (unsigned int i = 0; i < names.size(); i++) {
+    std::string path = std::string(source_) + "\\" + names[i];
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == NULL) {
+      continue;
+    }
+    std::string frame;
+    char buffer[65536];
+    size_t bytesRead;
+    while ((bytesRead = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+      frame.append(buffer, bytesRead);
+    }
+    fclose(file);
+    if (!frame.empty()) {
+      frames_.push_back(frame);
+    }
+  }
+  return !frames_.empty();
+}
+
+/*
+ * Loads the frames of the source if it is a frame archive.
+ */
+bool FakeCamera::LoadArchive() {
+  ArchiveReplay replay(false, false);
+  if (!replay.Open(source_)) {
+    return false;
+  }
+  for (int i = 0; i < replay.GetFrameCount(); i++) {
+    const char* jpeg;
+    int jpegSize;
+    double timestamp;
+    replay.GetFrame(i, &jpeg, &jpegSize, &timestamp);
+    frames_.push_back(std::string(jpeg, jpegSize));
+  }
+  return !frames_.empty();
+}
+
+/*
+ * Loads the frames of the source if it is a raw MJPEG stream.
+ */
+bool FakeCamera::LoadStream() {
+  FILE* file = fopen(source_, "rb");
+  if (file == NULL) {
+    return false;
+  }
+  MjpegParser parser(STREAM_BUFFER_SIZE);
+  while (1) {
+    int space;
+    char* writePtr = parser.GetWriteBuffer(&space);
+    int bytesRead = (int)fread(writePtr, 1, space, file);
+    if (bytesRead <= 0) {
+      break;
+    }
+    parser.CommitWrite(bytesRead);
+
+    const char* jpeg;
+    int jpegSize;
+    while (parser.NextFrame(&jpeg, &jpegSize)) {
+      frames_.push_back(std::string(jpeg, jpegSize));
+    }
+  }
+  fclose(file);
+  return !frames_.empty();
+}
+
+/*
+ * Reads a request from a client and answers it, then closes the connection.
+ */
+void FakeCamera::Serve(SOCKET socket) {
+  // Camera::Start ends its requests with a blank line but not with CRLFs, so either is accepted.
+  char request[kMaxRequestSize + 1];
+  int requestSize = 0;
+  while (requestSize < kMaxRequestSize) {
+    int received = recv(socket, request + requestSize, kMaxRequestSize - requestSize, 0);
+    if (received <= 0) {
+      break;
+    }
+    requestSize += received;
+    request[requestSize] = 0;
+    if (strstr(request, "\n\n") != NULL || strstr(request, "\r\n\r\n") != NULL) {
+      break;
+    }
+  }
+  request[requestSize] = 0;
+
+  const char* response = NULL;
+  if (strncmp(request, "GET ", 4) != 0) {
+    response = "HTTP/1.0 400 Bad Request\r\n\r\n";
+  }
+  else if (strstr(request, AUTHENTICATION) == NULL) {
+    response = "HTTP/1.0 401 Unauthorized\r\nWWW-Authenticate: Basic realm=\"AXIS\"\r\n\r\n";
+  }
+  else if (strncmp(request + 4, "/axis-cgi/admin/param.cgi", 25) == 0) {
+    response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain\r\n\r\nOK\r\n";
+  }
+  else if (strncmp(request + 4, "/axis-cgi/mjpg/video.cgi", 24) == 0) {
+    const char* fps = strstr(request, "des_fps=");
+    InterlockedIncrement(&streams_);
+    StreamFrames(socket, fps != NULL ? atoi(fps + 8) : 0);
+    InterlockedDecrement(&streams_);
+  }
+  else {
+    response = "HTTP/1.0 404 Not Found\r\n\r\n";
+  }
+  if (response != NULL) {
+    SendAll(socket, response, (int)strlen(response));
+  }
+  closesocket(socket);
+}
+
+/*
+ * Sends the frames to a client in a loop as an MJPEG stream, until the client disconnects or the connection is
+ * reset on purpose.
+ *
+ * @param requestedFps The frame rate asked for by the client, used unless FAKE_CAMERA_FPS overrides it.
+ */
+void FakeCamera::StreamFrames(SOCKET socket, int requestedFps) {
+  const char* header = "HTTP/1.0 200 OK\r\nContent-Type: multipart/x-mixed-replace;boundary=myboundary\r\n\r\n";
+  if (!SendAll(socket, header, (int)strlen(header))) {
+    return;
+  }
+
+  int fps = (FAKE_CAMERA_FPS != 0) ? FAKE_CAMERA_FPS : requestedFps;
+  double interval = (fps > 0) ? 1000.0 / fps : 0;
+  double nextFrameTime = GetMilliseconds();
+  for (int frame = 0; ; frame++) {
+    if (FAKE_CAMERA_RESET_INTERVAL > 0 && frame == FAKE_CAMERA_RESET_INTERVAL) {
+      // Closing with a zero linger timeout aborts the connection, so the client sees it reset.
+      LINGER linger = { 1, 0 };
+      setsockopt(socket, SOL_SOCKET, SO_LINGER, (const char*)&linger, sizeof(linger));
+      InterlockedIncrement(&resets_);
+      return;
+    }
+
+    const std::string& jpeg = frames_[frame % frames_.size()];
+    char partHeader[128];
+    if (FAKE_CAMERA_CONTENT_LENGTH) {
+      sprintf_s(partHeader,
+                sizeof(partHeader),
+                "--myboundary\r\nContent-Type: image/jpeg\r\nContent-Length: %d\r\n\r\n",
+                (int)jpeg.size());
+    }
+    else {
+      sprintf_s(partHeader, sizeof(partHeader), "--myboundary\r\nContent-Type: image/jpeg\r\n\r\n");
+    }
+
+    // A truncated part keeps its full Content-Length, as when a camera's send is cut off partway.
+    int size = (int)jpeg.size();
+    if (FAKE_CAMERA_TRUNCATE_INTERVAL > 0 && (frame + 1) % FAKE_CAMERA_TRUNCATE_INTERVAL == 0) {
+      size /= 2;
+      InterlockedIncrement(&truncations_);
+    }
+    if (!SendAll(socket, partHeader, (int)strlen(partHeader)) || !SendAll(socket, jpeg.data(), size) ||
+        !SendAll(socket, "\r\n", 2)) {
+      return;
+    }
+    InterlockedIncrement(&framesSent_);
+
+    // Keep to the frame rate on average, but don't send a burst of frames to catch up after falling behind.
+    if (interval > 0) {
+      nextFrameTime += interval;
+      double wait = nextFrameTime - GetMilliseconds();
+      if (wait > 0) {
+        Sleep((DWORD)wait);
+      }
+      else if (wait < -interval) {
+        nextFrameTime = GetMilliseconds();
+      }
+    }
+  }
+}
+
+/*
+ * Sends all of the given data, in chunks of FAKE_CAMERA_SEND_CHUNK bytes with a delay after each if set.
+ *
+ * @return Whether the data was sent, or false if the client has disconnected.
+ */
+bool FakeCamera::SendAll(SOCKET socket, const char* data, int size) {
+  int chunk = (FAKE_CAMERA_SEND_CHUNK > 0) ? FAKE_CAMERA_SEND_CHUNK : size;
+  while (size > 0) {
+    int sent = send(socket, data, min(chunk, size), 0);
+    if (sent == SOCKET_ERROR) {
+      return false;
+    }
+    data += sent;
+    size -= sent;
+    if (FAKE_CAMERA_SEND_CHUNK > 0 && FAKE_CAMERA_SEND_DELAY > 0) {
+      Sleep(FAKE_CAMERA_SEND_DELAY);
+    }
+  }
+  return true;
+}
+
+/*
+ * Entry point for the thread serving a connection.
+ */
+DWORD WINAPI FakeCamera::StartConnection(LPVOID param) {
+  Connection* connection = (Connection*)param;
+  connection->server->Serve(connection->socket);
+  delete connection;
+  return 0;
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a stand-in for the Axis camera's HTTP server, which streams recorded frames to clients on
+ * the local machine and can inject network faults.
+ */
+
+#ifndef _FAKE_CAMERA_H_
+#define _FAKE_CAMERA_H_
+
+#include <winsock2.h>
+#include <Windows.h>
+#include <string>
+#include <vector>
+
+class FakeCamera {
+public:
+  FakeCamera(const char* source);
+  int Run();
+
+private:
+  // A client connection, served on its own thread.
+  struct Connection {
+    FakeCamera* server;
+    SOCKET socket;
+  };
+
+  bool LoadFrames();
+  bool LoadDirectory();
+  bool LoadArchive();
+  bool LoadStream();
+  void Serve(SOCKET socket);
+  void StreamFrames(SOCKET socket, int requestedFps);
+  bool SendAll(SOCKET socket, const char* data, int size);
+  static DWORD WINAPI StartConnection(LPVOID param);
+
+  const char* source_;
+  std::vector<std::string> frames_;
+  volatile LONG connections_;
+  volatile LONG streams_;
+  volatile LONG framesSent_;
+  volatile LONG resets_;
+  volatile LONG truncations_;
+};
+
+#endif // _FAKE_CAMERA_H_
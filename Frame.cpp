@@ -0,0 +1,116 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Classes representing an image's pixels in memory, independently of NI Vision: a view of rows of pixels with a
+ * format and stride, and a buffer which owns the memory for one.
+ *
+ * The processing core works on frames rather than NI images, so that it builds and runs on platforms without NI
+ * Vision. ImageFrame.h converts between the two.
+ */
+
+#include "Frame.h"
+
+#include "Platform.h"
+#include <string.h>
+
+/*
+ * Creates an empty frame.
+ */
+Frame::Frame() {
+  format_ = kGray8;
+  pixels_ = NULL;
+  stride_ = 0;
+  width_ = 0;
+  height_ = 0;
+}
+
+/*
+ * Creates a view of pixels owned elsewhere.
+ *
+ * @param pixels The first pixel of the top row.
+ * @param stride The distance in bytes from the start of one row to the start of the next.
+ */
+Frame::Frame(PixelFormat format, unsigned char* pixels, int stride, int width, int height) {
+  format_ = format;
+  pixels_ = pixels;
+  stride_ = stride;
+  width_ = width;
+  height_ = height;
+}
+
+/*
+ * Returns a view of a rectangle within the frame, sharing its pixels, clipped to the frame's edges.
+ */
+Frame Frame::GetView(int left, int top, int width, int height) {
+  int right = min(left + width, width_);
+  int bottom = min(top + height, height_);
+  left = max(left, 0);
+  top = max(top, 0);
+  if (right <= left || bottom <= top) {
+    return Frame(format_, pixels_, stride_, 0, 0);
+  }
+  return Frame(format_, GetRow(top) + left * GetPixelBytes(format_), stride_, right - left, bottom - top);
+}
+
+/*
+ * Returns whether every row starts on a cache line boundary.
+ */
+bool Frame::IsAligned() {
+  return (size_t)pixels_ % kAlignment == 0 && stride_ % kAlignment == 0;
+}
+
+/*
+ * Copies the frame's pixels into another of the same format and size.
+ *
+ * @return Whether the pixels were copied, which they aren't if the formats or sizes differ.
+ */
+bool Frame::CopyTo(Frame destination) {
+  if (destination.format_ != format_ || destination.width_ != width_ || destination.height_ != height_) {
+    return false;
+  }
+  for (int y = 0; y < height_; y++) {
+    memcpy(destination.GetRow(y), GetRow(y), width_ * GetPixelBytes(format_));
+  }
+  return true;
+}
+
+int Frame::GetPixelBytes(PixelFormat format) {
+  return format == kBgrx32 ? 4 : 1;
+}
+
+FrameBuffer::FrameBuffer() {
+  memory_ = NULL;
+  capacity_ = 0;
+}
+
+FrameBuffer::~FrameBuffer() {
+  _aligned_free(memory_);
+}
+
+/*
+ * Lays out a frame of the given format and size in the buffer, with each row padded to a whole number of cache
+ * lines, growing the buffer if needed. Any frame allocated before is overwritten.
+ *
+ * @return The frame, or an empty frame if the memory couldn't be allocated.
+ */
+Frame FrameBuffer::Allocate(PixelFormat format, int width, int height) {
+  if (width <= 0 || height <= 0) {
+    frame_ = Frame(format, memory_, 0, 0, 0);
+    return frame_;
+  }
+  int stride = (width * Frame::GetPixelBytes(format) + Frame::kAlignment - 1) / Frame::kAlignment *
+               Frame::kAlignment;
+  size_t size = (size_t)stride * height;
+  if (size > capacity_) {
+    _aligned_free(memory_);
+    memory_ = (unsigned char*)_aligned_malloc(size, Frame::kAlignment);
+    capacity_ = memory_ != NULL ? size : 0;
+    if (memory_ == NULL) {
+      frame_ = Frame();
+      return frame_;
+    }
+  }
+  frame_ = Frame(format, memory_, stride, width, height);
+  return frame_;
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Classes representing an image's pixels in memory, independently of NI Vision: a view of rows of pixels with a
+ * format and stride, and a buffer which owns the memory for one.
+ */
+
+#ifndef _FRAME_H_
+#define _FRAME_H_
+
+#include <stddef.h>
+
+// The layout of a pixel in memory.
+enum PixelFormat {
+  // One byte per pixel, for grayscale images and masks.
+  kGray8,
+
+  // Blue, green, red and an unused byte per pixel, as in NI Vision's RGB images.
+  kBgrx32
+};
+
+// A view of an image's pixels, which doesn't own them, so it can be copied freely and a view of part of it taken
+// without copying any pixels.
+class Frame {
+public:
+  // Rows which start on a cache line boundary are never split between two lines, and can be loaded with aligned
+  // vector instructions.
+  enum {
+    kAlignment = 64
+  };
+
+  Frame();
+  Frame(PixelFormat format, unsigned char* pixels, int stride, int width, int height);
+  Frame GetView(int left, int top, int width, int height);
+  bool CopyTo(Frame destination);
+  bool IsAligned();
+  static int GetPixelBytes(PixelFormat format);
+
+  PixelFormat GetFormat() {
+    return format_;
+  }
+
+  unsigned char* GetPixels() {
+    return pixels_;
+  }
+
+  // Returns the pointer to the first pixel of a row.
+  unsigned char* GetRow(int y) {
+    return pixels_ + y * stride_;
+  }
+
+  // Returns the distance in bytes from the start of one row to the start of the next.
+  int GetStride() {
+    return stride_;
+  }
+
+  int GetWidth() {
+    return width_;
+  }
+
+  int GetHeight() {
+    return height_;
+  }
+
+  bool IsEmpty() {
+    return width_ <= 0 || height_ <= 0;
+  }
+
+private:
+  PixelFormat format_;
+  unsigned char* pixels_;
+  int stride_;
+  int width_;
+  int height_;
+};
+
+// The memory for a frame, with every row starting on a cache line boundary. It is kept between allocations, so a
+// buffer reused for frames of the same size only allocates once.
+class FrameBuffer {
+public:
+  FrameBuffer();
+  ~FrameBuffer();
+  Frame Allocate(PixelFormat format, int width, int height);
+
+  Frame GetFrame() {
+    return frame_;
+  }
+
+private:
+  unsigned char* memory_;
+  size_t capacity_;
+  Frame frame_;
+};
+
+#endif // _FRAME_H_
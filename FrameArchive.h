@@ -0,0 +1,46 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Layout of a frame archive, a file of JPEG frames recorded from the camera along with the time each was
+ * received.
+ *
+ * The file starts with an ArchiveHeader, followed by each frame as an ArchiveRecord and the JPEG data, padded
+ * to a multiple of eight bytes. When the recording is closed, an index of every frame is written after the last
+ * one as an array of ArchiveEntry, and its offset is filled in in the header. An archive whose recording was
+ * cut short has no index, but its frames can still be found by walking the records from the start.
+ *
+ * All values are little-endian. An archive is limited to 2 GB, so that offsets fit in 32 bits and the whole file
+ * can be mapped into memory by a 32-bit process.
+ */
+
+#ifndef _FRAME_ARCHIVE_H_
+#define _FRAME_ARCHIVE_H_
+
+// The first four bytes of every archive, and the version of the layout described here.
+#define ARCHIVE_MAGIC "FRCA"
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_MAX_SIZE 0x7fffffffu
+
+struct ArchiveHeader {
+  char magic[4];
+  unsigned int version;
+  unsigned int frameCount;
+  unsigned int indexOffset;
+};
+
+// Precedes the data of each frame. The timestamp is in milliseconds from the first frame.
+struct ArchiveRecord {
+  unsigned int size;
+  unsigned int reserved;
+  double timestamp;
+};
+
+// Locates the data of a frame within the archive.
+struct ArchiveEntry {
+  unsigned int offset;
+  unsigned int size;
+  double timestamp;
+};
+
+#endif // _FRAME_ARCHIVE_H_
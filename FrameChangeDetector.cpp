@@ -0,0 +1,170 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a cheap test of whether a frame from the camera differs enough from the last one processed
+ * to be worth decoding and processing.
+ *
+ * A frame whose compressed data is byte for byte the same as the last processed frame's is skipped after only
+ * hashing it. Otherwise, with a threshold above zero, the frame is decoded at an eighth of its size, which only
+ * needs the DC coefficient of each block, and the brightness of this thumbnail is compared against the last
+ * processed frame's. The frame is skipped if no block's brightness differs by more than the threshold, so sensor
+ * noise in a still scene doesn't count as a change, but a small target moving across it does. The thumbnail costs
+ * the entropy decoding of the frame but none of the transforms, so it is cheaper than a full decode and much
+ * cheaper than processing.
+ *
+ * Frames are always compared against the last frame which was processed rather than the previous frame, so a
+ * scene which changes slowly is still processed once it has drifted past the threshold. After maxSkipped frames
+ * in a row are skipped, the next is processed regardless, so that results are refreshed now and then.
+ */
+
+#include "FrameChangeDetector.h"
+
+#include "JpegDecoder.h"
+#include "Platform.h"
+#include <stdlib.h>
+
+/*
+ * Creates a change detector.
+ *
+ * @param threshold The brightness difference (0-255) which no thumbnail pixel may exceed for a frame to count as
+ *                  unchanged, or 0 to only skip frames which are exact duplicates.
+ * @param maxSkipped The most frames skipped in a row before one is processed anyway (0 for no limit).
+ */
+FrameChangeDetector::FrameChangeDetector(double threshold, int maxSkipped) {
+  threshold_ = threshold;
+  maxSkipped_ = maxSkipped;
+  jpegDecoder_ = new JpegDecoder();
+  decoder_ = jpegDecoder_;
+  skippedCount_ = 0;
+  lastDifference_ = 0;
+  Reset();
+}
+
+FrameChangeDetector::~FrameChangeDetector() {
+  delete jpegDecoder_;
+}
+
+/*
+ * Sets the decoder which thumbnails are decoded with, in place of the JPEG decoder. It isn't deleted with the
+ * detector.
+ */
+void FrameChangeDetector::SetDecoder(FrameDecoder* decoder) {
+  decoder_ = decoder;
+}
+
+/*
+ * Decides whether a frame should be decoded and processed, and if so, makes it the frame which later ones are
+ * compared against.
+ *
+ * @return False if the frame is close enough to the last processed frame to be skipped.
+ */
+bool FrameChangeDetector::HasChanged(const char* jpeg, int jpegSize) {
+  bool forced = !hasReference_ || (maxSkipped_ > 0 && skippedInRow_ >= maxSkipped_);
+  unsigned int hash = Hash(jpeg, jpegSize);
+  bool changed = true;
+  if (!forced && jpegSize == referenceSize_ && hash == referenceHash_) {
+    changed = false;
+    lastDifference_ = 0;
+  }
+  else if (threshold_ > 0) {
+    // A frame which can't be decoded is left for the decoder to reject, and the frame after it is processed.
+    if (!ReadThumbnail(jpeg, jpegSize)) {
+      reference_.clear();
+    }
+    else {
+      if (!forced && thumbnail_.size() == reference_.size()) {
+        // A mean over the whole frame would hide a small target moving in a still scene, so the block which
+        // changed most decides.
+        int largest = 0;
+        for (unsigned int i = 0; i < thumbnail_.size(); i++) {
+          largest = max(largest, abs((int)thumbnail_[i] - (int)reference_[i]));
+        }
+        lastDifference_ = largest;
+        changed = (lastDifference_ > threshold_);
+      }
+      if (changed) {
+        reference_.swap(thumbnail_);
+      }
+    }
+  }
+
+  if (!changed) {
+    skippedInRow_++;
+    skippedCount_++;
+    return false;
+  }
+  hasReference_ = true;
+  referenceSize_ = jpegSize;
+  referenceHash_ = hash;
+  skippedInRow_ = 0;
+  return true;
+}
+
+/*
+ * Forgets the last processed frame, so that the next frame is processed whatever it holds.
+ */
+void FrameChangeDetector::Reset() {
+  hasReference_ = false;
+  referenceSize_ = 0;
+  referenceHash_ = 0;
+  reference_.clear();
+  skippedInRow_ = 0;
+}
+
+/*
+ * Returns the number of frames skipped since the detector was created.
+ */
+int FrameChangeDetector::GetSkippedCount() {
+  return skippedCount_;
+}
+
+/*
+ * Returns the largest brightness difference of any thumbnail pixel in the last frame compared, for choosing a
+ * threshold.
+ */
+double FrameChangeDetector::GetLastDifference() {
+  return lastDifference_;
+}
+
+/*
+ * Decodes the frame at an eighth of its size and keeps the brightness of each pixel in thumbnail_. The buffers
+ * are kept between frames, so nothing is allocated once running.
+ *
+ * @return False if the frame couldn't be decoded.
+ */
+bool FrameChangeDetector::ReadThumbnail(const char* jpeg, int jpegSize) {
+  int width, height;
+  if (!decoder_->ReadHeader(jpeg, jpegSize, &width, &height)) {
+    return false;
+  }
+  int thumbnailWidth = FrameDecoder::GetScaledSize(width, 8);
+  int thumbnailHeight = FrameDecoder::GetScaledSize(height, 8);
+  pixels_.resize(4 * thumbnailWidth * thumbnailHeight);
+  DecodeTarget target;
+  target.pixels = &pixels_[0];
+  target.stride = 4 * thumbnailWidth;
+  target.scale = 8;
+  if (!decoder_->DecodeScaled(jpeg, jpegSize, &target, 1)) {
+    return false;
+  }
+
+  // Weight the channels roughly as the eye does, with green counting for half.
+  thumbnail_.resize(thumbnailWidth * thumbnailHeight);
+  for (unsigned int i = 0; i < thumbnail_.size(); i++) {
+    const unsigned char* pixel = &pixels_[4 * i];
+    thumbnail_[i] = (unsigned char)((pixel[0] + 2 * pixel[1] + pixel[2] + 2) >> 2);
+  }
+  return true;
+}
+
+/*
+ * Computes the 32-bit FNV-1a hash of the given data.
+ */
+unsigned int FrameChangeDetector::Hash(const char* data, int size) {
+  unsigned int hash = 2166136261u;
+  for (int i = 0; i < size; i++) {
+    hash = (hash ^ (unsigned char)data[i]) * 16777619u;
+  }
+  return hash;
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a cheap test of whether a frame from the camera differs enough from the last one processed
+ * to be worth decoding and processing.
+ */
+
+#ifndef _FRAME_CHANGE_DETECTOR_H_
+#define _FRAME_CHANGE_DETECTOR_H_
+
+#include <vector>
+
+class FrameDecoder;
+class JpegDecoder;
+
+class FrameChangeDetector {
+public:
+  FrameChangeDetector(double threshold, int maxSkipped);
+  ~FrameChangeDetector();
+  void SetDecoder(FrameDecoder* decoder);
+  bool HasChanged(const char* jpeg, int jpegSize);
+  void Reset();
+  int GetSkippedCount();
+  double GetLastDifference();
+
+private:
+  bool ReadThumbnail(const char* jpeg, int jpegSize);
+  static unsigned int Hash(const char* data, int size);
+
+  double threshold_;
+  int maxSkipped_;
+  JpegDecoder* jpegDecoder_;
+  FrameDecoder* decoder_;
+  bool hasReference_;
+  int referenceSize_;
+  unsigned int referenceHash_;
+  std::vector<unsigned char> pixels_;
+  std::vector<unsigned char> reference_;
+  std::vector<unsigned char> thumbnail_;
+  int skippedInRow_;
+  volatile int skippedCount_;
+  double lastDifference_;
+};
+
+#endif // _FRAME_CHANGE_DETECTOR_H_
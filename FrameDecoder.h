@@ -0,0 +1,32 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Abstract class representing an operation which decodes a compressed frame from the camera into pixels.
+ */
+
+#ifndef _FRAME_DECODER_H_
+#define _FRAME_DECODER_H_
+
+// A buffer to decode a frame into, at 1/scale of the frame's width and height (rounded up), where the scale is 1,
+// 2, 4 or 8.
+struct DecodeTarget {
+  unsigned char* pixels;
+  int stride;
+  int scale;
+};
+
+class FrameDecoder {
+public:
+  virtual ~FrameDecoder() {}
+  virtual bool ReadHeader(const char* data, int size, int* width, int* height) = 0;
+  virtual bool Decode(const char* data, int size, unsigned char* pixels, int stride) = 0;
+  virtual bool DecodeScaled(const char* data, int size, const DecodeTarget* targets, int targetCount) = 0;
+
+  // Returns the width or height of a frame of the given size once decoded at the given scale.
+  static int GetScaledSize(int size, int scale) {
+    return (size + scale - 1) / scale;
+  }
+};
+
+#endif // _FRAME_DECODER_H_
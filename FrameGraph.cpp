@@ -0,0 +1,380 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a chain of processing stages, such as extracting a plane, thresholding it, cleaning up the
+ * mask and analyzing its particles, which are run together as one graph over a frame.
+ *
+ * Stages are added in the order they run. The image starts as the colour frame, which only plane extraction, the
+ * HSL threshold and compiled pipelines of colour stages take; they give a grayscale image or mask, which every
+ * other stage then works on in place in the output frame.
+ *
+ * Plane extraction, the thresholds and compiled pipelines look at one pixel at a time, so a run of them is fused
+ * into a single pass: each row goes through every stage in turn, between two row buffers which stay in the cache,
+ * and only the last stage writes to the output image. Stages which look at a pixel's neighbours or the whole image
+ * (morphology and particle analysis) need the previous stage finished everywhere first, so they end a run. Each pass
+ * is split into bands of rows shared out among the process's worker pool, with TILE_PARALLEL.
+ *
+ * The graph only works on frames, so it doesn't depend on NI Vision; ProcessorGraph runs it on NI images.
+ */
+
+#include "FrameGraph.h"
+
+#include "Constants.h"
+#include "HslThreshold.h"
+#include "Platform.h"
+#include "WorkerPool.h"
+#include <string.h>
+
+// Runs a member function of FrameGraph for each band of rows of a parallel loop.
+class GraphTask : public ParallelTask {
+public:
+  typedef void (FrameGraph::*Function)(int);
+
+  GraphTask(FrameGraph* graph, Function function) {
+    graph_ = graph;
+    function_ = function;
+  }
+
+  virtual void Run(int index) {
+    (graph_->*function_)(index);
+  }
+
+private:
+  FrameGraph* graph_;
+  Function function_;
+};
+
+FrameGraph::FrameGraph() {
+  workerPool_ = TILE_PARALLEL ? WorkerPool::GetShared() : NULL;
+  colour_ = true;
+  analyzed_ = false;
+  fused_ = true;
+  sourceColour_ = false;
+  firstStage_ = 0;
+  lastStage_ = 0;
+  connectivity8_ = false;
+}
+
+FrameGraph::~FrameGraph() {
+  for (unsigned int i = 0; i < stages_.size(); i++) {
+    delete stages_[i].threshold;
+    delete stages_[i].morphology;
+  }
+}
+
+/*
+ * Adds a stage which takes one plane of the colour image.
+ *
+ * @return Whether the stage was added, which it isn't unless the image is still in colour.
+ */
+bool FrameGraph::AddPlaneExtraction(Plane plane) {
+  if (!colour_) {
+    return false;
+  }
+  AddStage(kPlaneExtraction)->plane = plane;
+  colour_ = false;
+  return true;
+}
+
+/*
+ * Adds a stage which thresholds the hue, saturation and luminance of the colour image into a mask.
+ *
+ * @param value The value given to pixels which pass; the rest are set to zero.
+ * @return The threshold, for its ranges to be set, or NULL if the image is no longer in colour.
+ */
+HslThreshold* FrameGraph::AddHslThreshold(unsigned char value) {
+  if (!colour_) {
+    return NULL;
+  }
+  Stage* stage = AddStage(kHslThreshold);
+  stage->threshold = new HslThreshold();
+  stage->value = value;
+  colour_ = false;
+  return stage->threshold;
+}
+
+/*
+ * Adds a stage which thresholds a grayscale image into a mask, keeping the pixels between the given values
+ * inclusive.
+ *
+ * @param value The value given to pixels which pass; the rest are set to zero.
+ * @return Whether the stage was added, which it isn't if the image is still in colour.
+ */
+bool FrameGraph::AddThreshold(int minValue, int maxValue, unsigned char value) {
+  if (colour_) {
+    return false;
+  }
+  Stage* stage = AddStage(kThreshold);
+  stage->minValue = minValue;
+  stage->maxValue = maxValue;
+  stage->value = value;
+  return true;
+}
+
+/*
+ * Adds a stage which applies a morphological operation to the mask.
+ *
+ * @return The morphology, for its structuring element to be set, or NULL if the image is still in colour.
+ */
+BinaryMorphology* FrameGraph::AddMorphology(BinaryMorphology::Operation operation) {
+  if (colour_) {
+    return NULL;
+  }
+  Stage* stage = AddStage(kMorphology);
+  stage->morphology = new BinaryMorphology();
+  stage->morphology->SetWorkerPool(workerPool_);
+  stage->operation = operation;
+  return stage->morphology;
+}
+
+/*
+ * Adds a stage which finds and measures the particles in the mask, replacing any found by an earlier stage.
+ *
+ * @return Whether the stage was added, which it isn't if the image is still in colour.
+ */
+bool FrameGraph::AddParticleAnalysis(bool connectivity8) {
+  if (colour_) {
+    return false;
+  }
+  AddStage(kParticleAnalysis)->connectivity8 = connectivity8;
+  analyzed_ = true;
+  return true;
+}
+
+/*
+ * Adds a stage which removes the particles whose measurement is outside the given range.
+ *
+ * @return Whether the stage was added, which it isn't unless the particles have been analyzed.
+ */
+bool FrameGraph::AddParticleFilter(ParticleTable::Measurement measurement, double minValue, double maxValue) {
+  if (!analyzed_) {
+    return false;
+  }
+  Stage* stage = AddStage(kParticleFilter);
+  stage->measurement = measurement;
+  stage->minMeasurement = minValue;
+  stage->maxMeasurement = maxValue;
+  return true;
+}
+
+/*
+ * Adds a stage which applies a compiled pixel pipeline to each row.
+ *
+ * @param colourSource Whether the pipeline takes colour pixels rather than grayscale ones.
+ */
+bool FrameGraph::AddRowFunction(RowFunction function, bool colourSource) {
+  if (colour_ != colourSource) {
+    return false;
+  }
+  AddStage(kPipeline)->function = function;
+  colour_ = false;
+  return true;
+}
+
+/*
+ * Sets whether runs of pixel stages are fused into one pass, which they are by default. Otherwise each stage
+ * makes its own pass over the whole output image, which gives the same result; used to measure what fusing saves.
+ */
+void FrameGraph::SetFused(bool fused) {
+  fused_ = fused;
+}
+
+/*
+ * Returns whether the graph finds particles, so that there are particles to report after it is run.
+ */
+bool FrameGraph::HasParticleAnalysis() {
+  return analyzed_;
+}
+
+/*
+ * Runs every stage of the graph on a frame. Either frame may be a view of part of a larger one.
+ *
+ * @param source The colour frame (kBgrx32).
+ * @param output The grayscale frame (kGray8) of the same size, which the last stage leaves its image or mask in.
+ * @return Whether the graph was run, which it isn't if either frame is of the wrong format or the sizes differ.
+ */
+bool FrameGraph::Run(Frame source, Frame output) {
+  particles_.Clear();
+  if (source.GetFormat() != kBgrx32 || output.GetFormat() != kGray8 || source.GetWidth() != output.GetWidth() ||
+      source.GetHeight() != output.GetHeight()) {
+    return false;
+  }
+
+  // An empty view has no pixels to process, and no particles.
+  if (output.IsEmpty()) {
+    return true;
+  }
+  source_ = source;
+  output_ = output;
+  unsigned char* mask = output.GetPixels();
+  int maskStride = output.GetStride();
+  int width = output.GetWidth();
+  int height = output.GetHeight();
+
+  int stageCount = (int)stages_.size();
+  int stage = 0;
+  while (stage < stageCount) {
+    if (IsPixelStage(stages_[stage].type)) {
+      int last = stage;
+      while (fused_ && last + 1 < stageCount && IsPixelStage(stages_[last + 1].type)) {
+        last++;
+      }
+      RunPixelStages(stage, last);
+      stage = last + 1;
+      continue;
+    }
+
+    Stage* current = &stages_[stage];
+    switch (current->type) {
+      case kMorphology:
+        current->morphology->Apply(current->operation, mask, maskStride, width, height);
+        break;
+      case kParticleAnalysis: {
+        // Joining the bands costs a little, so the mask is analyzed whole when there's only one thread to share
+        // them out among.
+        int tileCount = (height + kTileRows - 1) / kTileRows;
+        if (workerPool_ != NULL && workerPool_->GetThreadCount() > 1 && tileCount > 1) {
+          connectivity8_ = current->connectivity8;
+          particleAnalysis_.SetTileCount(tileCount);
+          GraphTask analyzeTask(this, &FrameGraph::AnalyzeTile);
+          workerPool_->ParallelFor(&analyzeTask, tileCount);
+          particleAnalysis_.MergeTiles(current->connectivity8, &particles_);
+        }
+        else {
+          particleAnalysis_.Analyze(mask, maskStride, width, height, current->connectivity8, &particles_);
+        }
+        break;
+      }
+      case kParticleFilter:
+        particles_.Filter(current->measurement, current->minMeasurement, current->maxMeasurement);
+        break;
+      default:
+        break;
+    }
+    stage++;
+  }
+  return true;
+}
+
+/*
+ * Returns the particles found the last time the graph was run, in the order their first pixels appear, which
+ * remain valid until it is run again.
+ */
+ParticleTable* FrameGraph::GetParticles() {
+  return &particles_;
+}
+
+FrameGraph::Stage* FrameGraph::AddStage(StageType type) {
+  Stage stage;
+  memset(&stage, 0, sizeof(stage));
+  stage.type = type;
+  stages_.push_back(stage);
+  return &stages_.back();
+}
+
+/*
+ * Returns whether a type of stage works on each pixel independently of the others.
+ */
+bool FrameGraph::IsPixelStage(StageType type) {
+  return type == kPipeline || type == kPlaneExtraction || type == kHslThreshold || type == kThreshold;
+}
+
+/*
+ * Applies a pixel stage to a row.
+ */
+void FrameGraph::ApplyRow(const Stage& stage, const unsigned char* source, unsigned char* dest, int width) {
+  switch (stage.type) {
+    case kPipeline:
+      stage.function(source, dest, width);
+      break;
+    case kPlaneExtraction: {
+      // Colour pixels are stored as blue, green and red.
+      const unsigned char* channel = source + (2 - stage.plane);
+      for (int x = 0; x < width; x++) {
+        dest[x] = channel[4 * x];
+      }
+      break;
+    }
+    case kHslThreshold:
+      stage.threshold->Apply(source, 0, dest, 0, width, 1, stage.value);
+      break;
+    case kThreshold: {
+      // A single unsigned comparison tests both ends of the range, without a branch per pixel.
+      int minValue = stage.minValue;
+      unsigned int range = stage.maxValue >= minValue ? stage.maxValue - minValue : 0;
+      unsigned char value = stage.maxValue >= minValue ? stage.value : 0;
+      for (int x = 0; x < width; x++) {
+        dest[x] = (unsigned int)(source[x] - minValue) <= range ? value : 0;
+      }
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+/*
+ * Makes one pass over the image for the pixel stages from first to last inclusive.
+ */
+void FrameGraph::RunPixelStages(int first, int last) {
+  firstStage_ = first;
+  lastStage_ = last;
+  // Only the first stage of a graph takes the colour frame.
+  sourceColour_ = (first == 0);
+  for (int i = first; i <= last; i++) {
+    if (stages_[i].type == kHslThreshold) {
+      stages_[i].threshold->Prepare();
+    }
+  }
+
+  // Each band has its own pair of row buffers to pass rows between the stages in.
+  int width = output_.GetWidth();
+  int tileCount = (output_.GetHeight() + kTileRows - 1) / kTileRows;
+  if ((int)tileRows_.size() < tileCount) {
+    tileRows_.resize(tileCount);
+  }
+  for (int tile = 0; tile < tileCount; tile++) {
+    if ((int)tileRows_[tile].size() < 2 * width) {
+      tileRows_[tile].resize(2 * width);
+    }
+  }
+  if (workerPool_ == NULL) {
+    for (int tile = 0; tile < tileCount; tile++) {
+      PixelTile(tile);
+    }
+    return;
+  }
+  GraphTask pixelTask(this, &FrameGraph::PixelTile);
+  workerPool_->ParallelFor(&pixelTask, tileCount);
+}
+
+/*
+ * Passes each row of a band through the current run of pixel stages, into the output image.
+ */
+void FrameGraph::PixelTile(int tile) {
+  int width = output_.GetWidth();
+  if (width <= 0) {
+    // A band of an empty view has no row buffers.
+    return;
+  }
+  unsigned char* buffers[2] = { &tileRows_[tile][0], &tileRows_[tile][width] };
+  int bottom = min((tile + 1) * kTileRows, output_.GetHeight());
+  for (int y = tile * kTileRows; y < bottom; y++) {
+    const unsigned char* row = sourceColour_ ? source_.GetRow(y) : output_.GetRow(y);
+    for (int i = firstStage_; i <= lastStage_; i++) {
+      unsigned char* dest = (i == lastStage_) ? output_.GetRow(y) : buffers[i % 2];
+      ApplyRow(stages_[i], row, dest, width);
+      row = dest;
+    }
+  }
+}
+
+/*
+ * Finds the particles within a band of rows of the mask.
+ */
+void FrameGraph::AnalyzeTile(int tile) {
+  int top = tile * kTileRows;
+  particleAnalysis_.AnalyzeTile(tile, output_.GetPixels(), output_.GetStride(), output_.GetWidth(), top,
+                                min(top + kTileRows, output_.GetHeight()), connectivity8_);
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a chain of processing stages, such as extracting a plane, thresholding it, cleaning up the
+ * mask and analyzing its particles, which are run together as one graph over a frame.
+ */
+
+#ifndef _FRAME_GRAPH_H_
+#define _FRAME_GRAPH_H_
+
+#include "BinaryMorphology.h"
+#include "Frame.h"
+#include "ParticleAnalysis.h"
+#include "PixelPipeline.h"
+#include <vector>
+
+class HslThreshold;
+class WorkerPool;
+
+class FrameGraph {
+public:
+  // The colour planes which can be extracted from an image.
+  enum Plane {
+    kRed,
+    kGreen,
+    kBlue
+  };
+
+  FrameGraph();
+  virtual ~FrameGraph();
+  bool AddPlaneExtraction(Plane plane);
+  HslThreshold* AddHslThreshold(unsigned char value);
+  bool AddThreshold(int minValue, int maxValue, unsigned char value);
+  BinaryMorphology* AddMorphology(BinaryMorphology::Operation operation);
+  bool AddParticleAnalysis(bool connectivity8);
+  bool AddParticleFilter(ParticleTable::Measurement measurement, double minValue, double maxValue);
+
+  // Adds a chain of pixel stages from PixelPipeline.h, compiled into one loop over each row. Returns whether it
+  // was added, which it isn't if it takes colour pixels and the image is no longer in colour, or the reverse.
+  template <class Stages>
+  bool AddPixelPipeline() {
+    return AddRowFunction(&PixelPipeline<Stages>::ApplyRow, Stages::kSourceBytes == 4);
+  }
+
+  void SetFused(bool fused);
+  bool HasParticleAnalysis();
+  bool Run(Frame source, Frame output);
+  ParticleTable* GetParticles();
+
+private:
+  // Applies a compiled pixel pipeline to a row.
+  typedef void (*RowFunction)(const unsigned char* source, unsigned char* dest, int width);
+
+  enum StageType {
+    kPipeline,
+    kPlaneExtraction,
+    kHslThreshold,
+    kThreshold,
+    kMorphology,
+    kParticleAnalysis,
+    kParticleFilter
+  };
+
+  enum {
+    kTileRows = 32
+  };
+
+  // One stage of the graph, with the settings for its type.
+  struct Stage {
+    StageType type;
+    RowFunction function;
+    Plane plane;
+    int minValue;
+    int maxValue;
+    unsigned char value;
+    HslThreshold* threshold;
+    BinaryMorphology* morphology;
+    BinaryMorphology::Operation operation;
+    bool connectivity8;
+    ParticleTable::Measurement measurement;
+    double minMeasurement;
+    double maxMeasurement;
+  };
+
+  Stage* AddStage(StageType type);
+  bool AddRowFunction(RowFunction function, bool colourSource);
+  static bool IsPixelStage(StageType type);
+  static void ApplyRow(const Stage& stage, const unsigned char* source, unsigned char* dest, int width);
+  void RunPixelStages(int first, int last);
+  void PixelTile(int tile);
+  void AnalyzeTile(int tile);
+
+  WorkerPool* workerPool_;
+  std::vector<Stage> stages_;
+  bool colour_;
+  bool analyzed_;
+  bool fused_;
+  ParticleAnalysis particleAnalysis_;
+  ParticleTable particles_;
+  std::vector<std::vector<unsigned char> > tileRows_;
+
+  // The frames being processed and the run of pixel stages being made over them, shared by the tiles they're
+  // split into.
+  Frame source_;
+  Frame output_;
+  bool sourceColour_;
+  int firstStage_;
+  int lastStage_;
+  bool connectivity8_;
+};
+
+#endif // _FRAME_GRAPH_H_
@@ -0,0 +1,135 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a pool of reference-counted NIVision images which are recycled between frames.
+ *
+ * Creating and disposing of an Image for every frame fragments the heap over a long run and makes frame times
+ * spiky. Instead, images are handed out by the pool and returned to it when their last reference is released,
+ * and a later request for the same format and resolution reuses the existing pixel buffer. Once the pipeline
+ * reaches a steady state, no further images are allocated.
+ */
+
+#include "FramePool.h"
+
+FramePool::FramePool() {
+  InitializeCriticalSection(&lock_);
+  allocationCount_ = 0;
+}
+
+FramePool::~FramePool() {
+  for (unsigned int i = 0; i < entries_.size(); i++) {
+    imaqDispose(entries_[i].image);
+  }
+  DeleteCriticalSection(&lock_);
+}
+
+/*
+ * Returns an image of the given format and resolution with a single reference, reusing a free image from the
+ * pool if one matches and allocating a new one otherwise. The pixel contents are undefined.
+ *
+ * @return The image, or NULL if it couldn't be created.
+ */
+Image* FramePool::Acquire(ImageType type, int width, int height) {
+  EnterCriticalSection(&lock_);
+  for (unsigned int i = 0; i < entries_.size(); i++) {
+    Entry* entry = &entries_[i];
+    if (entry->references == 0 && entry->type == type && entry->width == width && entry->height == height) {
+      entry->references = 1;
+      LeaveCriticalSection(&lock_);
+      return entry->image;
+    }
+  }
+  LeaveCriticalSection(&lock_);
+
+  Image* image = imaqCreateImage(type, 3);
+  if (image == NULL) {
+    return NULL;
+  }
+  if (imaqSetImageSize(image, width, height) == 0) {
+    imaqDispose(image);
+    return NULL;
+  }
+
+  Entry entry;
+  entry.image = image;
+  entry.type = type;
+  entry.width = width;
+  entry.height = height;
+  entry.references = 1;
+  EnterCriticalSection(&lock_);
+  entries_.push_back(entry);
+  allocationCount_++;
+  LeaveCriticalSection(&lock_);
+  return image;
+}
+
+/*
+ * Adds a reference to an image from the pool, for a consumer which holds on to it independently.
+ */
+void FramePool::AddRef(Image* image) {
+  EnterCriticalSection(&lock_);
+  Entry* entry = Find(image);
+  if (entry) {
+    entry->references++;
+  }
+  LeaveCriticalSection(&lock_);
+}
+
+/*
+ * Releases a reference to an image. Once none remain, the image returns to the pool to be reused. Images which
+ * didn't come from the pool are disposed of instead.
+ */
+void FramePool::Release(Image* image) {
+  EnterCriticalSection(&lock_);
+  Entry* entry = Find(image);
+  if (entry == NULL) {
+    LeaveCriticalSection(&lock_);
+    imaqDispose(image);
+    return;
+  }
+  if (--entry->references == 0) {
+    // NIVision functions may have changed the format or resolution of the image while it was in use, so record
+    // what it is now for matching against later requests.
+    ImageInfo info;
+    if (imaqGetImageInfo(image, &info)) {
+      entry->type = info.imageType;
+      entry->width = info.xRes;
+      entry->height = info.yRes;
+    }
+  }
+  LeaveCriticalSection(&lock_);
+}
+
+/*
+ * Returns the number of images the pool has had to create since it was constructed.
+ */
+int FramePool::GetAllocationCount() {
+  EnterCriticalSection(&lock_);
+  int allocationCount = allocationCount_;
+  LeaveCriticalSection(&lock_);
+  return allocationCount;
+}
+
+/*
+ * Returns the number of images owned by the pool, whether in use or free.
+ */
+int FramePool::GetImageCount() {
+  EnterCriticalSection(&lock_);
+  int imageCount = (int)entries_.size();
+  LeaveCriticalSection(&lock_);
+  return imageCount;
+}
+
+/*
+ * Returns the entry for the given image, or NULL if it isn't owned by the pool. Must be called while holding
+ * the lock.
+ */
+FramePool::Entry* FramePool::Find(Image* image) {
+  for (unsigned int i = 0; i < entries_.size(); i++) {
+    if (entries_[i].image == image) {
+      return &entries_[i];
+    }
+  }
+  return NULL;
+}
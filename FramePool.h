@@ -0,0 +1,42 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a pool of reference-counted NIVision images which are recycled between frames.
+ */
+
+#ifndef _FRAME_POOL_H_
+#define _FRAME_POOL_H_
+
+#include <nivision.h>
+#include <vector>
+#include <Windows.h>
+
+class FramePool {
+public:
+  FramePool();
+  ~FramePool();
+  Image* Acquire(ImageType type, int width, int height);
+  void AddRef(Image* image);
+  void Release(Image* image);
+  int GetAllocationCount();
+  int GetImageCount();
+
+private:
+  // An image owned by the pool, along with the format and resolution it was last used with.
+  struct Entry {
+    Image* image;
+    ImageType type;
+    int width;
+    int height;
+    int references;
+  };
+
+  Entry* Find(Image* image);
+
+  CRITICAL_SECTION lock_;
+  std::vector<Entry> entries_;
+  int allocationCount_;
+};
+
+#endif // _FRAME_POOL_H_
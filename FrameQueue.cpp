@@ -0,0 +1,156 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a bounded, thread-safe queue of frames between two stages of the capture pipeline.
+ */
+
+#include "FrameQueue.h"
+
+#include "Trace.h"
+#include <string.h>
+
+FrameQueue::FrameQueue(int capacity, OverflowPolicy policy) {
+  InitializeCriticalSection(&lock_);
+
+  // Manual-reset events which mirror whether the queue is non-empty and non-full. They are only changed while
+  // holding the lock, so a waiter that wakes up always re-checks the actual state.
+  notEmpty_ = CreateEvent(NULL, TRUE, FALSE, NULL);
+  notFull_ = CreateEvent(NULL, TRUE, TRUE, NULL);
+  frames_ = new PipelineFrame*[capacity];
+  capacity_ = capacity;
+  head_ = 0;
+  count_ = 0;
+  closed_ = false;
+  policy_ = policy;
+  dropCount_ = 0;
+}
+
+FrameQueue::~FrameQueue() {
+  delete[] frames_;
+  CloseHandle(notEmpty_);
+  CloseHandle(notFull_);
+  DeleteCriticalSection(&lock_);
+}
+
+/*
+ * Adds a frame to the back of the queue. If the queue is full, either the oldest queued frame or the new frame
+ * is dropped, or the caller waits for space, depending on the overflow policy.
+ *
+ * @return The frame which was dropped, to be recycled by the caller, or NULL if none was.
+ */
+PipelineFrame* FrameQueue::Push(PipelineFrame* frame) {
+  PipelineFrame* dropped = NULL;
+  EnterCriticalSection(&lock_);
+  while (count_ == capacity_ && !closed_) {
+    if (policy_ == kDropOldest) {
+      dropped = frames_[head_];
+      head_ = (head_ + 1) % capacity_;
+      count_--;
+      dropCount_++;
+    }
+    else if (policy_ == kDropNewest) {
+      dropCount_++;
+      LeaveCriticalSection(&lock_);
+      return frame;
+    }
+    else {
+      LeaveCriticalSection(&lock_);
+      TRACE_BEGIN("QueueFull");
+      WaitForSingleObject(notFull_, INFINITE);
+      TRACE_END("QueueFull");
+      EnterCriticalSection(&lock_);
+    }
+  }
+  if (closed_) {
+    LeaveCriticalSection(&lock_);
+    return frame;
+  }
+
+  frames_[(head_ + count_) % capacity_] = frame;
+  count_++;
+  UpdateEvents();
+  LeaveCriticalSection(&lock_);
+  return dropped;
+}
+
+/*
+ * Removes the frame at the front of the queue, waiting for one to arrive if the queue is empty.
+ *
+ * @return The frame, or NULL if the queue has been closed.
+ */
+PipelineFrame* FrameQueue::Pop() {
+  EnterCriticalSection(&lock_);
+  while (count_ == 0 && !closed_) {
+    LeaveCriticalSection(&lock_);
+    TRACE_BEGIN("QueueEmpty");
+    WaitForSingleObject(notEmpty_, INFINITE);
+    TRACE_END("QueueEmpty");
+    EnterCriticalSection(&lock_);
+  }
+  PipelineFrame* frame = NULL;
+  if (count_ > 0) {
+    frame = frames_[head_];
+    head_ = (head_ + 1) % capacity_;
+    count_--;
+    UpdateEvents();
+  }
+  LeaveCriticalSection(&lock_);
+  return frame;
+}
+
+/*
+ * Wakes up all waiting threads and makes subsequent calls to Pop() return NULL once the queue is empty.
+ */
+void FrameQueue::Close() {
+  EnterCriticalSection(&lock_);
+  closed_ = true;
+  SetEvent(notEmpty_);
+  SetEvent(notFull_);
+  LeaveCriticalSection(&lock_);
+}
+
+int FrameQueue::GetDepth() {
+  EnterCriticalSection(&lock_);
+  int depth = count_;
+  LeaveCriticalSection(&lock_);
+  return depth;
+}
+
+int FrameQueue::GetDropCount() {
+  EnterCriticalSection(&lock_);
+  int dropCount = dropCount_;
+  LeaveCriticalSection(&lock_);
+  return dropCount;
+}
+
+/*
+ * Converts the name of an overflow policy as used in Constants.h (drop_oldest, drop_newest or block).
+ */
+FrameQueue::OverflowPolicy FrameQueue::ParsePolicy(const char* name) {
+  if (strcmp(name, "drop_newest") == 0) {
+    return kDropNewest;
+  }
+  if (strcmp(name, "block") == 0) {
+    return kBlock;
+  }
+  return kDropOldest;
+}
+
+/*
+ * Brings the events in line with the current number of queued frames. Must be called while holding the lock.
+ */
+void FrameQueue::UpdateEvents() {
+  if (count_ > 0 || closed_) {
+    SetEvent(notEmpty_);
+  }
+  else {
+    ResetEvent(notEmpty_);
+  }
+  if (count_ < capacity_ || closed_) {
+    SetEvent(notFull_);
+  }
+  else {
+    ResetEvent(notFull_);
+  }
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a bounded, thread-safe queue of frames between two stages of the capture pipeline.
+ */
+
+#ifndef _FRAME_QUEUE_H_
+#define _FRAME_QUEUE_H_
+
+#include "Platform.h"
+
+struct PipelineFrame;
+
+class FrameQueue {
+public:
+  // What to do when a frame is pushed onto a full queue.
+  enum OverflowPolicy {
+    kDropOldest,
+    kDropNewest,
+    kBlock
+  };
+
+  FrameQueue(int capacity, OverflowPolicy policy);
+  ~FrameQueue();
+  PipelineFrame* Push(PipelineFrame* frame);
+  PipelineFrame* Pop();
+  void Close();
+  int GetDepth();
+  int GetDropCount();
+  static OverflowPolicy ParsePolicy(const char* name);
+
+private:
+  void UpdateEvents();
+
+  CRITICAL_SECTION lock_;
+  HANDLE notEmpty_;
+  HANDLE notFull_;
+  PipelineFrame** frames_;
+  int capacity_;
+  int head_;
+  int count_;
+  bool closed_;
+  OverflowPolicy policy_;
+  int dropCount_;
+};
+
+#endif // _FRAME_QUEUE_H_
@@ -0,0 +1,83 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Functions for filling in and formatting the results of processing a frame.
+ */
+
+#include "FrameResult.h"
+
+#include "Platform.h"
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Empties a result of any objects or target, keeping nothing from the frame it last held.
+ */
+void ClearFrameResult(FrameResult* result) {
+  memset(result, 0, sizeof(FrameResult));
+}
+
+/*
+ * Formats a frame's results as text for display beneath the processed image.
+ *
+ * @param size The size of the text buffer, which is always left terminated.
+ * @return The length of the text.
+ */
+int FormatFrameResult(const FrameResult* result, char* text, int size) {
+  int numChars = 0;
+  text[0] = 0;
+  int count = result->objectCount < FrameResult::kMaxObjects ? result->objectCount : FrameResult::kMaxObjects;
+  if (result->objectType == kResultParticle) {
+    // The largest particle comes first.
+    if (result->objectCount > 0) {
+      numChars += sprintf_s(text,
+                            size,
+                            "Position: (%3.1f, %3.1f)\r\nArea: %.0f\r\nParticles: %d",
+                            result->objects[0].x,
+                            result->objects[0].y,
+                            result->objects[0].area,
+                            result->objectCount);
+    }
+    else {
+      numChars += sprintf_s(text, size, "No particles found.");
+    }
+  }
+  else if (result->objectType == kResultEllipse) {
+    numChars += sprintf_s(text, size, "# of ellipses: %d\r\n\r\n", result->objectCount);
+    double totalX = 0;
+    for (int i = 0; i < count && size - numChars > 64; i++) {
+      // Print the location, size and score information for each detected ellipse.
+      numChars += sprintf_s(text + numChars,
+                            size - numChars,
+                            "Pos: (%.0f, %.0f)\tMaj: %.0f\tMin: %.0f\tScore: %.0f\r\n",
+                            result->objects[i].x,
+                            result->objects[i].y,
+                            result->objects[i].halfWidth,
+                            result->objects[i].halfHeight,
+                            result->objects[i].score);
+      totalX += result->objects[i].x;
+    }
+    if (count > 0 && size - numChars > 32) {
+      // Print the average X-coordinate of the ellipse centers.
+      numChars += sprintf_s(text + numChars, size - numChars, "\r\nAverage X: %.0f\r\n", totalX / count);
+    }
+  }
+
+  // Show the region a tracker searched after the processor's own text, if there's room for it.
+  if (result->tracked && size - numChars > 64) {
+    if (result->searchWidth > 0) {
+      numChars += sprintf_s(text + numChars,
+                            size - numChars,
+                            "\r\nSearched: (%d, %d) %dx%d",
+                            result->searchLeft,
+                            result->searchTop,
+                            result->searchWidth,
+                            result->searchHeight);
+    }
+    else {
+      numChars += sprintf_s(text + numChars, size - numChars, "\r\nSearched: whole image");
+    }
+  }
+  return numChars;
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Structures representing what an image processor found in a frame, as published to other processes through a
+ * ResultChannel. They hold only plain values, so that robot code can read them without NIVision.
+ */
+
+#ifndef _FRAME_RESULT_H_
+#define _FRAME_RESULT_H_
+
+// The kinds of object an image processor reports.
+enum ResultObjectType {
+  kResultNone,
+  kResultParticle,
+  kResultEllipse
+};
+
+// An object found in a frame, in full-resolution pixels. A particle's extent is half of its bounding box, and an
+// ellipse's is its major and minor radius.
+struct ResultObject {
+  double x;
+  double y;
+  double halfWidth;
+  double halfHeight;
+  double rotation;
+  double area;
+  double score;
+};
+
+// The results of processing one frame. Times are from GetMilliseconds(), which counts from the same point in
+// every process on the machine, so a reader can tell how old a result is.
+struct FrameResult {
+  enum {
+    kMaxObjects = 32
+  };
+
+  int camera;
+  unsigned int frameId;
+  double captureTime;
+  double processedTime;
+
+  // The region which was searched, and whether a tracker chose it rather than the whole image being searched.
+  int tracked;
+  int searchLeft;
+  int searchTop;
+  int searchWidth;
+  int searchHeight;
+
+  // The processor's target, and the objects it found. Only the first kMaxObjects objects are kept, but
+  // objectCount is the number found.
+  int targetFound;
+  ResultObject target;
+  int objectType;
+  int objectCount;
+  ResultObject objects[kMaxObjects];
+};
+
+void ClearFrameResult(FrameResult* result);
+int FormatFrameResult(const FrameResult* result, char* text, int size);
+
+#endif // _FRAME_RESULT_H_
@@ -0,0 +1,19 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Abstract class representing a source of JPEG frames which can stand in for the camera's stream.
+ */
+
+#ifndef _FRAME_SOURCE_H_
+#define _FRAME_SOURCE_H_
+
+class FrameSource {
+public:
+  virtual ~FrameSource() {}
+
+  // Waits for the next frame, which remains valid until the following call. Returns false once there are no more.
+  virtual bool NextFrame(const char** jpeg, int* jpegSize) = 0;
+};
+
+#endif // _FRAME_SOURCE_H_
@@ -0,0 +1,360 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a threshold on the hue, saturation and luminance of RGB pixels.
+ *
+ * The colour space is the one NIVision uses for thresholding, with each component scaled to 0-255 (so a hue of
+ * 255 is just short of 360 degrees) and every scaled value rounded down. RgbToHsl defines it exactly in integer
+ * arithmetic, and all three methods produce the mask it implies:
+ *
+ * - Scalar converts each pixel with RgbToHsl and tests the result.
+ * - SSE2 converts eight pixels at a time in 16-bit lanes. Rather than dividing to find the hue and saturation,
+ *   it multiplies out the range limits and compares products, which gives the same answer without rounding.
+ * - The lookup table holds a bit for every RGB colour saying whether it passes, built with the SSE2 method the
+ *   first time it is needed after the ranges change. At 8 bits per channel it takes 2 MB and is exact; with
+ *   fewer bits it is smaller but each cell takes the result of the colour at its centre.
+ */
+
+#include "HslThreshold.h"
+
+#include "CpuFeatures.h"
+#include <string.h>
+
+HslThreshold::HslThreshold() {
+  hueMin_ = 0;
+  hueMax_ = 255;
+  saturationMin_ = 0;
+  saturationMax_ = 255;
+  luminanceMin_ = 0;
+  luminanceMax_ = 255;
+  useLookupTable_ = false;
+  lookupBits_ = 8;
+  lookupTable_ = NULL;
+  lookupTableValid_ = false;
+}
+
+HslThreshold::~HslThreshold() {
+  delete[] lookupTable_;
+}
+
+/*
+ * Sets the inclusive range each component must be in for a pixel to pass. If the minimum hue is greater than
+ * the maximum, the hue range wraps around through red instead.
+ */
+void HslThreshold::SetRanges(int hueMin, int hueMax, int saturationMin, int saturationMax, int luminanceMin,
+                             int luminanceMax) {
+  if (hueMin == hueMin_ && hueMax == hueMax_ && saturationMin == saturationMin_ &&
+      saturationMax == saturationMax_ && luminanceMin == luminanceMin_ && luminanceMax == luminanceMax_) {
+    return;
+  }
+  hueMin_ = hueMin;
+  hueMax_ = hueMax;
+  saturationMin_ = saturationMin;
+  saturationMax_ = saturationMax;
+  luminanceMin_ = luminanceMin;
+  luminanceMax_ = luminanceMax;
+  lookupTableValid_ = false;
+}
+
+/*
+ * Sets whether Apply uses the lookup table rather than converting every pixel.
+ *
+ * @param bits The number of bits of each colour channel used to index the table, from 4 to 8. Only 8 gives
+ *             exactly the same mask as the other methods.
+ */
+void HslThreshold::SetLookupTable(bool enabled, int bits) {
+  useLookupTable_ = enabled;
+  if (bits != lookupBits_) {
+    delete[] lookupTable_;
+    lookupTable_ = NULL;
+    lookupTableValid_ = false;
+    lookupBits_ = bits;
+  }
+}
+
+/*
+ * Builds the lookup table now if Apply is going to use it. Apply builds it itself the first time otherwise, so
+ * this must be called before applying the threshold to parts of an image from several threads at once.
+ */
+void HslThreshold::Prepare() {
+  if (useLookupTable_ && !lookupTableValid_) {
+    BuildLookupTable();
+  }
+}
+
+/*
+ * Thresholds an image using the lookup table if enabled, or the fastest direct method otherwise.
+ *
+ * @param source The pixels to threshold, as blue, green, red and an unused byte.
+ * @param sourceStride The distance in bytes between the start of each source row.
+ * @param mask The destination for the mask, with one byte per pixel.
+ * @param maskStride The distance in bytes between the start of each mask row.
+ * @param value The value given to pixels which pass; the rest are set to zero.
+ */
+void HslThreshold::Apply(const unsigned char* source, int sourceStride, unsigned char* mask, int maskStride,
+                         int width, int height, unsigned char value) {
+  Method method = kScalar;
+  if (useLookupTable_) {
+    method = kLookupTable;
+  }
+  else if (IsSupported(kSse2)) {
+    method = kSse2;
+  }
+  Apply(method, source, sourceStride, mask, maskStride, width, height, value);
+}
+
+/*
+ * Thresholds an image using the given method, which must be supported by the processor. Used to compare the
+ * methods against each other.
+ */
+void HslThreshold::Apply(Method method, const unsigned char* source, int sourceStride, unsigned char* mask,
+                         int maskStride, int width, int height, unsigned char value) {
+  if (method == kLookupTable && !lookupTableValid_) {
+    BuildLookupTable();
+  }
+  for (int y = 0; y < height; y++) {
+    switch (method) {
+      case kScalar:
+        ApplyRowScalar(source, mask, width, value);
+        break;
+      case kSse2:
+        ApplyRowSse2(source, mask, width, value);
+        break;
+      default:
+        ApplyRowLookup(source, mask, width, value);
+        break;
+    }
+    source += sourceStride;
+    mask += maskStride;
+  }
+}
+
+/*
+ * Returns whether the given method can be used on this processor.
+ */
+bool HslThreshold::IsSupported(Method method) {
+#if SIMD_KERNELS
+  return method != kSse2 || CpuFeatures::HasSse2();
+#else
+  return method != kSse2;
+#endif
+}
+
+const char* HslThreshold::GetMethodName(Method method) {
+  static const char* names[kMethodCount] = { "Scalar", "SSE2", "Lookup" };
+  return names[method];
+}
+
+/*
+ * Converts an RGB colour to HSL, with each component scaled to 0-255 and rounded down.
+ */
+void HslThreshold::RgbToHsl(int red, int green, int blue, int* hue, int* saturation, int* luminance) {
+  int maxValue = red > green ? red : green;
+  maxValue = maxValue > blue ? maxValue : blue;
+  int minValue = red < green ? red : green;
+  minValue = minValue < blue ? minValue : blue;
+  int delta = maxValue - minValue;
+  int sum = maxValue + minValue;
+
+  *luminance = sum >> 1;
+  if (delta == 0) {
+    *hue = 0;
+    *saturation = 0;
+    return;
+  }
+  *saturation = 255 * delta / (sum <= 255 ? sum : 510 - sum);
+
+  // The position around the colour wheel in sixths, multiplied by delta to keep it an integer.
+  int sector;
+  if (red == maxValue) {
+    sector = green - blue;
+    if (sector < 0) {
+      sector += 6 * delta;
+    }
+  }
+  else if (green == maxValue) {
+    sector = 2 * delta + blue - red;
+  }
+  else {
+    sector = 4 * delta + red - green;
+  }
+  *hue = 85 * sector / (2 * delta);
+}
+
+void HslThreshold::ApplyRowScalar(const unsigned char* source, unsigned char* mask, int width,
+                                  unsigned char value) {
+  bool hueWraps = hueMin_ > hueMax_;
+  for (int x = 0; x < width; x++) {
+    int hue, saturation, luminance;
+    RgbToHsl(source[2], source[1], source[0], &hue, &saturation, &luminance);
+    bool hueInRange = hueWraps ? (hue >= hueMin_ || hue <= hueMax_) : (hue >= hueMin_ && hue <= hueMax_);
+    bool pass = hueInRange && saturation >= saturationMin_ && saturation <= saturationMax_ &&
+                luminance >= luminanceMin_ && luminance <= luminanceMax_;
+    mask[x] = pass ? value : 0;
+    source += 4;
+  }
+}
+
+#if SIMD_KERNELS
+
+// Range limits for the SSE2 method, multiplied out where necessary and broadcast to every lane.
+struct Sse2Limits {
+  __m128i luminanceBelow;
+  __m128i luminanceAbove;
+  __m128i saturationMin;
+  __m128i saturationAbove;
+  __m128i hueMin;
+  __m128i hueAbove;
+};
+
+/*
+ * Tests eight pixels against the limits, returning a 16-bit lane for each which is all ones if it passes.
+ */
+TARGET_SSE2 static __m128i ThresholdSse2(const unsigned char* source, const Sse2Limits& limits, bool hueWraps) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi16(1);
+  const __m128i byteMask = _mm_set1_epi32(0xff);
+
+  // Split the pixels into 16-bit channel values.
+  __m128i first = _mm_loadu_si128((const __m128i*)source);
+  __m128i second = _mm_loadu_si128((const __m128i*)(source + 16));
+  __m128i blue = _mm_packs_epi32(_mm_and_si128(first, byteMask), _mm_and_si128(second, byteMask));
+  __m128i green = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(first, 8), byteMask),
+                                  _mm_and_si128(_mm_srli_epi32(second, 8), byteMask));
+  __m128i red = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(first, 16), byteMask),
+                                _mm_and_si128(_mm_srli_epi32(second, 16), byteMask));
+
+  __m128i maxValue = _mm_max_epi16(_mm_max_epi16(red, green), blue);
+  __m128i minValue = _mm_min_epi16(_mm_min_epi16(red, green), blue);
+  __m128i delta = _mm_sub_epi16(maxValue, minValue);
+  __m128i sum = _mm_add_epi16(maxValue, minValue);
+
+  __m128i luminance = _mm_srli_epi16(sum, 1);
+  __m128i pass = _mm_and_si128(_mm_cmpgt_epi16(luminance, limits.luminanceBelow),
+                               _mm_cmplt_epi16(luminance, limits.luminanceAbove));
+
+  // The saturation is 255 * delta / divisor, so it is at least the minimum when 255 * delta is at least
+  // minimum * divisor, and at most the maximum when 255 * delta is less than (maximum + 1) * divisor. A grey
+  // pixel has a saturation of zero, which a divisor of at least one preserves. The products fit in unsigned
+  // 16-bit lanes, where a >= b exactly when subtracting a from b saturates to zero.
+  __m128i divisor = _mm_min_epi16(sum, _mm_sub_epi16(_mm_set1_epi16(510), sum));
+  divisor = _mm_max_epi16(divisor, one);
+  __m128i scaledDelta = _mm_mullo_epi16(delta, _mm_set1_epi16(255));
+  __m128i saturationAtLeastMin =
+      _mm_cmpeq_epi16(_mm_subs_epu16(_mm_mullo_epi16(divisor, limits.saturationMin), scaledDelta), zero);
+  __m128i saturationAboveMax =
+      _mm_cmpeq_epi16(_mm_subs_epu16(_mm_mullo_epi16(divisor, limits.saturationAbove), scaledDelta), zero);
+  pass = _mm_and_si128(pass, _mm_andnot_si128(saturationAboveMax, saturationAtLeastMin));
+
+  // Find the sector as in RgbToHsl, choosing between the three cases with masks.
+  __m128i redIsMax = _mm_cmpeq_epi16(red, maxValue);
+  __m128i greenIsMax = _mm_andnot_si128(redIsMax, _mm_cmpeq_epi16(green, maxValue));
+  __m128i redSector = _mm_sub_epi16(green, blue);
+  __m128i wholeTurn = _mm_mullo_epi16(delta, _mm_set1_epi16(6));
+  redSector = _mm_add_epi16(redSector, _mm_and_si128(_mm_cmpgt_epi16(zero, redSector), wholeTurn));
+  __m128i greenSector = _mm_add_epi16(_mm_slli_epi16(delta, 1), _mm_sub_epi16(blue, red));
+  __m128i blueSector = _mm_add_epi16(_mm_slli_epi16(delta, 2), _mm_sub_epi16(red, green));
+  __m128i sector = _mm_or_si128(_mm_and_si128(redIsMax, redSector), _mm_and_si128(greenIsMax, greenSector));
+  sector = _mm_or_si128(sector, _mm_andnot_si128(_mm_or_si128(redIsMax, greenIsMax), blueSector));
+
+  // The hue is 85 * sector / (2 * delta), compared in the same way as the saturation. The products need 32 bits,
+  // so each half is widened and multiplied with PMADDWD against limits stored in the low half of each 32-bit
+  // lane. A grey pixel has a sector of zero, so again a divisor of at least one gives a hue of zero.
+  delta = _mm_max_epi16(delta, one);
+  __m128i scaledSectorLow = _mm_madd_epi16(_mm_unpacklo_epi16(sector, zero), _mm_set1_epi32(85));
+  __m128i scaledSectorHigh = _mm_madd_epi16(_mm_unpackhi_epi16(sector, zero), _mm_set1_epi32(85));
+  __m128i deltaLow = _mm_unpacklo_epi16(delta, zero);
+  __m128i deltaHigh = _mm_unpackhi_epi16(delta, zero);
+  __m128i hueBelowMin = _mm_packs_epi32(_mm_cmpgt_epi32(_mm_madd_epi16(deltaLow, limits.hueMin), scaledSectorLow),
+                                        _mm_cmpgt_epi32(_mm_madd_epi16(deltaHigh, limits.hueMin), scaledSectorHigh));
+  __m128i hueAtMostMax = _mm_packs_epi32(
+      _mm_cmpgt_epi32(_mm_madd_epi16(deltaLow, limits.hueAbove), scaledSectorLow),
+      _mm_cmpgt_epi32(_mm_madd_epi16(deltaHigh, limits.hueAbove), scaledSectorHigh));
+  __m128i hueInRange;
+  if (hueWraps) {
+    hueInRange = _mm_or_si128(_mm_andnot_si128(hueBelowMin, _mm_set1_epi16(-1)), hueAtMostMax);
+  }
+  else {
+    hueInRange = _mm_andnot_si128(hueBelowMin, hueAtMostMax);
+  }
+  return _mm_and_si128(pass, hueInRange);
+}
+
+TARGET_SSE2 static void ThresholdRowSse2(const unsigned char* source, unsigned char* mask, int width,
+                                         unsigned char value, const Sse2Limits& limits, bool hueWraps) {
+  __m128i values = _mm_set1_epi8((char)value);
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    __m128i pass = _mm_packs_epi16(ThresholdSse2(source, limits, hueWraps),
+                                   ThresholdSse2(source + 32, limits, hueWraps));
+    _mm_storeu_si128((__m128i*)(mask + x), _mm_and_si128(pass, values));
+    source += 64;
+  }
+}
+
+#endif
+
+void HslThreshold::ApplyRowSse2(const unsigned char* source, unsigned char* mask, int width,
+                                unsigned char value) {
+  int x = 0;
+#if SIMD_KERNELS
+  // The hue limits sit in the low half of each 32-bit lane, with zero in the high half, for PMADDWD.
+  Sse2Limits limits;
+  limits.luminanceBelow = _mm_set1_epi16((short)(luminanceMin_ - 1));
+  limits.luminanceAbove = _mm_set1_epi16((short)(luminanceMax_ + 1));
+  limits.saturationMin = _mm_set1_epi16((short)saturationMin_);
+  limits.saturationAbove = _mm_set1_epi16((short)(saturationMax_ + 1));
+  limits.hueMin = _mm_set1_epi32(2 * hueMin_);
+  limits.hueAbove = _mm_set1_epi32(2 * (hueMax_ + 1));
+  ThresholdRowSse2(source, mask, width, value, limits, hueMin_ > hueMax_);
+  x = width & ~15;
+#endif
+  ApplyRowScalar(source + 4 * x, mask + x, width - x, value);
+}
+
+void HslThreshold::ApplyRowLookup(const unsigned char* source, unsigned char* mask, int width,
+                                  unsigned char value) {
+  int shift = 8 - lookupBits_;
+  for (int x = 0; x < width; x++) {
+    int index = (source[2] >> shift) << lookupBits_ | (source[1] >> shift);
+    index = index << lookupBits_ | (source[0] >> shift);
+    int bit = (lookupTable_[index >> 3] >> (index & 7)) & 1;
+    mask[x] = (unsigned char)(value & -bit);
+    source += 4;
+  }
+}
+
+/*
+ * Fills in the lookup table for the current ranges by thresholding one row of colours at a time.
+ */
+void HslThreshold::BuildLookupTable() {
+  int cells = 1 << lookupBits_;
+  int shift = 8 - lookupBits_;
+  int center = (1 << shift) >> 1;
+  int tableSize = (cells * cells * cells) >> 3;
+  if (lookupTable_ == NULL) {
+    lookupTable_ = new unsigned char[tableSize];
+  }
+  memset(lookupTable_, 0, tableSize);
+
+  Method method = IsSupported(kSse2) ? kSse2 : kScalar;
+  unsigned char row[4 * 256];
+  unsigned char rowMask[256];
+  for (int red = 0; red < cells; red++) {
+    for (int green = 0; green < cells; green++) {
+      for (int blue = 0; blue < cells; blue++) {
+        row[4 * blue] = (unsigned char)((blue << shift) | center);
+        row[4 * blue + 1] = (unsigned char)((green << shift) | center);
+        row[4 * blue + 2] = (unsigned char)((red << shift) | center);
+        row[4 * blue + 3] = 0;
+      }
+      Apply(method, row, 4 * cells, rowMask, cells, cells, 1, 1);
+      int index = (red * cells + green) * cells;
+      for (int blue = 0; blue < cells; blue++, index++) {
+        lookupTable_[index >> 3] |= (unsigned char)(rowMask[blue] << (index & 7));
+      }
+    }
+  }
+  lookupTableValid_ = true;
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a threshold on the hue, saturation and luminance of RGB pixels.
+ */
+
+#ifndef _HSL_THRESHOLD_H_
+#define _HSL_THRESHOLD_H_
+
+class HslThreshold {
+public:
+  // Ways of thresholding an image, which all produce the same mask.
+  enum Method {
+    kScalar,
+    kSse2,
+    kLookupTable,
+    kMethodCount
+  };
+
+  HslThreshold();
+  ~HslThreshold();
+  void SetRanges(int hueMin, int hueMax, int saturationMin, int saturationMax, int luminanceMin,
+                 int luminanceMax);
+  void SetLookupTable(bool enabled, int bits);
+  void Prepare();
+  void Apply(const unsigned char* source, int sourceStride, unsigned char* mask, int maskStride, int width,
+             int height, unsigned char value);
+  void Apply(Method method, const unsigned char* source, int sourceStride, unsigned char* mask, int maskStride,
+             int width, int height, unsigned char value);
+  bool IsSupported(Method method);
+  static const char* GetMethodName(Method method);
+  static void RgbToHsl(int red, int green, int blue, int* hue, int* saturation, int* luminance);
+
+private:
+  void ApplyRowScalar(const unsigned char* source, unsigned char* mask, int width, unsigned char value);
+  void ApplyRowSse2(const unsigned char* source, unsigned char* mask, int width, unsigned char value);
+  void ApplyRowLookup(const unsigned char* source, unsigned char* mask, int width, unsigned char value);
+  void BuildLookupTable();
+
+  int hueMin_;
+  int hueMax_;
+  int saturationMin_;
+  int saturationMax_;
+  int luminanceMin_;
+  int luminanceMax_;
+  bool useLookupTable_;
+  int lookupBits_;
+  unsigned char* lookupTable_;
+  bool lookupTableValid_;
+};
+
+#endif // _HSL_THRESHOLD_H_
@@ -0,0 +1,52 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Functions for passing NI Vision images to code which works on frames, and frames back to NI Vision.
+ */
+
+#include "ImageFrame.h"
+
+/*
+ * Returns a view of an NI image's pixels, without copying them. It remains valid until the image is resized or
+ * disposed of.
+ *
+ * @return The view, or an empty frame if the image is neither grayscale (U8) nor colour (RGB).
+ */
+Frame GetImageFrame(Image* image) {
+  ImageInfo info;
+  if (!imaqGetImageInfo(image, &info)) {
+    return Frame();
+  }
+  PixelFormat format;
+  if (info.imageType == IMAQ_IMAGE_U8) {
+    format = kGray8;
+  }
+  else if (info.imageType == IMAQ_IMAGE_RGB) {
+    format = kBgrx32;
+  }
+  else {
+    return Frame();
+  }
+  int pixelBytes = Frame::GetPixelBytes(format);
+  return Frame(format, (unsigned char*)info.imageStart, pixelBytes * info.pixelsPerLine, info.xRes, info.yRes);
+}
+
+/*
+ * Copies a frame into an NI image of the same format, resizing the image to match.
+ *
+ * @return Whether the frame was copied, which it isn't if the image is of another format.
+ */
+bool CopyFrameToImage(Frame frame, Image* image) {
+  ImageType type;
+  if (!imaqGetImageType(image, &type)) {
+    return false;
+  }
+  if (type != (frame.GetFormat() == kBgrx32 ? IMAQ_IMAGE_RGB : IMAQ_IMAGE_U8)) {
+    return false;
+  }
+  if (!imaqSetImageSize(image, frame.GetWidth(), frame.GetHeight())) {
+    return false;
+  }
+  return frame.CopyTo(GetImageFrame(image));
+}
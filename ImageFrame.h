@@ -0,0 +1,17 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Functions for passing NI Vision images to code which works on frames, and frames back to NI Vision.
+ */
+
+#ifndef _IMAGE_FRAME_H_
+#define _IMAGE_FRAME_H_
+
+#include "Frame.h"
+#include <nivision.h>
+
+Frame GetImageFrame(Image* image);
+bool CopyFrameToImage(Frame frame, Image* image);
+
+#endif // _IMAGE_FRAME_H_
@@ -8,11 +8,86 @@
 #ifndef _IMAGE_PROCESSOR_H_
 #define _IMAGE_PROCESSOR_H_
 
+#include "FrameResult.h"
 #include <nivision.h>
+#include <stddef.h>
+
+class FramePool;
+
+// The object an image processor is looking for, as the center of the object and half of its width and height.
+struct ImageTarget {
+  double x;
+  double y;
+  double halfWidth;
+  double halfHeight;
+};
 
 class ImageProcessor {
 public:
-  virtual Image* ProcessImage(Image* image, char* textOut) = 0;
+  ImageProcessor() {
+    framePool_ = NULL;
+    region_.top = 0;
+    region_.left = 0;
+    region_.height = 0;
+    region_.width = 0;
+    targetFound_ = false;
+  }
+  virtual ~ImageProcessor() {}
+
+  // Processes an image, filling in the type, number and positions of the objects found and the target in result,
+  // in full-resolution pixels. The rest of the result is left as the caller set it.
+  virtual Image* ProcessImage(Image* image, FrameResult* result) = 0;
+
+  // Returns how many times smaller than the camera's frames, in each direction, the images passed to ProcessImage
+  // should be decoded: 1, 2, 4 or 8.
+  virtual int GetDecodeScale() {
+    return 1;
+  }
+
+  // Sets the pool from which output images are acquired instead of being created for every frame.
+  virtual void SetFramePool(FramePool* framePool) {
+    framePool_ = framePool;
+  }
+
+  // Restricts processing to a region of the image, or lifts the restriction if the region is empty. Processors
+  // which don't look for a target process the whole image regardless.
+  void SetRegion(const Rect& region) {
+    region_ = region;
+  }
+
+  // Gets the target found in the last image processed, returning false if there wasn't one.
+  bool GetTarget(ImageTarget* target) {
+    if (targetFound_) {
+      *target = target_;
+    }
+    return targetFound_;
+  }
+
+protected:
+  // Returns the region to be processed within an image of the given size.
+  Rect GetRegion(int width, int height) {
+    Rect region = { 0, 0, height, width };
+    if (region_.width > 0 && region_.height > 0) {
+      region.left = region_.left < 0 ? 0 : (region_.left > width ? width : region_.left);
+      region.top = region_.top < 0 ? 0 : (region_.top > height ? height : region_.top);
+      int right = region_.left + region_.width;
+      int bottom = region_.top + region_.height;
+      region.width = (right > width ? width : right) - region.left;
+      region.height = (bottom > height ? height : bottom) - region.top;
+      if (region.width < 0) {
+        region.width = 0;
+      }
+      if (region.height < 0) {
+        region.height = 0;
+      }
+    }
+    return region;
+  }
+
+  FramePool* framePool_;
+  Rect region_;
+  bool targetFound_;
+  ImageTarget target_;
 };
 
 #endif // _IMAGE_PROCESSOR_H_
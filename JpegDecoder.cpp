@@ -0,0 +1,773 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing an in-memory decoder for baseline JPEG images.
+ *
+ * Only baseline (sequential, Huffman-coded, 8-bit) images with a single interleaved scan are supported, which is
+ * what the Axis camera produces. Progressive and arithmetic-coded images are rejected.
+ *
+ * Images can also be decoded at a half, a quarter or an eighth of their size. Rather than decoding at full size
+ * and shrinking the result, each block is transformed with a smaller inverse DCT over only its lowest
+ * frequencies, giving 4x4, 2x2 or 1x1 samples directly, so the transform and the colour conversion both cost
+ * less by the square of the scale. Only the entropy decoding is the same at every scale. An image can be decoded
+ * at two scales in one pass, for example at full size for display and at a smaller size for processing.
+ */
+
+#include "JpegDecoder.h"
+
+#include <string.h>
+
+// Order in which the coefficients of a block are stored in the entropy-coded data.
+static const unsigned char kZigzag[64] = {
+   0,  1,  8, 16,  9,  2,  3, 10,
+  17, 24, 32, 25, 18, 11,  4,  5,
+  12, 19, 26, 33, 40, 48, 41, 34,
+  27, 20, 13,  6,  7, 14, 21, 28,
+  35, 42, 49, 56, 57, 50, 43, 36,
+  29, 22, 15, 23, 30, 37, 44, 51,
+  58, 59, 52, 45, 38, 31, 39, 46,
+  53, 60, 61, 54, 47, 55, 62, 63
+};
+
+// Marks an entry in the Huffman fast lookup table whose code is longer than the lookup.
+static const unsigned short kSlowCode = 0xFFFF;
+
+// Number of bits looked up at once when decoding Huffman codes.
+static const int kFastBits = 9;
+
+// Fixed-point constants for the inverse DCT, scaled by 2^12.
+static const int kFix_0_298631336 = 1223;
+static const int kFix_0_390180644 = 1598;
+static const int kFix_0_541196100 = 2217;
+static const int kFix_0_765366865 = 3135;
+static const int kFix_0_899976223 = 3686;
+static const int kFix_1_175875602 = 4816;
+static const int kFix_1_501321110 = 6149;
+static const int kFix_1_847759065 = 7568;
+static const int kFix_1_961570560 = 8035;
+static const int kFix_2_053119869 = 8410;
+static const int kFix_2_562915447 = 10498;
+static const int kFix_3_072711026 = 12586;
+
+// Basis functions of the 4-point and 2-point inverse DCTs used to decode at a half and a quarter of full size,
+// scaled by 2^12 and with the same normalization as the 8-point transform, so that each output sample is close to
+// the average of the full-size samples it covers. Entry [x][u] weights frequency u for output x.
+static const int kReducedIdct4[4][4] = {
+  { 1448,  1892,  1448,   784 },
+  { 1448,   784, -1448, -1892 },
+  { 1448,  -784, -1448,  1892 },
+  { 1448, -1892,  1448,  -784 }
+};
+static const int kReducedIdct2[2][2] = {
+  { 1448,  1448 },
+  { 1448, -1448 }
+};
+
+static inline unsigned char Clamp(int value) {
+  if ((unsigned int)value > 255) {
+    return value < 0 ? 0 : 255;
+  }
+  return (unsigned char)value;
+}
+
+/*
+ * Computes one 8-point inverse DCT (the Loeffler, Ligtenberg and Moschytz algorithm used by the IJG library).
+ * The even and odd halves are returned separately; output i is even[i] + odd[i] and output 7 - i is
+ * even[i] - odd[i].
+ */
+static inline void Idct8(int s0, int s1, int s2, int s3, int s4, int s5, int s6, int s7, int* even, int* odd) {
+  // Even part.
+  int z1 = (s2 + s6) * kFix_0_541196100;
+  int t2 = z1 - s6 * kFix_1_847759065;
+  int t3 = z1 + s2 * kFix_0_765366865;
+  int t0 = (s0 + s4) * 4096;
+  int t1 = (s0 - s4) * 4096;
+  even[0] = t0 + t3;
+  even[3] = t0 - t3;
+  even[1] = t1 + t2;
+  even[2] = t1 - t2;
+
+  // Odd part.
+  int p1 = s7 + s1;
+  int p2 = s5 + s3;
+  int p3 = s7 + s3;
+  int p4 = s5 + s1;
+  int p5 = (p3 + p4) * kFix_1_175875602;
+  int o0 = s7 * kFix_0_298631336;
+  int o1 = s5 * kFix_2_053119869;
+  int o2 = s3 * kFix_3_072711026;
+  int o3 = s1 * kFix_1_501321110;
+  p1 = -p1 * kFix_0_899976223;
+  p2 = -p2 * kFix_2_562915447;
+  p3 = p5 - p3 * kFix_1_961570560;
+  p4 = p5 - p4 * kFix_0_390180644;
+  odd[3] = o0 + p1 + p3;
+  odd[2] = o1 + p2 + p4;
+  odd[1] = o2 + p2 + p3;
+  odd[0] = o3 + p1 + p4;
+}
+
+/*
+ * Transforms a block of dequantized coefficients into 8x8 samples, written to out with the given row stride.
+ */
+static void InverseDct(int* coefficients, unsigned char* out, int outStride) {
+  int even[4];
+  int odd[4];
+
+  // Columns, keeping two extra bits of precision for the row pass.
+  for (int i = 0; i < 8; i++) {
+    int* c = coefficients + i;
+    if (c[8] == 0 && c[16] == 0 && c[24] == 0 && c[32] == 0 && c[40] == 0 && c[48] == 0 && c[56] == 0) {
+      // Only the DC term is present, so the whole column has the same value.
+      int dc = c[0] * 4;
+      c[0] = c[8] = c[16] = c[24] = c[32] = c[40] = c[48] = c[56] = dc;
+      continue;
+    }
+    Idct8(c[0], c[8], c[16], c[24], c[32], c[40], c[48], c[56], even, odd);
+    for (int j = 0; j < 4; j++) {
+      c[8 * j] = (even[j] + odd[j] + 512) >> 10;
+      c[8 * (7 - j)] = (even[j] - odd[j] + 512) >> 10;
+    }
+  }
+
+  // Rows, removing the remaining scaling and the level shift.
+  for (int i = 0; i < 8; i++) {
+    int* c = coefficients + 8 * i;
+    unsigned char* o = out + outStride * i;
+    Idct8(c[0], c[1], c[2], c[3], c[4], c[5], c[6], c[7], even, odd);
+    for (int j = 0; j < 4; j++) {
+      int rounding = 65536 + (128 << 17);
+      o[j] = Clamp((even[j] + odd[j] + rounding) >> 17);
+      o[7 - j] = Clamp((even[j] - odd[j] + rounding) >> 17);
+    }
+  }
+}
+
+/*
+ * Transforms the lowest size x size frequencies of a block of dequantized coefficients into size x size samples,
+ * for a size of 4, 2 or 1, written to out with the given row stride. The coefficients are left unchanged.
+ */
+static void ReducedInverseDct(const int* coefficients, int size, unsigned char* out, int outStride) {
+  if (size == 1) {
+    // The DC term alone is the average of the block.
+    out[0] = Clamp(((coefficients[0] + 4) >> 3) + 128);
+    return;
+  }
+  const int* table = (size == 4) ? kReducedIdct4[0] : kReducedIdct2[0];
+
+  // Columns, keeping two extra bits of precision for the row pass.
+  int columns[16];
+  for (int u = 0; u < size; u++) {
+    for (int y = 0; y < size; y++) {
+      int sum = 0;
+      for (int v = 0; v < size; v++) {
+        sum += table[y * size + v] * coefficients[8 * v + u];
+      }
+      columns[y * size + u] = (sum + 512) >> 10;
+    }
+  }
+
+  // Rows, removing the remaining scaling and the level shift.
+  for (int y = 0; y < size; y++) {
+    unsigned char* o = out + outStride * y;
+    for (int x = 0; x < size; x++) {
+      int sum = 0;
+      for (int u = 0; u < size; u++) {
+        sum += table[x * size + u] * columns[y * size + u];
+      }
+      o[x] = Clamp(((sum + 8192) >> 14) + 128);
+    }
+  }
+}
+
+JpegDecoder::JpegDecoder() {
+  planes_ = NULL;
+  planesSize_ = 0;
+}
+
+JpegDecoder::~JpegDecoder() {
+  delete[] planes_;
+}
+
+/*
+ * Reads the dimensions of the given JPEG image without decoding it.
+ *
+ * @return False if the data isn't a supported JPEG image.
+ */
+bool JpegDecoder::ReadHeader(const char* data, int size, int* width, int* height) {
+  data_ = (const unsigned char*)data;
+  end_ = data_ + size;
+  if (!ParseHeaders(true)) {
+    return false;
+  }
+  *width = width_;
+  *height = height_;
+  return true;
+}
+
+/*
+ * Decodes the given JPEG image into a caller-supplied buffer, which is typically reused from frame to frame.
+ * Pixels are written as 32-bit blue, green, red, unused, matching the layout of an NIVision RGB Image.
+ *
+ * @param stride Distance in bytes between the starts of consecutive rows in the pixel buffer.
+ * @return False if the data isn't a supported JPEG image or is corrupt.
+ */
+bool JpegDecoder::Decode(const char* data, int size, unsigned char* pixels, int stride) {
+  DecodeTarget target;
+  target.pixels = pixels;
+  target.stride = stride;
+  target.scale = 1;
+  return DecodeScaled(data, size, &target, 1);
+}
+
+/*
+ * Decodes the given JPEG image into one or two caller-supplied buffers at once, each at its own scale, in the same
+ * pixel layout as Decode(). Each buffer must be large enough for the image at its scale, as given by
+ * GetScaledSize().
+ *
+ * @param targets The buffers to decode into, each with a different scale of 1, 2, 4 or 8.
+ * @param targetCount The number of buffers, no more than kMaxTargets.
+ * @return False if the data isn't a supported JPEG image or is corrupt, or the targets aren't supported.
+ */
+bool JpegDecoder::DecodeScaled(const char* data, int size, const DecodeTarget* targets, int targetCount) {
+  if (targetCount < 1 || targetCount > kMaxTargets) {
+    return false;
+  }
+  for (int i = 0; i < targetCount; i++) {
+    int scale = targets[i].scale;
+    if ((scale != 1 && scale != 2 && scale != 4 && scale != 8) || (i > 0 && scale == targets[0].scale)) {
+      return false;
+    }
+    targets_[i] = targets[i];
+  }
+  targetCount_ = targetCount;
+
+  data_ = (const unsigned char*)data;
+  end_ = data_ + size;
+  if (!ParseHeaders(false)) {
+    return false;
+  }
+
+  // Lay out scratch space holding one row of MCUs for each component at each scale, growing it only when
+  // necessary.
+  int planesSize = 0;
+  for (int target = 0; target < targetCount_; target++) {
+    int blockSize = 8 / targets_[target].scale;
+    for (int i = 0; i < componentCount_; i++) {
+      components_[i].planeStride[target] = mcusX_ * components_[i].h * blockSize;
+      planesSize += components_[i].planeStride[target] * components_[i].v * blockSize;
+    }
+  }
+  if (planesSize > planesSize_) {
+    delete[] planes_;
+    planes_ = new unsigned char[planesSize];
+    planesSize_ = planesSize;
+  }
+  unsigned char* plane = planes_;
+  for (int target = 0; target < targetCount_; target++) {
+    int blockSize = 8 / targets_[target].scale;
+    for (int i = 0; i < componentCount_; i++) {
+      components_[i].plane[target] = plane;
+      plane += components_[i].planeStride[target] * components_[i].v * blockSize;
+    }
+  }
+
+  return DecodeScan();
+}
+
+/*
+ * Walks the marker segments from the start of the image up to the start of the scan (or just to the frame
+ * header if headerOnly is set), recording the tables and parameters needed to decode it.
+ */
+bool JpegDecoder::ParseHeaders(bool headerOnly) {
+  pos_ = data_;
+  width_ = 0;
+  restartInterval_ = 0;
+  if (end_ - pos_ < 2 || pos_[0] != 0xFF || pos_[1] != 0xD8) {
+    return false;
+  }
+  pos_ += 2;
+  for (int i = 0; i < 4; i++) {
+    dcTables_[i].defined = false;
+    acTables_[i].defined = false;
+  }
+
+  while (pos_ < end_) {
+    // Find the next marker, skipping any fill bytes.
+    if (*pos_ != 0xFF) {
+      pos_++;
+      continue;
+    }
+    while (pos_ < end_ && *pos_ == 0xFF) {
+      pos_++;
+    }
+    if (pos_ >= end_) {
+      return false;
+    }
+    int marker = *pos_++;
+    if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+      // Standalone markers without a segment.
+      continue;
+    }
+    if (marker == 0xD9) {
+      // End of image before any scan.
+      return false;
+    }
+
+    if (end_ - pos_ < 2) {
+      return false;
+    }
+    int length = (pos_[0] << 8) | pos_[1];
+    if (length < 2 || end_ - pos_ < length) {
+      return false;
+    }
+    const unsigned char* segment = pos_ + 2;
+    length -= 2;
+    pos_ = segment + length;
+
+    switch (marker) {
+      case 0xC0:
+      case 0xC1:
+        // Baseline or extended sequential, Huffman coded.
+        if (!ParseFrameHeader(segment, length)) {
+          return false;
+        }
+        if (headerOnly) {
+          return true;
+        }
+        break;
+      case 0xC2: case 0xC3: case 0xC5: case 0xC6: case 0xC7:
+      case 0xC9: case 0xCA: case 0xCB: case 0xCD: case 0xCE: case 0xCF:
+        // Progressive, lossless, hierarchical or arithmetic coding isn't supported.
+        return false;
+      case 0xC4:
+        if (!ParseHuffmanTables(segment, length)) {
+          return false;
+        }
+        break;
+      case 0xDB:
+        if (!ParseQuantTables(segment, length)) {
+          return false;
+        }
+        break;
+      case 0xDD:
+        if (length < 2) {
+          return false;
+        }
+        restartInterval_ = (segment[0] << 8) | segment[1];
+        break;
+      case 0xDA:
+        return width_ > 0 && ParseScanHeader(segment, length);
+      default:
+        // Application data and comments are skipped.
+        break;
+    }
+  }
+  return false;
+}
+
+bool JpegDecoder::ParseFrameHeader(const unsigned char* segment, int length) {
+  if (length < 6 || segment[0] != 8) {
+    return false;
+  }
+  height_ = (segment[1] << 8) | segment[2];
+  width_ = (segment[3] << 8) | segment[4];
+  componentCount_ = segment[5];
+  if (width_ == 0 || height_ == 0 || (componentCount_ != 1 && componentCount_ != 3) ||
+      length < 6 + 3 * componentCount_) {
+    return false;
+  }
+
+  maxH_ = 1;
+  maxV_ = 1;
+  for (int i = 0; i < componentCount_; i++) {
+    Component* component = &components_[i];
+    component->id = segment[6 + 3 * i];
+    component->h = segment[7 + 3 * i] >> 4;
+    component->v = segment[7 + 3 * i] & 15;
+    component->quantTable = segment[8 + 3 * i] & 3;
+    if (componentCount_ == 1) {
+      // A single component is never interleaved, so each MCU is one block regardless of its sampling factors.
+      component->h = 1;
+      component->v = 1;
+    }
+    if (component->h < 1 || component->h > 4 || component->v < 1 || component->v > 4) {
+      return false;
+    }
+    maxH_ = component->h > maxH_ ? component->h : maxH_;
+    maxV_ = component->v > maxV_ ? component->v : maxV_;
+  }
+  for (int i = 0; i < componentCount_; i++) {
+    // Only sampling ratios which are powers of two are supported, so that upsampling is a shift.
+    int ratioH = maxH_ / components_[i].h;
+    int ratioV = maxV_ / components_[i].v;
+    if (maxH_ % components_[i].h || maxV_ % components_[i].v || (ratioH & (ratioH - 1)) ||
+        (ratioV & (ratioV - 1))) {
+      return false;
+    }
+  }
+
+  mcusX_ = (width_ + 8 * maxH_ - 1) / (8 * maxH_);
+  mcusY_ = (height_ + 8 * maxV_ - 1) / (8 * maxV_);
+  return true;
+}
+
+bool JpegDecoder::ParseHuffmanTables(const unsigned char* segment, int length) {
+  const unsigned char* end = segment + length;
+  while (segment + 17 <= end) {
+    int tableClass = segment[0] >> 4;
+    int tableId = segment[0] & 15;
+    if (tableClass > 1 || tableId > 3) {
+      return false;
+    }
+    HuffmanTable* table = (tableClass == 0) ? &dcTables_[tableId] : &acTables_[tableId];
+    const unsigned char* counts = segment + 1;
+    int total = 0;
+    for (int i = 0; i < 16; i++) {
+      total += counts[i];
+    }
+    segment += 17;
+    if (total > 256 || segment + total > end) {
+      return false;
+    }
+    memcpy(table->symbols, segment, total);
+    segment += total;
+
+    // Assign the canonical codes, filling the fast lookup for the short ones.
+    for (int i = 0; i < (1 << kFastBits); i++) {
+      table->fast[i] = kSlowCode;
+    }
+    int code = 0;
+    int symbol = 0;
+    for (int bits = 1; bits <= 16; bits++) {
+      table->valueOffset[bits] = symbol - code;
+      for (int i = 0; i < counts[bits - 1]; i++) {
+        if (bits <= kFastBits) {
+          int first = code << (kFastBits - bits);
+          for (int j = 0; j < (1 << (kFastBits - bits)); j++) {
+            table->fast[first + j] = (unsigned short)((bits << 8) | table->symbols[symbol]);
+          }
+        }
+        code++;
+        symbol++;
+      }
+      if (code > (1 << bits)) {
+        // More codes than can exist with this many bits.
+        return false;
+      }
+      table->maxCode[bits] = code << (16 - bits);
+      code <<= 1;
+    }
+    table->maxCode[17] = 0x7FFFFFFF;
+    table->defined = true;
+  }
+  return segment == end;
+}
+
+bool JpegDecoder::ParseQuantTables(const unsigned char* segment, int length) {
+  const unsigned char* end = segment + length;
+  while (segment < end) {
+    int precision = segment[0] >> 4;
+    int tableId = segment[0] & 15;
+    segment++;
+    if (tableId > 3 || segment + (precision ? 128 : 64) > end) {
+      return false;
+    }
+    for (int i = 0; i < 64; i++) {
+      if (precision) {
+        quantTables_[tableId][i] = (unsigned short)((segment[0] << 8) | segment[1]);
+        segment += 2;
+      }
+      else {
+        quantTables_[tableId][i] = *segment++;
+      }
+    }
+  }
+  return true;
+}
+
+bool JpegDecoder::ParseScanHeader(const unsigned char* segment, int length) {
+  if (length < 1 || segment[0] != componentCount_ || length < 4 + 2 * componentCount_) {
+    // Images split into one scan per component aren't supported.
+    return false;
+  }
+  for (int i = 0; i < componentCount_; i++) {
+    int id = segment[1 + 2 * i];
+    int tables = segment[2 + 2 * i];
+    Component* component = NULL;
+    for (int j = 0; j < componentCount_; j++) {
+      if (components_[j].id == id) {
+        component = &components_[j];
+      }
+    }
+    if (component == NULL) {
+      return false;
+    }
+    component->dcTable = (tables >> 4) & 3;
+    component->acTable = tables & 3;
+    if (!dcTables_[component->dcTable].defined || !acTables_[component->acTable].defined) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * Decodes the entropy-coded data following the scan header, one row of MCUs at a time.
+ */
+bool JpegDecoder::DecodeScan() {
+  bits_ = 0;
+  bitCount_ = 0;
+  hitMarker_ = false;
+  for (int i = 0; i < componentCount_; i++) {
+    components_[i].dcPrediction = 0;
+  }
+
+  int mcusToRestart = restartInterval_;
+  for (int mcuY = 0; mcuY < mcusY_; mcuY++) {
+    for (int mcuX = 0; mcuX < mcusX_; mcuX++) {
+      if (restartInterval_ && mcusToRestart-- == 0) {
+        if (!HandleRestart()) {
+          return false;
+        }
+        mcusToRestart = restartInterval_ - 1;
+      }
+
+      for (int i = 0; i < componentCount_; i++) {
+        Component* component = &components_[i];
+        for (int y = 0; y < component->v; y++) {
+          for (int x = 0; x < component->h; x++) {
+            if (!DecodeBlock(component, mcuX * component->h + x, y)) {
+              return false;
+            }
+          }
+        }
+      }
+    }
+    for (int target = 0; target < targetCount_; target++) {
+      ConvertRow(mcuY, target);
+    }
+  }
+  return true;
+}
+
+/*
+ * Decodes the coefficients of one block and transforms them into samples at each target's scale.
+ *
+ * @param blockX The column of the block within the component's row of MCUs.
+ * @param blockY The row of the block within the MCU.
+ */
+bool JpegDecoder::DecodeBlock(Component* component, int blockX, int blockY) {
+  int coefficients[64];
+  memset(coefficients, 0, sizeof(coefficients));
+  const unsigned short* quant = quantTables_[component->quantTable];
+
+  int length = DecodeHuffman(&dcTables_[component->dcTable]);
+  if (length < 0 || length > 11) {
+    return false;
+  }
+  component->dcPrediction += length ? ReceiveExtend(length) : 0;
+  coefficients[0] = component->dcPrediction * quant[0];
+
+  const HuffmanTable* acTable = &acTables_[component->acTable];
+  for (int k = 1; k < 64;) {
+    int symbol = DecodeHuffman(acTable);
+    if (symbol < 0) {
+      return false;
+    }
+    int run = symbol >> 4;
+    length = symbol & 15;
+    if (length == 0) {
+      if (run != 15) {
+        // End of block.
+        break;
+      }
+      k += 16;
+      continue;
+    }
+    k += run;
+    if (k > 63) {
+      return false;
+    }
+    coefficients[kZigzag[k]] = ReceiveExtend(length) * quant[k];
+    k++;
+  }
+
+  // The full-size transform works in place, so it's done after any reduced ones have used the coefficients.
+  int fullTarget = -1;
+  for (int target = 0; target < targetCount_; target++) {
+    int blockSize = 8 / targets_[target].scale;
+    int stride = component->planeStride[target];
+    unsigned char* out = component->plane[target] + blockSize * (blockY * stride + blockX);
+    if (blockSize == 8) {
+      fullTarget = target;
+    }
+    else {
+      ReducedInverseDct(coefficients, blockSize, out, stride);
+    }
+  }
+  if (fullTarget >= 0) {
+    int stride = component->planeStride[fullTarget];
+    InverseDct(coefficients, component->plane[fullTarget] + 8 * (blockY * stride + blockX), stride);
+  }
+  return true;
+}
+
+/*
+ * Converts a decoded row of MCUs of one target from YCbCr to blue, green, red, unused pixels, upsampling the
+ * chroma planes by replication.
+ */
+void JpegDecoder::ConvertRow(int mcuRow, int target) {
+  int scale = targets_[target].scale;
+  int blockSize = 8 / scale;
+  int width = GetScaledSize(width_, scale);
+  int height = GetScaledSize(height_, scale);
+  unsigned char* pixels = targets_[target].pixels;
+  int stride = targets_[target].stride;
+  int firstRow = mcuRow * blockSize * maxV_;
+  int rows = height - firstRow < blockSize * maxV_ ? height - firstRow : blockSize * maxV_;
+
+  const unsigned char* planes[3];
+  int strides[3];
+  int shiftX[3];
+  int shiftY[3];
+  for (int i = 0; i < componentCount_; i++) {
+    planes[i] = components_[i].plane[target];
+    strides[i] = components_[i].planeStride[target];
+    shiftX[i] = 0;
+    shiftY[i] = 0;
+    while ((components_[i].h << shiftX[i]) < maxH_) {
+      shiftX[i]++;
+    }
+    while ((components_[i].v << shiftY[i]) < maxV_) {
+      shiftY[i]++;
+    }
+  }
+
+  for (int y = 0; y < rows; y++) {
+    unsigned char* out = pixels + (firstRow + y) * stride;
+    const unsigned char* lumaRow = planes[0] + (y >> shiftY[0]) * strides[0];
+    if (componentCount_ == 1) {
+      for (int x = 0; x < width; x++) {
+        out[0] = out[1] = out[2] = lumaRow[x];
+        out[3] = 0;
+        out += 4;
+      }
+      continue;
+    }
+
+    const unsigned char* cbRow = planes[1] + (y >> shiftY[1]) * strides[1];
+    const unsigned char* crRow = planes[2] + (y >> shiftY[2]) * strides[2];
+    for (int x = 0; x < width; x++) {
+      int luma = lumaRow[x >> shiftX[0]];
+      int cb = cbRow[x >> shiftX[1]] - 128;
+      int cr = crRow[x >> shiftX[2]] - 128;
+
+      // ITU-R BT.601 conversion as specified by JFIF, with constants scaled by 2^16.
+      out[0] = Clamp(luma + ((116130 * cb + 32768) >> 16));
+      out[1] = Clamp(luma + ((-22553 * cb - 46802 * cr + 32768) >> 16));
+      out[2] = Clamp(luma + ((91881 * cr + 32768) >> 16));
+      out[3] = 0;
+      out += 4;
+    }
+  }
+}
+
+/*
+ * Skips the restart marker expected at the end of a restart interval and resets the decoder state.
+ */
+bool JpegDecoder::HandleRestart() {
+  // Discard any bits left over from the previous interval, then find the RSTn marker.
+  bits_ = 0;
+  bitCount_ = 0;
+  hitMarker_ = false;
+  while (pos_ + 1 < end_) {
+    if (pos_[0] == 0xFF && pos_[1] >= 0xD0 && pos_[1] <= 0xD7) {
+      pos_ += 2;
+      for (int i = 0; i < componentCount_; i++) {
+        components_[i].dcPrediction = 0;
+      }
+      return true;
+    }
+    pos_++;
+  }
+  return false;
+}
+
+/*
+ * Tops up the bit buffer to at least 25 bits. Once a marker is reached, zeros are supplied instead of data.
+ */
+void JpegDecoder::FillBits() {
+  while (bitCount_ <= 24) {
+    unsigned int byte = 0;
+    if (!hitMarker_ && pos_ < end_) {
+      byte = *pos_;
+      if (byte == 0xFF) {
+        if (pos_ + 1 < end_ && pos_[1] == 0) {
+          // A stuffed zero byte follows a literal 0xFF.
+          pos_ += 2;
+        }
+        else {
+          hitMarker_ = true;
+          byte = 0;
+        }
+      }
+      else {
+        pos_++;
+      }
+    }
+    bits_ |= byte << (24 - bitCount_);
+    bitCount_ += 8;
+  }
+}
+
+/*
+ * Decodes one Huffman-coded symbol. Returns -1 if the bits don't form a valid code.
+ */
+int JpegDecoder::DecodeHuffman(const HuffmanTable* table) {
+  if (bitCount_ < 16) {
+    FillBits();
+  }
+
+  unsigned short entry = table->fast[bits_ >> (32 - kFastBits)];
+  if (entry != kSlowCode) {
+    int length = entry >> 8;
+    bits_ <<= length;
+    bitCount_ -= length;
+    return entry & 0xFF;
+  }
+
+  // Longer codes are found by comparing against the upper limit for each code length.
+  int peek = (int)(bits_ >> 16);
+  int length = kFastBits + 1;
+  while (length <= 16 && peek >= table->maxCode[length]) {
+    length++;
+  }
+  if (length > 16) {
+    return -1;
+  }
+  int index = (peek >> (16 - length)) + table->valueOffset[length];
+  if (index < 0 || index > 255) {
+    return -1;
+  }
+  bits_ <<= length;
+  bitCount_ -= length;
+  return table->symbols[index];
+}
+
+/*
+ * Reads a coefficient of the given bit length and extends its sign.
+ */
+int JpegDecoder::ReceiveExtend(int length) {
+  if (bitCount_ < length) {
+    FillBits();
+  }
+  int value = (int)(bits_ >> (32 - length));
+  bits_ <<= length;
+  bitCount_ -= length;
+  if (value < (1 << (length - 1))) {
+    value += 1 - (1 << length);
+  }
+  return value;
+}
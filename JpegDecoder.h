@@ -0,0 +1,87 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing an in-memory decoder for baseline JPEG images.
+ */
+
+#ifndef _JPEG_DECODER_H_
+#define _JPEG_DECODER_H_
+
+#include "FrameDecoder.h"
+
+class JpegDecoder : public FrameDecoder {
+public:
+  JpegDecoder();
+  ~JpegDecoder();
+  virtual bool ReadHeader(const char* data, int size, int* width, int* height);
+  virtual bool Decode(const char* data, int size, unsigned char* pixels, int stride);
+  virtual bool DecodeScaled(const char* data, int size, const DecodeTarget* targets, int targetCount);
+
+  // Most targets which can be decoded into at once.
+  static const int kMaxTargets = 2;
+
+private:
+  // Huffman table with a lookup for short codes and canonical code limits for longer ones.
+  struct HuffmanTable {
+    unsigned short fast[512];
+    unsigned char symbols[256];
+    int maxCode[18];
+    int valueOffset[17];
+    bool defined;
+  };
+
+  // Image component (Y, Cb or Cr) as described by the frame and scan headers.
+  struct Component {
+    int id;
+    int h;
+    int v;
+    int quantTable;
+    int dcTable;
+    int acTable;
+    int dcPrediction;
+    unsigned char* plane[kMaxTargets];
+    int planeStride[kMaxTargets];
+  };
+
+  bool ParseHeaders(bool headerOnly);
+  bool ParseFrameHeader(const unsigned char* segment, int length);
+  bool ParseHuffmanTables(const unsigned char* segment, int length);
+  bool ParseQuantTables(const unsigned char* segment, int length);
+  bool ParseScanHeader(const unsigned char* segment, int length);
+  bool DecodeScan();
+  bool DecodeBlock(Component* component, int blockX, int blockY);
+  void ConvertRow(int mcuRow, int target);
+  bool HandleRestart();
+  void FillBits();
+  int DecodeHuffman(const HuffmanTable* table);
+  int ReceiveExtend(int length);
+
+  const unsigned char* data_;
+  const unsigned char* end_;
+  const unsigned char* pos_;
+  unsigned int bits_;
+  int bitCount_;
+  bool hitMarker_;
+
+  int width_;
+  int height_;
+  int componentCount_;
+  int maxH_;
+  int maxV_;
+  int mcusX_;
+  int mcusY_;
+  int restartInterval_;
+  Component components_[3];
+  unsigned short quantTables_[4][64];
+  HuffmanTable dcTables_[4];
+  HuffmanTable acTables_[4];
+
+  DecodeTarget targets_[kMaxTargets];
+  int targetCount_;
+
+  unsigned char* planes_;
+  int planesSize_;
+};
+
+#endif // _JPEG_DECODER_H_
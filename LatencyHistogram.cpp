@@ -0,0 +1,99 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a histogram of latencies, from which percentiles can be read.
+ *
+ * Latencies are counted in microseconds. Below 64 us each microsecond has its own bucket. Above that, each
+ * doubling of the latency is split into 32 buckets, so a percentile is accurate to within about 3% however many
+ * samples are recorded, and the histogram takes the same space for a second as for a day.
+ */
+
+#include "LatencyHistogram.h"
+
+#include <string.h>
+
+LatencyHistogram::LatencyHistogram() {
+  Clear();
+}
+
+void LatencyHistogram::Record(double milliseconds) {
+  double microseconds = milliseconds * 1000 + 0.5;
+  unsigned int bucketed = microseconds < 0 ? 0 : (microseconds > 2e9 ? 2000000000u : (unsigned int)microseconds);
+  counts_[GetBucket(bucketed)]++;
+  count_++;
+  total_ += milliseconds;
+  if (milliseconds > max_) {
+    max_ = milliseconds;
+  }
+}
+
+void LatencyHistogram::Clear() {
+  memset(counts_, 0, sizeof(counts_));
+  count_ = 0;
+  total_ = 0;
+  max_ = 0;
+}
+
+int LatencyHistogram::GetCount() {
+  return count_;
+}
+
+/*
+ * Returns the sum of every latency recorded, in milliseconds.
+ */
+double LatencyHistogram::GetTotal() {
+  return total_;
+}
+
+double LatencyHistogram::GetMax() {
+  return max_;
+}
+
+/*
+ * Returns the latency in milliseconds below which the given percentage of the recorded latencies fall.
+ */
+double LatencyHistogram::GetPercentile(double percentile) {
+  if (count_ == 0) {
+    return 0;
+  }
+  int rank = (int)(percentile / 100 * count_ + 0.999999);
+  if (rank < 1) {
+    rank = 1;
+  }
+  int seen = 0;
+  for (int bucket = 0; bucket < kBucketCount; bucket++) {
+    seen += counts_[bucket];
+    if (seen >= rank) {
+      // The middle of the bucket is the best estimate, but no latency was higher than the maximum.
+      double middle = GetBucketMiddle(bucket) / 1000;
+      return middle < max_ ? middle : max_;
+    }
+  }
+  return max_;
+}
+
+/*
+ * Returns the bucket counting the given latency. Values are halved until they fit in the first two octaves of
+ * buckets, and the number of halvings selects the octave.
+ */
+int LatencyHistogram::GetBucket(unsigned int microseconds) {
+  int shift = 0;
+  while (microseconds >= 2 * kSubBuckets) {
+    microseconds >>= 1;
+    shift++;
+  }
+  return shift * kSubBuckets + microseconds;
+}
+
+/*
+ * Returns the latency in microseconds in the middle of the range counted by a bucket.
+ */
+double LatencyHistogram::GetBucketMiddle(int bucket) {
+  int shift = bucket / kSubBuckets - 1;
+  if (shift <= 0) {
+    return bucket;
+  }
+  int value = bucket - shift * kSubBuckets;
+  return ((double)value + 0.5) * (1 << shift);
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a histogram of latencies, from which percentiles can be read.
+ */
+
+#ifndef _LATENCY_HISTOGRAM_H_
+#define _LATENCY_HISTOGRAM_H_
+
+class LatencyHistogram {
+public:
+  LatencyHistogram();
+  void Record(double milliseconds);
+  void Clear();
+  int GetCount();
+  double GetTotal();
+  double GetMax();
+  double GetPercentile(double percentile);
+
+private:
+  enum {
+    kSubBuckets = 32,
+    kOctaves = 27,
+    kBucketCount = (kOctaves + 1) * kSubBuckets
+  };
+
+  static int GetBucket(unsigned int microseconds);
+  static double GetBucketMiddle(int bucket);
+
+  int counts_[kBucketCount];
+  int count_;
+  double total_;
+  double max_;
+};
+
+#endif // _LATENCY_HISTOGRAM_H_
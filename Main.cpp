@@ -6,11 +6,63 @@
  */
 
 #include "AppWindow.h"
+#include "Benchmark.h"
+#include "FakeCamera.h"
+#include "ResultMonitor.h"
 #include <Windows.h>
+#include <stdlib.h>
 
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR szCmdLine, int iCmdShow) {
-  // Create and display the main window.
+  // Run the headless benchmarks instead of the application if requested, e.g. "-benchmark stream.mjpg".
+  if (strncmp(szCmdLine, "-benchmark ", 11) == 0) {
+    Benchmark benchmark(szCmdLine + 11);
+    return benchmark.Run();
+  }
+
+  // Serve recorded frames in place of the camera if requested, e.g. "-fakecamera stream.mjpg".
+  if (strncmp(szCmdLine, "-fakecamera ", 12) == 0) {
+    FakeCamera fakeCamera(szCmdLine + 12);
+    return fakeCamera.Run();
+  }
+
+  // Print the results published for a camera by another instance if requested, e.g. "-results 0".
+  if (strncmp(szCmdLine, "-results", 8) == 0) {
+    ResultMonitor monitor(atoi(szCmdLine + 8));
+    return monitor.Run();
+  }
+
+  // Record the camera's frames to an archive, or replay an archive instead of connecting to the camera, if
+  // requested, e.g. "-record match.frames" or "-replay match.frames".
   AppWindow mainWindow;
+  if (strncmp(szCmdLine, "-record ", 8) == 0) {
+    mainWindow.GetCamera()->SetRecordFile(szCmdLine + 8);
+  }
+  else if (strncmp(szCmdLine, "-replay ", 8) == 0) {
+    mainWindow.GetCamera()->SetReplayFile(szCmdLine + 8);
+  }
+  else if (strncmp(szCmdLine, "-camera ", 8) == 0) {
+    // Connect to a camera at another address, e.g. "-camera 127.0.0.1:8080" for a fake camera.
+    char* address = szCmdLine + 8;
+    char* port = strchr(address, ':');
+    if (port != NULL) {
+      *port++ = 0;
+    }
+    mainWindow.GetCamera()->SetAddress(address, port != NULL ? atoi(port) : PORT);
+  }
+  else if (strncmp(szCmdLine, "-cameras ", 9) == 0) {
+    // Receive from several cameras at once, e.g. "-cameras 10.0.0.90:80,10.0.0.91:80".
+    char* context = NULL;
+    for (char* address = strtok_s(szCmdLine + 9, ",", &context); address != NULL;
+         address = strtok_s(NULL, ",", &context)) {
+      char* port = strchr(address, ':');
+      if (port != NULL) {
+        *port++ = 0;
+      }
+      mainWindow.GetCamera()->AddStream(address, port != NULL ? atoi(port) : PORT);
+    }
+  }
+
+  // Create and display the main window.
   mainWindow.Create(hInstance);
   ShowWindow(mainWindow.GetHWnd(), iCmdShow);
   UpdateWindow(mainWindow.GetHWnd());
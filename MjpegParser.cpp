@@ -0,0 +1,294 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a streaming parser for multipart/x-mixed-replace (MJPEG) HTTP responses.
+ */
+
+#include "MjpegParser.h"
+
+#include "Platform.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Largest block of headers that is buffered before the stream is considered corrupt.
+static const int kMaxHeaderSize = 4096;
+
+/*
+ * Finds the first occurrence of the given byte sequence within [begin, end). Returns NULL if not found.
+ */
+static const char* FindBytes(const char* begin, const char* end, const char* pattern, int length) {
+  const char* last = end - length;
+  while (begin <= last) {
+    const char* match = (const char*)memchr(begin, pattern[0], last - begin + 1);
+    if (match == NULL) {
+      return NULL;
+    }
+    if (memcmp(match, pattern, length) == 0) {
+      return match;
+    }
+    begin = match + 1;
+  }
+  return NULL;
+}
+
+/*
+ * Finds the given text within [begin, end), ignoring case. If atLineStart is set, only matches at the start
+ * of a line are considered. Returns a pointer to the first character following the match, or NULL.
+ */
+static const char* FindText(const char* begin, const char* end, const char* text, bool atLineStart) {
+  int length = (int)strlen(text);
+  for (const char* p = begin; p + length <= end; p++) {
+    if (atLineStart && p != begin && p[-1] != '\n') {
+      continue;
+    }
+    if (_strnicmp(p, text, length) == 0) {
+      return p + length;
+    }
+  }
+  return NULL;
+}
+
+/*
+ * Creates a parser whose buffer can hold the given number of bytes. Frames larger than this cannot be parsed.
+ */
+MjpegParser::MjpegParser(int capacity) {
+  buffer_ = new char[capacity];
+  capacity_ = capacity;
+  frameCount_ = 0;
+  resyncCount_ = 0;
+  Reset();
+}
+
+MjpegParser::~MjpegParser() {
+  delete[] buffer_;
+}
+
+/*
+ * Discards all buffered data, in preparation for parsing a new stream.
+ */
+void MjpegParser::Reset() {
+  readPos_ = 0;
+  writePos_ = 0;
+  scanPos_ = 0;
+  state_ = kHeaders;
+  contentLength_ = -1;
+  boundary_[0] = 0;
+  boundaryLength_ = 0;
+}
+
+/*
+ * Returns the free space at the end of the buffer into which new stream data should be received. Any frame
+ * previously returned by NextFrame() is invalidated by this call.
+ *
+ * @param space Set to the number of bytes that may be written.
+ */
+char* MjpegParser::GetWriteBuffer(int* space) {
+  if (readPos_ == writePos_) {
+    // Everything has been consumed, so start again at the front of the buffer for free.
+    readPos_ = 0;
+    writePos_ = 0;
+    scanPos_ = 0;
+  }
+  else if (readPos_ > 0 && capacity_ - writePos_ < capacity_ / 4) {
+    // Slide the unconsumed tail to the front once space runs low. This keeps every frame contiguous in the
+    // buffer, so frames can be handed out in place instead of being copied out of a wrapping ring.
+    memmove(buffer_, buffer_ + readPos_, writePos_ - readPos_);
+    writePos_ -= readPos_;
+    scanPos_ -= readPos_;
+    readPos_ = 0;
+  }
+
+  if (writePos_ == capacity_) {
+    // The buffer is full of data which doesn't form a frame, so throw it away and look for the next part.
+    Resync();
+  }
+
+  *space = capacity_ - writePos_;
+  return buffer_ + writePos_;
+}
+
+/*
+ * Records that the given number of bytes were written into the space returned by GetWriteBuffer().
+ */
+void MjpegParser::CommitWrite(int bytes) {
+  writePos_ += bytes;
+}
+
+/*
+ * Extracts the next complete JPEG image from the buffered stream data. The image is not copied; the returned
+ * pointer refers to the parser's buffer and remains valid until the next call to GetWriteBuffer().
+ *
+ * @return True if a frame was found, or false if more data must be received first.
+ */
+bool MjpegParser::NextFrame(const char** frame, int* frameSize) {
+  while (1) {
+    if (state_ == kHeaders) {
+      if (!ParseHeaders()) {
+        return false;
+      }
+    }
+    else {
+      if (!ParseBody(frame, frameSize)) {
+        return false;
+      }
+
+      // Only hand out parts which look like JPEG images; anything else is the remains of a corrupt part.
+      if (*frameSize >= 2 && (unsigned char)(*frame)[0] == 0xFF && (unsigned char)(*frame)[1] == 0xD8) {
+        frameCount_++;
+        return true;
+      }
+      resyncCount_++;
+    }
+  }
+}
+
+/*
+ * Consumes the next block of headers, which is either the HTTP response header or the header of a part.
+ *
+ * @return True if a block was consumed, or false if more data is needed.
+ */
+bool MjpegParser::ParseHeaders() {
+  // Search for the double CRLF separating the headers from the content, resuming where the last search left off.
+  const char* begin = buffer_ + readPos_;
+  const char* searchStart = buffer_ + (scanPos_ - 3 > readPos_ ? scanPos_ - 3 : readPos_);
+  const char* headerEnd = FindBytes(searchStart, buffer_ + writePos_, "\r\n\r\n", 4);
+  if (headerEnd == NULL) {
+    scanPos_ = writePos_;
+    if (writePos_ - readPos_ > kMaxHeaderSize) {
+      // Too much data without a header terminator; skip most of it but keep enough to catch a split header.
+      readPos_ = writePos_ - 256;
+      resyncCount_++;
+    }
+    return false;
+  }
+  headerEnd += 4;
+
+  if (headerEnd - begin >= 5 && _strnicmp(begin, "HTTP/", 5) == 0) {
+    // This is the response header; remember the part delimiter given in its Content-Type.
+    const char* boundary = FindText(begin, headerEnd, "boundary=", false);
+    if (boundary) {
+      if (*boundary == '"') {
+        boundary++;
+      }
+      boundaryLength_ = 0;
+      if (boundary[0] != '-' || boundary[1] != '-') {
+        boundary_[boundaryLength_++] = '-';
+        boundary_[boundaryLength_++] = '-';
+      }
+      while (boundary < headerEnd && boundaryLength_ < (int)sizeof(boundary_) - 1 &&
+             strchr("\";\r\n ", *boundary) == NULL) {
+        boundary_[boundaryLength_++] = *boundary++;
+      }
+      boundary_[boundaryLength_] = 0;
+    }
+  }
+  else {
+    const char* contentLength = FindText(begin, headerEnd, "Content-Length:", true);
+    if (contentLength) {
+      while (*contentLength == ' ' || *contentLength == '\t') {
+        contentLength++;
+      }
+      contentLength_ = atol(contentLength);
+      if (contentLength_ <= 0 || contentLength_ > capacity_ / 2) {
+        // Implausible length; fall back to searching for the end of the part instead.
+        contentLength_ = -1;
+      }
+      state_ = kBody;
+    }
+    else if (FindText(begin, headerEnd, "Content-Type:", true) ||
+             (boundaryLength_ > 0 && FindBytes(begin, headerEnd, boundary_, boundaryLength_))) {
+      // A part with no length given; its end will be found by searching for the delimiter.
+      contentLength_ = -1;
+      state_ = kBody;
+    }
+    // Otherwise this is a stray blank line or garbage between parts, which is simply skipped.
+  }
+
+  readPos_ = (int)(headerEnd - buffer_);
+  scanPos_ = readPos_;
+  return true;
+}
+
+/*
+ * Locates the end of the current part's content.
+ *
+ * @return True if the whole part has been received, or false if more data is needed.
+ */
+bool MjpegParser::ParseBody(const char** frame, int* frameSize) {
+  const char* begin = buffer_ + readPos_;
+  const char* end = buffer_ + writePos_;
+
+  if (contentLength_ >= 0) {
+    if (writePos_ - readPos_ < contentLength_) {
+      return false;
+    }
+    *frame = begin;
+    *frameSize = contentLength_;
+    readPos_ += contentLength_;
+
+    // A part that was cut short swallows the start of the next one, so look for a delimiter inside the content to
+    // resume from. The content's last bytes can't rule this out, as the part swallowed may end with an end-of-image
+    // marker of its own.
+    if (boundaryLength_ > 0) {
+      const char* match = FindBytes(begin, begin + contentLength_, boundary_, boundaryLength_);
+      if (match) {
+        *frameSize = 0;
+        readPos_ = (int)(match - buffer_);
+      }
+    }
+  }
+  else {
+    // Without a Content-Length, the part ends at the next delimiter, or at the JPEG end-of-image marker if the
+    // response didn't declare a boundary.
+    const char* delimiter = boundaryLength_ > 0 ? boundary_ : "\xFF\xD9";
+    int delimiterLength = boundaryLength_ > 0 ? boundaryLength_ : 2;
+    const char* searchStart =
+        buffer_ + (scanPos_ - delimiterLength + 1 > readPos_ ? scanPos_ - delimiterLength + 1 : readPos_);
+    const char* match = FindBytes(searchStart, end, delimiter, delimiterLength);
+    if (match == NULL) {
+      scanPos_ = writePos_;
+      return false;
+    }
+
+    *frame = begin;
+    if (boundaryLength_ > 0) {
+      // Leave the delimiter in the buffer to be parsed with the next part's headers, and drop the CRLF
+      // preceding it, which belongs to the delimiter rather than the content.
+      *frameSize = (int)(match - begin);
+      if (*frameSize >= 2 && match[-2] == '\r' && match[-1] == '\n') {
+        *frameSize -= 2;
+      }
+      readPos_ = (int)(match - buffer_);
+    }
+    else {
+      *frameSize = (int)(match + 2 - begin);
+      readPos_ = (int)(match + 2 - buffer_);
+    }
+  }
+
+  scanPos_ = readPos_;
+  state_ = kHeaders;
+  contentLength_ = -1;
+  return true;
+}
+
+/*
+ * Discards all buffered data after corruption and resumes by searching for the next part's headers.
+ */
+void MjpegParser::Resync() {
+  resyncCount_++;
+  readPos_ = 0;
+  writePos_ = 0;
+  scanPos_ = 0;
+  state_ = kHeaders;
+  contentLength_ = -1;
+}
+
+int MjpegParser::GetFrameCount() {
+  return frameCount_;
+}
+
+int MjpegParser::GetResyncCount() {
+  return resyncCount_;
+}
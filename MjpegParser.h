@@ -0,0 +1,45 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a streaming parser for multipart/x-mixed-replace (MJPEG) HTTP responses.
+ */
+
+#ifndef _MJPEG_PARSER_H_
+#define _MJPEG_PARSER_H_
+
+class MjpegParser {
+public:
+  MjpegParser(int capacity);
+  ~MjpegParser();
+  char* GetWriteBuffer(int* space);
+  void CommitWrite(int bytes);
+  bool NextFrame(const char** frame, int* frameSize);
+  void Reset();
+  int GetFrameCount();
+  int GetResyncCount();
+
+private:
+  enum State {
+    kHeaders,
+    kBody
+  };
+
+  bool ParseHeaders();
+  bool ParseBody(const char** frame, int* frameSize);
+  void Resync();
+
+  char* buffer_;
+  int capacity_;
+  int readPos_;
+  int writePos_;
+  int scanPos_;
+  State state_;
+  int contentLength_;
+  char boundary_[76];
+  int boundaryLength_;
+  int frameCount_;
+  int resyncCount_;
+};
+
+#endif // _MJPEG_PARSER_H_
@@ -0,0 +1,458 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a connected-component analysis of a binary image, which finds each particle and measures
+ * it in a single pass.
+ *
+ * The image is scanned one row at a time, reduced to runs of non-zero pixels. Each run is joined to the runs it
+ * touches in the row above with a union-find structure, and its pixels are added to running sums for its
+ * provisional label straight away. Once the scan is done, the sums of labels which turned out to be the same
+ * particle are folded together, and every measurement is derived from the sums. The image is read exactly once
+ * and the work after that depends only on the number of runs, so the cost barely changes between a mask with
+ * one particle and one with hundreds.
+ *
+ * The image can also be split into bands of rows, or tiles, which are scanned independently, so that they can be
+ * spread across threads. Each tile keeps the runs of its first and last rows, and once every tile is done, the
+ * runs either side of each seam are joined in the same way as those of neighbouring rows.
+ *
+ * The perimeter is the length of the particle's boundary along pixel edges, including the boundaries of any
+ * holes. It is exact for horizontal and vertical edges and overestimates diagonal ones by up to a factor of
+ * root two.
+ */
+
+#include "ParticleAnalysis.h"
+
+#include <algorithm>
+#include <math.h>
+
+static const double kPi = 3.14159265358979323846;
+
+int ParticleTable::GetCount() {
+  return (int)columns_[kArea].size();
+}
+
+double ParticleTable::Get(Measurement measurement, int particle) {
+  return columns_[measurement][particle];
+}
+
+/*
+ * Returns the values of one measurement for every particle, which remain valid until the table is changed.
+ */
+const double* ParticleTable::GetColumn(Measurement measurement) {
+  return columns_[measurement].empty() ? NULL : &columns_[measurement][0];
+}
+
+/*
+ * Removes every particle. The storage is kept for the next frame.
+ */
+void ParticleTable::Clear() {
+  for (int i = 0; i < kMeasurementCount; i++) {
+    columns_[i].clear();
+  }
+}
+
+/*
+ * Adds a particle with every measurement set to zero.
+ *
+ * @return The index of the new particle.
+ */
+int ParticleTable::Add() {
+  for (int i = 0; i < kMeasurementCount; i++) {
+    columns_[i].push_back(0);
+  }
+  return GetCount() - 1;
+}
+
+void ParticleTable::Set(Measurement measurement, int particle, double value) {
+  columns_[measurement][particle] = value;
+}
+
+/*
+ * Removes the particles for which the given measurement is outside the inclusive range.
+ */
+void ParticleTable::Filter(Measurement measurement, double minValue, double maxValue) {
+  int count = GetCount();
+  int kept = 0;
+  for (int particle = 0; particle < count; particle++) {
+    double value = columns_[measurement][particle];
+    if (value < minValue || value > maxValue) {
+      continue;
+    }
+    if (kept != particle) {
+      for (int i = 0; i < kMeasurementCount; i++) {
+        columns_[i][kept] = columns_[i][particle];
+      }
+    }
+    kept++;
+  }
+  for (int i = 0; i < kMeasurementCount; i++) {
+    columns_[i].resize(kept);
+  }
+}
+
+// Orders particle indices by the value of one measurement.
+struct ParticleOrder {
+  const double* values;
+  bool descending;
+
+  bool operator()(int first, int second) const {
+    return descending ? values[first] > values[second] : values[first] < values[second];
+  }
+};
+
+/*
+ * Sorts the particles by the given measurement. Particles with equal values stay in the order they were in.
+ */
+void ParticleTable::Sort(Measurement measurement, bool descending) {
+  int count = GetCount();
+  if (count < 2) {
+    return;
+  }
+  std::vector<int> order(count);
+  for (int particle = 0; particle < count; particle++) {
+    order[particle] = particle;
+  }
+  ParticleOrder compare;
+  compare.values = &columns_[measurement][0];
+  compare.descending = descending;
+  std::stable_sort(order.begin(), order.end(), compare);
+  Reorder(order);
+}
+
+/*
+ * Moves every particle by the given offset, for particles found in part of a larger image.
+ */
+void ParticleTable::Translate(double dx, double dy) {
+  int count = GetCount();
+  for (int particle = 0; particle < count; particle++) {
+    columns_[kCenterX][particle] += dx;
+    columns_[kLeft][particle] += dx;
+    columns_[kRight][particle] += dx;
+    columns_[kCenterY][particle] += dy;
+    columns_[kTop][particle] += dy;
+    columns_[kBottom][particle] += dy;
+  }
+}
+
+/*
+ * Rearranges every measurement so that particle i becomes the particle previously at order[i].
+ */
+void ParticleTable::Reorder(const std::vector<int>& order) {
+  int count = GetCount();
+  scratch_.resize(count);
+  for (int i = 0; i < kMeasurementCount; i++) {
+    for (int particle = 0; particle < count; particle++) {
+      scratch_[particle] = columns_[i][order[particle]];
+    }
+    columns_[i].swap(scratch_);
+  }
+}
+
+ParticleAnalysis::ParticleAnalysis() {
+}
+
+/*
+ * Finds the particles in the given mask and fills in the table with their measurements, in the order their
+ * first pixels appear in the image.
+ *
+ * @param mask The binary image, in which any non-zero pixel is part of a particle.
+ * @param stride The distance in bytes between the start of each row.
+ * @param connectivity8 Whether pixels which only touch diagonally are part of the same particle.
+ */
+void ParticleAnalysis::Analyze(const unsigned char* mask, int stride, int width, int height, bool connectivity8,
+                               ParticleTable* table) {
+  SetTileCount(1);
+  AnalyzeTile(0, mask, stride, width, 0, height, connectivity8);
+  MergeTiles(connectivity8, table);
+}
+
+/*
+ * Sets the number of tiles the next mask is analyzed in. Each tile is a band of rows covering the whole width,
+ * and the bands must follow one another down the mask without gaps.
+ */
+void ParticleAnalysis::SetTileCount(int tileCount) {
+  tiles_.resize(tileCount);
+}
+
+/*
+ * Finds the particles within one tile of the mask. Different tiles can be analyzed on different threads at the
+ * same time, and once they all have been, MergeTiles joins the particles which cross from one to the next.
+ *
+ * @param mask The whole mask, from its first row.
+ * @param top The first row of the tile.
+ * @param bottom The row after the last row of the tile.
+ */
+void ParticleAnalysis::AnalyzeTile(int tile, const unsigned char* mask, int stride, int width, int top, int bottom,
+                                   bool connectivity8) {
+  Tile* current = &tiles_[tile];
+  current->parents.clear();
+  current->sums.clear();
+  current->firstRuns.clear();
+  current->lastRuns.clear();
+
+  // Runs in neighbouring rows touch if their columns overlap, or with 8-connectivity, are adjacent.
+  int slack = connectivity8 ? 1 : 0;
+  std::vector<Run>& previousRuns = current->lastRuns;
+  std::vector<Run>& currentRuns = current->currentRuns;
+  for (int y = top; y < bottom; y++) {
+    FindRuns(mask + y * stride, width, &currentRuns);
+
+    // Both rows of runs are in order, so a single sweep finds every pair which touches.
+    unsigned int first = 0;
+    for (unsigned int i = 0; i < currentRuns.size(); i++) {
+      Run* run = &currentRuns[i];
+      while (first < previousRuns.size() && previousRuns[first].end < run->start - slack) {
+        first++;
+      }
+      int label = -1;
+      for (unsigned int j = first; j < previousRuns.size() && previousRuns[j].start <= run->end + slack; j++) {
+        label = (label < 0) ? Find(&current->parents, previousRuns[j].label)
+                            : Union(&current->parents, label, previousRuns[j].label);
+
+        // Where pixels are directly above one another, neither has a boundary edge between them.
+        int overlap = std::min(run->end, previousRuns[j].end) - std::max(run->start, previousRuns[j].start) + 1;
+        if (overlap > 0) {
+          current->sums[label].edges -= 2 * overlap;
+        }
+      }
+      if (label < 0) {
+        label = NewLabel(&current->parents, &current->sums);
+      }
+      run->label = label;
+      AddRun(&current->sums[label], y, run->start, run->end);
+    }
+    if (y == top) {
+      current->firstRuns = currentRuns;
+    }
+    previousRuns.swap(currentRuns);
+  }
+
+  // A label's root always has a lower number than the label itself, so every root is final by the time its
+  // descendants are folded into it. Each label is left pointing straight at its root.
+  for (unsigned int label = 0; label < current->parents.size(); label++) {
+    int root = Find(&current->parents, label);
+    current->parents[label] = root;
+    if (root != (int)label) {
+      Merge(&current->sums[root], current->sums[label]);
+    }
+  }
+  for (unsigned int i = 0; i < current->firstRuns.size(); i++) {
+    current->firstRuns[i].label = current->parents[current->firstRuns[i].label];
+  }
+  for (unsigned int i = 0; i < current->lastRuns.size(); i++) {
+    current->lastRuns[i].label = current->parents[current->lastRuns[i].label];
+  }
+}
+
+/*
+ * Joins the particles of every tile which touch across the seams between them, and fills in the table with
+ * their measurements, in the order their first pixels appear in the image. The table is exactly the same as
+ * analyzing the whole mask as one tile would give.
+ */
+void ParticleAnalysis::MergeTiles(bool connectivity8, ParticleTable* table) {
+  table->Clear();
+
+  // The labels of each tile follow on from those of the tile above, so they are still numbered in the order
+  // their first runs appear, and the lowest label of a particle is still that of its first run.
+  std::vector<int> offsets(tiles_.size());
+  int labelCount = 0;
+  for (unsigned int tile = 0; tile < tiles_.size(); tile++) {
+    offsets[tile] = labelCount;
+    labelCount += (int)tiles_[tile].parents.size();
+  }
+  parents_.resize(labelCount);
+  sums_.resize(labelCount);
+  for (unsigned int tile = 0; tile < tiles_.size(); tile++) {
+    const Tile& current = tiles_[tile];
+    for (unsigned int label = 0; label < current.parents.size(); label++) {
+      parents_[offsets[tile] + label] = offsets[tile] + current.parents[label];
+      sums_[offsets[tile] + label] = current.sums[label];
+    }
+  }
+
+  // Join the runs on either side of each seam in the same way as the runs of neighbouring rows within a tile.
+  int slack = connectivity8 ? 1 : 0;
+  for (unsigned int tile = 1; tile < tiles_.size(); tile++) {
+    const std::vector<Run>& above = tiles_[tile - 1].lastRuns;
+    const std::vector<Run>& below = tiles_[tile].firstRuns;
+    unsigned int first = 0;
+    for (unsigned int i = 0; i < below.size(); i++) {
+      const Run& run = below[i];
+      while (first < above.size() && above[first].end < run.start - slack) {
+        first++;
+      }
+      for (unsigned int j = first; j < above.size() && above[j].start <= run.end + slack; j++) {
+        int label = Union(&parents_, offsets[tile] + run.label, offsets[tile - 1] + above[j].label);
+        int overlap = std::min(run.end, above[j].end) - std::max(run.start, above[j].start) + 1;
+        if (overlap > 0) {
+          sums_[label].edges -= 2 * overlap;
+        }
+      }
+    }
+  }
+
+  // Fold the roots of each tile into the roots of the particles they joined, then measure each particle. Every
+  // sum is a whole number, so the order they're added in makes no difference to the measurements.
+  for (unsigned int tile = 0; tile < tiles_.size(); tile++) {
+    const Tile& current = tiles_[tile];
+    for (unsigned int label = 0; label < current.parents.size(); label++) {
+      if (current.parents[label] != (int)label) {
+        continue;
+      }
+      int root = Find(&parents_, offsets[tile] + label);
+      if (root != offsets[tile] + (int)label) {
+        Merge(&sums_[root], sums_[offsets[tile] + label]);
+      }
+    }
+  }
+  for (unsigned int label = 0; label < parents_.size(); label++) {
+    if (parents_[label] == (int)label) {
+      Measure(sums_[label], table);
+    }
+  }
+}
+
+/*
+ * Finds the runs of non-zero pixels in a row.
+ */
+void ParticleAnalysis::FindRuns(const unsigned char* row, int width, std::vector<Run>* runs) {
+  runs->clear();
+  int x = 0;
+  while (x < width) {
+    while (x < width && row[x] == 0) {
+      x++;
+    }
+    if (x == width) {
+      break;
+    }
+    Run run;
+    run.start = x;
+    while (x < width && row[x] != 0) {
+      x++;
+    }
+    run.end = x - 1;
+    run.label = -1;
+    runs->push_back(run);
+  }
+}
+
+int ParticleAnalysis::NewLabel(std::vector<int>* parents, std::vector<Sums>* sums) {
+  int label = (int)parents->size();
+  parents->push_back(label);
+  Sums empty;
+  empty.area = 0;
+  empty.sumX = 0;
+  empty.sumY = 0;
+  empty.sumXX = 0;
+  empty.sumXY = 0;
+  empty.sumYY = 0;
+  empty.edges = 0;
+  empty.left = 0x7fffffff;
+  empty.top = 0x7fffffff;
+  empty.right = -1;
+  empty.bottom = -1;
+  sums->push_back(empty);
+  return label;
+}
+
+/*
+ * Returns the root of the given label, halving the path to it along the way.
+ */
+int ParticleAnalysis::Find(std::vector<int>* parents, int label) {
+  std::vector<int>& parent = *parents;
+  while (parent[label] != label) {
+    parent[label] = parent[parent[label]];
+    label = parent[label];
+  }
+  return label;
+}
+
+/*
+ * Joins the sets containing the two labels, keeping the lower root.
+ *
+ * @return The root of the joined set.
+ */
+int ParticleAnalysis::Union(std::vector<int>* parents, int first, int second) {
+  first = Find(parents, first);
+  second = Find(parents, second);
+  if (first < second) {
+    (*parents)[second] = first;
+    return first;
+  }
+  (*parents)[first] = second;
+  return second;
+}
+
+/*
+ * Adds the pixels of a run to the sums for a label.
+ */
+void ParticleAnalysis::AddRun(Sums* sums, int y, int start, int end) {
+  double length = end - start + 1;
+  double sumX = 0.5 * length * (start + end);
+
+  // The sum of x squared over the run, as the difference of two sums of squares from zero.
+  double sumXX = (end * (end + 1.0) * (2.0 * end + 1) - (start - 1.0) * start * (2.0 * start - 1)) / 6;
+
+  sums->area += length;
+  sums->sumX += sumX;
+  sums->sumY += length * y;
+  sums->sumXX += sumXX;
+  sums->sumXY += sumX * y;
+  sums->sumYY += length * y * y;
+  sums->edges += 2 * length + 2;
+  sums->left = std::min(sums->left, start);
+  sums->right = std::max(sums->right, end);
+  sums->top = std::min(sums->top, y);
+  sums->bottom = std::max(sums->bottom, y);
+}
+
+void ParticleAnalysis::Merge(Sums* into, const Sums& from) {
+  into->area += from.area;
+  into->sumX += from.sumX;
+  into->sumY += from.sumY;
+  into->sumXX += from.sumXX;
+  into->sumXY += from.sumXY;
+  into->sumYY += from.sumYY;
+  into->edges += from.edges;
+  into->left = std::min(into->left, from.left);
+  into->top = std::min(into->top, from.top);
+  into->right = std::max(into->right, from.right);
+  into->bottom = std::max(into->bottom, from.bottom);
+}
+
+/*
+ * Derives the measurements of a particle from its sums and adds it to the table. The bounding box is inclusive.
+ * The orientation of the major axis is in degrees from 0 to 180, anticlockwise from horizontal as displayed, and
+ * the eccentricity is that of the ellipse with the same second moments, from 0 for a circle towards 1.
+ */
+void ParticleAnalysis::Measure(const Sums& sums, ParticleTable* table) {
+  double centerX = sums.sumX / sums.area;
+  double centerY = sums.sumY / sums.area;
+
+  // Second moments about the center, and the variances along the major and minor axes.
+  double xx = sums.sumXX / sums.area - centerX * centerX;
+  double xy = sums.sumXY / sums.area - centerX * centerY;
+  double yy = sums.sumYY / sums.area - centerY * centerY;
+  double spread = sqrt(0.25 * (xx - yy) * (xx - yy) + xy * xy);
+  double major = 0.5 * (xx + yy) + spread;
+  double minor = 0.5 * (xx + yy) - spread;
+
+  // Rows count downwards, so the angle is negated to make it anticlockwise on screen.
+  double orientation = -0.5 * atan2(2 * xy, xx - yy) * 180 / kPi;
+  if (orientation < 0) {
+    orientation += 180;
+  }
+
+  int particle = table->Add();
+  table->Set(ParticleTable::kArea, particle, sums.area);
+  table->Set(ParticleTable::kCenterX, particle, centerX);
+  table->Set(ParticleTable::kCenterY, particle, centerY);
+  table->Set(ParticleTable::kLeft, particle, sums.left);
+  table->Set(ParticleTable::kTop, particle, sums.top);
+  table->Set(ParticleTable::kRight, particle, sums.right);
+  table->Set(ParticleTable::kBottom, particle, sums.bottom);
+  table->Set(ParticleTable::kOrientation, particle, orientation);
+  table->Set(ParticleTable::kEccentricity, particle, major > 0 ? sqrt(std::max(0.0, 1 - minor / major)) : 0);
+  table->Set(ParticleTable::kPerimeter, particle, sums.edges);
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a connected-component analysis of a binary image, which finds each particle and measures
+ * it in a single pass, optionally over several tiles of the image at once.
+ */
+
+#ifndef _PARTICLE_ANALYSIS_H_
+#define _PARTICLE_ANALYSIS_H_
+
+#include <vector>
+
+// Measurements of a set of particles, stored as one array per measurement.
+class ParticleTable {
+public:
+  enum Measurement {
+    kArea,
+    kCenterX,
+    kCenterY,
+    kLeft,
+    kTop,
+    kRight,
+    kBottom,
+    kOrientation,
+    kEccentricity,
+    kPerimeter,
+    kMeasurementCount
+  };
+
+  int GetCount();
+  double Get(Measurement measurement, int particle);
+  const double* GetColumn(Measurement measurement);
+  void Clear();
+  int Add();
+  void Set(Measurement measurement, int particle, double value);
+  void Filter(Measurement measurement, double minValue, double maxValue);
+  void Sort(Measurement measurement, bool descending);
+  void Translate(double dx, double dy);
+
+private:
+  void Reorder(const std::vector<int>& order);
+
+  std::vector<double> columns_[kMeasurementCount];
+  std::vector<double> scratch_;
+};
+
+class ParticleAnalysis {
+public:
+  ParticleAnalysis();
+  void Analyze(const unsigned char* mask, int stride, int width, int height, bool connectivity8,
+               ParticleTable* table);
+  void SetTileCount(int tileCount);
+  void AnalyzeTile(int tile, const unsigned char* mask, int stride, int width, int top, int bottom,
+                   bool connectivity8);
+  void MergeTiles(bool connectivity8, ParticleTable* table);
+
+private:
+  // A horizontal run of non-zero pixels, and the provisional label of the particle it belongs to.
+  struct Run {
+    int start;
+    int end;
+    int label;
+  };
+
+  // Running sums for a provisional label, from which the measurements are derived.
+  struct Sums {
+    double area;
+    double sumX;
+    double sumY;
+    double sumXX;
+    double sumXY;
+    double sumYY;
+    double edges;
+    int left;
+    int top;
+    int right;
+    int bottom;
+  };
+
+  // The provisional labels found in a band of rows, each folded into its root by the end of the band, and the
+  // runs of the band's first and last rows, which are joined to the neighbouring bands.
+  struct Tile {
+    std::vector<int> parents;
+    std::vector<Sums> sums;
+    std::vector<Run> firstRuns;
+    std::vector<Run> lastRuns;
+    std::vector<Run> currentRuns;
+  };
+
+  void FindRuns(const unsigned char* row, int width, std::vector<Run>* runs);
+  static int NewLabel(std::vector<int>* parents, std::vector<Sums>* sums);
+  static int Find(std::vector<int>* parents, int label);
+  static int Union(std::vector<int>* parents, int first, int second);
+  static void AddRun(Sums* sums, int y, int start, int end);
+  static void Merge(Sums* into, const Sums& from);
+  void Measure(const Sums& sums, ParticleTable* table);
+
+  std::vector<Tile> tiles_;
+  std::vector<int> parents_;
+  std::vector<Sums> sums_;
+};
+
+#endif // _PARTICLE_ANALYSIS_H_
@@ -0,0 +1,216 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class containing the kernels which convert NIVision pixel data into 24-bit bitmap rows.
+ *
+ * Both conversions are pure byte shuffles: an RGB image stores each pixel as blue, green, red and an unused
+ * byte, and a grayscale or binary image is spread across all three channels. Each has a scalar version and
+ * SSSE3 and AVX2 versions built around PSHUFB, and the best one the processor supports is chosen at runtime.
+ * The vector kernels produce exactly the same bytes as the scalar ones and never write past the end of a row,
+ * so the padding at the end of each bitmap row is left alone.
+ */
+
+#include "PixelConversion.h"
+
+#include "CpuFeatures.h"
+
+// Converts a single row of pixels.
+typedef void (*RowKernel)(const unsigned char* source, unsigned char* dest, int width);
+
+static void BgrxToBgrScalar(const unsigned char* source, unsigned char* dest, int width) {
+  for (int x = 0; x < width; x++) {
+    dest[0] = source[0];
+    dest[1] = source[1];
+    dest[2] = source[2];
+    source += 4;
+    dest += 3;
+  }
+}
+
+static void GrayToBgrScalar(const unsigned char* source, unsigned char* dest, int width) {
+  for (int x = 0; x < width; x++) {
+    dest[0] = source[x];
+    dest[1] = source[x];
+    dest[2] = source[x];
+    dest += 3;
+  }
+}
+
+#if SIMD_KERNELS
+
+TARGET_SSSE3 static void BgrxToBgrSsse3(const unsigned char* source, unsigned char* dest, int width) {
+  // Gathers the colour bytes of four pixels into the low 12 bytes of a register.
+  const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+  // Sixteen pixels in four registers become three full registers of output.
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    __m128i a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)source), pack);
+    __m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(source + 16)), pack);
+    __m128i c = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(source + 32)), pack);
+    __m128i d = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(source + 48)), pack);
+    _mm_storeu_si128((__m128i*)dest, _mm_or_si128(a, _mm_slli_si128(b, 12)));
+    _mm_storeu_si128((__m128i*)(dest + 16), _mm_or_si128(_mm_srli_si128(b, 4), _mm_slli_si128(c, 8)));
+    _mm_storeu_si128((__m128i*)(dest + 32), _mm_or_si128(_mm_srli_si128(c, 8), _mm_slli_si128(d, 4)));
+    source += 64;
+    dest += 48;
+  }
+  BgrxToBgrScalar(source, dest, width - x);
+}
+
+TARGET_SSSE3 static void GrayToBgrSsse3(const unsigned char* source, unsigned char* dest, int width) {
+  // Each output register takes five or six consecutive pixels, repeating each one three times.
+  const __m128i spread0 = _mm_setr_epi8(0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5);
+  const __m128i spread1 = _mm_setr_epi8(5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10);
+  const __m128i spread2 = _mm_setr_epi8(10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15);
+
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    __m128i pixels = _mm_loadu_si128((const __m128i*)(source + x));
+    _mm_storeu_si128((__m128i*)dest, _mm_shuffle_epi8(pixels, spread0));
+    _mm_storeu_si128((__m128i*)(dest + 16), _mm_shuffle_epi8(pixels, spread1));
+    _mm_storeu_si128((__m128i*)(dest + 32), _mm_shuffle_epi8(pixels, spread2));
+    dest += 48;
+  }
+  GrayToBgrScalar(source + x, dest, width - x);
+}
+
+TARGET_AVX2 static void BgrxToBgrAvx2(const unsigned char* source, unsigned char* dest, int width) {
+  // Packs each 128-bit lane down to 12 bytes, then moves the two packed lanes together into the low 24 bytes.
+  const __m256i pack = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                        0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+  const __m256i join = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+
+  // Each store writes 32 bytes for eight pixels, and the surplus is overwritten by the next one. The loop stops
+  // while there is still room for the surplus within the row.
+  int x = 0;
+  for (; x + 11 <= width; x += 8) {
+    __m256i pixels = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)source), pack);
+    _mm256_storeu_si256((__m256i*)dest, _mm256_permutevar8x32_epi32(pixels, join));
+    source += 32;
+    dest += 24;
+  }
+  BgrxToBgrScalar(source, dest, width - x);
+}
+
+TARGET_AVX2 static void GrayToBgrAvx2(const unsigned char* source, unsigned char* dest, int width) {
+  // The same spreading as the SSSE3 version, with the first two output registers handled in one.
+  const __m256i spread01 = _mm256_setr_epi8(0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5,
+                                            5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10);
+  const __m128i spread2 = _mm_setr_epi8(10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15);
+
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    __m128i pixels = _mm_loadu_si128((const __m128i*)(source + x));
+    __m256i both = _mm256_inserti128_si256(_mm256_castsi128_si256(pixels), pixels, 1);
+    _mm256_storeu_si256((__m256i*)dest, _mm256_shuffle_epi8(both, spread01));
+    _mm_storeu_si128((__m128i*)(dest + 32), _mm_shuffle_epi8(pixels, spread2));
+    dest += 48;
+  }
+  GrayToBgrScalar(source + x, dest, width - x);
+}
+
+static const RowKernel bgrxKernels[PixelConversion::kKernelCount] = {
+  BgrxToBgrScalar, BgrxToBgrSsse3, BgrxToBgrAvx2
+};
+static const RowKernel grayKernels[PixelConversion::kKernelCount] = {
+  GrayToBgrScalar, GrayToBgrSsse3, GrayToBgrAvx2
+};
+
+#else
+
+static const RowKernel bgrxKernels[PixelConversion::kKernelCount] = {
+  BgrxToBgrScalar, BgrxToBgrScalar, BgrxToBgrScalar
+};
+static const RowKernel grayKernels[PixelConversion::kKernelCount] = {
+  GrayToBgrScalar, GrayToBgrScalar, GrayToBgrScalar
+};
+
+#endif
+
+/*
+ * Applies a row kernel to each row of an image.
+ */
+static void ConvertRows(RowKernel kernel, const unsigned char* source, int sourceStride, unsigned char* dest,
+                        int destStride, int width, int height) {
+  for (int y = 0; y < height; y++) {
+    kernel(source, dest, width);
+    source += sourceStride;
+    dest += destStride;
+  }
+}
+
+/*
+ * Converts 32-bit pixels stored as blue, green, red and an unused byte (the layout of an NIVision RGB image)
+ * into 24-bit bitmap pixels, using the best kernel for the processor.
+ *
+ * @param sourceStride The distance in bytes between the start of each source row.
+ * @param destStride The distance in bytes between the start of each destination row.
+ */
+void PixelConversion::BgrxToBgr(const unsigned char* source, int sourceStride, unsigned char* dest,
+                                int destStride, int width, int height) {
+  BgrxToBgr(GetBestKernel(), source, sourceStride, dest, destStride, width, height);
+}
+
+/*
+ * Converts 8-bit grayscale or binary pixels into 24-bit bitmap pixels, using the best kernel for the processor.
+ *
+ * @param sourceStride The distance in bytes between the start of each source row.
+ * @param destStride The distance in bytes between the start of each destination row.
+ */
+void PixelConversion::GrayToBgr(const unsigned char* source, int sourceStride, unsigned char* dest,
+                                int destStride, int width, int height) {
+  GrayToBgr(GetBestKernel(), source, sourceStride, dest, destStride, width, height);
+}
+
+/*
+ * Converts 32-bit pixels into 24-bit bitmap pixels using the given kernel, which must be supported by the
+ * processor. Used to compare the kernels against each other.
+ */
+void PixelConversion::BgrxToBgr(Kernel kernel, const unsigned char* source, int sourceStride,
+                                unsigned char* dest, int destStride, int width, int height) {
+  ConvertRows(bgrxKernels[kernel], source, sourceStride, dest, destStride, width, height);
+}
+
+/*
+ * Converts 8-bit pixels into 24-bit bitmap pixels using the given kernel, which must be supported by the
+ * processor. Used to compare the kernels against each other.
+ */
+void PixelConversion::GrayToBgr(Kernel kernel, const unsigned char* source, int sourceStride,
+                                unsigned char* dest, int destStride, int width, int height) {
+  ConvertRows(grayKernels[kernel], source, sourceStride, dest, destStride, width, height);
+}
+
+/*
+ * Returns the fastest kernel supported by the processor and operating system.
+ */
+PixelConversion::Kernel PixelConversion::GetBestKernel() {
+  if (CpuFeatures::HasAvx2()) {
+    return kAvx2;
+  }
+  if (CpuFeatures::HasSsse3()) {
+    return kSsse3;
+  }
+  return kScalar;
+}
+
+/*
+ * Returns whether the given kernel can be used on this processor.
+ */
+bool PixelConversion::IsSupported(Kernel kernel) {
+  return kernel <= GetBestKernel();
+}
+
+const char* PixelConversion::GetKernelName(Kernel kernel) {
+  static const char* names[kKernelCount] = { "Scalar", "SSSE3", "AVX2" };
+  return names[kernel];
+}
+
+/*
+ * Returns the distance in bytes between rows of a 24-bit bitmap of the given width, which are padded to a
+ * multiple of four bytes.
+ */
+int PixelConversion::GetBitmapStride(int width) {
+  return (3 * width + 3) & ~3;
+}
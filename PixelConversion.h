@@ -0,0 +1,35 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class containing the kernels which convert NIVision pixel data into 24-bit bitmap rows.
+ */
+
+#ifndef _PIXEL_CONVERSION_H_
+#define _PIXEL_CONVERSION_H_
+
+class PixelConversion {
+public:
+  // Instruction sets the kernels are implemented with, in increasing order of preference.
+  enum Kernel {
+    kScalar,
+    kSsse3,
+    kAvx2,
+    kKernelCount
+  };
+
+  static void BgrxToBgr(const unsigned char* source, int sourceStride, unsigned char* dest, int destStride,
+                        int width, int height);
+  static void GrayToBgr(const unsigned char* source, int sourceStride, unsigned char* dest, int destStride,
+                        int width, int height);
+  static void BgrxToBgr(Kernel kernel, const unsigned char* source, int sourceStride, unsigned char* dest,
+                        int destStride, int width, int height);
+  static void GrayToBgr(Kernel kernel, const unsigned char* source, int sourceStride, unsigned char* dest,
+                        int destStride, int width, int height);
+  static Kernel GetBestKernel();
+  static bool IsSupported(Kernel kernel);
+  static const char* GetKernelName(Kernel kernel);
+  static int GetBitmapStride(int width);
+};
+
+#endif // _PIXEL_CONVERSION_H_
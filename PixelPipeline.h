@@ -0,0 +1,117 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Templates for pixel stages whose settings are fixed when the program is compiled, chained into a pipeline which
+ * processes a whole row in one loop.
+ *
+ * Each stage is a struct with a static Apply function, which takes a pointer to a source pixel and returns the
+ * output value, and kSourceBytes, the size of the source pixel. Colour pixels are blue, green, red and an unused
+ * byte; grayscale pixels are a single byte. Stages which take a grayscale pixel also have Map, which takes the
+ * value itself, so that Then can pass one stage's output straight to the next. Since every setting is a template
+ * parameter and every call is inlined, the compiler sees the whole per-pixel path with its constants, and can
+ * fold away tests which always pass and vectorize the loop.
+ *
+ * A pipeline is run as one stage of a ProcessorGraph with AddPixelPipeline, which calls it once per row, so the
+ * existing ImageProcessor interface is kept.
+ */
+
+#ifndef _PIXEL_PIPELINE_H_
+#define _PIXEL_PIPELINE_H_
+
+// Takes one plane of a colour image, numbered as FrameGraph::Plane: 0 for red, 1 for green and 2 for blue.
+template <int Plane>
+struct ExtractPlane {
+  enum { kSourceBytes = 4 };
+
+  static unsigned char Apply(const unsigned char* pixel) {
+    return pixel[2 - Plane];
+  }
+};
+
+// Keeps the grayscale pixels between MinValue and MaxValue inclusive, giving them Value and the rest zero.
+template <int MinValue, int MaxValue, unsigned char Value>
+struct RangeThreshold {
+  enum { kSourceBytes = 1 };
+
+  static unsigned char Map(unsigned char value) {
+    // A single unsigned comparison tests both ends of the range.
+    return (unsigned int)(value - MinValue) <= (unsigned int)(MaxValue - MinValue) ? Value : 0;
+  }
+
+  static unsigned char Apply(const unsigned char* pixel) {
+    return Map(*pixel);
+  }
+};
+
+// Keeps the colour pixels whose hue, saturation and luminance are within the given ranges, giving them Value and
+// the rest zero. The mask is exactly the one HslThreshold gives for the same ranges, including a hue range which
+// wraps around through red when HueMin is greater than HueMax.
+template <int HueMin, int HueMax, int SaturationMin, int SaturationMax, int LuminanceMin, int LuminanceMax,
+          unsigned char Value>
+struct HslRange {
+  enum { kSourceBytes = 4 };
+
+  static unsigned char Apply(const unsigned char* pixel) {
+    int blue = pixel[0];
+    int green = pixel[1];
+    int red = pixel[2];
+    int maxValue = red > green ? red : green;
+    maxValue = maxValue > blue ? maxValue : blue;
+    int minValue = red < green ? red : green;
+    minValue = minValue < blue ? minValue : blue;
+    int delta = maxValue - minValue;
+    int sum = maxValue + minValue;
+
+    // HslThreshold::RgbToHsl rounds each component down after dividing, so each end of a range can be tested by
+    // multiplying out the division instead: a / b >= m exactly when a >= m * b, and a / b <= m when
+    // a < (m + 1) * b. Luminance is half the sum. Every test is worked out without branching, so that the loop
+    // can be vectorized.
+    bool luminancePass = (sum >= 2 * LuminanceMin) & (sum <= 2 * LuminanceMax + 1);
+    int divisor = sum <= 255 ? sum : 510 - sum;
+    bool saturationPass = (255 * delta >= SaturationMin * divisor) & (255 * delta < (SaturationMax + 1) * divisor);
+
+    // The position around the colour wheel in sixths, multiplied by delta, as in RgbToHsl.
+    int sector = red == maxValue ? green - blue + (green < blue ? 6 * delta : 0)
+                                 : (green == maxValue ? 2 * delta + blue - red : 4 * delta + red - green);
+    bool huePass = InHueRange(85 * sector, 2 * delta);
+
+    // Grays have a hue and saturation of zero, which the tests above can't be trusted with.
+    bool grayPass = InHueRange(0, 1) && SaturationMin <= 0 && SaturationMax >= 0;
+    bool pass = luminancePass & (delta == 0 ? grayPass : (saturationPass & huePass));
+    return pass ? Value : 0;
+  }
+
+  // Returns whether the hue numerator / denominator, rounded down, is in range.
+  static bool InHueRange(int numerator, int denominator) {
+    bool aboveMin = numerator >= HueMin * denominator;
+    bool belowMax = numerator < (HueMax + 1) * denominator;
+    return HueMin > HueMax ? (aboveMin | belowMax) : (aboveMin & belowMax);
+  }
+};
+
+// Passes the output of one stage, which may take either kind of pixel, to another which takes grayscale pixels.
+template <class First, class Second>
+struct Then {
+  enum { kSourceBytes = First::kSourceBytes };
+
+  static unsigned char Map(unsigned char value) {
+    return Second::Map(First::Map(value));
+  }
+
+  static unsigned char Apply(const unsigned char* pixel) {
+    return Second::Map(First::Apply(pixel));
+  }
+};
+
+// Runs a chain of stages over every pixel of a row.
+template <class Stages>
+struct PixelPipeline {
+  static void ApplyRow(const unsigned char* source, unsigned char* dest, int width) {
+    for (int x = 0; x < width; x++) {
+      dest[x] = Stages::Apply(source + Stages::kSourceBytes * x);
+    }
+  }
+};
+
+#endif // _PIXEL_PIPELINE_H_
@@ -0,0 +1,265 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * The operating system services used by the capture, decoding and processing core, implemented on POSIX threads
+ * where Windows isn't available.
+ *
+ * Threads, events and semaphores are all handles to the same kind of object: a mutex and condition variable
+ * guarding a state which waits are satisfied by. A thread's object is shared between its handle and the thread
+ * itself, and freed once both are finished with it, so the handle can be closed while the thread runs on.
+ * Security attributes, names and creation flags aren't supported, so those parameters are ignored.
+ */
+
+#include "Platform.h"
+
+#ifndef _WIN32
+
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+enum ObjectType {
+  kThread,
+  kEvent,
+  kSemaphore
+};
+
+struct WaitObject {
+  ObjectType type;
+  pthread_mutex_t mutex;
+  pthread_cond_t changed;
+  volatile LONG references;
+
+  // Whether a thread has finished or an event is set, or a semaphore's count.
+  LONG state;
+  LONG maximumCount;
+  bool manualReset;
+
+  // The function a thread runs.
+  LPTHREAD_START_ROUTINE start;
+  LPVOID param;
+};
+
+static WaitObject* NewObject(ObjectType type, LONG state) {
+  WaitObject* object = new WaitObject();
+  object->type = type;
+  pthread_mutex_init(&object->mutex, NULL);
+  pthread_cond_init(&object->changed, NULL);
+  object->references = 1;
+  object->state = state;
+  object->maximumCount = 0;
+  object->manualReset = false;
+  object->start = NULL;
+  object->param = NULL;
+  return object;
+}
+
+static void ReleaseObject(WaitObject* object) {
+  if (InterlockedDecrement(&object->references) == 0) {
+    pthread_cond_destroy(&object->changed);
+    pthread_mutex_destroy(&object->mutex);
+    delete object;
+  }
+}
+
+// Runs a thread's function, then marks the thread as finished for anything waiting on it.
+static void* RunThread(void* param) {
+  WaitObject* object = (WaitObject*)param;
+  object->start(object->param);
+  pthread_mutex_lock(&object->mutex);
+  object->state = 1;
+  pthread_cond_broadcast(&object->changed);
+  pthread_mutex_unlock(&object->mutex);
+  ReleaseObject(object);
+  return NULL;
+}
+
+HANDLE CreateThread(void*, size_t stackSize, LPTHREAD_START_ROUTINE start, LPVOID param, DWORD, DWORD* threadId) {
+  WaitObject* object = NewObject(kThread, 0);
+  object->start = start;
+  object->param = param;
+  object->references = 2;
+  pthread_attr_t threadAttributes;
+  pthread_attr_init(&threadAttributes);
+  pthread_attr_setdetachstate(&threadAttributes, PTHREAD_CREATE_DETACHED);
+  if (stackSize > 0) {
+    pthread_attr_setstacksize(&threadAttributes, stackSize);
+  }
+  pthread_t thread;
+  int error = pthread_create(&thread, &threadAttributes, RunThread, object);
+  pthread_attr_destroy(&threadAttributes);
+  if (error != 0) {
+    object->references = 1;
+    ReleaseObject(object);
+    return NULL;
+  }
+  if (threadId != NULL) {
+    *threadId = 0;
+  }
+  return object;
+}
+
+HANDLE CreateEvent(void*, BOOL manualReset, BOOL initialState, LPCSTR) {
+  WaitObject* object = NewObject(kEvent, initialState ? 1 : 0);
+  object->manualReset = (manualReset != FALSE);
+  return object;
+}
+
+BOOL SetEvent(HANDLE event) {
+  WaitObject* object = (WaitObject*)event;
+  pthread_mutex_lock(&object->mutex);
+  object->state = 1;
+  pthread_cond_broadcast(&object->changed);
+  pthread_mutex_unlock(&object->mutex);
+  return TRUE;
+}
+
+BOOL ResetEvent(HANDLE event) {
+  WaitObject* object = (WaitObject*)event;
+  pthread_mutex_lock(&object->mutex);
+  object->state = 0;
+  pthread_mutex_unlock(&object->mutex);
+  return TRUE;
+}
+
+HANDLE CreateSemaphore(void*, LONG initialCount, LONG maximumCount, LPCSTR) {
+  WaitObject* object = NewObject(kSemaphore, initialCount);
+  object->maximumCount = maximumCount;
+  return object;
+}
+
+BOOL ReleaseSemaphore(HANDLE semaphore, LONG releaseCount, LONG* previousCount) {
+  WaitObject* object = (WaitObject*)semaphore;
+  pthread_mutex_lock(&object->mutex);
+  if (previousCount != NULL) {
+    *previousCount = object->state;
+  }
+  if (releaseCount <= 0 || object->state + releaseCount > object->maximumCount) {
+    pthread_mutex_unlock(&object->mutex);
+    return FALSE;
+  }
+  object->state += releaseCount;
+  pthread_cond_broadcast(&object->changed);
+  pthread_mutex_unlock(&object->mutex);
+  return TRUE;
+}
+
+/*
+ * Waits until a thread has finished, an event is set or a semaphore's count is above zero. An event which isn't
+ * reset manually is reset again, and a semaphore's count is taken one from, by a wait which it satisfies.
+ */
+DWORD WaitForSingleObject(HANDLE handle, DWORD milliseconds) {
+  WaitObject* object = (WaitObject*)handle;
+  timespec deadline;
+  if (milliseconds != INFINITE) {
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += milliseconds / 1000;
+    deadline.tv_nsec += (milliseconds % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+  }
+
+  pthread_mutex_lock(&object->mutex);
+  while (object->state == 0) {
+    if (milliseconds == INFINITE) {
+      pthread_cond_wait(&object->changed, &object->mutex);
+    }
+    else if (pthread_cond_timedwait(&object->changed, &object->mutex, &deadline) == ETIMEDOUT) {
+      pthread_mutex_unlock(&object->mutex);
+      return WAIT_TIMEOUT;
+    }
+  }
+  if (object->type == kSemaphore) {
+    object->state--;
+  }
+  else if (object->type == kEvent && !object->manualReset) {
+    object->state = 0;
+  }
+  pthread_mutex_unlock(&object->mutex);
+  return WAIT_OBJECT_0;
+}
+
+BOOL CloseHandle(HANDLE handle) {
+  if (handle == NULL) {
+    return FALSE;
+  }
+  ReleaseObject((WaitObject*)handle);
+  return TRUE;
+}
+
+void InitializeCriticalSection(CRITICAL_SECTION* section) {
+  pthread_mutexattr_t attributes;
+  pthread_mutexattr_init(&attributes);
+  pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&section->mutex, &attributes);
+  pthread_mutexattr_destroy(&attributes);
+}
+
+void DeleteCriticalSection(CRITICAL_SECTION* section) {
+  pthread_mutex_destroy(&section->mutex);
+}
+
+void EnterCriticalSection(CRITICAL_SECTION* section) {
+  pthread_mutex_lock(&section->mutex);
+}
+
+void LeaveCriticalSection(CRITICAL_SECTION* section) {
+  pthread_mutex_unlock(&section->mutex);
+}
+
+DWORD TlsAlloc() {
+  pthread_key_t key;
+  pthread_key_create(&key, NULL);
+  return (DWORD)key;
+}
+
+LPVOID TlsGetValue(DWORD index) {
+  return pthread_getspecific((pthread_key_t)index);
+}
+
+BOOL TlsSetValue(DWORD index, LPVOID value) {
+  return pthread_setspecific((pthread_key_t)index, value) == 0;
+}
+
+/*
+ * Returns the kernel's ID for the calling thread on Linux, which is what profilers show.
+ */
+DWORD GetCurrentThreadId() {
+#ifdef __linux__
+  return (DWORD)syscall(SYS_gettid);
+#else
+  return (DWORD)(size_t)pthread_self();
+#endif
+}
+
+void GetSystemInfo(SYSTEM_INFO* systemInfo) {
+  long processors = sysconf(_SC_NPROCESSORS_ONLN);
+  systemInfo->dwNumberOfProcessors = processors > 0 ? (DWORD)processors : 1;
+}
+
+/*
+ * Reads the monotonic clock, in nanoseconds.
+ */
+BOOL QueryPerformanceCounter(LARGE_INTEGER* count) {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  count->QuadPart = (LONGLONG)now.tv_sec * 1000000000LL + now.tv_nsec;
+  return TRUE;
+}
+
+BOOL QueryPerformanceFrequency(LARGE_INTEGER* frequency) {
+  frequency->QuadPart = 1000000000LL;
+  return TRUE;
+}
+
+void Sleep(DWORD milliseconds) {
+  usleep((useconds_t)milliseconds * 1000);
+}
+
+#endif // _WIN32
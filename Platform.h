@@ -0,0 +1,138 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * The operating system services used by the capture, decoding and processing core: threads, events, semaphores,
+ * critical sections, atomic operations, thread-local storage, the performance counter and aligned memory.
+ *
+ * On Windows this is just Windows.h. Elsewhere the same names are implemented on POSIX threads, covering only the
+ * calls the core makes, so that it can be built and run under profilers and sanitizers on Linux without change.
+ * The parts which use NI Vision, sockets or the display remain Windows-only.
+ */
+
+#ifndef _PLATFORM_H_
+#define _PLATFORM_H_
+
+#ifdef _WIN32
+
+#include <Windows.h>
+#include <malloc.h>
+
+#else
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+
+typedef int BOOL;
+typedef unsigned int DWORD;
+typedef int LONG;
+typedef long long LONGLONG;
+typedef void* PVOID;
+typedef void* LPVOID;
+typedef const char* LPCSTR;
+typedef void* HANDLE;
+
+#define TRUE 1
+#define FALSE 0
+#define WINAPI
+#define INFINITE 0xFFFFFFFF
+#define WAIT_OBJECT_0 0
+#define WAIT_TIMEOUT 258
+
+typedef DWORD (WINAPI *LPTHREAD_START_ROUTINE)(LPVOID param);
+
+union LARGE_INTEGER {
+  LONGLONG QuadPart;
+};
+
+struct SYSTEM_INFO {
+  DWORD dwNumberOfProcessors;
+};
+
+// Critical sections may be entered again by the thread holding them, so they are recursive mutexes.
+struct CRITICAL_SECTION {
+  pthread_mutex_t mutex;
+};
+
+HANDLE CreateThread(void* attributes, size_t stackSize, LPTHREAD_START_ROUTINE start, LPVOID param, DWORD flags,
+                    DWORD* threadId);
+HANDLE CreateEvent(void* attributes, BOOL manualReset, BOOL initialState, LPCSTR name);
+BOOL SetEvent(HANDLE event);
+BOOL ResetEvent(HANDLE event);
+HANDLE CreateSemaphore(void* attributes, LONG initialCount, LONG maximumCount, LPCSTR name);
+BOOL ReleaseSemaphore(HANDLE semaphore, LONG releaseCount, LONG* previousCount);
+DWORD WaitForSingleObject(HANDLE handle, DWORD milliseconds);
+BOOL CloseHandle(HANDLE handle);
+void InitializeCriticalSection(CRITICAL_SECTION* section);
+void DeleteCriticalSection(CRITICAL_SECTION* section);
+void EnterCriticalSection(CRITICAL_SECTION* section);
+void LeaveCriticalSection(CRITICAL_SECTION* section);
+DWORD TlsAlloc();
+LPVOID TlsGetValue(DWORD index);
+BOOL TlsSetValue(DWORD index, LPVOID value);
+DWORD GetCurrentThreadId();
+void GetSystemInfo(SYSTEM_INFO* systemInfo);
+BOOL QueryPerformanceCounter(LARGE_INTEGER* count);
+BOOL QueryPerformanceFrequency(LARGE_INTEGER* frequency);
+void Sleep(DWORD milliseconds);
+
+// Each atomic operation is a full barrier, as on Windows.
+inline LONG InterlockedIncrement(volatile LONG* value) {
+  return __sync_add_and_fetch(value, 1);
+}
+
+inline LONG InterlockedDecrement(volatile LONG* value) {
+  return __sync_sub_and_fetch(value, 1);
+}
+
+inline LONG InterlockedExchangeAdd(volatile LONG* addend, LONG value) {
+  return __sync_fetch_and_add(addend, value);
+}
+
+inline LONG InterlockedExchange(volatile LONG* target, LONG value) {
+  return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+inline LONG InterlockedCompareExchange(volatile LONG* destination, LONG exchange, LONG comparand) {
+  return __sync_val_compare_and_swap(destination, comparand, exchange);
+}
+
+inline PVOID InterlockedCompareExchangePointer(PVOID volatile* destination, PVOID exchange, PVOID comparand) {
+  return __sync_val_compare_and_swap(destination, comparand, exchange);
+}
+
+inline void MemoryBarrier() {
+  __sync_synchronize();
+}
+
+inline void* _aligned_malloc(size_t size, size_t alignment) {
+  void* memory = NULL;
+  if (posix_memalign(&memory, alignment, size) != 0) {
+    return NULL;
+  }
+  return memory;
+}
+
+inline void _aligned_free(void* memory) {
+  free(memory);
+}
+
+#define sprintf_s snprintf
+#define _strnicmp strncasecmp
+
+// Windows.h defines min and max as macros; templates do the same job without clashing with the standard library.
+template <class T>
+inline T min(T a, T b) {
+  return b < a ? b : a;
+}
+
+template <class T>
+inline T max(T a, T b) {
+  return a < b ? b : a;
+}
+
+#endif // _WIN32
+
+#endif // _PLATFORM_H_
@@ -0,0 +1,109 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing an image processor made up of a chain of stages, such as extracting a plane, thresholding
+ * it, cleaning up the mask and analyzing its particles, which are run together as one graph.
+ *
+ * The stages are those of FrameGraph, run on views of the NI images without copying them. The output image is
+ * what the processor returns for display. When the graph analyzes particles, the largest one is the target, and
+ * only the region being searched is processed, the rest of the output being left empty. Otherwise the whole image
+ * is processed.
+ */
+
+#include "ProcessorGraph.h"
+
+#include "FramePool.h"
+#include "ImageFrame.h"
+#include <string.h>
+
+/*
+ * Runs the graph on the source image.
+ *
+ * @param result The results of the frame, filled in with the particles found, largest first, if the graph
+ *               analyzes particles, or with no objects otherwise.
+ */
+Image* ProcessorGraph::ProcessImage(Image* image, FrameResult* result) {
+  ImageInfo info;
+  imaqGetImageInfo(image, &info);
+  Image* output = framePool_->Acquire(IMAQ_IMAGE_U8, info.xRes, info.yRes);
+  if (output == NULL) {
+    // Without an image to put the mask in, the frame can't be processed, so the original is shown instead.
+    ReportNothing(result);
+    return image;
+  }
+  Frame source = GetImageFrame(image);
+  Frame mask = GetImageFrame(output);
+
+  // Outside the region being searched, the output is left empty.
+  Rect region = { 0, 0, info.yRes, info.xRes };
+  if (HasParticleAnalysis()) {
+    region = GetRegion(info.xRes, info.yRes);
+  }
+  if (region.width < info.xRes || region.height < info.yRes) {
+    for (int y = 0; y < info.yRes; y++) {
+      memset(mask.GetRow(y), 0, info.xRes);
+    }
+  }
+  Run(source.GetView(region.left, region.top, region.width, region.height),
+      mask.GetView(region.left, region.top, region.width, region.height));
+
+  if (HasParticleAnalysis()) {
+    ReportParticles(region, result);
+  }
+  else {
+    ReportNothing(result);
+  }
+  return output;
+}
+
+/*
+ * Reports that no objects were found.
+ */
+void ProcessorGraph::ReportNothing(FrameResult* result) {
+  targetFound_ = false;
+  result->objectType = kResultNone;
+  result->objectCount = 0;
+  result->targetFound = 0;
+}
+
+/*
+ * Reports the particles found, largest first, with the largest as the target.
+ */
+void ProcessorGraph::ReportParticles(const Rect& region, FrameResult* result) {
+  ParticleTable* particles = GetParticles();
+  particles->Translate(region.left, region.top);
+  int numParticles = particles->GetCount();
+  particles->Sort(ParticleTable::kArea, true);
+  targetFound_ = (numParticles > 0);
+  if (targetFound_) {
+    // The largest particle is the target, and its bounding box gives its extent.
+    double left = particles->Get(ParticleTable::kLeft, 0);
+    double top = particles->Get(ParticleTable::kTop, 0);
+    target_.x = particles->Get(ParticleTable::kCenterX, 0);
+    target_.y = particles->Get(ParticleTable::kCenterY, 0);
+    target_.halfWidth = 0.5 * (particles->Get(ParticleTable::kRight, 0) - left + 1);
+    target_.halfHeight = 0.5 * (particles->Get(ParticleTable::kBottom, 0) - top + 1);
+  }
+
+  // Report the largest particles, in full-resolution pixels.
+  double scale = GetDecodeScale();
+  result->objectType = kResultParticle;
+  result->objectCount = numParticles;
+  for (int i = 0; i < numParticles && i < FrameResult::kMaxObjects; i++) {
+    ResultObject* object = &result->objects[i];
+    double left = particles->Get(ParticleTable::kLeft, i);
+    double top = particles->Get(ParticleTable::kTop, i);
+    object->x = scale * particles->Get(ParticleTable::kCenterX, i);
+    object->y = scale * particles->Get(ParticleTable::kCenterY, i);
+    object->halfWidth = scale * 0.5 * (particles->Get(ParticleTable::kRight, i) - left + 1);
+    object->halfHeight = scale * 0.5 * (particles->Get(ParticleTable::kBottom, i) - top + 1);
+    object->rotation = 0;
+    object->area = scale * scale * particles->Get(ParticleTable::kArea, i);
+    object->score = 0;
+  }
+  result->targetFound = targetFound_;
+  if (targetFound_) {
+    result->target = result->objects[0];
+  }
+}
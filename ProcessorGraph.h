@@ -0,0 +1,24 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing an image processor made up of a chain of stages, such as extracting a plane, thresholding
+ * it, cleaning up the mask and analyzing its particles, which are run together as one graph.
+ */
+
+#ifndef _PROCESSOR_GRAPH_H_
+#define _PROCESSOR_GRAPH_H_
+
+#include "FrameGraph.h"
+#include "ImageProcessor.h"
+
+class ProcessorGraph : public ImageProcessor, public FrameGraph {
+public:
+  virtual Image* ProcessImage(Image* image, FrameResult* result);
+
+private:
+  void ReportParticles(const Rect& region, FrameResult* result);
+  void ReportNothing(FrameResult* result);
+};
+
+#endif // _PROCESSOR_GRAPH_H_
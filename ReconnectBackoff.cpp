@@ -0,0 +1,47 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing the delays between attempts to reconnect to a camera, which grow exponentially while the
+ * attempts keep failing.
+ *
+ * The first attempt after a connection is lost is made straight away, since a camera which blipped is usually
+ * back at once. Each attempt after that waits twice as long as the one before, from the minimum delay up to the
+ * maximum, so that a camera which is gone for a while isn't flooded with connection attempts.
+ */
+
+#include "ReconnectBackoff.h"
+
+/*
+ * Creates the backoff.
+ *
+ * @param minDelay The delay in milliseconds before the second attempt.
+ * @param maxDelay The longest delay in milliseconds between attempts.
+ */
+ReconnectBackoff::ReconnectBackoff(int minDelay, int maxDelay) {
+  minDelay_ = minDelay;
+  maxDelay_ = maxDelay;
+  attempts_ = 0;
+}
+
+/*
+ * Returns how long to wait before the next attempt, in milliseconds.
+ */
+int ReconnectBackoff::NextDelay() {
+  int attempt = attempts_++;
+  if (attempt == 0) {
+    return 0;
+  }
+  int delay = minDelay_;
+  for (int i = 1; i < attempt && delay < maxDelay_; i++) {
+    delay *= 2;
+  }
+  return delay < maxDelay_ ? delay : maxDelay_;
+}
+
+/*
+ * Starts again from an immediate attempt, once a connection has succeeded.
+ */
+void ReconnectBackoff::Reset() {
+  attempts_ = 0;
+}
@@ -0,0 +1,24 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing the delays between attempts to reconnect to a camera, which grow exponentially while the
+ * attempts keep failing.
+ */
+
+#ifndef _RECONNECT_BACKOFF_H_
+#define _RECONNECT_BACKOFF_H_
+
+class ReconnectBackoff {
+public:
+  ReconnectBackoff(int minDelay, int maxDelay);
+  int NextDelay();
+  void Reset();
+
+private:
+  int minDelay_;
+  int maxDelay_;
+  int attempts_;
+};
+
+#endif // _RECONNECT_BACKOFF_H_
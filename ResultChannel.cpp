@@ -0,0 +1,229 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a ring of frame results in named shared memory, published by this application and polled
+ * by another process on the same machine, such as the robot's control loop.
+ *
+ * The memory holds a header and a ring of slots, each holding one result. There is one publisher, which writes
+ * each result into the next slot and then counts it in the header, so a reader polling the count sees a new
+ * result as soon as it is written, without any system calls on either side. Each slot is guarded by a sequence
+ * number, which the publisher makes odd while it writes the slot. A reader copies the result out and checks that
+ * the sequence was the same before and after the copy, and if the publisher has come round the ring and started
+ * to overwrite the slot in the meantime, the result is counted as missed rather than returned half-written. The
+ * publisher never waits for readers, so a reader which falls more than a ring behind misses the oldest results.
+ *
+ * A reader can use either ReadNext() to see every result in order, or ReadLatest() to see only the newest one.
+ */
+
+#include "ResultChannel.h"
+
+#include "Constants.h"
+#include <stdio.h>
+#include <string.h>
+
+ResultChannel::ResultChannel() {
+  mapping_ = NULL;
+  header_ = NULL;
+  slots_ = NULL;
+  slotCount_ = 0;
+  nextRead_ = 0;
+  missed_ = 0;
+}
+
+ResultChannel::~ResultChannel() {
+  Close();
+}
+
+/*
+ * Creates the shared memory for publishing results, or takes over the memory of an earlier publisher which
+ * readers still have open, starting it over as empty.
+ *
+ * @param name The name of the shared memory, from GetChannelName().
+ * @param slotCount The number of results kept for readers.
+ * @return Whether the memory could be created.
+ */
+bool ResultChannel::Create(const char* name, int slotCount) {
+  Close();
+  DWORD size = (DWORD)(sizeof(Header) + slotCount * sizeof(Slot));
+  HANDLE mapping = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, size, name);
+  if (mapping == NULL || !Map(mapping, FILE_MAP_ALL_ACCESS, size)) {
+    return false;
+  }
+
+  // Readers which already have the memory open notice the count going backwards and start over. The magic number
+  // is cleared first and set last, so that a reader can't open the memory while it's being set up.
+  InterlockedExchange(&header_->magic, 0);
+  memset(header_, 0, size);
+  header_->version = kVersion;
+  header_->slotCount = slotCount;
+  header_->slotSize = sizeof(Slot);
+  InterlockedExchange(&header_->magic, kMagic);
+  slotCount_ = slotCount;
+  return true;
+}
+
+/*
+ * Opens the shared memory of a publisher to read its results.
+ *
+ * @param name The name of the shared memory, from GetChannelName().
+ * @return Whether the memory exists and holds results in the format this reader expects.
+ */
+bool ResultChannel::Open(const char* name) {
+  Close();
+  HANDLE mapping = OpenFileMapping(FILE_MAP_READ, FALSE, name);
+  if (mapping == NULL || !Map(mapping, FILE_MAP_READ, 0)) {
+    return false;
+  }
+  if (header_->magic != kMagic || header_->version != kVersion || header_->slotSize != sizeof(Slot) ||
+      header_->slotCount <= 0) {
+    Close();
+    return false;
+  }
+  slotCount_ = header_->slotCount;
+
+  // Only results published from now on are read in order.
+  nextRead_ = header_->published;
+  return true;
+}
+
+/*
+ * Unmaps the shared memory. The memory itself lasts until neither the publisher nor any reader has it open.
+ */
+void ResultChannel::Close() {
+  if (header_ != NULL) {
+    UnmapViewOfFile(header_);
+    header_ = NULL;
+    slots_ = NULL;
+  }
+  if (mapping_ != NULL) {
+    CloseHandle(mapping_);
+    mapping_ = NULL;
+  }
+  slotCount_ = 0;
+}
+
+/*
+ * Writes a result into the next slot and makes it visible to readers. Only one thread may publish at a time.
+ */
+void ResultChannel::Publish(const FrameResult& result) {
+  if (header_ == NULL) {
+    return;
+  }
+  unsigned int index = (unsigned int)header_->published;
+  Slot* slot = &slots_[index % slotCount_];
+
+  // The exchanges are full barriers, so a reader can never see the new sequence with the old result or the new
+  // count with the old sequence.
+  InterlockedExchange(&slot->sequence, (LONG)(2 * index + 1));
+  slot->result = result;
+  InterlockedExchange(&slot->sequence, (LONG)(2 * index + 2));
+  InterlockedExchange(&header_->published, (LONG)(index + 1));
+}
+
+/*
+ * Reads the oldest result which hasn't been read yet, skipping any which have already been overwritten.
+ *
+ * @return Whether there was a result to read.
+ */
+bool ResultChannel::ReadNext(FrameResult* result) {
+  if (header_ == NULL) {
+    return false;
+  }
+  unsigned int published = (unsigned int)header_->published;
+  if (published < nextRead_) {
+    // The publisher has started over.
+    nextRead_ = published;
+  }
+  while (nextRead_ < published) {
+    if (published - nextRead_ > slotCount_) {
+      missed_ += published - slotCount_ - nextRead_;
+      nextRead_ = published - slotCount_;
+    }
+    if (ReadSlot(nextRead_++, result)) {
+      return true;
+    }
+
+    // The slot was overwritten while it was being read.
+    missed_++;
+    published = (unsigned int)header_->published;
+  }
+  return false;
+}
+
+/*
+ * Reads the newest result, whether or not it has been read before. Reading in order with ReadNext() carries on
+ * after it.
+ *
+ * @return Whether any result has been published.
+ */
+bool ResultChannel::ReadLatest(FrameResult* result) {
+  if (header_ == NULL) {
+    return false;
+  }
+  unsigned int published = (unsigned int)header_->published;
+  while (published > 0) {
+    if (ReadSlot(published - 1, result)) {
+      nextRead_ = published;
+      return true;
+    }
+    published = (unsigned int)header_->published;
+  }
+  return false;
+}
+
+/*
+ * Returns the number of results published since the memory was created.
+ */
+unsigned int ResultChannel::GetPublishedCount() {
+  return header_ != NULL ? (unsigned int)header_->published : 0;
+}
+
+/*
+ * Returns the number of results this reader skipped because they were overwritten before it read them.
+ */
+unsigned int ResultChannel::GetMissedCount() {
+  return missed_;
+}
+
+/*
+ * Formats the name of the shared memory holding the results of the given camera.
+ */
+void ResultChannel::GetChannelName(int camera, char* name, int size) {
+  sprintf_s(name, size, "%s%d", RESULTS_CHANNEL_NAME, camera);
+}
+
+/*
+ * Maps a view of the shared memory, taking ownership of its handle. Mapping fails if the memory was created
+ * by an earlier publisher with fewer slots.
+ *
+ * @param size The number of bytes to map, or 0 for all of the memory.
+ */
+bool ResultChannel::Map(HANDLE mapping, DWORD access, DWORD size) {
+  mapping_ = mapping;
+  header_ = (Header*)MapViewOfFile(mapping, access, 0, 0, size);
+  if (header_ == NULL) {
+    Close();
+    return false;
+  }
+  slots_ = (Slot*)(header_ + 1);
+  return true;
+}
+
+/*
+ * Copies out the result with the given index, checking that it wasn't overwritten during the copy.
+ *
+ * @return Whether the slot still held the result, and was never being written to during the copy.
+ */
+bool ResultChannel::ReadSlot(unsigned int index, FrameResult* result) {
+  Slot* slot = &slots_[index % slotCount_];
+  LONG sequence = (LONG)(2 * index + 2);
+  if (slot->sequence != sequence) {
+    return false;
+  }
+  memcpy(result, &slot->result, sizeof(FrameResult));
+
+  // The copy has to be complete before the sequence is checked again.
+  MemoryBarrier();
+  return slot->sequence == sequence;
+}
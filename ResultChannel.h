@@ -0,0 +1,62 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a ring of frame results in named shared memory, published by this application and polled
+ * by another process on the same machine, such as the robot's control loop.
+ */
+
+#ifndef _RESULT_CHANNEL_H_
+#define _RESULT_CHANNEL_H_
+
+#include "FrameResult.h"
+#include <Windows.h>
+
+class ResultChannel {
+public:
+  ResultChannel();
+  ~ResultChannel();
+  bool Create(const char* name, int slotCount);
+  bool Open(const char* name);
+  void Close();
+  void Publish(const FrameResult& result);
+  bool ReadNext(FrameResult* result);
+  bool ReadLatest(FrameResult* result);
+  unsigned int GetPublishedCount();
+  unsigned int GetMissedCount();
+  static void GetChannelName(int camera, char* name, int size);
+
+  static const LONG kMagic = 0x52435246;
+  static const LONG kVersion = 1;
+
+private:
+  // The start of the shared memory, padded to a cache line so that the slots don't share one with it.
+  struct Header {
+    LONG magic;
+    LONG version;
+    LONG slotCount;
+    LONG slotSize;
+    volatile LONG published;
+    LONG padding[11];
+  };
+
+  // A slot holding one result. Its sequence is odd while the result is being written, and otherwise tells which
+  // of the results published so far it holds.
+  struct Slot {
+    volatile LONG sequence;
+    LONG padding;
+    FrameResult result;
+  };
+
+  bool Map(HANDLE mapping, DWORD access, DWORD size);
+  bool ReadSlot(unsigned int index, FrameResult* result);
+
+  HANDLE mapping_;
+  Header* header_;
+  Slot* slots_;
+  unsigned int slotCount_;
+  unsigned int nextRead_;
+  unsigned int missed_;
+};
+
+#endif // _RESULT_CHANNEL_H_
@@ -0,0 +1,79 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a console reader of a camera's results channel, which prints each result as it arrives.
+ *
+ * It reads the channel the way the robot's code would, from another process, and shows how old each result is
+ * when it is read, both since its frame arrived from the camera and since it was published. It sleeps for a
+ * millisecond whenever there's nothing new, where a control loop which needs the lowest latency would keep
+ * polling instead.
+ */
+
+#include "ResultMonitor.h"
+
+#include "ResultChannel.h"
+#include "Timer.h"
+#include <stdio.h>
+#include <Windows.h>
+
+/*
+ * Creates a monitor for the results of the given camera, numbered from 0.
+ */
+ResultMonitor::ResultMonitor(int camera) {
+  camera_ = camera;
+}
+
+/*
+ * Waits for the camera's results channel to be created, then prints its results until the process is ended.
+ *
+ * @return The process exit code.
+ */
+int ResultMonitor::Run() {
+  // Write to the console the application was started from, or to a new one.
+  if (!AttachConsole(ATTACH_PARENT_PROCESS)) {
+    AllocConsole();
+  }
+  freopen("CONOUT$", "w", stdout);
+
+  char name[64];
+  ResultChannel::GetChannelName(camera_, name, sizeof(name));
+  ResultChannel channel;
+  printf("Waiting for the results of camera %d on '%s'.\n", camera_, name);
+  while (!channel.Open(name)) {
+    Sleep(100);
+  }
+
+  unsigned int missed = 0;
+  while (1) {
+    FrameResult result;
+    if (!channel.ReadNext(&result)) {
+      Sleep(1);
+      continue;
+    }
+    double now = GetMilliseconds();
+    if (channel.GetMissedCount() != missed) {
+      printf("Missed %u results.\n", channel.GetMissedCount() - missed);
+      missed = channel.GetMissedCount();
+    }
+    if (result.targetFound) {
+      printf("Frame %u: target at (%.1f, %.1f), %.1f x %.1f, %d objects; %.2f ms since capture, %.3f ms since "
+             "published\n",
+             result.frameId,
+             result.target.x,
+             result.target.y,
+             2 * result.target.halfWidth,
+             2 * result.target.halfHeight,
+             result.objectCount,
+             now - result.captureTime,
+             now - result.processedTime);
+    }
+    else {
+      printf("Frame %u: no target; %.2f ms since capture, %.3f ms since published\n",
+             result.frameId,
+             now - result.captureTime,
+             now - result.processedTime);
+    }
+  }
+  return 0;
+}
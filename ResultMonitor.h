@@ -0,0 +1,20 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a console reader of a camera's results channel, which prints each result as it arrives.
+ */
+
+#ifndef _RESULT_MONITOR_H_
+#define _RESULT_MONITOR_H_
+
+class ResultMonitor {
+public:
+  ResultMonitor(int camera);
+  int Run();
+
+private:
+  int camera_;
+};
+
+#endif // _RESULT_MONITOR_H_
@@ -0,0 +1,163 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a tracker which predicts where a moving target will be in the next frame, so that only the
+ * region around it needs to be searched.
+ *
+ * The target's position and velocity are estimated with an alpha-beta filter, which is the steady state of a
+ * Kalman filter with a constant-velocity model. The search window is centered on the predicted position and
+ * covers the target's last size plus a margin, which grows with the target's speed and with each frame in which
+ * it is missed. After too many misses in a row the target is considered lost, and the whole image is searched
+ * until it is found again. The whole image is also searched at a fixed interval while tracking, so that a second
+ * target coming into view isn't ignored for ever.
+ */
+
+#include "RoiTracker.h"
+
+#include <math.h>
+
+// Filter gains for the position and velocity. Detections are precise, so they are trusted over the prediction.
+static const double kAlpha = 0.8;
+static const double kBeta = 0.5;
+
+RoiTracker::RoiTracker() {
+  margin_ = 32;
+  coastFrames_ = 5;
+  fullScanInterval_ = 30;
+  Reset();
+}
+
+/*
+ * Sets the number of pixels added around the target's predicted extent on each side.
+ */
+void RoiTracker::SetMargin(int margin) {
+  margin_ = margin;
+}
+
+/*
+ * Sets the number of frames in a row in which the target can be missed before it is considered lost.
+ */
+void RoiTracker::SetCoastFrames(int frames) {
+  coastFrames_ = frames;
+}
+
+/*
+ * Sets the number of frames after which the whole image is searched even though the target is being tracked, or
+ * 0 to only search the whole image once the target is lost.
+ */
+void RoiTracker::SetFullScanInterval(int frames) {
+  fullScanInterval_ = frames;
+}
+
+/*
+ * Forgets the target, so that the next frame is searched in full.
+ */
+void RoiTracker::Reset() {
+  tracking_ = false;
+  windowed_ = false;
+  misses_ = 0;
+  framesSinceFullScan_ = 0;
+  x_ = 0;
+  y_ = 0;
+  velocityX_ = 0;
+  velocityY_ = 0;
+  halfWidth_ = 0;
+  halfHeight_ = 0;
+}
+
+bool RoiTracker::IsTracking() {
+  return tracking_;
+}
+
+/*
+ * Gets the region of the next frame to search.
+ *
+ * @param window Set to the region to search, clipped to the image, if the function returns true.
+ * @return False if the whole image should be searched instead, because the target isn't being tracked, a full
+ *         search is due, or the window would cover most of the image anyway.
+ */
+bool RoiTracker::Predict(int imageWidth, int imageHeight, RoiWindow* window) {
+  windowed_ = false;
+  if (!tracking_ || (fullScanInterval_ > 0 && framesSinceFullScan_ >= fullScanInterval_)) {
+    return false;
+  }
+
+  // Each missed frame is another frame the target has moved for since the last detection.
+  int frames = misses_ + 1;
+  double x = x_ + velocityX_ * frames;
+  double y = y_ + velocityY_ * frames;
+  double spreadX = halfWidth_ + margin_ * frames + fabs(velocityX_) * frames;
+  double spreadY = halfHeight_ + margin_ * frames + fabs(velocityY_) * frames;
+  int left = (int)floor(x - spreadX);
+  int top = (int)floor(y - spreadY);
+  int right = (int)ceil(x + spreadX);
+  int bottom = (int)ceil(y + spreadY);
+  if (left < 0) {
+    left = 0;
+  }
+  if (top < 0) {
+    top = 0;
+  }
+  if (right > imageWidth) {
+    right = imageWidth;
+  }
+  if (bottom > imageHeight) {
+    bottom = imageHeight;
+  }
+  if (right <= left || bottom <= top) {
+    return false;
+  }
+
+  // Searching a window covering more than half the image saves little, and a full search can't miss.
+  if (2 * (right - left) * (bottom - top) > imageWidth * imageHeight) {
+    return false;
+  }
+  window->left = left;
+  window->top = top;
+  window->width = right - left;
+  window->height = bottom - top;
+  windowed_ = true;
+  return true;
+}
+
+/*
+ * Updates the estimate of the target's motion with the result of searching the region returned by Predict.
+ *
+ * @param found Whether the target was found, in which case the remaining parameters give its center and half of
+ *              its width and height in image coordinates.
+ */
+void RoiTracker::Update(bool found, double x, double y, double halfWidth, double halfHeight) {
+  framesSinceFullScan_ = windowed_ ? framesSinceFullScan_ + 1 : 0;
+  if (!found) {
+    // Nothing in the whole image means the target is gone; otherwise it may just have left the window.
+    misses_++;
+    if (!windowed_ || misses_ > coastFrames_) {
+      tracking_ = false;
+    }
+    return;
+  }
+
+  int frames = misses_ + 1;
+  double residualX = x - (x_ + velocityX_ * frames);
+  double residualY = y - (y_ + velocityY_ * frames);
+
+  // A full search may find a different target far from the prediction, whose motion is unknown.
+  bool jumped = fabs(residualX) > halfWidth_ + margin_ || fabs(residualY) > halfHeight_ + margin_;
+  if (!tracking_ || (!windowed_ && jumped)) {
+    x_ = x;
+    y_ = y;
+    velocityX_ = 0;
+    velocityY_ = 0;
+  }
+  else {
+    x_ += velocityX_ * frames + kAlpha * residualX;
+    y_ += velocityY_ * frames + kAlpha * residualY;
+    velocityX_ += kBeta * residualX / frames;
+    velocityY_ += kBeta * residualY / frames;
+  }
+  halfWidth_ = halfWidth;
+  halfHeight_ = halfHeight;
+  misses_ = 0;
+  tracking_ = true;
+}
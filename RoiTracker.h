@@ -0,0 +1,47 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a tracker which predicts where a moving target will be in the next frame, so that only the
+ * region around it needs to be searched.
+ */
+
+#ifndef _ROI_TRACKER_H_
+#define _ROI_TRACKER_H_
+
+// A rectangular region of an image, in pixels.
+struct RoiWindow {
+  int left;
+  int top;
+  int width;
+  int height;
+};
+
+class RoiTracker {
+public:
+  RoiTracker();
+  void SetMargin(int margin);
+  void SetCoastFrames(int frames);
+  void SetFullScanInterval(int frames);
+  bool Predict(int imageWidth, int imageHeight, RoiWindow* window);
+  void Update(bool found, double x, double y, double halfWidth, double halfHeight);
+  void Reset();
+  bool IsTracking();
+
+private:
+  int margin_;
+  int coastFrames_;
+  int fullScanInterval_;
+  bool tracking_;
+  bool windowed_;
+  int misses_;
+  int framesSinceFullScan_;
+  double x_;
+  double y_;
+  double velocityX_;
+  double velocityY_;
+  double halfWidth_;
+  double halfHeight_;
+};
+
+#endif // _ROI_TRACKER_H_
@@ -0,0 +1,195 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing the choice of frame rate and compression to ask the camera for, adjusted to what the
+ * decoding and processing threads can keep up with.
+ *
+ * The settings it can choose form a ladder from the cheapest to the most expensive to handle: the compression
+ * falls from the highest to the configured compression at the lowest frame rate, then the frame rate rises to the
+ * highest, then the compression falls to the lowest. So the frame rate is raised before the image quality, and
+ * the image quality is given up before the frame rate. The configured frame rate and compression are where it
+ * starts.
+ *
+ * At regular intervals, the controller measures the load, as the fraction of the time that the busiest of the
+ * threads handling the stream was busy, along with the fraction of the frames received which were dropped. If
+ * either is too high, it steps down the ladder at once, by as many steps as the dropped frames suggest are needed,
+ * and holds off stepping back up to where it was for a while. If the load stays low for several intervals, it steps
+ * up one rung, as long as the camera is keeping up with the current frame rate and the higher frame rate isn't
+ * expected to overload the threads. Measurements taken while the stream is being restarted or settling after a
+ * change are ignored.
+ */
+
+#include "StreamController.h"
+
+#include "Constants.h"
+#include "Platform.h"
+
+/*
+ * Creates a controller starting from the given settings, which are moved onto the ladder if they're outside it.
+ */
+StreamController::StreamController(int framesPerSecond, int compression) {
+  int startFps = min(max(framesPerSecond, ADAPTIVE_MIN_FPS), ADAPTIVE_MAX_FPS);
+  int startCompression = min(max(compression, ADAPTIVE_MIN_COMPRESSION), ADAPTIVE_MAX_COMPRESSION);
+  for (int c = ADAPTIVE_MAX_COMPRESSION; c > startCompression; c -= ADAPTIVE_COMPRESSION_STEP) {
+    AddLevel(ADAPTIVE_MIN_FPS, c);
+  }
+  level_ = -1;
+  for (int f = ADAPTIVE_MIN_FPS; f < ADAPTIVE_MAX_FPS; f += ADAPTIVE_FPS_STEP) {
+    if (level_ < 0 && f >= startFps) {
+      level_ = (int)ladder_.size();
+    }
+    AddLevel(f, startCompression);
+  }
+  if (level_ < 0) {
+    level_ = (int)ladder_.size();
+  }
+  for (int c = startCompression; c >= ADAPTIVE_MIN_COMPRESSION; c -= ADAPTIVE_COMPRESSION_STEP) {
+    AddLevel(ADAPTIVE_MAX_FPS, c);
+  }
+
+  sampled_ = false;
+  sampleTime_ = 0;
+  sampleFrames_ = 0;
+  sampleDropped_ = 0;
+  settleUntil_ = 0;
+  headroomCount_ = 0;
+  blockedLevel_ = (int)ladder_.size();
+  blockedUntil_ = 0;
+  load_ = 0;
+  changeCount_ = 0;
+}
+
+/*
+ * Takes a measurement of the stream, and decides whether to change its settings if one is due.
+ *
+ * @param now The time in milliseconds.
+ * @param busyMs The total time each of the threads handling the stream has spent busy, in milliseconds.
+ * @param busyCount The number of threads, which must be the same every time.
+ * @param frames The total number of frames received from the camera.
+ * @param dropped The total number of frames received but dropped because the threads weren't ready for them.
+ * @return Whether the settings have changed, in which case the stream should be requested again.
+ */
+bool StreamController::Update(double now, const double* busyMs, int busyCount, int frames, int dropped) {
+  if (!sampled_ || now < settleUntil_) {
+    TakeSample(now, busyMs, busyCount, frames, dropped);
+    return false;
+  }
+  double elapsed = now - sampleTime_;
+  if (elapsed < ADAPTIVE_INTERVAL) {
+    return false;
+  }
+
+  // The stream can go no faster than the busiest thread, so its load is the stream's.
+  double busiest = 0;
+  for (int i = 0; i < busyCount; i++) {
+    busiest = max(busiest, busyMs[i] - sampleBusy_[i]);
+  }
+  load_ = busiest / elapsed;
+  int received = frames - sampleFrames_;
+  double dropRatio = received > 0 ? (double)(dropped - sampleDropped_) / received : 0;
+  double receivedFps = 1000.0 * received / elapsed;
+  TakeSample(now, busyMs, busyCount, frames, dropped);
+
+  const StreamSettings& current = ladder_[level_];
+  if (load_ > ADAPTIVE_HIGH_LOAD || dropRatio > ADAPTIVE_MAX_DROPPED) {
+    if (level_ == 0) {
+      return false;
+    }
+
+    // A busy thread can't show how far over the limit it is, but dropped frames can. Then the frame rate which the
+    // threads handled at the load measured gives the rate they should manage with room to spare.
+    int level = level_ - 1;
+    if (dropRatio > ADAPTIVE_MAX_DROPPED && load_ > 0) {
+      double capacity = receivedFps * (1 - dropRatio) / load_;
+      double targetFps = capacity * 0.5 * (ADAPTIVE_HIGH_LOAD + ADAPTIVE_LOW_LOAD);
+      while (level > 0 && ladder_[level].framesPerSecond > targetFps) {
+        level--;
+      }
+    }
+    blockedLevel_ = level_;
+    blockedUntil_ = now + ADAPTIVE_RETRY_TIME;
+    ChangeLevel(level, now);
+    return true;
+  }
+
+  // Step up once there has been room to spare for long enough, unless the camera isn't managing the frame rate
+  // already asked for, the next step is expected to be too much, or it overloaded recently.
+  if (load_ >= ADAPTIVE_LOW_LOAD || receivedFps < 0.8 * current.framesPerSecond) {
+    headroomCount_ = 0;
+    return false;
+  }
+  headroomCount_++;
+  if (headroomCount_ < ADAPTIVE_RAMP_INTERVALS || level_ + 1 >= (int)ladder_.size()) {
+    return false;
+  }
+  const StreamSettings& next = ladder_[level_ + 1];
+  if (load_ * next.framesPerSecond / current.framesPerSecond > ADAPTIVE_HIGH_LOAD) {
+    return false;
+  }
+  if (level_ + 1 >= blockedLevel_ && now < blockedUntil_) {
+    return false;
+  }
+  ChangeLevel(level_ + 1, now);
+  return true;
+}
+
+/*
+ * Returns the settings to ask the camera for.
+ */
+StreamSettings StreamController::GetSettings() {
+  return ladder_[level_];
+}
+
+/*
+ * Returns the position of the current settings on the ladder, from 0 for the cheapest.
+ */
+int StreamController::GetLevel() {
+  return level_;
+}
+
+int StreamController::GetLevelCount() {
+  return (int)ladder_.size();
+}
+
+/*
+ * Returns the load of the busiest thread over the last interval measured, as a fraction of the time.
+ */
+double StreamController::GetLoad() {
+  return load_;
+}
+
+/*
+ * Returns the number of times the settings have been changed.
+ */
+int StreamController::GetChangeCount() {
+  return changeCount_;
+}
+
+void StreamController::AddLevel(int framesPerSecond, int compression) {
+  StreamSettings settings;
+  settings.framesPerSecond = framesPerSecond;
+  settings.compression = compression;
+  ladder_.push_back(settings);
+}
+
+/*
+ * Keeps the counters to measure the next interval from.
+ */
+void StreamController::TakeSample(double now, const double* busyMs, int busyCount, int frames, int dropped) {
+  sampled_ = true;
+  sampleTime_ = now;
+  sampleBusy_.assign(busyMs, busyMs + busyCount);
+  sampleFrames_ = frames;
+  sampleDropped_ = dropped;
+}
+
+/*
+ * Moves to another level, ignoring the stream until it has been restarted with the new settings and has settled.
+ */
+void StreamController::ChangeLevel(int level, double now) {
+  level_ = level;
+  changeCount_++;
+  headroomCount_ = 0;
+  settleUntil_ = now + ADAPTIVE_SETTLE_TIME;
+}
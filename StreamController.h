@@ -0,0 +1,50 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing the choice of frame rate and compression to ask the camera for, adjusted to what the
+ * decoding and processing threads can keep up with.
+ */
+
+#ifndef _STREAM_CONTROLLER_H_
+#define _STREAM_CONTROLLER_H_
+
+#include <vector>
+
+// The frame rate and compression requested from the camera for its stream.
+struct StreamSettings {
+  int framesPerSecond;
+  int compression;
+};
+
+class StreamController {
+public:
+  StreamController(int framesPerSecond, int compression);
+  bool Update(double now, const double* busyMs, int busyCount, int frames, int dropped);
+  StreamSettings GetSettings();
+  int GetLevel();
+  int GetLevelCount();
+  double GetLoad();
+  int GetChangeCount();
+
+private:
+  void AddLevel(int framesPerSecond, int compression);
+  void TakeSample(double now, const double* busyMs, int busyCount, int frames, int dropped);
+  void ChangeLevel(int level, double now);
+
+  std::vector<StreamSettings> ladder_;
+  int level_;
+  bool sampled_;
+  double sampleTime_;
+  std::vector<double> sampleBusy_;
+  int sampleFrames_;
+  int sampleDropped_;
+  double settleUntil_;
+  int headroomCount_;
+  int blockedLevel_;
+  double blockedUntil_;
+  double load_;
+  int changeCount_;
+};
+
+#endif // _STREAM_CONTROLLER_H_
@@ -0,0 +1,28 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Contains timing functions shared by the capture pipeline and the benchmarks.
+ */
+
+#ifndef _TIMER_H_
+#define _TIMER_H_
+
+#include "Platform.h"
+
+/*
+ * Returns the current time in milliseconds from the high resolution performance counter.
+ */
+inline double GetMilliseconds() {
+  static double frequency = 0;
+  if (frequency == 0) {
+    LARGE_INTEGER counterFrequency;
+    QueryPerformanceFrequency(&counterFrequency);
+    frequency = (double)counterFrequency.QuadPart / 1000.0;
+  }
+  LARGE_INTEGER counter;
+  QueryPerformanceCounter(&counter);
+  return (double)counter.QuadPart / frequency;
+}
+
+#endif // _TIMER_H_
@@ -0,0 +1,159 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a recorder of timestamped begin and end events on each thread, which can be saved as a
+ * Chrome trace.
+ *
+ * Each thread records into its own ring buffer, found through thread-local storage, so recording an event takes
+ * no locks and never waits for another thread. When the buffer is full the oldest events are overwritten, so a
+ * saved trace covers the last TRACE_BUFFER_EVENTS events of each thread. Buffers are created on a thread's first
+ * event and kept until the process exits, since the threads they belong to run for as long as the application.
+ *
+ * While tracing is turned off, each event costs a test of a single flag.
+ */
+
+#include "Trace.h"
+
+#include <stdio.h>
+#include <vector>
+
+volatile bool Trace::enabled_ = (TRACE_AT_STARTUP != 0);
+DWORD Trace::tlsIndex_ = TlsAlloc();
+Trace::Buffer* volatile Trace::buffers_ = NULL;
+
+void Trace::SetEnabled(bool enabled) {
+  enabled_ = enabled;
+}
+
+bool Trace::IsEnabled() {
+  return enabled_;
+}
+
+/*
+ * Names the calling thread in saved traces. The name must be a string literal, as only the pointer is kept.
+ */
+void Trace::SetThreadName(const char* name) {
+  GetBuffer()->threadName = name;
+}
+
+/*
+ * Adds an event to the calling thread's buffer.
+ */
+void Trace::Record(const char* name, char phase) {
+  Buffer* buffer = GetBuffer();
+  LONG count = buffer->count;
+  Event* event = &buffer->events[count % TRACE_BUFFER_EVENTS];
+  LARGE_INTEGER now;
+  QueryPerformanceCounter(&now);
+  event->time = now.QuadPart;
+  event->name = name;
+  event->phase = phase;
+
+  // Publish the event only once it is complete, so that a trace being saved never reads half of it.
+  InterlockedExchange(&buffer->count, count + 1);
+}
+
+/*
+ * Returns the calling thread's buffer, creating it on first use.
+ */
+Trace::Buffer* Trace::GetBuffer() {
+  Buffer* buffer = (Buffer*)TlsGetValue(tlsIndex_);
+  if (buffer != NULL) {
+    return buffer;
+  }
+  buffer = new Buffer;
+  buffer->threadId = GetCurrentThreadId();
+  buffer->threadName = NULL;
+  buffer->count = 0;
+  TlsSetValue(tlsIndex_, buffer);
+
+  // Add the buffer to the front of the list without a lock, retrying if another thread got there first.
+  Buffer* head;
+  do {
+    head = buffers_;
+    buffer->next = head;
+  } while (InterlockedCompareExchangePointer((PVOID volatile*)&buffers_, buffer, head) != head);
+  return buffer;
+}
+
+/*
+ * Saves the events in every thread's buffer as a Chrome trace in JSON format, which can be opened with
+ * chrome://tracing or Perfetto. Events can go on being recorded while the trace is saved.
+ *
+ * @return Whether the file could be written.
+ */
+bool Trace::WriteChromeTrace(const char* path) {
+  FILE* file = fopen(path, "w");
+  if (file == NULL) {
+    return false;
+  }
+  LARGE_INTEGER frequency;
+  QueryPerformanceFrequency(&frequency);
+  double microsecondsPerTick = 1000000.0 / (double)frequency.QuadPart;
+
+  // Copy each buffer, then drop any events which were overwritten while they were being copied.
+  std::vector<std::vector<Event> > threadEvents;
+  std::vector<Buffer*> threadBuffers;
+  LONGLONG startTime = 0;
+  for (Buffer* buffer = buffers_; buffer != NULL; buffer = buffer->next) {
+    LONG end = buffer->count;
+    MemoryBarrier();
+    LONG start = end > TRACE_BUFFER_EVENTS ? end - TRACE_BUFFER_EVENTS : 0;
+    std::vector<Event> events;
+    for (LONG i = start; i < end; i++) {
+      events.push_back(buffer->events[i % TRACE_BUFFER_EVENTS]);
+    }
+
+    // The slot after the last published event may be in the middle of being written, too.
+    MemoryBarrier();
+    LONG overwritten = buffer->count + 1 - TRACE_BUFFER_EVENTS;
+    if (overwritten > start) {
+      events.erase(events.begin(), events.begin() + min(overwritten - start, end - start));
+    }
+    if (!events.empty() && (startTime == 0 || events[0].time < startTime)) {
+      startTime = events[0].time;
+    }
+    threadEvents.push_back(events);
+    threadBuffers.push_back(buffer);
+  }
+
+  fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  bool first = true;
+  for (unsigned int thread = 0; thread < threadBuffers.size(); thread++) {
+    Buffer* buffer = threadBuffers[thread];
+    if (buffer->threadName != NULL) {
+      fprintf(file,
+              "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%lu,\"args\":{\"name\":\"%s\"}}",
+              first ? "" : ",\n",
+              (unsigned long)buffer->threadId,
+              buffer->threadName);
+      first = false;
+    }
+
+    // The oldest events may end spans whose beginnings have been overwritten, which can't be shown.
+    int depth = 0;
+    std::vector<Event>& events = threadEvents[thread];
+    for (unsigned int i = 0; i < events.size(); i++) {
+      if (events[i].phase == 'E') {
+        if (depth == 0) {
+          continue;
+        }
+        depth--;
+      }
+      else {
+        depth++;
+      }
+      fprintf(file,
+              "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%lu}",
+              first ? "" : ",\n",
+              events[i].name,
+              events[i].phase,
+              (double)(events[i].time - startTime) * microsecondsPerTick,
+              (unsigned long)buffer->threadId);
+      first = false;
+    }
+  }
+  fprintf(file, "\n]}\n");
+  return fclose(file) == 0;
+}
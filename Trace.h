@@ -0,0 +1,92 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a recorder of timestamped begin and end events on each thread, which can be saved as a
+ * Chrome trace.
+ */
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include "Constants.h"
+#include "Platform.h"
+
+// Marks the start and end of a span of work on the calling thread. The name must be a string literal, as only
+// the pointer is kept. They compile to nothing when ENABLE_TRACING is not set.
+#if ENABLE_TRACING
+#define TRACE_BEGIN(name) Trace::Begin(name)
+#define TRACE_END(name) Trace::End(name)
+#define TRACE_SCOPE(name) TraceScope TRACE_SCOPE_VARIABLE(__LINE__)(name)
+#define TRACE_SCOPE_VARIABLE(line) TRACE_SCOPE_JOIN(traceScope, line)
+#define TRACE_SCOPE_JOIN(prefix, line) prefix##line
+#else
+#define TRACE_BEGIN(name) ((void)0)
+#define TRACE_END(name) ((void)0)
+#define TRACE_SCOPE(name) ((void)0)
+#endif
+
+class Trace {
+public:
+  static void SetEnabled(bool enabled);
+  static bool IsEnabled();
+  static void SetThreadName(const char* name);
+  static bool WriteChromeTrace(const char* path);
+
+  // Records the start of a span of work, if tracing is turned on.
+  static void Begin(const char* name) {
+    if (enabled_) {
+      Record(name, 'B');
+    }
+  }
+
+  // Records the end of a span of work, if tracing is turned on.
+  static void End(const char* name) {
+    if (enabled_) {
+      Record(name, 'E');
+    }
+  }
+
+private:
+  // A begin or end event, timed with the performance counter.
+  struct Event {
+    LONGLONG time;
+    const char* name;
+    char phase;
+  };
+
+  // The ring buffer of events recorded by one thread. Only that thread writes to it, and count is only advanced
+  // once an event is complete, so it can be read from any thread without locking.
+  struct Buffer {
+    DWORD threadId;
+    const char* threadName;
+    volatile LONG count;
+    Event events[TRACE_BUFFER_EVENTS];
+    Buffer* next;
+  };
+
+  static void Record(const char* name, char phase);
+  static Buffer* GetBuffer();
+
+  static volatile bool enabled_;
+  static DWORD tlsIndex_;
+  static Buffer* volatile buffers_;
+};
+
+// Records a span of work lasting until the end of the enclosing block.
+class TraceScope {
+public:
+  TraceScope(const char* name) {
+    name_ = name;
+    Trace::Begin(name);
+  }
+
+  ~TraceScope() {
+    Trace::End(name_);
+  }
+
+private:
+  const char* name_;
+};
+
+#endif // _TRACE_H_
@@ -0,0 +1,69 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing an image processor which only processes the region of each image where the target found
+ * by another processor is expected to be.
+ */
+
+#include "TrackedProcessor.h"
+
+#include "Constants.h"
+
+/*
+ * Creates a processor which restricts the given one to the region around its target. The given processor is
+ * deleted along with this one.
+ */
+TrackedProcessor::TrackedProcessor(ImageProcessor* processor) {
+  processor_ = processor;
+  tracker_.SetMargin(ROI_MARGIN);
+  tracker_.SetCoastFrames(ROI_COAST_FRAMES);
+  tracker_.SetFullScanInterval(ROI_FULL_SCAN_INTERVAL);
+}
+
+TrackedProcessor::~TrackedProcessor() {
+  delete processor_;
+}
+
+int TrackedProcessor::GetDecodeScale() {
+  return processor_->GetDecodeScale();
+}
+
+void TrackedProcessor::SetFramePool(FramePool* framePool) {
+  ImageProcessor::SetFramePool(framePool);
+  processor_->SetFramePool(framePool);
+}
+
+/*
+ * Runs the wrapped processor on the region where its target is predicted to be, or on the whole image if the
+ * target isn't being tracked, and updates the prediction with what it finds.
+ *
+ * @param result The results of the frame, filled in by the wrapped processor along with the region searched.
+ */
+Image* TrackedProcessor::ProcessImage(Image* image, FrameResult* result) {
+  int width, height;
+  imaqGetImageSize(image, &width, &height);
+  RoiWindow window;
+  Rect region = { 0, 0, 0, 0 };
+  if (tracker_.Predict(width, height, &window)) {
+    region.left = window.left;
+    region.top = window.top;
+    region.width = window.width;
+    region.height = window.height;
+  }
+  processor_->SetRegion(region);
+  Image* output = processor_->ProcessImage(image, result);
+
+  targetFound_ = processor_->GetTarget(&target_);
+  tracker_.Update(targetFound_, target_.x, target_.y, target_.halfWidth, target_.halfHeight);
+
+  // Report the region that was searched, in full-resolution pixels, with an empty region for the whole image.
+  int scale = GetDecodeScale();
+  result->tracked = 1;
+  result->searchLeft = scale * region.left;
+  result->searchTop = scale * region.top;
+  result->searchWidth = scale * region.width;
+  result->searchHeight = scale * region.height;
+
+  return output;
+}
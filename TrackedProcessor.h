@@ -0,0 +1,28 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing an image processor which only processes the region of each image where the target found
+ * by another processor is expected to be.
+ */
+
+#ifndef _TRACKED_PROCESSOR_H_
+#define _TRACKED_PROCESSOR_H_
+
+#include "ImageProcessor.h"
+#include "RoiTracker.h"
+
+class TrackedProcessor : public ImageProcessor {
+public:
+  TrackedProcessor(ImageProcessor* processor);
+  ~TrackedProcessor();
+  virtual Image* ProcessImage(Image* image, FrameResult* result);
+  virtual int GetDecodeScale();
+  virtual void SetFramePool(FramePool* framePool);
+
+private:
+  ImageProcessor* processor_;
+  RoiTracker tracker_;
+};
+
+#endif // _TRACKED_PROCESSOR_H_
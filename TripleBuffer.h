@@ -0,0 +1,91 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a lock-free channel which passes the newest value of some type from one thread to another.
+ *
+ * There are three slots. The producer fills its own slot and publishes it by swapping it with the shared middle
+ * slot, and the consumer takes the middle slot by swapping it with its own, so each side always has a slot to
+ * itself and neither ever waits for the other. A value which is published before the consumer takes the previous
+ * one replaces it, so the consumer always sees the newest complete value, never a half-written one. Each slot
+ * keeps whatever it holds between uses, which lets values own buffers that are reused rather than reallocated.
+ *
+ * Only one thread at a time may produce, and only one may consume. A consumer which needs a value for longer
+ * than until its next take, or a second consumer, should copy it out or have its own channel.
+ */
+
+#ifndef _TRIPLE_BUFFER_H_
+#define _TRIPLE_BUFFER_H_
+
+#include "Platform.h"
+
+template <class T>
+class TripleBuffer {
+public:
+  TripleBuffer() {
+    writeIndex_ = 0;
+    middle_ = 1;
+    readIndex_ = 2;
+  }
+
+  /*
+   * Returns the slot to fill with the next value. It is the producer's until Publish() is called, and holds
+   * whatever value it last held.
+   */
+  T* GetWriteSlot() {
+    return &slots_[writeIndex_];
+  }
+
+  /*
+   * Makes the value in the write slot the newest, and gives the producer another slot to fill.
+   */
+  void Publish() {
+    // The exchange is a full barrier, so the value is completely written before the consumer can see it.
+    LONG previous = InterlockedExchange(&middle_, writeIndex_ | kFresh);
+    writeIndex_ = previous & kIndexMask;
+  }
+
+  /*
+   * Takes the newest published value, if there is one which hasn't been taken yet.
+   *
+   * @return Whether the read slot now holds a newer value than before.
+   */
+  bool Acquire() {
+    if ((middle_ & kFresh) == 0) {
+      return false;
+    }
+    LONG previous = InterlockedExchange(&middle_, readIndex_);
+    readIndex_ = previous & kIndexMask;
+    return true;
+  }
+
+  /*
+   * Returns the slot holding the value most recently taken by Acquire(). It is the consumer's until the next
+   * call to Acquire().
+   */
+  T* GetReadSlot() {
+    return &slots_[readIndex_];
+  }
+
+  /*
+   * Returns one of the three slots, for setting up or freeing what they hold while no other thread is using the
+   * buffer.
+   */
+  T* GetSlot(int index) {
+    return &slots_[index];
+  }
+
+  static const int kSlotCount = 3;
+
+private:
+  // The middle slot's index is kept alongside a flag which is set when it holds a value the consumer hasn't taken.
+  static const LONG kIndexMask = 3;
+  static const LONG kFresh = 4;
+
+  T slots_[kSlotCount];
+  LONG writeIndex_;
+  volatile LONG middle_;
+  LONG readIndex_;
+};
+
+#endif // _TRIPLE_BUFFER_H_
@@ -0,0 +1,138 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a set of worker threads which share out the iterations of a loop.
+ *
+ * The workers are created once and sleep between loops, so splitting a few milliseconds of work per frame
+ * across cores doesn't pay for creating threads every time. The calling thread takes part in the loop too,
+ * and iterations are handed out one at a time from a shared counter, so a slow iteration doesn't hold up the
+ * others.
+ *
+ * The processors all share one pool, so that however many cameras are running, no more worker threads are
+ * started than there are processors. A loop started while another thread's is running is run on its calling
+ * thread alone.
+ */
+
+#include "WorkerPool.h"
+
+#include "Constants.h"
+
+WorkerPool* volatile WorkerPool::shared_ = NULL;
+
+/*
+ * Creates the pool.
+ *
+ * @param threadCount The total number of threads to run each loop on, including the calling thread, or zero for
+ *                    one per processor.
+ */
+WorkerPool::WorkerPool(int threadCount) {
+  if (threadCount <= 0) {
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
+    threadCount = (int)systemInfo.dwNumberOfProcessors;
+  }
+  workerCount_ = threadCount > 1 ? threadCount - 1 : 0;
+  task_ = NULL;
+  count_ = 0;
+  next_ = 0;
+  running_ = 0;
+  busy_ = 0;
+  stopping_ = false;
+
+  // The start semaphore is released once for each worker at the start of a loop, and the last worker to finish
+  // sets the finished event.
+  start_ = CreateSemaphore(NULL, 0, workerCount_ > 0 ? workerCount_ : 1, NULL);
+  finished_ = CreateEvent(NULL, FALSE, FALSE, NULL);
+  workers_ = new HANDLE[workerCount_ > 0 ? workerCount_ : 1];
+  for (int i = 0; i < workerCount_; i++) {
+    workers_[i] = CreateThread(NULL, 0, StartWorker, this, 0, NULL);
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  stopping_ = true;
+  if (workerCount_ > 0) {
+    ReleaseSemaphore(start_, workerCount_, NULL);
+  }
+  for (int i = 0; i < workerCount_; i++) {
+    WaitForSingleObject(workers_[i], INFINITE);
+    CloseHandle(workers_[i]);
+  }
+  delete[] workers_;
+  CloseHandle(start_);
+  CloseHandle(finished_);
+}
+
+/*
+ * Calls task->Run(index) for every index from 0 to count - 1, spread across the workers and the calling thread,
+ * and returns once they have all finished. If the pool is already running a loop for another thread, or for the
+ * task itself, the calling thread runs every iteration.
+ */
+void WorkerPool::ParallelFor(ParallelTask* task, int count) {
+  if (workerCount_ == 0 || count <= 1 || InterlockedCompareExchange(&busy_, 1, 0) != 0) {
+    for (int i = 0; i < count; i++) {
+      task->Run(i);
+    }
+    return;
+  }
+
+  task_ = task;
+  count_ = count;
+  next_ = 0;
+  running_ = workerCount_;
+  ReleaseSemaphore(start_, workerCount_, NULL);
+  RunIterations();
+  WaitForSingleObject(finished_, INFINITE);
+  task_ = NULL;
+  InterlockedExchange(&busy_, 0);
+}
+
+/*
+ * Returns the number of threads each loop is spread across, including the calling thread.
+ */
+int WorkerPool::GetThreadCount() {
+  return workerCount_ + 1;
+}
+
+/*
+ * Returns the pool shared by the whole process, with WORKER_THREADS threads, creating it on first use. It lasts
+ * as long as the process.
+ */
+WorkerPool* WorkerPool::GetShared() {
+  if (shared_ == NULL) {
+    // Threads racing to create the pool keep whichever was stored first.
+    WorkerPool* pool = new WorkerPool(WORKER_THREADS);
+    if (InterlockedCompareExchangePointer((PVOID volatile*)&shared_, pool, NULL) != NULL) {
+      delete pool;
+    }
+  }
+  return shared_;
+}
+
+/*
+ * Runs iterations of the current loop until none are left.
+ */
+void WorkerPool::RunIterations() {
+  int index;
+  while ((index = InterlockedIncrement(&next_) - 1) < count_) {
+    task_->Run(index);
+  }
+}
+
+/*
+ * Entry point for a worker thread, which joins in each loop as it starts.
+ */
+DWORD WINAPI WorkerPool::StartWorker(LPVOID param) {
+  WorkerPool* pool = (WorkerPool*)param;
+  while (1) {
+    WaitForSingleObject(pool->start_, INFINITE);
+    if (pool->stopping_) {
+      return 0;
+    }
+    pool->RunIterations();
+    if (InterlockedDecrement(&pool->running_) == 0) {
+      SetEvent(pool->finished_);
+    }
+  }
+}
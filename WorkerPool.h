@@ -0,0 +1,45 @@
+/*
+ * Copyright 2009-2010 Patrick Fairbank. All Rights Reserved.
+ * See LICENSE.TXT for licensing information.
+ *
+ * Class representing a set of worker threads which share out the iterations of a loop.
+ */
+
+#ifndef _WORKER_POOL_H_
+#define _WORKER_POOL_H_
+
+#include "Platform.h"
+
+// Abstract class representing the body of a loop run by a WorkerPool.
+class ParallelTask {
+public:
+  virtual ~ParallelTask() {}
+  virtual void Run(int index) = 0;
+};
+
+class WorkerPool {
+public:
+  WorkerPool(int threadCount);
+  ~WorkerPool();
+  void ParallelFor(ParallelTask* task, int count);
+  int GetThreadCount();
+  static WorkerPool* GetShared();
+
+private:
+  void RunIterations();
+  static DWORD WINAPI StartWorker(LPVOID param);
+
+  int workerCount_;
+  HANDLE* workers_;
+  HANDLE start_;
+  HANDLE finished_;
+  ParallelTask* volatile task_;
+  volatile LONG count_;
+  volatile LONG next_;
+  volatile LONG running_;
+  volatile LONG busy_;
+  volatile bool stopping_;
+  static WorkerPool* volatile shared_;
+};
+
+#endif // _WORKER_POOL_H_